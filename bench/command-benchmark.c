@@ -0,0 +1,112 @@
+/**
+ * @file command-benchmark.c
+ * @brief 命令分派: 命令表哈希查找 vs 原先遍历命令数组逐个比较命令名
+ *
+ * n个命令名为 CMD<i*7919>，查询使用小写(模拟客户端输入)，轮流查找每个命令，输出每次查找的耗时。
+ *
+ *  command-benchmark -n 200 -i 2000000
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+#include "command.h"
+#include "redis.h"
+#include "log.h"
+
+static void nopProc(redisClient* c)
+{
+    (void)c;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 原先的查找方式：遍历命令数组，逐个比较命令名 */
+static redisCommand* linearLookup(redisCommand* cmds, int n, const char* name, size_t len)
+{
+    for (int i = 0; i < n; i++) {
+        if (strlen(cmds[i].name) == len && strncasecmp(cmds[i].name, name, len) == 0)
+            return &cmds[i];
+    }
+    return NULL;
+}
+
+static void run(int n, long iters)
+{
+    char (*names)[32] = malloc(n * sizeof(*names));
+    char (*queries)[32] = malloc(n * sizeof(*queries));
+    size_t* qlens = malloc(n * sizeof(size_t));
+    redisCommand* cmds = calloc(n, sizeof(redisCommand));
+    for (int i = 0; i < n; i++) {
+        snprintf(names[i], sizeof(names[i]), "CMD%d", i * 7919);
+        cmds[i] = (redisCommand){CMD_MASTER, names[i], nopProc, -1, 0};
+        qlens[i] = strlen(names[i]);
+        for (size_t j = 0; j <= qlens[i]; j++)
+            queries[i][j] = tolower((unsigned char)names[i][j]);
+    }
+    commandTable* t = commandTableCreate(cmds, n, REDIS_CLUSTER_MASTER);
+
+    long hits = 0;
+    double start = now();
+    for (long i = 0; i < iters; i++) {
+        int q = i % n;
+        hits += commandTableFind(t, queries[q], qlens[q]) != NULL;
+    }
+    double mid = now();
+    for (long i = 0; i < iters; i++) {
+        int q = i % n;
+        hits += linearLookup(cmds, n, queries[q], qlens[q]) != NULL;
+    }
+    double end = now();
+    if (hits != iters * 2) {
+        fprintf(stderr, "lookup missed: %ld of %ld\n", iters * 2 - hits, iters * 2);
+        exit(1);
+    }
+    printf("dispatch %4d commands: table %6.1f ns/op, linear %6.1f ns/op\n",
+           n, (mid - start) * 1e9 / iters, (end - mid) * 1e9 / iters);
+
+    commandTableRelease(t);
+    free(cmds);
+    free(qlens);
+    free(queries);
+    free(names);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: command-benchmark [-n commands] [-i lookups]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    int n = 0;
+    long iters = 2000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:i:h")) != -1) {
+        switch (opt) {
+        case 'n': n = atoi(optarg); break;
+        case 'i': iters = atol(optarg); break;
+        default: usage();
+        }
+    }
+    if (n < 0 || iters <= 0) usage();
+    log_set_level(LOG_INFO);
+
+    if (n > 0) {
+        run(n, iters);
+    } else {
+        // 默认: 当前命令数量级和十倍命令数
+        run(20, iters);
+        run(200, iters);
+    }
+    return 0;
+}
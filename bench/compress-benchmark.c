@@ -0,0 +1,218 @@
+/**
+ * @file compress-benchmark.c
+ * @brief 字符串值压缩：LZF压缩率、内存占用、RDB保存编码耗时、GET读取延迟，原始保存 vs 内存中压缩保存
+ *
+ * 值为2~20KB的JSON文档(对象数组，字段名重复、取值来自有限的词表)，和线上缓存的大值相似。
+ *  raw:        robj按原样保存；保存RDB时逐个LZF压缩(rdbcompression=yes)；GET直接引用sds
+ *  compressed: 设置value-compress-threshold，robj创建时压缩；保存RDB时直接写压缩数据；GET先解压
+ * 保存耗时包括编码和经过带缓冲的rio写入临时文件(不fsync)。 GET延迟为取出完整内容所需的时间。
+ *
+ *  compress-benchmark -n 20000 -t 1024
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "lzf.h"
+#include "rio.h"
+#include "robj.h"
+#include "sds.h"
+#include "zmalloc.h"
+#include "log.h"
+
+#define RDB_LZF_MIN_LEN 20
+
+static const char* words[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+    "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+};
+
+static uint64_t randState = 88172645463325252ull;
+static uint64_t nextRand(void)
+{
+    randState ^= randState << 13;
+    randState ^= randState >> 7;
+    randState ^= randState << 17;
+    return randState;
+}
+
+static const char* word(void)
+{
+    return words[nextRand() % (sizeof(words) / sizeof(words[0]))];
+}
+
+/* 生成一个大约size字节的JSON文档 */
+static sds makeJson(size_t size)
+{
+    sds s = sdsnew("[");
+    for (int i = 0; sdslen(s) < size; i++) {
+        char rec[256];
+        int n = snprintf(rec, sizeof(rec),
+            "%s{\"id\":%lu,\"name\":\"%s_%s\",\"email\":\"%s@%s.example.com\","
+            "\"tags\":[\"%s\",\"%s\"],\"score\":%lu.%02lu,\"active\":%s}",
+            i ? "," : "", (unsigned long)(nextRand() % 1000000), word(), word(), word(), word(),
+            word(), word(), (unsigned long)(nextRand() % 100), (unsigned long)(nextRand() % 100),
+            nextRand() % 2 ? "true" : "false");
+        s = sdscatlen(s, rec, n);
+    }
+    return sdscatlen(s, "]", 1);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmpDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* 和rdb.c中字符串的保存方式相同: 长度+字节，或ENC_LZF+压缩长度+原始长度+压缩数据。 长度固定按8字节写 */
+static void saveString(rio* r, robj* o)
+{
+    uint64_t hdr[2];
+    if (o->encoding == REDIS_ENCODING_COMPRESSED) {
+        sds lzf = o->ptr;
+        hdr[0] = sdslen(lzf) - OBJ_COMPRESS_HDR;
+        hdr[1] = robjCompressedRawLen(o);
+        rioWrite(r, hdr, sizeof(hdr));
+        rioWrite(r, lzf + OBJ_COMPRESS_HDR, hdr[0]);
+        return;
+    }
+    sds s = o->ptr;
+    size_t len = sdslen(s);
+    if (len > RDB_LZF_MIN_LEN) {
+        void* buf = zmalloc(len - 4);
+        size_t n = lzfCompress(s, len, buf, len - 4);
+        if (n) {
+            hdr[0] = n;
+            hdr[1] = len;
+            rioWrite(r, hdr, sizeof(hdr));
+            rioWrite(r, buf, n);
+            zfree(buf);
+            return;
+        }
+        zfree(buf);
+    }
+    hdr[0] = len;
+    rioWrite(r, hdr, sizeof(hdr[0]));
+    rioWrite(r, s, len);
+}
+
+static void run(const char* mode, sds* docs, long n, size_t threshold)
+{
+    robjSetCompressThreshold(threshold);
+    size_t before = zmallocUsedMemory(), rawBytes = 0;
+    robj** objs = zmalloc(sizeof(robj*) * n);
+    double start = now();
+    for (long i = 0; i < n; i++) {
+        objs[i] = robjCreateStringObjectLen(docs[i], sdslen(docs[i]));
+        rawBytes += sdslen(docs[i]);
+    }
+    double createSecs = now() - start;
+    size_t used = zmallocUsedMemory() - before;
+
+    char path[] = "/tmp/compress-benchmark-XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    rio r;
+    rioInitWithBufferedFD(&r, fd, 4 * 1024 * 1024);
+    start = now();
+    for (long i = 0; i < n; i++) saveString(&r, objs[i]);
+    rioFlush(&r);
+    double saveSecs = now() - start;
+    size_t fileBytes = r.processedBytes;
+    rioFreeBufferedFD(&r);
+    close(fd);
+
+    // GET: 取出完整内容。 原始保存时只是引用，压缩保存时要解压
+    double* lat = zmalloc(sizeof(double) * n);
+    volatile size_t sink = 0;
+    for (long i = 0; i < n; i++) {
+        long k = nextRand() % n;
+        double t = now();
+        robj* o = objs[k];
+        if (o->encoding == REDIS_ENCODING_COMPRESSED) {
+            sds s = robjDecompressString(o);
+            sink += s[sdslen(s) - 1];
+            sdsfree(s);
+        } else {
+            sds s = o->ptr;
+            sink += s[sdslen(s) - 1];
+        }
+        lat[i] = (now() - t) * 1e6;
+    }
+    qsort(lat, n, sizeof(double), cmpDouble);
+
+    printf("%-10s memory=%7.1fMB (ratio %.2f)  create=%6.0fMB/s  save=%6.3fs file=%7.1fMB  "
+           "GET p50=%.2fus p99=%.2fus\n",
+           mode, used / 1048576.0, (double)rawBytes / used, rawBytes / createSecs / 1048576,
+           saveSecs, fileBytes / 1048576.0, lat[n / 2], lat[n * 99 / 100]);
+
+    for (long i = 0; i < n; i++) robjDestroy(objs[i]);
+    zfree(objs);
+    zfree(lat);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: compress-benchmark [-n values] [-t compress-threshold]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    long n = 20000;
+    size_t threshold = 1024;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:h")) != -1) {
+        switch (opt) {
+        case 'n': n = atol(optarg); break;
+        case 't': threshold = atol(optarg); break;
+        default: usage();
+        }
+    }
+    if (n <= 0 || threshold == 0) usage();
+    log_set_level(LOG_INFO);
+    robjInit();
+
+    sds* docs = malloc(sizeof(sds) * n);
+    size_t total = 0, packed = 0;
+    double lzfSecs = 0, unlzfSecs = 0;
+    for (long i = 0; i < n; i++) {
+        docs[i] = makeJson(2048 + nextRand() % (18 * 1024));
+        size_t len = sdslen(docs[i]);
+        char* buf = malloc(len);
+        double t = now();
+        size_t c = lzfCompress(docs[i], len, buf, len);
+        lzfSecs += now() - t;
+        char* back = malloc(len);
+        t = now();
+        if (c == 0 || lzfDecompress(buf, c, back, len) != len || memcmp(back, docs[i], len) != 0) {
+            fprintf(stderr, "LZF roundtrip failed\n");
+            return 1;
+        }
+        unlzfSecs += now() - t;
+        total += len;
+        packed += c;
+        free(buf);
+        free(back);
+    }
+    printf("%ld JSON values, %.1fMB, LZF ratio %.2f, compress %.0fMB/s, decompress %.0fMB/s\n",
+           n, total / 1048576.0, (double)total / packed, total / lzfSecs / 1048576,
+           total / unlzfSecs / 1048576);
+
+    run("raw", docs, n, 0);
+    run("compressed", docs, n, threshold);
+
+    for (long i = 0; i < n; i++) sdsfree(docs[i]);
+    free(docs);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file dict-benchmark.c
+ * @brief dict引擎对比：链式 vs swiss，插入、命中查找、未命中查找、删除的耗时和每个键的内存
+ *
+ * 键为整数(直接存指针，不额外分配)，hash使用dictGenHashFunction，与数据库的键走同样的hash路径。
+ * 内存为插入前后malloc已分配字节数之差(mallinfo2，含mmap分配的大块)，包含桶数组/组数组和链式引擎的节点。
+ *
+ *  dict-benchmark -n 1000000 -e swiss
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <time.h>
+#include "dict.h"
+#include "log.h"
+
+static unsigned long intHash(const void* key)
+{
+    uintptr_t k = (uintptr_t)key;
+    return dictGenHashFunction(&k, sizeof(k));
+}
+
+static int intCompare(void* privdata, const void* key1, const void* key2)
+{
+    return key1 == key2 ? 0 : 1;
+}
+
+static dictType benchTypes[] = {
+    { .hashFunction = intHash, .keyCompare = intCompare, .engine = DICT_ENGINE_CHAINED },
+    { .hashFunction = intHash, .keyCompare = intCompare, .engine = DICT_ENGINE_SWISS },
+};
+static const char* engineNames[] = { "chained", "swiss" };
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 打乱访问顺序，避免顺序键带来的缓存局部性
+static uintptr_t keyAt(long i, long n)
+{
+    return (uintptr_t)(((uint64_t)i * 2654435761u) % (uint64_t)n) + 1;
+}
+
+// 查找使用随机键：按插入顺序查找时，链式引擎的节点在内存中近似顺序分布，会高估它的命中性能
+static uint64_t randState = 88172645463325252ull;
+static uintptr_t randomKey(long n)
+{
+    randState ^= randState << 13;
+    randState ^= randState >> 7;
+    randState ^= randState << 17;
+    return (uintptr_t)(randState % (uint64_t)n) + 1;
+}
+
+static size_t mallocUsed(void)
+{
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+static void report(const char* engine, const char* op, long n, double secs)
+{
+    printf("%-8s %-12s %10.1f ns/op %12.0f ops/s\n", engine, op, secs * 1e9 / n, n / secs);
+}
+
+static void benchEngine(int engine, long n)
+{
+    const char* name = engineNames[engine];
+    size_t before = mallocUsed();
+    dict* d = dictCreate(&benchTypes[engine], NULL);
+
+    double start = now();
+    for (long i = 0; i < n; i++) {
+        dictAdd(d, (void*)keyAt(i, n), (void*)1);
+    }
+    report(name, "insert", n, now() - start);
+    size_t used = mallocUsed() - before;
+
+    start = now();
+    long hits = 0;
+    for (long i = 0; i < n; i++) {
+        hits += dictFind(d, (void*)randomKey(n)) != NULL;
+    }
+    report(name, "lookup-hit", n, now() - start);
+
+    start = now();
+    long misses = 0;
+    for (long i = 0; i < n; i++) {
+        misses += dictFind(d, (void*)(randomKey(n) + n)) == NULL;
+    }
+    report(name, "lookup-miss", n, now() - start);
+
+    start = now();
+    for (long i = 0; i < n; i++) {
+        dictDelete(d, (void*)keyAt(i, n));
+    }
+    report(name, "delete", n, now() - start);
+
+    printf("%-8s %-12s %10.1f bytes/key (%zu MB)\n", name, "memory", (double)used / n, used >> 20);
+    if (hits != n || misses != n || dictSize(d) != 0) {
+        fprintf(stderr, "%s: unexpected result hits=%ld misses=%ld size=%zu\n", name, hits, misses, dictSize(d));
+        exit(EXIT_FAILURE);
+    }
+    dictRelease(d);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: dict-benchmark [-n keys] [-e chained|swiss|all]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    long n = 1000000;
+    const char* engine = "all";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:e:h")) != -1) {
+        switch (opt) {
+        case 'n': n = atol(optarg); break;
+        case 'e': engine = optarg; break;
+        default: usage();
+        }
+    }
+    if (n <= 0) usage();
+    log_set_level(LOG_INFO);
+    printf("keys: %ld\n", n);
+    for (int i = 0; i < 2; i++) {
+        if (strcmp(engine, "all") == 0 || strcmp(engine, engineNames[i]) == 0)
+            benchEngine(i, n);
+    }
+    return 0;
+}
@@ -0,0 +1,400 @@
+/**
+ * @file fedis-benchmark.c
+ * @brief 压测工具： 多线程、多连接、pipeline发送SET/GET/INCR，统计吞吐
+ *
+ * 每个压测线程负责一组连接，先向每个连接发送一批(pipeline)命令，再依次读回同样数量的回复。
+ * 同时在途的请求数 = 连接数 * pipeline。
+ *
+ *  fedis-benchmark -p 6666 -c 50 -n 1000000 -P 16 -T 4 -t set,get
+ *
+ * -z 按Zipf分布选key(参数为指数，0为均匀分布)，排名第i的key被访问的概率正比于 1/i^s。
+ * cache测试模拟缓存旁路：GET未命中再SET，统计命中率。 配合maxmemory比较不同淘汰策略：
+ *  fedis-benchmark -p 6666 -r 1000000 -n 2000000 -z 1.0 -d 100 -t cache
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+#include <math.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define BENCH_BUF_SIZE (64 * 1024)
+
+typedef struct benchConfig {
+    const char* host;
+    int port;
+    int clients;        // 连接数
+    long requests;      // 每项测试的请求总数
+    int pipeline;
+    int datasize;       // SET值长度
+    long keyspace;      // key范围 key:0 .. key:keyspace-1
+    int threads;        // 压测线程数
+    double zipf;        // Zipf指数，0表示均匀分布
+} benchConfig;
+
+typedef struct benchConn {
+    int fd;
+    char* rbuf;     // 未解析完的回复
+    size_t rlen;
+} benchConn;
+
+typedef struct benchThread {
+    pthread_t tid;
+    int id;
+    benchConn* conns;
+    int nconns;
+    const char* cmd;    // "SET" / "GET"
+    unsigned int seed;
+} benchThread;
+
+static benchConfig config = {
+    .host = "127.0.0.1",
+    .port = 6666,
+    .clients = 50,
+    .requests = 100000,
+    .pipeline = 1,
+    .datasize = 3,
+    .keyspace = 10000,
+    .threads = 1,
+    .zipf = 0,
+};
+static _Atomic long requestsIssued;     // 已领取的请求数
+static _Atomic long requestsFinished;
+static _Atomic long cacheHits;
+static char* value;
+static double* zipfCdf;     // Zipf累积分布，keyspace项
+
+static long long ustime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((long long)tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static int benchConnect(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.host, &addr.sin_addr) <= 0) {
+        close(fd);
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    return fd;
+}
+
+static int writeAll(int fd, const char* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief 从buf开头解析完整的回复个数，返回消耗的字节
+ *
+ * @param [in] buf
+ * @param [in] len
+ * @param [out] count
+ * @return size_t
+ */
+static size_t countReplies(const char* buf, size_t len, long* count, char* missed)
+{
+    size_t pos = 0;
+    while (pos < len) {
+        const char* nl = memchr(buf + pos, '\n', len - pos);
+        if (nl == NULL) break;
+        size_t lineEnd = nl - buf + 1;
+        int miss = buf[pos] == '-';
+        if (buf[pos] == '$') {
+            long n = strtol(buf + pos + 1, NULL, 10);
+            if (n >= 0) {
+                if (len - lineEnd < (size_t)n + 2) break;
+                lineEnd += n + 2;
+            } else {
+                miss = 1;
+            }
+        }
+        if (missed) missed[*count] = miss;
+        pos = lineEnd;
+        (*count)++;
+    }
+    return pos;
+}
+
+/**
+ * @brief 读取expect个回复
+ *
+ * @param [in] c
+ * @param [in] expect
+ * @param [out] missed 可为NULL。 第i个回复是错误或空回复时置1
+ * @return int
+ */
+static int readReplies(benchConn* c, long expect, char* missed)
+{
+    long got = 0;
+    while (got < expect) {
+        ssize_t n = read(c->fd, c->rbuf + c->rlen, BENCH_BUF_SIZE - c->rlen);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        c->rlen += n;
+        size_t used = countReplies(c->rbuf, c->rlen, &got, missed);
+        memmove(c->rbuf, c->rbuf + used, c->rlen - used);
+        c->rlen -= used;
+        if (c->rlen == BENCH_BUF_SIZE) {
+            fprintf(stderr, "reply larger than %d bytes\n", BENCH_BUF_SIZE);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static size_t appendCommand(char* buf, const char* cmd, long key)
+{
+    char k[32];
+    int klen = snprintf(k, sizeof(k), "key:%ld", key);
+    if (strcmp(cmd, "SET") == 0) {
+        return sprintf(buf, "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%d\r\n%s\r\n", klen, k, config.datasize, value);
+    }
+    if (strcmp(cmd, "INCR") == 0) {
+        return sprintf(buf, "*2\r\n$4\r\nINCR\r\n$%d\r\n%s\r\n", klen, k);
+    }
+    return sprintf(buf, "*2\r\n$3\r\nGET\r\n$%d\r\n%s\r\n", klen, k);
+}
+
+/**
+ * @brief 预先计算Zipf累积分布
+ *
+ * @param [in] n
+ * @param [in] s
+ */
+static void zipfInit(long n, double s)
+{
+    zipfCdf = malloc(n * sizeof(double));
+    double sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, s);
+        zipfCdf[i] = sum;
+    }
+    for (long i = 0; i < n; i++) {
+        zipfCdf[i] /= sum;
+    }
+}
+
+static long nextKey(unsigned int* seed)
+{
+    if (zipfCdf == NULL)
+        return rand_r(seed) % config.keyspace;
+    // 二分查找第一个累积概率不小于u的排名
+    double u = (double)rand_r(seed) / RAND_MAX;
+    long lo = 0, hi = config.keyspace - 1;
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (zipfCdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief 缓存旁路：一批GET，未命中的key再一批SET回填
+ *
+ * @param [in] arg
+ * @return void*
+ */
+static void* cacheThreadMain(void* arg)
+{
+    benchThread* t = arg;
+    char* wbuf = malloc((size_t)config.pipeline * (config.datasize + 128));
+    long* keys = malloc(config.pipeline * sizeof(long));
+    char* missed = malloc(config.pipeline);
+    int conn = 0;
+    while (1) {
+        long start = atomic_fetch_add(&requestsIssued, config.pipeline);
+        if (start >= config.requests) break;
+        long batch = config.requests - start < config.pipeline ? config.requests - start : config.pipeline;
+        benchConn* c = &t->conns[conn++ % t->nconns];
+        size_t len = 0;
+        for (long j = 0; j < batch; j++) {
+            keys[j] = nextKey(&t->seed);
+            len += appendCommand(wbuf + len, "GET", keys[j]);
+        }
+        if (writeAll(c->fd, wbuf, len) < 0 || readReplies(c, batch, missed) < 0) {
+            fprintf(stderr, "connection error: %s\n", strerror(errno));
+            exit(1);
+        }
+        long misses = 0;
+        len = 0;
+        for (long j = 0; j < batch; j++) {
+            if (!missed[j]) continue;
+            len += appendCommand(wbuf + len, "SET", keys[j]);
+            misses++;
+        }
+        if (misses && (writeAll(c->fd, wbuf, len) < 0 || readReplies(c, misses, NULL) < 0)) {
+            fprintf(stderr, "connection error: %s\n", strerror(errno));
+            exit(1);
+        }
+        atomic_fetch_add(&cacheHits, batch - misses);
+        atomic_fetch_add(&requestsFinished, batch);
+    }
+    free(missed);
+    free(keys);
+    free(wbuf);
+    return NULL;
+}
+
+static void* benchThreadMain(void* arg)
+{
+    benchThread* t = arg;
+    char* wbuf = malloc((size_t)config.pipeline * (config.datasize + 128));
+    long* batches = calloc(t->nconns, sizeof(long));
+    int active = t->nconns;
+    while (active == t->nconns) {
+        // 先向所有连接发送一批，再依次读取回复，所有连接同时在途
+        active = 0;
+        for (int i = 0; i < t->nconns; i++) {
+            long start = atomic_fetch_add(&requestsIssued, config.pipeline);
+            if (start >= config.requests) break;
+            long batch = config.requests - start < config.pipeline ? config.requests - start : config.pipeline;
+            size_t len = 0;
+            for (long j = 0; j < batch; j++) {
+                len += appendCommand(wbuf + len, t->cmd, nextKey(&t->seed));
+            }
+            if (writeAll(t->conns[i].fd, wbuf, len) < 0) {
+                fprintf(stderr, "connection error: %s\n", strerror(errno));
+                exit(1);
+            }
+            batches[i] = batch;
+            active++;
+        }
+        for (int i = 0; i < active; i++) {
+            if (readReplies(&t->conns[i], batches[i], NULL) < 0) {
+                fprintf(stderr, "connection error: %s\n", strerror(errno));
+                exit(1);
+            }
+            atomic_fetch_add(&requestsFinished, batches[i]);
+        }
+    }
+    free(batches);
+    free(wbuf);
+    return NULL;
+}
+
+static void runTest(benchThread* threads, const char* cmd)
+{
+    atomic_store(&requestsIssued, 0);
+    atomic_store(&requestsFinished, 0);
+    atomic_store(&cacheHits, 0);
+    int cache = strcmp(cmd, "CACHE") == 0;
+    long long start = ustime();
+    for (int i = 0; i < config.threads; i++) {
+        threads[i].cmd = cmd;
+        pthread_create(&threads[i].tid, NULL, cache ? cacheThreadMain : benchThreadMain, &threads[i]);
+    }
+    for (int i = 0; i < config.threads; i++) {
+        pthread_join(threads[i].tid, NULL);
+    }
+    double secs = (ustime() - start) / 1e6;
+    long done = atomic_load(&requestsFinished);
+    printf("%s: %ld requests in %.2f seconds, %.0f requests per second\n", cmd, done, secs, done / secs);
+    if (cache)
+        printf("CACHE: hit ratio %.2f%%\n", done ? atomic_load(&cacheHits) * 100.0 / done : 0);
+}
+
+static void usage(void)
+{
+    printf("Usage: fedis-benchmark [-h host] [-p port] [-c clients] [-n requests] [-P pipeline]\n"
+           "                       [-d datasize] [-r keyspace] [-T threads] [-z zipf] [-t set,get,incr,cache]\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    char tests[64] = "set,get";
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:n:P:d:r:T:t:z:")) != -1) {
+        switch (opt) {
+            case 'h': config.host = optarg; break;
+            case 'p': config.port = atoi(optarg); break;
+            case 'c': config.clients = atoi(optarg); break;
+            case 'n': config.requests = atol(optarg); break;
+            case 'P': config.pipeline = atoi(optarg); break;
+            case 'd': config.datasize = atoi(optarg); break;
+            case 'r': config.keyspace = atol(optarg); break;
+            case 'T': config.threads = atoi(optarg); break;
+            case 't': snprintf(tests, sizeof(tests), "%s", optarg); break;
+            case 'z': config.zipf = atof(optarg); break;
+            default: usage();
+        }
+    }
+    if (config.clients < 1 || config.pipeline < 1 || config.threads < 1 || config.keyspace < 1 || config.zipf < 0)
+        usage();
+    if (config.threads > config.clients)
+        config.threads = config.clients;
+
+    value = malloc(config.datasize + 1);
+    memset(value, 'x', config.datasize);
+    value[config.datasize] = '\0';
+    if (config.zipf > 0)
+        zipfInit(config.keyspace, config.zipf);
+
+    // 连接均分给压测线程
+    benchThread* threads = calloc(config.threads, sizeof(benchThread));
+    for (int i = 0; i < config.threads; i++) {
+        benchThread* t = &threads[i];
+        t->id = i;
+        t->seed = i + 1;
+        t->nconns = config.clients / config.threads + (i < config.clients % config.threads);
+        t->conns = calloc(t->nconns, sizeof(benchConn));
+        for (int j = 0; j < t->nconns; j++) {
+            t->conns[j].fd = benchConnect();
+            if (t->conns[j].fd < 0) {
+                fprintf(stderr, "connect %s:%d failed: %s\n", config.host, config.port, strerror(errno));
+                return 1;
+            }
+            t->conns[j].rbuf = malloc(BENCH_BUF_SIZE);
+        }
+    }
+    printf("clients: %d, pipeline: %d, threads: %d, datasize: %d, keyspace: %ld, zipf: %.2f\n",
+           config.clients, config.pipeline, config.threads, config.datasize, config.keyspace, config.zipf);
+
+    char* saveptr;
+    for (char* t = strtok_r(tests, ",", &saveptr); t; t = strtok_r(NULL, ",", &saveptr)) {
+        if (strcasecmp(t, "set") == 0)
+            runTest(threads, "SET");
+        else if (strcasecmp(t, "get") == 0)
+            runTest(threads, "GET");
+        else if (strcasecmp(t, "incr") == 0)
+            runTest(threads, "INCR");
+        else if (strcasecmp(t, "cache") == 0)
+            runTest(threads, "CACHE");
+        else
+            fprintf(stderr, "unknown test %s\n", t);
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+# io-threads 吞吐对比： 分别以 1/2/4/8 个IO线程启动fedis，运行同样的压测
+#   bench/io-threads.sh [build目录] [fedis-benchmark参数...]
+#   bench/io-threads.sh build -c 200 -n 2000000 -P 16 -T 8
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=${1:-$ROOT/build}
+shift || true
+ARGS=${@:-"-c 200 -n 1000000 -P 16 -T 8"}
+PORT=7390
+CONF=conf/bench-io-threads.conf
+
+for n in 1 2 4 8; do
+    cat > "$ROOT/$CONF" <<CONF_EOF
+role=master
+port=$PORT
+dbnum=4
+aof_file=data/bench.aof
+rdb_file=data/bench.rdb
+consistency=none
+appendfsync=everysec
+io-threads=$n
+CONF_EOF
+    "$BUILD/fedis" "$CONF" > /dev/null 2>&1 &
+    pid=$!
+    sleep 1
+    echo "== io-threads $n"
+    "$BUILD/fedis-benchmark" -p $PORT -t set,get $ARGS | grep "requests per second"
+    kill $pid
+    wait $pid 2>/dev/null || true
+done
+rm -f "$ROOT/$CONF"
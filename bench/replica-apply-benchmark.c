@@ -0,0 +1,207 @@
+/**
+ * @file replica-apply-benchmark.c
+ * @brief 从服务器应用主传播的写命令的吞吐: 每条命令之后offset的持久化方式对比
+ *
+ * 每条命令: 从缓冲区解析一条SET(与读取主连接相同的请求解析器)，写入dict，offset增加命令长度，然后
+ *  config:     update_config把offset写入配置文件(重写整个文件再rename)，原来的做法
+ *  state-sync: 复制状态文件 pwrite + fdatasync，每条命令都落盘的上限参考
+ *  state:      只更新内存，每秒写一次复制状态文件(serverCron的做法)
+ * 每种方式运行相同的时间，输出每秒应用的命令数和写文件次数。
+ *
+ *  replica-apply-benchmark -s 2 -r 100000 -d 32
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "conf.h"
+#include "dict.h"
+#include "log.h"
+#include "replstate.h"
+#include "resp.h"
+#include "sds.h"
+#include "util.h"
+
+#define MODE_CONFIG 0
+#define MODE_STATE_SYNC 1
+#define MODE_STATE 2
+
+static const char* modeNames[] = {"config", "state-sync", "state"};
+
+static unsigned long sdsHash(const void* key)
+{
+    return dictGenHashFunction(key, sdslen((sds)key));
+}
+
+static int sdsCompare(void* privdata, const void* key1, const void* key2)
+{
+    (void)privdata;
+    size_t l1 = sdslen((sds)key1), l2 = sdslen((sds)key2);
+    return l1 == l2 && memcmp(key1, key2, l1) == 0 ? 0 : 1;
+}
+
+static int sdsCompareView(void* privdata, const void* key, const char* buf, size_t len)
+{
+    (void)privdata;
+    return sdslen((sds)key) == len && memcmp(key, buf, len) == 0 ? 0 : 1;
+}
+
+static void sdsDestructor(void* privdata, void* p)
+{
+    (void)privdata;
+    sdsfree(p);
+}
+
+static dictType kvType = {
+    .hashFunction = sdsHash,
+    .keyCompare = sdsCompare,
+    .keyCompareView = sdsCompareView,
+    .keyDestructor = sdsDestructor,
+    .valDestructor = sdsDestructor,
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 主传播过来的一段命令流: keys条 SET key:<i> <value> */
+static sds makeStream(long keys, int datasize)
+{
+    sds value = sdsempty();
+    for (int i = 0; i < datasize; i++) value = sdscatlen(value, "x", 1);
+    sds s = sdsempty();
+    for (long i = 0; i < keys; i++) {
+        char key[32];
+        char hdr[96];
+        int klen = snprintf(key, sizeof(key), "key:%ld", i);
+        int n = snprintf(hdr, sizeof(hdr), "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%d\r\n", klen, key, datasize);
+        s = sdscatlen(s, hdr, n);
+        s = sdscatlen(s, value, datasize);
+        s = sdscatlen(s, "\r\n", 2);
+    }
+    sdsfree(value);
+    return s;
+}
+
+static void run(int mode, sds stream, double seconds, const char* confPath, int stateFd)
+{
+    dict* kv = dictCreate(&kvType, NULL);
+    respReqParser p;
+    respReqParserInit(&p);
+    long offset = 0, applied = 0, writes = 0;
+    double start = now(), lastSave = start, end = start + seconds;
+    double t = start;
+    while (t < end) {
+        // 每应用1024条命令看一次时间
+        for (int i = 0; i < 1024; i++) {
+            if (p.pos >= sdslen(stream)) {
+                p.pos = 0;
+                p.cmdstart = 0;
+            }
+            if (respParseRequest(&p, stream, sdslen(stream)) != RESP_REQ_OK) {
+                fprintf(stderr, "parse failed\n");
+                exit(1);
+            }
+            const char* key = stream + p.argvoff[1];
+            size_t klen = p.argvlen[1];
+            sds val = sdsnewlen(stream + p.argvoff[2], p.argvlen[2]);
+            dictEntry* de = dictFindView(kv, key, klen);
+            if (de) {
+                sdsfree(de->v.val);
+                de->v.val = val;
+            } else {
+                dictAdd(kv, sdsnewlen(key, klen), val);
+            }
+            offset += p.pos - p.cmdstart;
+            respReqParserReset(&p);
+            applied++;
+
+            if (mode == MODE_CONFIG) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%ld", offset);
+                update_config(confPath, "offset", buf);
+                writes++;
+            } else if (mode == MODE_STATE_SYNC) {
+                replState st = {offset, "9f1c0e7a5d3b2c4e6f8091a2b3c4d5e6f7081920"};
+                replStateWrite(stateFd, &st);
+                writes++;
+            }
+        }
+        t = now();
+        if (mode == MODE_STATE && t - lastSave >= 1.0) {
+            replState st = {offset, "9f1c0e7a5d3b2c4e6f8091a2b3c4d5e6f7081920"};
+            replStateWrite(stateFd, &st);
+            writes++;
+            lastSave = t;
+        }
+    }
+    double secs = now() - start;
+    if (mode == MODE_STATE) {
+        // 关闭前再写一次
+        replState st = {offset, "9f1c0e7a5d3b2c4e6f8091a2b3c4d5e6f7081920"};
+        replStateWrite(stateFd, &st);
+        writes++;
+    }
+    printf("%-10s %10.0f ops/sec  %8ld commands  %6ld file writes  %.2fs\n",
+           modeNames[mode], applied / secs, applied, writes, secs);
+    respReqParserFree(&p);
+    dictRelease(kv);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: replica-apply-benchmark [-s seconds per mode] [-r keyspace] [-d datasize]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = 2;
+    long keys = 100000;
+    int datasize = 32;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:d:h")) != -1) {
+        switch (opt) {
+        case 's': seconds = atof(optarg); break;
+        case 'r': keys = atol(optarg); break;
+        case 'd': datasize = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if (seconds <= 0 || keys <= 0 || datasize <= 0) usage();
+    log_set_level(LOG_INFO);
+
+    // update_config的临时文件在conf/下，配置文件放在同一个文件系统才能rename
+    char* confPath = fullPath("conf/bench-replica-apply.conf");
+    FILE* f = fopen(confPath, "w");
+    if (f == NULL) {
+        perror(confPath);
+        return 1;
+    }
+    fprintf(f, "role=slave\nport=7778\ndbnum=4\naof_file=data/7778.aof\nrdb_file=data/7778.rdb\n"
+               "consistency=none\nmaster=127.0.0.1:6666\noffset=-1\n");
+    fclose(f);
+    char* statePath = fullPath("conf/bench-replica-apply.repl");
+    int stateFd = replStateOpen(statePath);
+    if (stateFd == -1) {
+        perror(statePath);
+        return 1;
+    }
+
+    sds stream = makeStream(keys, datasize);
+    printf("%ld keys, %d bytes values, %.1fs per mode\n", keys, datasize, seconds);
+    for (int mode = MODE_CONFIG; mode <= MODE_STATE; mode++)
+        run(mode, stream, seconds, confPath, stateFd);
+
+    sdsfree(stream);
+    close(stateFd);
+    unlink(statePath);
+    unlink(confPath);
+    free(statePath);
+    free(confPath);
+    return 0;
+}
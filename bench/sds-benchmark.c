@@ -0,0 +1,151 @@
+/**
+ * @file sds-benchmark.c
+ * @brief sds对比旧实现(结构体 + 独立buf，两次分配): 创建/释放短字符串、反复追加构建中等长度字符串的分配次数和耗时
+ *
+ * 新实现的分配次数在计时循环外，通过 追加前可用空间是否足够 统计。
+ *
+ *  sds-benchmark -n 100000 -r 2000 -a 256
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "sds.h"
+#include "log.h"
+
+/* 旧实现。 noinline: 和sds.c一样作为独立函数调用，避免分配被优化掉 */
+static long legacyAllocs = 0;
+typedef struct legacySds {
+    int len;
+    int free;
+    char* buf;
+} legacySds;
+
+__attribute__((noinline)) static legacySds* legacySdsnewlen(const char* init, int len)
+{
+    int bufLen = len < 1024 ? len * 2 + 1 : len + 1024 + 1;
+    legacySds* ss = calloc(1, sizeof(legacySds));
+    ss->buf = calloc(bufLen, sizeof(char));
+    legacyAllocs += 2;
+    ss->len = len;
+    ss->free = bufLen - len - 1;
+    memcpy(ss->buf, init, len);
+    return ss;
+}
+
+__attribute__((noinline)) static void legacySdscatlen(legacySds* dest, const char* buf, int n)
+{
+    int len = dest->len;
+    int newlen = len + n;
+    if (n > dest->free) {
+        int newbuflen = newlen < 1024 ? newlen * 2 + 1 : newlen + 1024 + 1;
+        dest->buf = realloc(dest->buf, newbuflen);
+        legacyAllocs++;
+        dest->free = newbuflen - newlen - 1;
+        memset(dest->buf + len, 0, newbuflen - len);
+    } else {
+        dest->free -= n;
+    }
+    memcpy(dest->buf + len, buf, n);
+    dest->len = newlen;
+}
+
+__attribute__((noinline)) static void legacySdsfree(legacySds* ss)
+{
+    free(ss->buf);
+    free(ss);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: sds-benchmark [-n keys] [-r rounds] [-a appends per round]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    int nkeys = 100000;
+    int nrounds = 2000;
+    int nappend = 256;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:a:h")) != -1) {
+        switch (opt) {
+        case 'n': nkeys = atoi(optarg); break;
+        case 'r': nrounds = atoi(optarg); break;
+        case 'a': nappend = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if (nkeys <= 0 || nrounds <= 0 || nappend <= 0) usage();
+    log_set_level(LOG_INFO);
+
+    const char chunk[] = "0123456789abcdef";
+    // volatile: 避免编译器对旧实现做常量传播，两者都走通用路径
+    volatile int chunklenv = sizeof(chunk) - 1;
+    const int chunklen = chunklenv;
+    char (*keys)[32] = malloc(nkeys * sizeof(*keys));
+    int* klens = malloc(nkeys * sizeof(int));
+    for (int i = 0; i < nkeys; i++)
+        klens[i] = snprintf(keys[i], sizeof(keys[i]), "key:%d", i);
+
+    // 1. 创建/释放短字符串(类似key)
+    legacyAllocs = 0;
+    double start = now();
+    for (int i = 0; i < nkeys; i++)
+        legacySdsfree(legacySdsnewlen(keys[i], klens[i]));
+    double legacyNewMs = (now() - start) * 1e3;
+    long legacyNewAllocs = legacyAllocs;
+
+    start = now();
+    for (int i = 0; i < nkeys; i++)
+        sdsfree(sdsnewlen(keys[i], klens[i]));
+    double newNewMs = (now() - start) * 1e3;
+    long newNewAllocs = nkeys;
+
+    // 2. 追加吞吐: 反复构建中等长度的字符串(类似回复/查询缓冲)
+    legacyAllocs = 0;
+    start = now();
+    for (int r = 0; r < nrounds; r++) {
+        legacySds* ls = legacySdsnewlen("", 0);
+        for (int i = 0; i < nappend; i++)
+            legacySdscatlen(ls, chunk, chunklen);
+        legacySdsfree(ls);
+    }
+    double legacyCatMs = (now() - start) * 1e3;
+    long legacyCatAllocs = legacyAllocs;
+
+    start = now();
+    for (int r = 0; r < nrounds; r++) {
+        sds s = sdsempty();
+        for (int i = 0; i < nappend; i++)
+            s = sdscatlen(s, chunk, chunklen);
+        sdsfree(s);
+    }
+    double newCatMs = (now() - start) * 1e3;
+
+    long newCatAllocs = 1;
+    sds s = sdsempty();
+    for (int i = 0; i < nappend; i++) {
+        if (sdsavail(s) < (size_t)chunklen)
+            newCatAllocs++;
+        s = sdscatlen(s, chunk, chunklen);
+    }
+    sdsfree(s);
+    newCatAllocs *= nrounds;
+
+    printf("sds new/free %d keys: legacy %ld allocs %.2fms, sds %ld allocs %.2fms\n",
+           nkeys, legacyNewAllocs, legacyNewMs, newNewAllocs, newNewMs);
+    printf("sds append %d x %d x %dB: legacy %ld allocs %.2fms, sds %ld allocs %.2fms\n",
+           nrounds, nappend, chunklen, legacyCatAllocs, legacyCatMs, newCatAllocs, newCatMs);
+    free(klens);
+    free(keys);
+    return 0;
+}
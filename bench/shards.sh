@@ -0,0 +1,33 @@
+#!/bin/bash
+# 分片模式吞吐对比： 分别以 1/2/4/8 个分片启动fedis，运行同样的压测
+#   bench/shards.sh [build目录] [fedis-benchmark参数...]
+#   bench/shards.sh build -c 200 -n 2000000 -P 16 -T 8
+# 随机key，分片数为N时约(N-1)/N的命令需要转发到其他分片
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=${1:-$ROOT/build}
+shift || true
+ARGS=${@:-"-c 200 -n 1000000 -P 16 -T 8"}
+PORT=7391
+CONF=conf/bench-shards.conf
+
+for n in 1 2 4 8; do
+    cat > "$ROOT/$CONF" <<CONF_EOF
+role=master
+port=$PORT
+dbnum=4
+aof_file=data/bench.aof
+rdb_file=data/bench.rdb
+consistency=none
+appendfsync=everysec
+shards=$n
+CONF_EOF
+    "$BUILD/fedis" "$CONF" > /dev/null 2>&1 &
+    pid=$!
+    sleep 1
+    echo "== shards $n"
+    "$BUILD/fedis-benchmark" -p $PORT -t set,get $ARGS | grep "requests per second"
+    kill $pid
+    wait $pid 2>/dev/null || true
+done
+rm -f "$ROOT/$CONF"
@@ -0,0 +1,159 @@
+/**
+ * @file zmalloc-benchmark.c
+ * @brief 分配器对比：libc vs slab vs arena，SET/DEL反复增删下的吞吐、常驻内存和碎片率
+ *
+ * 模拟数据库的分配模式：键为sds，值为字符串对象(短值robj和sds一次分配，长值robj + sds)，
+ * 存在swiss引擎的dict中。 先写入-k个键，再做-n次操作：随机选一个键，存在则删除，不存在则以随机长度的值写入。
+ * 值长度在1~200之间变化，分配落在不同大小级上，和真实负载一样会留下碎片。
+ * 每个模式单独运行一个进程，常驻内存才有可比性：
+ *
+ *  zmalloc-benchmark -a libc; zmalloc-benchmark -a slab; zmalloc-benchmark -a arena
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include "dict.h"
+#include "sds.h"
+#include "zmalloc.h"
+#include "log.h"
+
+#define EMBSTR_LIMIT 44     // 和robj一样，不超过这个长度的值与对象头一次分配
+
+typedef struct benchObject {
+    unsigned type:4;
+    unsigned encoding:4;
+    unsigned lru:24;
+    int refcount;
+    void* ptr;
+} benchObject;
+
+static unsigned long sdsHash(const void* key)
+{
+    return dictGenHashFunction(key, sdslen((const sds)key));
+}
+
+static int sdsCompare(void* privdata, const void* key1, const void* key2)
+{
+    size_t l1 = sdslen((const sds)key1), l2 = sdslen((const sds)key2);
+    return l1 == l2 && memcmp(key1, key2, l1) == 0 ? 0 : 1;
+}
+
+static int sdsCompareView(void* privdata, const void* key, const char* buf, size_t len)
+{
+    return sdslen((const sds)key) == len && memcmp(key, buf, len) == 0 ? 0 : 1;
+}
+
+static void sdsDestructor(void* privdata, void* key)
+{
+    sdsfree(key);
+}
+
+static void objectDestructor(void* privdata, void* val)
+{
+    benchObject* o = val;
+    if (o->encoding == 1) sdsfree(o->ptr);
+    zfree(o);
+}
+
+static dictType benchType = {
+    .hashFunction = sdsHash,
+    .keyCompare = sdsCompare,
+    .keyCompareView = sdsCompareView,
+    .keyDestructor = sdsDestructor,
+    .valDestructor = objectDestructor,
+    .engine = DICT_ENGINE_SWISS,
+};
+
+static char payload[256];
+
+static benchObject* createValue(size_t len)
+{
+    benchObject* o;
+    if (len <= EMBSTR_LIMIT) {
+        o = zmalloc(sizeof(*o) + 3 + len + 1);  // 对象头 + sdshdr8 + 内容
+        o->encoding = 0;
+        o->ptr = (char*)(o + 1) + 3;
+        memcpy(o->ptr, payload, len);
+        ((char*)o->ptr)[len] = '\0';
+    } else {
+        o = zmalloc(sizeof(*o));
+        o->encoding = 1;
+        o->ptr = sdsnewlen(payload, len);
+    }
+    o->refcount = 1;
+    return o;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t randState = 88172645463325252ull;
+static uint64_t nextRand(void)
+{
+    randState ^= randState << 13;
+    randState ^= randState >> 7;
+    randState ^= randState << 17;
+    return randState;
+}
+
+static void toggleKey(dict* d, long keyspace)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "key:%lu", (unsigned long)(nextRand() % (uint64_t)keyspace));
+    dictKeyView view = dictMakeView(buf, len);
+    if (dictDeleteByView(d, &view) == DICT_OK)
+        return;
+    dictAdd(d, sdsnewlen(buf, len), createValue(nextRand() % 200 + 1));
+}
+
+static void report(const char* phase, long ops, double secs, dict* d)
+{
+    size_t used = zmallocUsedMemory(), rss = zmallocGetRss();
+    printf("%-6s %-6s %10.0f ops/s  keys=%-9lu used=%6zuMB rss=%6zuMB frag=%.2f\n",
+           zmallocModeName(), phase, ops / secs, dictSize(d), used >> 20, rss >> 20,
+           used ? (double)rss / used : 0);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: zmalloc-benchmark [-n ops] [-k keyspace] [-a libc|slab|arena]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    long n = 10000000, keyspace = 2000000;
+    int mode = ZMALLOC_SLAB;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:k:a:h")) != -1) {
+        switch (opt) {
+        case 'n': n = atol(optarg); break;
+        case 'k': keyspace = atol(optarg); break;
+        case 'a': mode = zmallocModeFromString(optarg); break;
+        default: usage();
+        }
+    }
+    if (n <= 0 || keyspace <= 0 || mode < 0) usage();
+    log_set_level(LOG_INFO);
+    zmallocInit(mode, 0);
+    memset(payload, 'x', sizeof(payload));
+
+    dict* d = dictCreate(&benchType, NULL);
+    double start = now();
+    for (long i = 0; i < keyspace; i++) toggleKey(d, keyspace);
+    report("fill", keyspace, now() - start, d);
+
+    start = now();
+    for (long i = 0; i < n; i++) toggleKey(d, keyspace);
+    report("churn", n, now() - start, d);
+
+    dictRelease(d);
+    return 0;
+}
@@ -70,13 +70,13 @@ int read_response(int sock) {
     if (bytes_received > 0) {
         buffer[bytes_received] = '\0';
         char* endptr;
-        sds* sbuf = sdsnew(buffer);
+        sds sbuf = sdsnew(buffer);
         char buf[512] = {0};
-        while (( endptr = respParse(sbuf->buf, sbuf->len)) != NULL)
+        while (( endptr = respParse(sbuf, sdslen(sbuf))) != NULL)
         {
-            memcpy(buf, sbuf->buf, endptr - sbuf->buf + 1);
+            memcpy(buf, sbuf, endptr - sbuf + 1);
             printf("<<< %s\n", resp_str(buf));
-            sdsrange(sbuf, endptr - sbuf->buf + 1, sdslen(sbuf) - 1);
+            sdsrange(sbuf, endptr - sbuf + 1, sdslen(sbuf) - 1);
         }
         return 0;
     } else if (bytes_received == 0)
@@ -26,6 +26,10 @@ typedef void aeFileProc(struct aeEventLoop *eventLoop, int fd, void *clientData)
 // 时间事件处理函数返回
 #define AE_NOMORE -1
 typedef int aeTimeProc(struct aeEventLoop* eventLoop, long long id, void* clientData);
+// 每轮进入epoll_wait之前调用
+typedef void aeBeforeSleepProc(struct aeEventLoop* eventLoop);
+// 每轮epoll_wait返回之后、处理事件之前调用
+typedef void aeAfterSleepProc(struct aeEventLoop* eventLoop);
 // 文件事件
 typedef struct aeFileEvent {
     int mask;   // AE_READABLE，AE_WRITABLE
@@ -70,6 +74,8 @@ typedef struct aeEventLoop {
     aeTimeEvent* timeEventHead; // 时间事件链表头
     long long timeEventNextId;  // 下一个时间事件id
 
+    aeBeforeSleepProc* beforesleep; // epoll_wait之前的回调，可以为NULL
+    aeAfterSleepProc* aftersleep;   // epoll_wait之后的回调，可以为NULL
 } aeEventLoop;
 
 
@@ -89,5 +95,7 @@ int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask);
 
 int aeCreateTimeEvent(aeEventLoop* loop, long long when, aeTimeProc* proc, void* procArg);
 
+void aeSetBeforeSleepProc(aeEventLoop* eventLoop, aeBeforeSleepProc* beforesleep);
+void aeSetAfterSleepProc(aeEventLoop* eventLoop, aeAfterSleepProc* aftersleep);
 void aeMain(aeEventLoop* eventLoop);
 #endif
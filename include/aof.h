@@ -3,20 +3,92 @@
 
 #include <stdbool.h>
 #include "sds.h"
-#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "typedefs.h"
+#include "list.h"
+#include "spsc.h"
+
+// 单元测试(C++)经redis.h包含本文件，只用到其中的宏和声明，不访问这些字段
+#ifdef __cplusplus
+#define AOF_ATOMIC(T) T
+#else
+#define AOF_ATOMIC(T) _Atomic T
+#endif
+
+#define AOF_REWRITE_PERC 100                    // 默认auto-aof-rewrite-percentage
+#define AOF_REWRITE_MIN_SIZE (64 * 1024 * 1024) // 默认auto-aof-rewrite-min-size
+#define AOF_IO_BUF_SIZE (4 * 1024 * 1024)       // 重写子进程写文件的用户态缓冲
+#define AOF_QUEUE_SIZE 1024                     // 交给刷盘线程、还没写入的批次上限
+#define AOF_BUF_REUSE_MAX (1024 * 1024)         // 不超过这个容量的批次buf写完后复用
+
+// appendfsync
+#define AOF_FSYNC_NO 0          // 只write，由操作系统决定何时落盘
+#define AOF_FSYNC_EVERYSEC 1    // 每秒fsync一次
+#define AOF_FSYNC_ALWAYS 2      // 回复之前fsync: 一轮事件循环的写命令为一批，一次write+fdatasync
+
+/**
+ * AOF写入
+ *  主线程执行写命令时追加到buf，不加锁；beforeSleep中把buf作为一批通过无锁队列交给刷盘线程，
+ *  换一个新的buf继续。 批次按交出的顺序编号，刷盘线程按顺序写入，更新已写入、已落盘的批次号。
+ *  always: 执行了写命令的客户端记下所在批次，批次fdatasync之前回复不发送；
+ *          刷盘线程一次取出队列中所有批次，write之后只fdatasync一次（组提交），通过eventfd通知主线程放行回复。
+ *          主线程不等待fsync，继续处理下一批
+ */
 struct AOF
 {
-    int fd; // aof fd 长期打开
-    sds* active_buf; // 主线程写的.  
-    sds* io_buf; // io刷盘
-    long long lastAofTime; // everysec 使用
-    bool isAofing;
-    pthread_mutex_t aof_mutex; // aof线程
-    pthread_cond_t aof_cond; // 
+    AOF_ATOMIC(int) fd; // aof fd 长期打开。 重写完成时主线程替换，刷盘线程关闭旧的
+    char* filename; // aof文件完整路径
+    sds buf; // 本轮事件循环的写命令，只有主线程访问
+    int selectedDb; // 最后写入aof的SELECT，-1表示下一条写命令前必须先写SELECT
+
+    // 刷盘线程
+    spscQueue* queue; // 主线程 -> 刷盘线程，元素为sds
+    spscQueue* freeQueue; // 刷盘线程 -> 主线程，写完的sds还给主线程复用、释放
+    sds spare; // 复用的空buf
+    int threadWakefd; // eventfd，交出批次后写入，唤醒刷盘线程
+    int syncedWakefd; // eventfd，always模式批次落盘后写入，主线程放行回复
+    AOF_ATOMIC(int) fsyncPolicy; // 刷盘线程使用的appendfsync。 server->aofFsync只在主线程访问，修改后发布到这里
+    unsigned long long batchSeq; // 已交出的批次数，只有主线程访问
+    AOF_ATOMIC(unsigned long long) writtenSeq; // 已write的批次
+    AOF_ATOMIC(unsigned long long) syncedSeq; // 已fsync的批次
+    list* clientsWaitingFsync; // always模式回复等待fsync的客户端
+
+    // 文件大小。 刷盘线程写入后增加
+    AOF_ATOMIC(off_t) currentSize;
+    off_t baseSize; // 启动或上次重写完成时的大小，自动重写按相对它的增长判断
+
+    // fsync统计，刷盘线程更新
+    AOF_ATOMIC(long long) statFsyncs;
+    AOF_ATOMIC(long long) statFsyncTotalUs;
+    AOF_ATOMIC(long long) statFsyncLastUs;
+    AOF_ATOMIC(long long) statFsyncMaxUs;
+    long long statDelayedFsync; // 刷盘线程还在写入/fsync，队列满，批次留到下一轮交出的次数
+
+    // BGREWRITEAOF
+    pid_t childPid; // 正在重写的子进程，-1表示没有
+    sds rewriteBuf; // 重写期间主线程的写命令，子进程结束后追加到新文件末尾
+    bool rewriteScheduled; // BGSAVE进行中收到的重写请求，BGSAVE结束后开始
+    time_t rewriteTimeStart;
+    long long lastRewriteTimeSec; // 上次重写耗时，-1表示没有重写过
+    int lastBgrewriteStatus; // 上次重写结果，0成功，-1失败
 };
 void aof_load();
 void aof_init();
 void  flushAppendOnlyFile();
-void* erverySecAOF(void* arg);
+void stopAppendOnly(void);
+int aofFsyncPolicyFromString(const char* s);
+const char* aofFsyncPolicyToString(int policy);
+void aofFsyncPolicyChanged(void);
+
+unsigned long long feedAppendOnlyFile(int dbid, const char* cmd, size_t len);
+int aofHoldClientReply(redisClient* c);
+void aofUnlinkClient(redisClient* c);
+
+int rewriteAppendOnlyFileBackground(void);
+void rewriteAppendOnlyFileIfNeeded(void);
+void backgroundRewriteDoneHandler(bool ok);
+void killAppendOnlyChild(void);
 
-#endif
\ No newline at end of file
+#endif
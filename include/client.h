@@ -17,7 +17,10 @@
 #include "error.h"
 #include "typedefs.h"
 #include "redis.h"
+#include "resp.h"
+#include "reply.h"
 #define CLIENT_NAME_MAX 32
+#define REDIS_IOBUF_LEN (16 * 1024) // 一次read最多读取字节数
 
 // 存储事务中命令状态
 struct MultiCmd
@@ -42,19 +45,40 @@ struct redisClient {
     int toclose; // 将要关闭
 
     // 读写缓冲
-    sds* readBuf;
-    sds* writeBuf;
+    sds readBuf;
+    replyList reply;    ///< 待发送的回复
 
     // 数据库
     int dbid;
     redisDb* db;
 
     // req命令处理
+    respReqParser reqParser; ///< readBuf上的可恢复解析状态，支持半包、pipeline
     int argc;   ///< 参数个数
-    char** argv;    ///< 参数数组
+    char** argv;    ///< 参数视图数组，指向readBuf内部，不以'\0'结尾，必须配合argvlen使用
+    size_t* argvlen;    ///< 参数长度
+    int argvcap;    ///< argv, argvlen 容量
+    const char* rawCmd; ///< 当前命令的原始RESP字节视图。 AOF、命令传播使用
+    size_t rawCmdLen;
+    sds propagateCmd;   ///< proc改写后写入AOF、传播给从的命令(RESP)，代替rawCmd。 NULL表示原样传播
+    int reqParsed;  ///< IO线程已解析出的结果(RESP_REQ_OK/RESP_REQ_ERR)，RESP_REQ_INCOMPLETE表示没有
+    dictKeyView keyView;    ///< 当前命令第一个键的视图，processCommand中计算一次hash，惰性过期和proc共用
+
+    // IO线程
+    int ioPending;  ///< CLIENT_PENDING_READ / CLIENT_PENDING_WRITE / CLIENT_PENDING_FSYNC
+    ssize_t ioResult;   ///< IO线程read/write的返回值
+    int ioErrno;
+    unsigned long long aofWaitSeq; ///< 最近一条写命令所在的AOF批次，appendfsync always时落盘后才能回复
+
+    // 分片
+    list* shardRequests;    ///< 转发到其他分片、回复还没发送的请求，按命令顺序。 没有时为NULL
 
     // repli复制特性
     int replState; ///< 对端同步状态。
+    sds replPending;    ///< 全量同步: RDB之后的写命令(fork之后传播的)，RDB发完后接在后面发送
+    int replRdbFd;      ///< 磁盘同步: 正在发送的RDB文件，没有时为-1
+    off_t replRdbOff;   ///< 磁盘同步: 已经放进回复队列的RDB字节数
+    off_t replRdbSize;
 
     // sentinel 客户实例特性
     char* name; // 对端名称
@@ -64,7 +88,7 @@ struct redisClient {
     ErrorCode last_errno;
 
     // 事务队列
-    sds** multcmds; // 固定大小，最大支持10个。
+    sds* multcmds; // 固定大小，最大支持10个。
     int multiCmdCount;
 
 } ;
@@ -74,8 +98,15 @@ void freeClient(redisClient* client);
 void clientToclose(redisClient* c);
 
 void addWrite(redisClient* client, char* s) ;
-void addWriteBuf(redisClient* client, char* buf, size_t len);
+void addWriteBuf(redisClient* client, const char* buf, size_t len);
+void addWriteObject(redisClient* client, robj* o);
+void addWriteSds(redisClient* client, sds s);
+int clientHasPendingReplies(redisClient* c);
+int writeToClient(redisClient* c);
+ssize_t clientReadFromSocket(redisClient* c);
 
 void readToReadBuf(redisClient* client) ;
 void clientMultiAdd(redisClient* c);
+void clientSetArgv(redisClient* c, respReqParser* p, const char* buf);
+int clientArgIs(redisClient* c, int i, const char* s);
 #endif
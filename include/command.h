@@ -1,20 +1,52 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
-#include "client.h"
+#include <stddef.h>
+#include "typedefs.h"
 
-// 命令标志：命令-服务器角色
+// 命令标志：不只有服务器角色，还应该有客户端角色，此后还可能会有更多。
 #define CMD_MASTER (1<<0)   //      0001 主服务器可以执行
 #define CMD_SLAVE (1<<2)    //      0100 从服务器可以执行
 #define CMD_WRITE (1<<3)    //      1000 数据库写
 #define CMD_READ (1<<4)     //     10000 数据库读
+#define CMD_SHARD_LOCAL (1<<5)  // 修改客户端状态（如WATCH），分片模式下不转发，所有键必须属于本分片
+#define CMD_DENYOOM (1<<6)      // 可能增加内存，超过maxmemory且无法淘汰时拒绝
 
 typedef void redisCommandProc(redisClient* client);
-typedef  struct  {
+struct  redisCommand{
     int flags;  // CMD_
-    char* name; //
+    const char* name; // 命令名，指向字符串常量
     redisCommandProc* proc;
     int arity; // 参数个数. -x:表示至少X个变长参数（完整，包含操作字）
-} redisCommand;
+    int firstkey; // 第一个键参数的位置，0表示没有键。 分片模式按它路由
+} ;
+
+/**
+ * 命令分派表：开放寻址（线性探测）哈希表，命令名大小写不敏感。
+ *  启动/角色切换时由命令数组构建，之后只读。
+ *  查询直接使用argv[0]的(指针,长度)视图，不分配内存。
+ */
+typedef struct commandTableEntry {
+    redisCommand* cmd;      // NULL表示空槽
+    size_t namelen;
+    unsigned int hash;
+    int rejectClientFlags;  // 当前服务器角色下，拒绝这些类型客户端调用（REDIS_CLIENT_*）
+} commandTableEntry;
+
+typedef struct commandTable {
+    commandTableEntry* slots;
+    unsigned long size;     // 槽数，2的幂，至少是命令数的2倍
+    unsigned long sizemask;
+    unsigned long used;
+} commandTable;
+
+commandTable* commandTableCreate(redisCommand* cmds, int n, int serverFlags);
+void commandTableRelease(commandTable* t);
+// 按命令名视图查找，name无需'\0'结尾
+commandTableEntry* commandTableFind(const commandTable* t, const char* name, size_t len);
+// 大小写不敏感的命令名hash
+unsigned int commandNameHash(const char* name, size_t len);
+// 参数个数是否满足arity
+int commandCheckArity(const redisCommand* cmd, int argc);
 
 #endif
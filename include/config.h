@@ -0,0 +1,49 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+#include <stddef.h>
+#include "sds.h"
+#include "typedefs.h"
+
+/**
+ * 配置表
+ *  启动时只读一次配置文件，按配置表把每一项解析成对应类型，写入server的字段。
+ *  运行期间CONFIG GET/SET直接读写内存中的字段，不再访问文件；CONFIG REWRITE把当前值写回配置文件。
+ *  可以在线修改的配置项SET之后调用apply立即生效（比如调小maxmemory后淘汰、切换appendfsync后放行回复）。
+ */
+
+#define CONFIG_MAX_LINE 512
+
+typedef enum configType {
+    CONFIG_BOOL,    // yes/no -> int
+    CONFIG_INT,     // 整数 -> int，取值范围[min, max]
+    CONFIG_MEMORY,  // 支持k/m/g单位 -> unsigned long long
+    CONFIG_ENUM,    // 名字 -> int，由fromString/toString转换
+    CONFIG_STRING,  // 字符串 -> char*
+    CONFIG_SPECIAL, // 由set/get自行解析，比如save、role
+} configType;
+
+#define CONFIG_IMMUTABLE (1<<0) // 只在启动时从配置文件读取，CONFIG SET拒绝
+
+typedef struct standardConfig {
+    const char* name;
+    configType type;
+    int flags;              // CONFIG_IMMUTABLE
+    size_t offset;          // 字段在redisServer中的偏移，SPECIAL不使用
+    const char* defaultValue; // 配置文件中没有时的值，NULL表示不设置
+    long long min, max;     // INT取值范围
+    int (*fromString)(const char* s);       // ENUM: 名字 -> 值，无效返回-1
+    const char* (*toString)(int val);       // ENUM: 值 -> 名字
+    int (*set)(const char* val);            // SPECIAL: 解析并设置，成功返回0
+    sds (*get)(void);                       // SPECIAL: 当前值
+    void (*apply)(void);                    // CONFIG SET成功后调用，使新值立即生效
+} standardConfig;
+
+int loadServerConfig(const char* filename);
+int configSetValue(const char* name, const char* value, const char** err);
+int configRewrite(const char* filename);
+
+void configGetCommand(redisClient* c);
+void configSetCommand(redisClient* c);
+void configRewriteCommand(redisClient* c);
+
+#endif
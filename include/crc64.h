@@ -0,0 +1,13 @@
+#ifndef CRC64_H
+#define CRC64_H
+/**
+ * CRC-64-Jones: 多项式0xad93d23594c935a9，输入输出反射，初值0，不取反。 与Redis RDB校验和相同
+ *  crc64(0, "123456789", 9) == 0xe9c6d914c4b8d9ca
+ * 按8字节一组查表(slice-by-8)，可以在上一次的结果上继续计算，用于边写边算
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+uint64_t crc64(uint64_t crc, const void* buf, size_t len);
+
+#endif
@@ -5,6 +5,7 @@
 #include "sds.h"
 #include "typedefs.h"
 #include "robj.h"
+#include "list.h"
 
 #define DB_DICT_ERR -1
 
@@ -19,7 +20,7 @@ extern dictType dbDictType;  // 数据库键值对
 typedef struct redisDb {
     dict *kv;          /* 存储键值对的主哈希表 */
     int id;              /* 数据库编号 */
-    dict * expires; // 过期时间键值， {key:expiretime} 值是expireat过期的时间戳
+    dict * expires; // 过期时间键值， {key:expiretime} 值是过期的毫秒时间戳，存在entry的v.s64
     dict* watched_keys; // 正在watch监视的键-客户端。 值是客户端set
 } redisDb;
 
@@ -31,18 +32,25 @@ void dbFree(redisDb *db);
 void dbClear(redisDb *db);
 void dbInit(redisDb* db, int id) ;
 /* 键值操作 */
-int dbAdd(redisDb *db, sds* key, void* value);
-void *dbGet(redisDb *db, sds* key);
-int dbDelete(redisDb *db, sds* key);
+int dbAdd(redisDb *db, sds key, void* value);
+void *dbGet(redisDb *db, sds key);
+int dbDelete(redisDb *db, sds key);
 
 /* 过期管理 */
-int dbSetExpire(redisDb *db, sds* key, long time);
-long dbGetTTL(redisDb *db, sds* key);
-
-void expireIfNeed(redisDb* db, sds* key);
-
-void dbAddWatch(redisDb* db, sds* key, redisClient* client);
-int dbIsWatching(redisDb* db, sds* key);
+int dbSetExpire(redisDb *db, sds key, long long when);    // when: 毫秒时间戳
+long long dbGetExpire(redisDb *db, sds key);
+
+/* 按键视图访问，不分配sds。 命令处理使用 */
+void* dbLookupView(redisDb* db, const dictKeyView* key);
+int dbSetView(redisDb* db, const dictKeyView* key, void* value);    // 新插入返回1
+int dbDeleteView(redisDb* db, const dictKeyView* key);
+int dbSetExpireView(redisDb* db, const dictKeyView* key, long long when);
+int dbRemoveExpireView(redisDb* db, const dictKeyView* key);
+long long dbGetTTLView(redisDb* db, const dictKeyView* key);   // 剩余毫秒，没有过期时间返回-1
+int expireIfNeededView(redisDb* db, const dictKeyView* key);  // 过期删除返回1
+
+void dbAddWatch(redisDb* db, const dictKeyView* key, redisClient* client);
+list* dbWatchingClients(redisDb* db, const dictKeyView* key);
 
 /* 数据库信息 */
 void dbPrint(redisDb *db);
@@ -8,40 +8,60 @@
 #define DICT_ERR -1
 #define DICT_INITIAL_SIZE 4 // 初始化tablesize大小
 #define DICT_LOAD_RATIO 0.2  // 缩容比率
-typedef struct dictEntry dictEntry;  // 向前声明
-struct dictEntry {
+#define DICT_ENGINE_CHAINED 0  // 链地址法：每个键一个单独分配的节点
+#define DICT_ENGINE_SWISS 1    // 开放寻址：控制字节分组、SIMD探测，键值内联在槽位中
+
+/**
+ * @brief 键值对。 两种引擎对外都以dictEntry*返回，只能访问key、v，
+ *  在下一次修改字典之前有效（swiss引擎扩缩容时槽位会移动）
+ */
+typedef struct dictEntry {
     void* key;
     union {
         void* val;
         uint64_t u64;
         int64_t s64;
     }v;
-    dictEntry *next;    // 解决冲突。
-} ;
+} dictEntry;
 
+/* 链式引擎 */
+typedef struct dictNode dictNode;
 
 typedef struct dictHT {
-    dictEntry** table;  
+    dictNode** table;
     unsigned long size; // table数组大小
     unsigned long sizemask; //  哈希表大小掩码，计算索引值，总是等于size-1
     unsigned long used; // 已用节点数：键值对数量
 } dictHT;
 
+/* swiss引擎 */
+#define DICT_GROUP_SLOTS 15 // 每组槽位数。 16个控制字节：15个tag + 1个溢出计数
+typedef struct dictGroup dictGroup;
+
+typedef struct dictSwissTable {
+    dictGroup* groups;
+    unsigned long ngroups;  // 组数，2的幂
+    unsigned long groupmask;
+    unsigned long used;
+} dictSwissTable;
+
 typedef struct dictType {
     unsigned long (*hashFunction)(const void* key); // 必须
     void* (*keyDup)(void* privdata, const void* key);   // 默认行为：直接赋值
     void* (*valDup)(void* privdata, const void* obj);   // 默认行为：直接赋值
     int (*keyCompare)(void* privdata, const void* key1, const void* key2); // 必须
+    int (*keyCompareView)(void* privdata, const void* key, const char* buf, size_t len); // 可选，支持按键视图查找
     void (*keyDestructor)(void* privdata, void* key);   // 默认行为：不释放
     void (*valDestructor)(void* privdata, void* val);   // 默认行为：不释放
-    
+    int engine;     // DICT_ENGINE_*, 默认链式
 } dictType;
 typedef struct dict {
     dictType* type;
     void* privdata; // 外部调用者的携带信息：比如seed
 
-    dictHT ht[2];
-    int rehashidx;  
+    dictHT ht[2];           // 链式引擎
+    dictSwissTable st[2];   // swiss引擎
+    long rehashidx;         // 渐进式rehash进度: 链式为桶下标，swiss为组下标。 -1表示没有rehash
 } dict;
 
 dict* dictCreate(dictType* type, void* privData);   
@@ -57,12 +77,27 @@ dictEntry* dictAddRaw(dict* dict, const void* key);
 dictEntry* dictFind(dict* dict, const void* key);
 size_t dictSize(dict* dict);
 
+/**
+ * @brief 键视图：借用调用方内存的(指针,长度)，查找、删除时不需要分配键对象。
+ *  只能用于设置了keyCompareView的dictType，并且hashFunction(key)必须等于dictGenHashFunction(键的字节, 长度)
+ */
+typedef struct dictKeyView {
+    const char* buf;
+    size_t len;
+    unsigned int hash;  // dictGenHashFunction(buf, len)，构造时计算一次
+} dictKeyView;
+
+dictKeyView dictMakeView(const char* buf, size_t len);
+dictEntry* dictFindView(dict* dict, const char* key, size_t len);
+dictEntry* dictFindByView(dict* dict, const dictKeyView* view);
+int dictDeleteByView(dict* dict, const dictKeyView* view);
+
 
 /* dict iterator*/
 typedef struct dictIterator {
     dict* dict; // 当前遍历字典
-    long index; // 当前遍历索引
-    dictEntry* entry;  // 当前遍历entry
+    long index; // 当前遍历索引。 swiss引擎为槽位下标
+    dictNode* node;  // 链式引擎: 当前桶中下一个节点
     int _htidx;     // 在遍历哪个ht，ht[0]还是ht[1]
 } dictIterator;
 
@@ -71,5 +106,13 @@ dictEntry* dictIterNext(dictIterator* iter);
 void dictReleaseIterator(dictIterator* iter);
 
 int dictIsEmpty(dict* dict);
+int dictIsRehashing(dict* dict);
+int dictExpand(dict* dict, unsigned long size);    // 预先分配能容纳size个键的表
+int dictRehash(dict* dict, int n);    // 迁移n个桶，返回1表示还没完成
+int dictRehashMilliseconds(dict* dict, int ms);  // 限时批量rehash，返回迁移的桶数
+double dictRehashProgress(dict* dict);  // 0~1
+
+// 二进制安全的通用hash函数，按长度处理, 不依赖'\0'
+unsigned int dictGenHashFunction(const void* key, size_t len);
 
 #endif
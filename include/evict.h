@@ -0,0 +1,60 @@
+#ifndef EVICT_H
+#define EVICT_H
+#include "robj.h"
+#include "sds.h"
+
+/* maxmemory-policy */
+#define MAXMEMORY_NO_EVICTION 0     // 不淘汰，超过maxmemory拒绝会增加内存的写命令
+#define MAXMEMORY_ALLKEYS_LRU 1     // 所有键中淘汰最久没访问的
+#define MAXMEMORY_VOLATILE_LRU 2    // 设置了过期时间的键中淘汰最久没访问的
+#define MAXMEMORY_ALLKEYS_RANDOM 3  // 所有键中随机淘汰
+#define MAXMEMORY_VOLATILE_TTL 4    // 设置了过期时间的键中淘汰最快过期的
+#define MAXMEMORY_ALLKEYS_LFU 5     // 所有键中淘汰访问频率最低的
+#define MAXMEMORY_VOLATILE_LFU 6    // 设置了过期时间的键中淘汰访问频率最低的
+
+#define MAXMEMORY_SAMPLES 5     // 每个数据库每次抽样的键数. 配置maxmemory-samples
+#define EVPOOL_SIZE 16          // 淘汰池大小
+
+#define EVICT_OK 0
+#define EVICT_FAIL -1   // 内存仍然超过maxmemory
+
+/* LRU时钟：秒精度，24位，约194天回绕 */
+#define LRU_BITS 24
+#define LRU_CLOCK_MAX ((1 << LRU_BITS) - 1)
+#define LRU_CLOCK_RESOLUTION 1000  // ms
+
+/* LFU: lru字段拆成 高16位上次衰减的时间(分钟) + 低8位对数计数器 */
+#define LFU_INIT_VAL 5          // 新对象的计数，避免刚写入就被淘汰
+#define LFU_LOG_FACTOR 10       // 配置lfu-log-factor，越大计数增长越慢
+#define LFU_DECAY_TIME 1        // 配置lfu-decay-time，每过这么多分钟计数减一，0表示不衰减
+
+/**
+ * @brief 淘汰池中的候选键，按idle升序，越靠后越优先淘汰
+ */
+typedef struct evictionPoolEntry {
+    unsigned long long idle;    // LRU为空闲毫秒数；LFU为255-访问计数；TTL为ULLONG_MAX-过期时刻
+    sds key;                    // 键的拷贝，NULL表示空位
+    int dbid;
+} evictionPoolEntry;
+
+/**
+ * 近似LRU/LFU淘汰
+ *  不维护全局LRU链表，而是从每个数据库随机抽样maxmemory-samples个键，
+ *  和上次留下的候选一起放入按空闲时间排序的淘汰池，淘汰池中最久没访问的键。
+ *  LFU用访问频率代替空闲时间：8位计数器按概率1/((counter-LFU_INIT_VAL)*lfu-log-factor+1)递增，
+ *  近似访问次数的对数；每过lfu-decay-time分钟减一，过去的热点会逐渐冷却。
+ *  写命令执行前检查，内存超过maxmemory时淘汰到限制以下。
+ */
+unsigned int lruClock(void);
+unsigned long long estimateObjectIdleTime(robj* o);
+unsigned long lfuDecrAndReturn(robj* o);
+void objectInitAccess(robj* o);
+void objectTouch(robj* o);
+int policyIsLFU(int policy);
+int policyUsesObjectAccess(int policy);
+int maxmemoryPolicyFromString(const char* s);
+const char* maxmemoryPolicyToString(int policy);
+evictionPoolEntry* evictionPoolCreate(void);
+int performEvictions(void);
+
+#endif
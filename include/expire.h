@@ -0,0 +1,21 @@
+#ifndef EXPIRE_H
+#define EXPIRE_H
+
+#define ACTIVE_EXPIRE_CYCLE_SLOW 0  // serverCron中执行
+#define ACTIVE_EXPIRE_CYCLE_FAST 1  // beforeSleep中执行，只在上一次慢周期没做完时
+
+#define ACTIVE_EXPIRE_CYCLE_KEYS_PER_LOOP 20    // 每轮从expires中抽样的键数
+#define ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC 25   // 慢周期最多占用serverCron周期的百分比
+#define ACTIVE_EXPIRE_CYCLE_FAST_DURATION 1000  // 快周期时间预算，us
+#define ACTIVE_EXPIRE_CYCLE_ACCEPTABLE_STALE 10 // 抽样中过期键超过这个百分比，继续清理当前数据库
+
+/**
+ * 主动过期
+ *  惰性删除只在访问键时检查，不再访问的过期键一直占着内存。
+ *  定时从每个数据库的expires中随机抽样，删除已过期的键；抽样中过期比例超过ACCEPTABLE_STALE，
+ *  说明还有很多过期键，继续抽样，直到比例降下来或用完时间预算。
+ *  慢周期用完预算时，说明过期键堆积，beforeSleep中再以短预算的快周期继续清理。
+ */
+void activeExpireCycle(int type);
+
+#endif
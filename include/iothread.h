@@ -0,0 +1,32 @@
+#ifndef IOTHREAD_H
+#define IOTHREAD_H
+
+#include "typedefs.h"
+
+#define IO_THREADS_MAX 128
+
+// redisClient.ioPending
+#define CLIENT_PENDING_READ (1<<0)  // 已加入待读队列，等待beforeSleep读取
+#define CLIENT_PENDING_WRITE (1<<1) // 已加入待写队列，等待beforeSleep发送
+#define CLIENT_PENDING_FSYNC (1<<2) // appendfsync always: 回复等待AOF批次落盘
+
+/**
+ * IO线程
+ *  主线程在epoll返回后只把就绪的客户端加入待读队列；下一轮epoll_wait之前（beforeSleep）
+ *  把待读、待写客户端分给IO线程，socket读取+解析第一条命令、回复发送在IO线程并行完成。
+ *  主线程也处理自己的一份，然后等待所有IO线程结束，再串行执行命令。
+ *  所以命令执行、db/dict访问都只在主线程，不需要加锁。
+ *
+ *  io-threads为1时不创建线程，但回复同样在beforeSleep中直接发送，只有没发送完才注册可写事件。
+ */
+void initIOThreads(int num);
+// 读事件到来时调用，返回1表示读取延迟到beforeSleep由IO线程完成
+int postponeClientRead(redisClient* c);
+// 客户端有待发送回复，加入待写队列
+void clientInstallWriteHandler(redisClient* c);
+void handleClientsWithPendingReads(void);
+void handleClientsWithPendingWrites(void);
+// 释放客户端前，从待处理队列中移除
+void ioThreadsUnlinkClient(redisClient* c);
+
+#endif
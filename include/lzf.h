@@ -0,0 +1,18 @@
+#ifndef LZF_H
+#define LZF_H
+/**
+ * LZF压缩，与liblzf/Redis的格式兼容，不依赖外部库。
+ * 压缩后的数据由控制字节开头的块组成:
+ *  000LLLLL + L+1个字节            字面量，一次最多32个
+ *  LLLooooo [+ 长度扩展字节] + oooooooo   回溯引用: 长度L+2(L为7时再加下一个字节)，距离o+1，最远8KB
+ * 适合JSON、文本这类有大量重复片段的值，压缩、解压都只需要一遍线性扫描。
+ */
+#include <stddef.h>
+
+#define LZF_MAX_OFF (1 << 13)       // 回溯距离上限
+#define LZF_MAX_REF ((1 << 8) + (1 << 3))   // 回溯长度上限 264
+
+size_t lzfCompress(const void* in, size_t inLen, void* out, size_t outLen);
+size_t lzfDecompress(const void* in, size_t inLen, void* out, size_t outLen);
+
+#endif
@@ -21,6 +21,7 @@
 #define NET_OK 0
 #define NET_ERR -1
 int anetTcpServer(int port, char *bindaddr, int backlog);
+int anetTcpServerReusePort(int port, char *bindaddr, int backlog);
 int anetEnableTcpNoDelay(int fd);
 int anetNonBlock(int fd);
 
@@ -1,13 +1,13 @@
 #ifndef RDB_H
 #define RDB_H
-#include "crypto.h"
+#include "rio.h"
 
-#define RDB_MAX_SIZE 4096
-#define RDB_CHECKSUM_LEN SHA256_DIGEST_LENGTH
+#define RDB_IO_BUF_SIZE (4 * 1024 * 1024)   // 保存、加载的用户态缓冲
+#define RDB_CHECKSUM_LEN 8                  // 末尾CRC64，小端
 
 
 #define RDB_MAGIC "REDIS"
-#define RDB_VERSION "0001"
+#define RDB_VERSION "0002"  // 0002: 长度编码调整，校验和改为流式CRC64
 
 #define RDB_TYPE_STRING REDIS_STRING
 #define RDB_TYPE_LIST   REDIS_LIST
@@ -15,17 +15,41 @@
 #define RDB_TYPE_ZSET   REDIS_ZSET
 #define RDB_TYPE_HASH   REDIS_HASH
 
-#define RDB_ENC_INT8 0xFC
-#define RDB_ENC_INT16 0xFD
-#define RDB_ENC_INT32 0xFE
+/* 长度编码，第一个字节的高2位区分：
+ *  00xxxxxx                6位长度
+ *  01xxxxxx xxxxxxxx       14位长度
+ *  10000000 + 4字节        32位长度
+ *  10000001 + 8字节        64位长度
+ *  11xxxxxx                不是长度，字符串的特殊编码，低6位为编码类型 */
+#define RDB_6BITLEN 0x00
+#define RDB_14BITLEN 0x40
+#define RDB_32BITLEN 0x80
+#define RDB_64BITLEN 0x81
+#define RDB_ENCVAL 0xC0
+#define RDB_ENC_INT8 0xC0
+#define RDB_ENC_INT16 0xC1
+#define RDB_ENC_INT32 0xC2
+#define RDB_ENC_LZF 0xC3     // LZF压缩: 压缩后长度、原始长度(长度编码) + 压缩数据
+#define RDB_LZF_MIN_LEN 20  // 更短的字符串不压缩
+
 #define RDB_EOF 0XFF
-#define RDB_SELECTDB 0xFE   // 与INT32不冲突
-#define RDB_EXPIRETIME 0XFD
+#define RDB_SELECTDB 0xFE
+#define RDB_EXPIRETIME 0XFD      // 秒级过期时间。 保存时不再写入，版本号不同的旧文件被拒绝，加载器仍接受
+#define RDB_EXPIRETIME_MS 0xFC   // 毫秒级过期时间
+#define RDB_RESIZEDB 0xFB        // 数据库大小提示：键数、过期键数
+
+#define RDB_LOAD_THREADS_MAX 16
+
+#define RDB_CHILD_TYPE_DISK 0   // BGSAVE，写server->rdbfile
+#define RDB_CHILD_TYPE_SOCKET 1 // 无盘复制，写管道
 
 
 
+int rdbSave();
+int rdbSaveToFd(int fd);
+int bgsave();
 void bgSaveIfNeeded();
-void rdbLoad();
-void receiveRDBfile(char* buf, int n);
+int rdbLoad();
+void receiveRDBfile(const char* buf, size_t n);
 
-#endif
\ No newline at end of file
+#endif
@@ -7,6 +7,7 @@
 #include "dict.h"
 #include "robj.h"
 #include "typedefs.h"
+#include "command.h"
 #include "client.h"
 #include <stdbool.h>
 #include "aof.h"
@@ -20,30 +21,21 @@
 #define REDIS_CLUSTER_SENTINEL (1<<2)
 
 
-extern struct redisServer* server;
+// 每个事件循环线程一份。 分片模式下每个分片线程指向自己的redisServer
+extern __thread struct redisServer* server;
 
 #define REDIS_SHAREAD_MAX_INT 999
 
 #define REDIS_MAX_STRING 256
 
-#define MASTER_REPLI_RINGBUFFER_SIZE 1024
+#define REPL_ID_SIZE 40 // 复制ID: 40个十六进制字符
 
-// TODO 主从同步中， 主维持的buf. 应该作为环形缓冲区。
+#define SERVER_CRON_PERIOD_MS 100   // serverCron周期
+#define ACTIVE_REHASH_MS 1          // 每次serverCron用于主动rehash的时间预算
 
+// 在serverCron中按ms周期执行，ms不足一个serverCron周期时每次都执行
+#define run_with_period(ms) if ((ms) <= SERVER_CRON_PERIOD_MS || !(server->cronloops % ((ms) / SERVER_CRON_PERIOD_MS)))
 
-// 命令标志：不只有服务器角色，还应该有客户端角色，此后还可能会有更多。
-// 应该修正lookup，给与更多的层次
-#define CMD_MASTER (1<<0)   //      0001 主服务器可以执行
-#define CMD_SLAVE (1<<2)    //      0100 从服务器可以执行
-#define CMD_WRITE (1<<3)    //      1000 数据库写
-#define CMD_READ (1<<4)     //     10000 数据库读
-typedef void redisCommandProc(redisClient* client);
-struct  redisCommand{
-    int flags;  // CMD_
-    char* name; //
-    redisCommandProc* proc;
-    int arity; // 参数个数. -x:表示至少X个变长参数（完整，包含操作字）
-} ;
 
 extern redisCommand commandsTable[];
 
@@ -60,21 +52,51 @@ struct redisServer {
     int port;
     int daemonize;  // 是否守护进程
     char *configfile; // 
+    int allocator;  // ZMALLOC_LIBC/SLAB/ARENA. 配置allocator
+    unsigned long long arenaSize;   // arena模式预留的地址空间. 配置arena-size
 
     // 运行时状态
     time_t unixtime;    // 统一的粗粒度时间, 秒进度
     long long mstime;   // 当前时间，毫秒
     int shutdownAsap;   // 是否立即关闭
+    int loading;        // 正在加载AOF
+    long long cronloops;    // serverCron执行次数
 
     // 客户端连接
     int maxclients; // 最大客户端连接数
     list * clients;  // 客户端链表    
     list * clientsToClose;   // 待关闭客户端链表
+    list * clientsPendingRead;  // 等待beforeSleep读取的客户端
+    list * clientsPendingWrite; // 等待beforeSleep发送回复的客户端
+    int ioThreadsNum;   // IO线程数，包括主线程. 配置io-threads
+
+    // 分片
+    int shardsNum;  // 分片数，每个分片一个线程、一个事件循环、一组数据库. 配置shards
+    int shardId;    // 当前线程所属分片
 
     // 数据库
     int dbnum;  // 数据库数量
     redisDb* db;    // 数据库数组
-    dict* commands; // 命令表: 键是字符串, 命令名，值是cmd结构
+    int activerehashing;    // 定时任务中主动推进数据库dict的rehash. 配置activerehashing
+    int rehashDb;           // 下一次主动rehash从哪个数据库开始
+    long long statActiveRehashes;   // 主动rehash迁移的桶数
+    long long statActiveRehashUs;   // 主动rehash累计耗时
+    int expireDb;                   // 下一次主动过期从哪个数据库开始
+    int expireTimelimitHit;         // 上一次主动过期用完了时间预算
+    long long expireLastFastCycle;  // 上一次快周期开始时间，us
+    long long statExpiredKeys;      // 过期删除的键数，包括惰性删除
+    double statExpiredStalePerc;    // 主动过期抽样中过期键比例的滑动平均
+    long long statExpiredTimeCapReached;    // 主动过期用完时间预算的次数
+    unsigned long long maxmemory;   // 内存上限，字节，0表示不限制. 配置maxmemory
+    unsigned long long valueCompressThreshold; // 不小于这个长度的字符串值在内存中压缩保存，0表示关闭. 配置value-compress-threshold
+    int maxmemoryPolicy;            // MAXMEMORY_*. 配置maxmemory-policy
+    int maxmemorySamples;           // 每次淘汰每个数据库抽样的键数. 配置maxmemory-samples
+    int lfuLogFactor;               // LFU计数器增长的对数因子. 配置lfu-log-factor
+    int lfuDecayTime;               // LFU计数器每隔多少分钟减一. 配置lfu-decay-time
+    struct evictionPoolEntry* evictionPool; // 近似LRU/TTL淘汰的候选池
+    int evictDb;                    // allkeys-random下一次从哪个数据库淘汰
+    long long statEvictedKeys;      // 淘汰的键数
+    commandTable* commands; // 命令分派表: 命令名(大小写不敏感) -> cmd结构
 
     // 事件循环
     aeEventLoop* eventLoop; // 事件循环
@@ -82,10 +104,19 @@ struct redisServer {
     // TODO 考虑使用flags标
     int flags; // 角色 REDIS_CLUSTER_
 
-    // master 特性
-    unsigned char repli_buffer[MASTER_REPLI_RINGBUFFER_SIZE];
-    unsigned long begin_offset; // 逻辑offset
-    unsigned long last_offset; // 逻辑offset. 最新的offset = last_offset - 1
+    // 复制。 主从都维护: 从被提升为主后，其他从可以在新主上续传
+    char replid[REPL_ID_SIZE + 1];  // 复制ID。 主启动时随机生成，从使用主的ID
+    char replid2[REPL_ID_SIZE + 1]; // 上一个复制ID，从被提升为主(SLAVEOF NO ONE)之前跟随的主的ID
+    long secondReplidOffset;        // replid2有效的offset上界，-1表示没有replid2
+    RingBuffer* replBacklog;        // 复制积压缓冲区，最近repl-backlog-size字节的写命令流。 分片模式下为NULL
+    unsigned long long replBacklogSize; // 配置repl-backlog-size
+    int replDisklessSync;           // 全量同步不写磁盘: 子进程把RDB写入管道，主进程转入从的回复队列. 配置repl-diskless-sync
+    int replDisklessSyncDelay;      // 第一个从等待无盘同步后再等几秒才fork，期间到达的从共用这次fork. 配置repl-diskless-sync-delay
+    time_t replDisklessWaitStart;   // 第一个等待无盘同步的从到达的时间，0表示没有从在等待
+    int rdbPipeFd;                  // 无盘同步子进程写RDB的管道读端，-1表示没有
+    int rdbPipePaused;              // 有从的回复队列积压太多，暂停读取管道
+    long rdbChildOffset;            // 磁盘同步的BGSAVE fork时的offset，RDB对应这个位置
+    char rdbEofMark[REPL_ID_SIZE];  // 无盘同步RDB的结束标记，长度事先未知
 
     // Slave特性
     redisClient* master; // （从字段）主客户端
@@ -93,7 +124,9 @@ struct redisServer {
     int masterport; // （从字段）主port
     int replState; ///< （从字段）状态: 从服务器维护自己主从复制状态。
     time_t repltimeout; // 心跳检测阈值. 从服务器检测主的阈值
-    long offset; // 从服务器记录现在的同步offset。 -1表示还没同步过。0表示还没有增量同步，其他正常
+    long offset; // 复制offset: 主为传播的写命令字节数，从为已应用的字节数。 -1表示从还没同步过
+    char* replStateFileName; // （从字段）复制状态文件，相对工程目录. 配置repl_state_file，默认data/<port>.repl
+    int replStateFd; // （从字段）复制状态文件fd，-1表示没有打开
 
     // 模块化
 
@@ -103,29 +136,46 @@ struct redisServer {
 
     //  RDB持久化 (Master)
     long long dirty; // 上次SAVE之后修改了多少次,set del 
+    long long dirtyBeforeBgsave; // BGSAVE开始时的dirty，保存成功后从dirty中减去
     time_t lastSave;    // 上次SAVE时间
     int saveCondSize; // 
     struct saveparam* saveParams; // SAVE条件数组
-    int rdbfd;     ///< 不关闭rdbfd
-    char* rdbfile; //
+    char* rdbfile; // 完整路径
+    char* rdbFileName; // 相对工程目录. 配置rdb_file
     pid_t rdbChildPid; // 正在执行BGSAVE的子进程ID
     int isBgSaving; // 正在BGSAVE
+    int rdbChildType; // RDB_CHILD_TYPE_DISK/SOCKET，rdbChildPid写文件还是给从写管道
+    int rdbLoadThreads; // 加载RDB时并行解析数据库段的线程数. 配置rdb-load-threads
+    int rdbCompression; // 保存RDB时LZF压缩较长的字符串. 配置rdbcompression
 
     // aof持久化
     struct AOF aof;
+    char* aofFileName; // 相对工程目录. 配置aof_file
+    int aofRewritePerc; // 相对上次重写后的大小增长超过这个百分比时自动重写，0表示关闭. 配置auto-aof-rewrite-percentage
+    unsigned long long aofRewriteMinSize; // 小于这个大小不自动重写. 配置auto-aof-rewrite-min-size
+    int aofFsync; // AOF_FSYNC_NO/EVERYSEC/ALWAYS. 配置appendfsync
+    int aofLoadTruncated; // 加载时AOF末尾命令不完整，截掉继续启动；否则退出. 配置aof-load-truncated
 
     // sentinel 服务器特性
     dict* instances; // 监控的sentinel列表
+    char* sentinelMonitor; // 监控的master: name,host,port. 配置monitor
 
 };
 
 void initServer();
 void initServerConfig();
+void initServerEventLoop();
 void readRespFromClient(aeEventLoop *el, int fd, void *privData);
 
 void readFromClient(aeEventLoop *el, int fd, void *privData);
 int serverCron(struct aeEventLoop* eventLoop, long long id, void* clientData);
 
 void processClientQueryBuf(redisClient* client);
+void loadCommands();
+void clientReadDone(redisClient* client, ssize_t nread);
+void clientReplySent(redisClient* client);
+void processCommand(redisClient* c);
+void propagateDeletion(redisDb* db, const char* key, size_t len);
+redisCommand* lookupCommand(redisClient* c, const char* name, size_t len);
 
 #endif
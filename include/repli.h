@@ -1,7 +1,13 @@
 #ifndef REPLI_H
 #define REPLI_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "typedefs.h"
 
 #define MASTER_SLAVE_TIMEOUT 60 // 从<=>主都采用这个
+#define REPL_BACKLOG_MIN_SIZE (16 * 1024) // repl-backlog-size的下限
+#define REPL_RDB_PIPE_MAX_PENDING (1024 * 1024) // 无盘同步时从的回复队列超过这个大小，暂停读取管道
+#define REPL_RDB_BULK_CHUNK (256 * 1024) // 磁盘同步时每次从RDB文件读入从的回复队列的大小
 
 // 主从复制状态
 enum REPL_STATE {
@@ -9,18 +15,17 @@ enum REPL_STATE {
     REPL_STATE_SLAVE_NONE,          // (从）未启用复制
     REPL_STATE_SLAVE_CONNECTING,    // 正在连接主服务器
     REPL_STATE_SLAVE_SEND_REPLCONF,   // 发送port号
-    REPL_STATE_SLAVE_SEND_SYNC,    // 发送SYNC请求
-    REPL_STATE_SLAVE_RECEIVE_RDB,      // 接收RDB文件
-    REPL_STATE_SLAVE_RECEIVE_APPENDSYNC, // 接受增量同步命令
-    REPL_STATE_SLAVE_RECEIVE_BUF,      // 增量接受字节数据 内容位一些RESP命令
-    REPL_STATE_SLAVE_CONNECTED,      // 等待REPL ACK返回
+    REPL_STATE_SLAVE_SEND_SYNC,    // 发送PSYNC请求
+    REPL_STATE_SLAVE_RECEIVE_RDB,      // 收到FULLRESYNC，接收RDB文件
+    REPL_STATE_SLAVE_CONNECTED,      // 同步完成，按普通客户端处理主传播的命令
     // 主服务器维护主向从的状态。
     REPL_STATE_MASTER_NONE,     //
     REPL_STATE_MASTER_WAIT_PING,    // 正在等待PING
-    REPL_STATE_MASTER_SEND_FULLSYNC,  // 发送FULLSYNC响应
-    REPL_STATE_MASTER_SEND_RDB, // 正在发送RDB
-    REPL_STATE_MASTER_CONNECTED, // 主认为此次同步完成
-    REPL_STATE_MASTER_SEND_APPENDSYNC,  // 发生FULLSYNC
+    REPL_STATE_MASTER_WAIT_BGSAVE_START, // 等待全量同步的子进程fork
+    REPL_STATE_MASTER_WAIT_BGSAVE_END,  // 磁盘同步: 已发送+FULLRESYNC，等待BGSAVE完成
+    REPL_STATE_MASTER_SEND_RDB,     // 无盘同步: 子进程写的RDB正在进入回复队列
+    REPL_STATE_MASTER_SEND_BULK,    // 磁盘同步: RDB文件正在分块进入回复队列
+    REPL_STATE_MASTER_CONNECTED, // 主认为此次同步完成: FULLRESYNC+RDB或CONTINUE+积压数据已进入回复队列
 
 };
 
@@ -33,6 +38,23 @@ void repliWriteHandler(aeEventLoop *el, int fd, void* privData);
 void repliReadHandler(aeEventLoop *el, int fd, void* privData);
 int slaveCron(aeEventLoop* eventLoop, long long id, void* clientData);
 void slaveUpdateOffset(long offset);
+void replicationLoadState(bool resume);
+void replicationSaveState(void);
+void replicationUnsetMaster(void);
+
+void changeReplicationId(void);
+void clearReplicationId2(void);
+void createReplicationBacklog(void);
+void resizeReplicationBacklog(void);
+void replicationFeedBacklog(const char* buf, size_t len);
+bool masterTryPartialResync(redisClient* c, const char* replid, long offset);
+void replicationWaitDisklessSync(redisClient* c);
+void replicationWaitBgsave(redisClient* c);
+void replicationSyncCron(void);
+void replicationDisklessDone(bool ok);
+void replicationBgsaveDone(bool ok);
+void replicationSendBulk(redisClient* c);
+void replicationRdbPipeResume(void);
 
 
 #endif
\ No newline at end of file
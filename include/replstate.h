@@ -0,0 +1,25 @@
+#ifndef REPLSTATE_H
+#define REPLSTATE_H
+/**
+ * 从服务器的复制状态文件
+ *  offset只在内存中随每条写命令更新，正常关闭时(AOF写完之后)写入这个文件，重启后用于增量同步；
+ *  启动读取后立即作废，运行中宕机的下次启动全量同步。
+ *  文件只有一条定长记录，一次pwrite覆盖写入文件开头再fdatasync；记录带CRC64，
+ *  写到一半宕机读到的是坏记录，按没有同步过处理(全量同步)。
+ */
+#include <stdint.h>
+
+#define REPL_STATE_MAGIC "FEDISREP"
+#define REPL_STATE_VERSION 2  // 2: 用复制ID代替主的host:port
+#define REPL_STATE_REPLID_LEN 48
+
+typedef struct replState {
+    long long offset;   // 同步到的offset，-1表示没有同步过
+    char replid[REPL_STATE_REPLID_LEN]; // offset所属的复制ID，PSYNC时一起发给主
+} replState;
+
+int replStateOpen(const char* path);
+int replStateWrite(int fd, const replState* st);
+int replStateRead(int fd, replState* st);
+
+#endif
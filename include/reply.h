@@ -0,0 +1,66 @@
+#ifndef REPLY_H
+#define REPLY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define REPLY_CHUNK_BYTES (16 * 1024)           // 内联缓冲大小
+#define REPLY_BLOCK_BYTES (16 * 1024)           // 拷贝块最小容量
+#define REPLY_REF_MIN_BYTES 1024                // 不可变数据超过该长度时只引用不拷贝
+#define REPLY_MAX_IOV 64                        // 一次writev最多的iovec
+#define REPLY_MAX_WRITE_PER_EVENT (64 * 1024)   // 一次可写事件最多写出字节，避免单个客户端占满事件循环
+
+typedef void replyRelease(void* owner);
+
+/**
+ * @brief 回复块。 两种：
+ *  拷贝块：数据在buf中，size为容量，可以继续追加。
+ *  引用块：data指向外部不可变数据（共享回复、对象），size为0。 发送完后调用release(owner)。
+ */
+typedef struct replyBlock {
+    struct replyBlock* next;
+    const char* data;
+    size_t len;     // 有效数据长度
+    size_t size;    // buf容量，0表示引用块
+    replyRelease* release;
+    void* owner;
+    char buf[];
+} replyBlock;
+
+/**
+ * @brief 客户端回复队列： 内联缓冲 + 块链表，writev一次发送多段。
+ *  只有链表为空时才写入内联缓冲，所以内联缓冲中的数据总是在链表之前。
+ *  sentlen记录第一段数据（内联缓冲或head块）已发送的部分，支持部分写后继续。
+ *  replyListWrite可以在IO线程调用：它不调用release，引用块发送完后挂到sent上，
+ *  由主线程replyListReleaseSent统一释放，对象引用计数只在主线程修改。
+ */
+typedef struct replyList {
+    char buf[REPLY_CHUNK_BYTES];
+    size_t bufpos;      // 内联缓冲已用
+    size_t sentlen;     // 第一段已发送字节
+    replyBlock* head;
+    replyBlock* tail;
+    size_t pending;     // 待发送总字节
+    replyBlock* sent;   // 已发送完、还没有release的引用块。 由主线程调用replyListReleaseSent释放
+} replyList;
+
+void replyListInit(replyList* l);
+// 释放所有块，不释放l本身
+void replyListFree(replyList* l);
+// 拷贝追加
+void replyListAdd(replyList* l, const void* data, size_t len);
+// 追加不可变数据。 较短时直接拷贝并立即release，否则只引用，发送完后release
+void replyListAddRef(replyList* l, const char* data, size_t len, replyRelease* release, void* owner);
+// 待发送字节数
+static inline size_t replyListPending(const replyList* l)
+{
+    return l->pending;
+}
+// 尽可能发送到fd. 返回写出的字节数, 出错（非EAGAIN）返回-1
+ssize_t replyListWrite(replyList* l, int fd);
+// 把所有待发送数据按顺序拷贝到dst（至少replyListPending字节），不改变队列
+void replyListCopy(const replyList* l, char* dst);
+// 释放已发送完的引用块（调用release）, 只能在主线程调用
+void replyListReleaseSent(replyList* l);
+
+#endif
@@ -1,5 +1,7 @@
 #ifndef RESP_H
 #define RESP_H
+#include <stddef.h>
+#include "sds.h"
 // 统一
 struct RespShared {
     char *ok;
@@ -8,13 +10,30 @@ struct RespShared {
     char* keyNotFound;
     char* bye;
     char* invalidCommand;
-    char* fullsync;
-    char* appendsync;
-    char* nosync;
     char* dupkey;
     char* ping;
     char* info;
     char* valmissed;
+    char* protoerr;
+    char* wrongArity;
+    char* crossShard;
+    char* shardsUnsupported;
+    char* nullBulk;
+    char* czero;
+    char* cone;
+    char* syntaxErr;
+    char* invalidExpire;
+    char* oom;
+    char* lfuNotSelected;
+    char* lruNotSelected;
+    char* notInteger;
+    char* incrOverflow;
+    char* notFloat;
+    char* nanOrInfinity;
+    char* aofDisabled;
+    char* aofRewriteInProgress;
+    char* aofRewriteStarted;
+    char* aofRewriteScheduled;
 };
 extern struct RespShared resp;
 
@@ -24,4 +43,38 @@ char* resp_str(const char *resp);
 char* respEncodeBulkString(const char* s);
 char* respParse(char* buf, size_t len);
 
+/* ---------------- 请求解析器 ---------------- */
+#define RESP_REQ_OK 0           // 解析出一条完整命令
+#define RESP_REQ_INCOMPLETE 1   // 数据不完整，等待下一次read
+#define RESP_REQ_ERR -1         // 协议错误
+
+#define RESP_MAX_MULTIBULK (1024 * 1024)        // 单条命令最多参数个数
+#define RESP_MAX_BULK (512L * 1024 * 1024)      // 单个参数最大长度
+#define RESP_MAX_INLINE (64 * 1024)             // *N\r\n / $N\r\n 头部最大长度
+
+/**
+ * @brief 可恢复的请求解析器，挂在client上，跨多次read保持状态。
+ *  参数只记录(偏移,长度)，不做任何拷贝。命令完整后由调用方把偏移转成指向缓冲区的视图。
+ *  使用偏移而不是指针，是因为缓冲区在两次read之间可能realloc。
+ */
+typedef struct respReqParser {
+    size_t pos;         // 解析游标：下一个待解析字节的偏移
+    size_t cmdstart;    // 当前命令起始偏移。 [cmdstart, pos)即当前命令原始字节
+    long multibulklen;  // 当前命令剩余未解析参数个数。0表示还没有读到 *N
+    long bulklen;       // 当前参数长度。-1表示还没有读到 $N
+    int argc;           // 已解析参数个数
+    int argcap;         // argvoff, argvlen 容量
+    size_t* argvoff;    // 参数在缓冲区内偏移
+    size_t* argvlen;    // 参数长度
+} respReqParser;
+
+void respReqParserInit(respReqParser* p);
+void respReqParserFree(respReqParser* p);
+int respParseRequest(respReqParser* p, const char* buf, size_t len);
+void respReqParserReset(respReqParser* p);
+void respReqParserShift(respReqParser* p, size_t n);
+
+// 命令编码为RESP数组追加到s，参数二进制安全
+sds respCatCommand(sds s, int argc, const char** argv, const size_t* argvlen);
+
 #endif
\ No newline at end of file
@@ -2,26 +2,34 @@
 #define _RINGBUFFER_H_
 
 /**
- * 环形缓冲区。 定长。
+ * 环形缓冲区。 数据在堆上，大小创建时指定。
  */
 #include <stdbool.h>
 #include <stdint.h>
 #define RBUFFER_SIZE 1024
 /**
- * 固定大小1023环形缓冲
+ * 大小为size的环形缓冲，最多保存size-1字节
  * head = tail 为空。 所以少一个
  */
 typedef  struct
 {
-    unsigned char data[RBUFFER_SIZE];
-    long head; // 
-    long tail; // 
+    unsigned char* data;
+    long size; // data的字节数
+    long head; //
+    long tail; //
 }RingBuffer;
 RingBuffer* ringBufferCreate();
+RingBuffer* ringBufferCreateSize(long size);
+void ringBufferFree(RingBuffer* rb);
+void ringBufferClear(RingBuffer* rb);
+long ringBufferSize(RingBuffer* rb);
 bool ringBufferDequeue(RingBuffer* rb, uint8_t *data);
 bool ringBufferDequeueBulk(RingBuffer* rb, uint8_t data[], long size);
 bool ringBufferEnQeueueBulk(RingBuffer* rb, uint8_t data[], long size);
 bool ringBufferEnQeueue(RingBuffer* rb, uint8_t data);
 
-// TODO 增加满了 覆盖写入
+// 满了覆盖最旧的数据，只保留最近写入的size-1字节。 用于复制积压缓冲区
+void ringBufferWrite(RingBuffer* rb, const uint8_t data[], long size);
+// 不出队，从head之后skip字节处读取size字节
+bool ringBufferPeek(RingBuffer* rb, long skip, uint8_t data[], long size);
 #endif
@@ -12,6 +12,7 @@
 #define RIO_H
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "sds.h"
 // TODO 错误码只打印 或 内部属性，不作为返回值，不然影响语义    
 enum {
@@ -29,8 +30,12 @@ typedef struct rio {
     ssize_t (*write)(struct rio *r, const void *buf, size_t len); // 写操作
     off_t (*tell)(struct rio *r);  // 当前文件偏移
     void (*flush)(struct rio *r);  // 刷新
-    void *data;  // 数据源（File*, sds* , int fd, int socket）, 
+    void *data;  // 数据源（File*, sds , int fd, int socket）, 
     int error;  // 错误码，非0表示有错误。
+    // 校验和：updateCksum不为NULL时，每次rioRead/rioWrite的数据都累计到cksum
+    void (*updateCksum)(struct rio *r, const void *buf, size_t len);
+    uint64_t cksum;
+    size_t processedBytes;  // rioRead/rioWrite累计的字节数
 }rio;
 
 // 向rio中写入 len长度的buf
@@ -42,7 +47,17 @@ off_t rioTell(rio *r);
 void rioFlush(rio *r);
 
 void rioInitWithFile(rio *r, FILE *fp);   ///< 普通文件IO。 fread, fwrite,
-void rioInitWithBuf(rio *r, sds *buf);    ///< 内存IO
+void rioInitWithBuf(rio *r, sds buf);    ///< 内存IO
 void rioInitWithSocket(rio *r, int socket);   ///< 网络IO，  send,recv
 void rioInitWithFD(rio *r, int fd);   //< 其他文件IO ,write,read
+// 带用户态缓冲的fd：写入先攒到bufsize再write，读取一次read bufsize。 一个rio只用于读或只用于写
+void rioInitWithBufferedFD(rio *r, int fd, size_t bufsize);
+void rioFreeBufferedFD(rio *r);    // 释放缓冲，不flush、不关闭fd
+
+void rioGenericUpdateChecksum(rio *r, const void *buf, size_t len);   // CRC64
+
+// 以RESP格式写出命令: 数组头、bulk字符串。 返回写入的字节数，0表示出错
+size_t rioWriteBulkCount(rio *r, char prefix, long count);  // prefix为'*'或'$'
+size_t rioWriteBulkString(rio *r, const char *buf, size_t len);
+size_t rioWriteBulkLongLong(rio *r, long long value);
 #endif
\ No newline at end of file
@@ -1,5 +1,11 @@
 #ifndef ROBJ_H
 #define ROBJ_H
+#include <stddef.h>
+#include <limits.h>
+#include "sds.h"
+
+#define OBJ_SHARED_REFCOUNT INT_MAX     // 共享对象的引用计数，固定不变，永不释放
+#define OBJ_COMPRESS_HDR 4              // 压缩字符串sds开头的原始长度
 
 
 enum robj_encoding{
@@ -10,7 +16,8 @@ enum robj_encoding{
     REDIS_ENCODING_LINKEDLIST,  // 双端链表
     REDIS_ENCODING_ZIPLIST, // 压缩列表
     REDIS_ENCODING_INTSET,  // 整数集合
-    REDIS_ENCODING_SKIPLIST // 跳跃表和字典
+    REDIS_ENCODING_SKIPLIST, // 跳跃表和字典
+    REDIS_ENCODING_COMPRESSED // LZF压缩的字符串，ptr为sds: 4字节原始长度 + 压缩数据
 };
 enum robj_type{
     REDIS_STRING,
@@ -32,7 +39,16 @@ robj* robjCreate(int type, void* ptr);
 void robjDestroy(robj* obj);
 
 void robjInit();
+void robjSetShareIntegers(int enable);
+int robjIsShared(const robj* obj);
 
 robj* robjCreateStringObject(const char*s);
+robj* robjCreateStringObjectLen(const char* s, size_t len);
+robj* robjCreateStringObjectFromLong(long value);
+void robjSetCompressThreshold(size_t minSize);
+size_t robjCompressThreshold(void);
+robj* robjCreateCompressedStringObject(const void* lzf, size_t lzfLen, size_t rawLen);
+size_t robjCompressedRawLen(const robj* obj);
+sds robjDecompressString(const robj* obj);
 char* robjGetValStr(robj* obj) ;
 #endif
\ No newline at end of file
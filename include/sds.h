@@ -2,44 +2,153 @@
 #define SDS_H
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include <assert.h>
-typedef struct sds{
-    int len;    // 字符串长度，不含'\0'
-    int free;   // 剩余空间，如果为0表示没有空闲。不含'\0'
-    char *buf; // 内容以'\0'结束。至少一个字节长度'\0'. 
-} sds;
 
+/**
+ * sds: 二进制安全的动态字符串
+ *  头部和内容在同一次分配中，sds指针指向buf，可以直接当作C字符串使用（始终以'\0'结尾）。
+ *  根据长度选择不同宽度的头部，短字符串只需要3字节头部。
+ *
+ * | len | alloc | flags | buf ...  '\0' |
+ *                         ^
+ *                         sds
+ */
+typedef char *sds;
+
+struct __attribute__ ((__packed__)) sdshdr8 {
+    uint8_t len;    // 字符串长度，不含'\0'
+    uint8_t alloc;  // buf容量，不含'\0'
+    unsigned char flags;    // 低3位为头部类型
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr16 {
+    uint16_t len;
+    uint16_t alloc;
+    unsigned char flags;
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr32 {
+    uint32_t len;
+    uint32_t alloc;
+    unsigned char flags;
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr64 {
+    uint64_t len;
+    uint64_t alloc;
+    unsigned char flags;
+    char buf[];
+};
+
+#define SDS_TYPE_8  0
+#define SDS_TYPE_16 1
+#define SDS_TYPE_32 2
+#define SDS_TYPE_64 3
+#define SDS_TYPE_MASK 7
+#define SDS_HDR_VAR(T,s) struct sdshdr##T *sh = (void*)((s)-(sizeof(struct sdshdr##T)));
+#define SDS_HDR(T,s) ((struct sdshdr##T *)((s)-(sizeof(struct sdshdr##T))))
+
+// sds长度
+static inline size_t sdslen(const sds s)
+{
+    unsigned char flags = s[-1];
+    switch (flags & SDS_TYPE_MASK) {
+        case SDS_TYPE_8: return SDS_HDR(8, s)->len;
+        case SDS_TYPE_16: return SDS_HDR(16, s)->len;
+        case SDS_TYPE_32: return SDS_HDR(32, s)->len;
+        case SDS_TYPE_64: return SDS_HDR(64, s)->len;
+    }
+    return 0;
+}
+// sds空闲长度
+static inline size_t sdsavail(const sds s)
+{
+    unsigned char flags = s[-1];
+    switch (flags & SDS_TYPE_MASK) {
+        case SDS_TYPE_8: return SDS_HDR(8, s)->alloc - SDS_HDR(8, s)->len;
+        case SDS_TYPE_16: return SDS_HDR(16, s)->alloc - SDS_HDR(16, s)->len;
+        case SDS_TYPE_32: return SDS_HDR(32, s)->alloc - SDS_HDR(32, s)->len;
+        case SDS_TYPE_64: return SDS_HDR(64, s)->alloc - SDS_HDR(64, s)->len;
+    }
+    return 0;
+}
+static inline void sdssetlen(sds s, size_t newlen)
+{
+    unsigned char flags = s[-1];
+    switch (flags & SDS_TYPE_MASK) {
+        case SDS_TYPE_8: SDS_HDR(8, s)->len = newlen; break;
+        case SDS_TYPE_16: SDS_HDR(16, s)->len = newlen; break;
+        case SDS_TYPE_32: SDS_HDR(32, s)->len = newlen; break;
+        case SDS_TYPE_64: SDS_HDR(64, s)->len = newlen; break;
+    }
+}
+// buf容量，不含'\0'
+static inline size_t sdsalloc(const sds s)
+{
+    unsigned char flags = s[-1];
+    switch (flags & SDS_TYPE_MASK) {
+        case SDS_TYPE_8: return SDS_HDR(8, s)->alloc;
+        case SDS_TYPE_16: return SDS_HDR(16, s)->alloc;
+        case SDS_TYPE_32: return SDS_HDR(32, s)->alloc;
+        case SDS_TYPE_64: return SDS_HDR(64, s)->alloc;
+    }
+    return 0;
+}
+static inline void sdssetalloc(sds s, size_t newlen)
+{
+    unsigned char flags = s[-1];
+    switch (flags & SDS_TYPE_MASK) {
+        case SDS_TYPE_8: SDS_HDR(8, s)->alloc = newlen; break;
+        case SDS_TYPE_16: SDS_HDR(16, s)->alloc = newlen; break;
+        case SDS_TYPE_32: SDS_HDR(32, s)->alloc = newlen; break;
+        case SDS_TYPE_64: SDS_HDR(64, s)->alloc = newlen; break;
+    }
+}
+
+/*
+ * 会重新分配内存的接口都返回新的sds，调用方必须使用返回值替换旧指针:
+ *      s = sdscatlen(s, buf, len);
+ */
+
+// 从二进制buf创建sds, init为NULL时内容填充0
+sds sdsnewlen(const void* init, size_t len);
 // 从c字符串创建sds
-sds* sdsnew(const char* s);
+sds sdsnew(const char* s);
 // 创建一个空sds
-sds* sdsempty();
+sds sdsempty(void);
 // 释放sds
-void sdsfree(sds* ss);
-// sds长度
-int sdslen(const sds* ss);
-// sds空闲长度
-int sdsavail(const sds* ss);
+void sdsfree(sds s);
 // 返回一个sds副本,,copy
-sds* sdsdump(const sds* ss);
-// 情况sds字符串内容
-void sdsclear(sds* ss);
+sds sdsdump(const sds s);
+// 清空sds字符串内容, 不释放空间
+void sdsclear(sds s);
 // 将buf追加到后面， 不一定是字符串
-void sdscatlen(sds* dest, const char* buf, int n);
-
+sds sdscatlen(sds s, const void* buf, size_t len);
 // 将C字符串拼接到SDS末尾
-void sdscat(sds* dest, const char* s);
+sds sdscat(sds s, const char* t);
 // 将sds字符串拼接到sds末尾
-void sdscatsds(sds* dest, sds* src);
+sds sdscatsds(sds s, const sds t);
 // 将C字符串覆盖写入SDS
-void sdscpy(sds* dest, const char* s);
+sds sdscpy(sds s, const char* t);
+// 将二进制buf覆盖写入SDS
+sds sdscpylen(sds s, const char* t, size_t len);
 // 用空字符将SDS len扩展到指定长度
-void sdsgrowzero(sds* ss, int newlen);
-// 裁剪， 去掉区间外数据
-void sdsrange(sds* ss, int start, int end);
+sds sdsgrowzero(sds s, size_t len);
+
+// 保证至少addlen字节空闲，不改变len
+sds sdsMakeRoomFor(sds s, size_t addlen);
+// 调用方直接写入buf末尾后，增加len（配合sdsMakeRoomFor）, incr可以为负
+void sdsIncrLen(sds s, ssize_t incr);
+// 整个sds占用的内存(头部+buf+'\0')
+size_t sdsAllocSize(const sds s);
+
+// 裁剪，保留[start, end]，支持负数下标
+void sdsrange(sds s, ssize_t start, ssize_t end);
 // 去除两端无关字符
-void sdstrim(sds* sds, const char* s);
-// 比较两个sds字符串相同
-int sdscmp(const sds* sds1, const sds* sds2);
+void sdstrim(sds s, const char* cset);
+// 按字节比较两个sds, 相同返回0
+int sdscmp(const sds s1, const sds s2);
 
 #endif
-
@@ -0,0 +1,12 @@
+#ifndef SDSALLOC_H
+#define SDSALLOC_H
+/**
+ * sds使用的分配器。 替换分配器时只需修改这里
+ */
+#include "zmalloc.h"
+
+#define s_malloc zmalloc
+#define s_realloc zrealloc
+#define s_free zfree
+
+#endif
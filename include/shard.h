@@ -0,0 +1,44 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stddef.h>
+#include "typedefs.h"
+
+#define SHARDS_MAX 64
+#define SHARD_QUEUE_SIZE 4096       // 每对分片之间每个方向的队列容量
+#define SHARD_POP_PER_EVENT 1024    // 一次唤醒最多从每条队列取出的消息，避免一个分片占满事件循环
+
+// shardRouteCommand返回值
+#define SHARD_ROUTE_LOCAL 0     // 直接在本分片执行
+#define SHARD_ROUTE_QUEUED 1    // 已转发(或为了保持顺序已代为执行)，回复稍后按命令顺序追加
+#define SHARD_ROUTE_WAIT 2      // 还有转发没回复，而这条命令必须在客户端上执行，暂停该客户端的pipeline
+
+/**
+ * 分片模式（shards N，无共享）
+ *  N个线程，每个线程一个aeEventLoop和一组独立的redisServer状态：数据库、客户端、定时任务。
+ *  server是线程局部的，每个分片线程看到的是自己的redisServer，命令执行代码不需要改动，也不需要加锁。
+ *  每个分片用SO_REUSEPORT监听同一端口，由内核分配新连接。
+ *
+ *  键按hash归属于一个分片。 带键命令落在其他分片时，原始RESP拷贝一份，
+ *  通过(来源,目标)这一对分片之间的SPSC无锁队列发给目标，目标执行后把回复沿反方向队列送回。
+ *  消息在beforeSleep中批量交付，每轮每个目标只用eventfd唤醒一次。
+ *
+ *  同一客户端的回复必须按命令顺序发送：客户端有转发未回复时，后续带键命令即使属于本分片，
+ *  也执行后暂存在请求队列中排队；不带键的命令（SELECT、MULTI等）需要客户端状态，暂停pipeline直到回复全部到达。
+ *  事务、WATCH不转发，键必须属于本分片。
+ *
+ *  限制：只能作为master运行，不支持持久化、复制、IO线程。
+ */
+void initShards(int num);
+// 键所属分片
+int shardKeyOwner(const char* key, size_t len);
+// 解析出一条命令后、执行前调用，决定在哪里执行
+int shardRouteCommand(redisClient* c);
+// 命令访问的键是否都属于本分片
+int shardCommandIsLocal(redisClient* c, redisCommand* cmd);
+// beforeSleep中调用：把本轮产生的消息交付给其他分片并唤醒它们
+void shardsBeforeSleep(void);
+// 释放客户端前调用，丢弃还没回复的转发
+void shardUnlinkClient(redisClient* c);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stddef.h>
+
+/**
+ * 单生产者单消费者无锁队列： 固定容量的环形数组，元素为指针。
+ *  只有一个线程push、一个线程pop，不需要锁也不需要CAS：
+ *  生产者只写tail，消费者只写head，各自缓存对方的游标，只在看起来满/空时才重新读取，
+ *  两个游标放在不同的缓存行，避免伪共享。
+ *  push对元素的写入通过tail的release/acquire对消费者可见。
+ */
+typedef struct spscQueue spscQueue;
+
+// cap向上取整为2的幂
+spscQueue* spscQueueCreate(size_t cap);
+void spscQueueRelease(spscQueue* q);
+// 生产者调用。 成功返回1，队列满返回0
+int spscQueuePush(spscQueue* q, void* item);
+// 消费者调用。 队列空返回NULL
+void* spscQueuePop(spscQueue* q);
+
+#endif
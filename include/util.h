@@ -2,6 +2,7 @@
 #define UTIL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 
 /* 可视化打印buf */
@@ -9,8 +10,13 @@ void printBuf(const char* prefix, const char* buf, int len);
 
 char* fullPath(char* path);
 long long mstime(void) ;
+long long ustime(void);
 void strim(char *s);
 bool string2long(const char*s, long* out);
+bool string2longLen(const char* s, size_t len, long* out);
+bool memtoull(const char* s, unsigned long long* out);
+void getRandomHexChars(char* p, size_t len);
+long memFindIncremental(const char* buf, size_t len, const char* mark, size_t marklen, size_t* scanned);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef ZMALLOC_H
+#define ZMALLOC_H
+/**
+ * 带统计的分配器：记录进程中经过这里分配的字节数，maxmemory淘汰、INFO使用。
+ *  zmalloc分配的内存必须用zfree释放。 计数是原子变量，IO线程、AOF线程、分片线程都可以分配。
+ *
+ * 分配模式，启动时zmallocInit选择一次：
+ *  libc:  直接使用malloc，按malloc_usable_size统计
+ *  slab:  不超过ZMALLOC_SLAB_MAX的小对象(robj、sds、dict节点)按大小分级，从线程本地的slab分配，
+ *         没有malloc的块头开销，释放后放回当前线程的空闲链表复用。 大对象仍走malloc
+ *  arena: 同slab，但slab页从启动时预留的一段连续地址空间中切分（透明大页），减少映射数量和TLB缺失
+ * slab页不归还给系统。 释放时通过页表(pagemap)判断指针属于哪个大小级，和分配模式无关，
+ * 所以切换模式之前分配的内存也能正确释放。
+ */
+#include <stddef.h>
+
+#define ZMALLOC_LIBC 0
+#define ZMALLOC_SLAB 1
+#define ZMALLOC_ARENA 2
+
+#define ZMALLOC_SLAB_MAX 256            // 不超过这个大小的分配走slab
+#define ZMALLOC_SLAB_CLASSES 14         // 大小级数
+#define ZMALLOC_SLAB_PAGE_SIZE (64 * 1024)  // slab页大小，按页大小对齐
+#define ZMALLOC_ARENA_SIZE (4ULL << 30)     // arena默认预留的地址空间
+
+void* zmalloc(size_t size);
+void* zcalloc(size_t nmemb, size_t size);
+void* zrealloc(void* ptr, size_t size);
+void* zalignedAlloc(size_t alignment, size_t size);
+void zfree(void* ptr);
+char* zstrdup(const char* s);
+size_t zmallocSize(void* ptr);
+size_t zmallocUsedMemory(void);
+
+int zmallocInit(int mode, size_t arenaSize);
+int zmallocModeFromString(const char* s);
+const char* zmallocModeToString(int mode);
+const char* zmallocModeName(void);
+size_t zmallocGetRss(void);
+void zmallocClassStats(int cls, size_t* size, size_t* pages, size_t* inuse);
+
+#endif
@@ -26,7 +26,6 @@
 
 #include "redis.h"
 #include "net.h"
-#include "aof.h"
 /**
  * @brief 初始化apistate
  * 
@@ -167,6 +166,11 @@ aeEventLoop *aeCreateEventLoop(int maxsize)
         return NULL;
     }
     eventLoop->stop = 0;
+    eventLoop->maxfd = -1;
+    eventLoop->timeEventHead = NULL;
+    eventLoop->timeEventNextId = 0;
+    eventLoop->beforesleep = NULL;
+    eventLoop->aftersleep = NULL;
     return eventLoop;
 }
 
@@ -230,13 +234,15 @@ int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask)
     if (mask == AE_NONE) {
         return AE_OK;
     }
+    int op = eventLoop->events[fd].mask == AE_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    // 合并已有的监听，否则注册写事件时会覆盖掉读事件
+    mask |= eventLoop->events[fd].mask;
     if (mask & AE_READABLE) {
         ee.events |= EPOLLIN;
     }
     if (mask & AE_WRITABLE) {
         ee.events |= EPOLLOUT;
     }
-    int op = eventLoop->events[fd].mask == AE_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
     if (epoll_ctl(eventLoop->apiState->epfd, op, fd, &ee) == -1) {
         checkSockErr(fd);
         return AE_ERROR;
@@ -359,8 +365,15 @@ static int aeProcessEvents(aeEventLoop* loop, int flags)
     // log_debug("API POLL timeout %u ms", tvp->tv_sec * 1000 + tvp->tv_usec/1000);
 
     // 文件事件: 至多等到下一个定时任务
+    if (loop->beforesleep) {
+        loop->beforesleep(loop);
+    }
+
     // TODO while运行很快，很可能在ms级别之下，运行了很多次timeOut 0 .(忙查询)
     numevents = aeApiPoll(loop, tvp);
+    if (loop->aftersleep) {
+        loop->aftersleep(loop);
+    }
     for (int i = 0; i < numevents; i++) {
         aeFileEvent* fe = &loop->events[loop->fireEvents[i].fd];
         int mask = loop->fireEvents[i].mask;
@@ -380,9 +393,6 @@ static int aeProcessEvents(aeEventLoop* loop, int flags)
         processTimeEvents(loop);
     }
 
-    // 文件事件的写命令会追加到aof_buf缓冲， 需要考虑这里是否将缓冲刷到aof
-    flushAppendOnlyFile();
-
     return AE_OK;
 }
 /**
@@ -429,8 +439,8 @@ int aeDeleteFileEvent(aeEventLoop* loop, int fd, int mask)
         return AE_ERROR;
     }
     aeFileEvent* fe = &loop->events[fd];
-    // fd上无监听，无需del
-    if (fe->mask == AE_NONE) {
+    // fd上无该监听，无需del
+    if (!(fe->mask & mask)) {
         return AE_OK;
     }
     fe->mask &= ~mask;
@@ -482,6 +492,16 @@ int aeCreateTimeEvent(aeEventLoop* loop, long long ms, aeTimeProc* proc, void* d
 
 
 
+void aeSetBeforeSleepProc(aeEventLoop* eventLoop, aeBeforeSleepProc* beforesleep)
+{
+    eventLoop->beforesleep = beforesleep;
+}
+
+void aeSetAfterSleepProc(aeEventLoop* eventLoop, aeAfterSleepProc* aftersleep)
+{
+    eventLoop->aftersleep = aftersleep;
+}
+
 /**
  * @brief 事件循环main
  * 
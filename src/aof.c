@@ -1,5 +1,4 @@
 #include "aof.h"
-#include "conf.h"
 #include "redis.h"
 #include <stdio.h>
 #include "log.h"
@@ -9,115 +8,712 @@
 #include "util.h"
 #include <pthread.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <stdatomic.h>
 
 #include "resp.h"
+#include "rio.h"
+#include "client.h"
+#include "iothread.h"
+#include "ae.h"
+
+/**
+ * @brief 加载失败：文件格式错误，或者末尾截断且没有开启aof-load-truncated
+ */
+static void aofLoadFail(const char* reason)
+{
+    log_error("Bad AOF file %s: %s. Unrecoverable error, aborting now.", server->aof.filename, reason);
+    exit(EXIT_FAILURE);
+}
 
 /**
  * 服务器启动时候，通过fakeclient读取aof执行
+ *  mmap整个文件，解析器在映射上原地解析，参数是指向映射的视图，不拷贝、不移动剩余数据；
+ *  每条命令直接交给命令表执行，没有读缓冲和回复
+ *  末尾不完整的命令(写入时宕机)：开启aof-load-truncated时截掉这部分继续启动，否则退出
  */
 void aof_load()
 {
-    log_info("Aof load...");
-    redisClient* fkc = redisFakeClientCreate();
-    // load aof 到 readbuf
     struct AOF* aof = &(server->aof);
-    char buf[1024] = {0};
-    sds* sbuf = sdsempty();
-    int nread;
-    while ((nread = read(aof->fd, buf , sizeof(buf))) > 0)
-    {
-        // 由于aof巨大，很可能一个resp就很长，导致超越一个buf，所以先使用sds
-        sdscatlen(sbuf, buf, nread);
+    struct stat st;
+    if (aof->fd == -1 || fstat(aof->fd, &st) == -1 || st.st_size == 0)
+        return;
+    log_info("Aof load...");
+    size_t size = st.st_size;
+    char* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, aof->fd, 0);
+    if (base == MAP_FAILED) {
+        log_error("Aof mmap failed: %s", strerror(errno));
+        exit(EXIT_FAILURE);
     }
+    madvise(base, size, MADV_SEQUENTIAL);
 
-    // 从buf中读取一些完整的resp
-    char* endptr;
-    while (( endptr = respParse(sbuf->buf, sbuf->len)) != NULL)
-    {
-        sdscatlen(fkc->readBuf, sbuf->buf, endptr - sbuf->buf + 1);
-        // 找到了一个有效的resp
-        processClientQueryBuf(fkc);
-        sdsrange(sbuf, endptr - sbuf->buf + 1, sdslen(sbuf) - 1);
+    long long start = ustime();
+    long long commands = 0;
+    // 命令执行路径上的调试日志每条命令好几行，加载时只保留INFO以上
+    int level = log_get_level();
+    if (level < LOG_INFO)
+        log_set_level(LOG_INFO);
+    // 加载期间淘汰、过期删除的键不再写回AOF
+    server->loading = 1;
+    redisClient* fkc = redisFakeClientCreate();
+    respReqParser* p = &fkc->reqParser;
+    int ret = RESP_REQ_OK;
+    while (p->pos < size && (ret = respParseRequest(p, base, size)) == RESP_REQ_OK) {
+        clientSetArgv(fkc, p, base);
+        processCommand(fkc);
+        respReqParserReset(p);
+        commands++;
     }
+    size_t valid = p->cmdstart;
+    fkc->argc = 0;
+    fkc->rawCmd = NULL;
+    fkc->rawCmdLen = 0;
+    freeClient(fkc);
+    server->loading = 0;
+    munmap(base, size);
+    log_set_level(level);
 
+    if (ret == RESP_REQ_ERR)
+        aofLoadFail("Bad file format reading the append only file");
+    if (valid < size) {
+        if (!server->aofLoadTruncated)
+            aofLoadFail("Unexpected end of file, use aof-load-truncated=yes to load it anyway");
+        // 截掉半条命令，之后追加的命令才能被正确解析
+        if (ftruncate(aof->fd, valid) == -1) {
+            log_error("Error truncating the AOF file: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        log_warn("AOF loaded anyway because aof-load-truncated is enabled, truncated %zu bytes incomplete tail",
+                 size - valid);
+        aof->currentSize = valid;
+        aof->baseSize = valid;
+    }
+    double secs = (ustime() - start) / 1e6;
+    log_info("DB loaded from append only file: %lld commands, %zu bytes in %.3f seconds (%.0f MB/s)",
+             commands, valid, secs, secs > 0 ? valid / secs / (1024 * 1024) : 0);
 }
 
+static void aofSyncedHandler(aeEventLoop* el, int fd, void* privdata);
+static void* aofFlushThreadMain(void* arg);
+
 void aof_init()
 {
     struct AOF* aof = &(server->aof);
-    aof->active_buf = sdsempty();
-    aof->io_buf = sdsempty();
-    pthread_mutex_init(&aof->aof_mutex, NULL);
-    pthread_cond_init(&aof->aof_cond, NULL);
-    aof->isAofing = false;
-    aof->lastAofTime = 0;
+    aof->buf = sdsempty();
+    aof->spare = NULL;
+    aof->selectedDb = -1;
+    aof->queue = spscQueueCreate(AOF_QUEUE_SIZE);
+    // 还回的buf不会超过交出去的，留出余量，满了由刷盘线程直接释放
+    aof->freeQueue = spscQueueCreate(AOF_QUEUE_SIZE * 2);
+    aof->batchSeq = 0;
+    atomic_init(&aof->writtenSeq, 0);
+    atomic_init(&aof->syncedSeq, 0);
+    aof->clientsWaitingFsync = listCreate();
+    atomic_init(&aof->statFsyncs, 0);
+    atomic_init(&aof->statFsyncTotalUs, 0);
+    atomic_init(&aof->statFsyncLastUs, 0);
+    atomic_init(&aof->statFsyncMaxUs, 0);
+    aof->statDelayedFsync = 0;
+    aof->childPid = -1;
+    aof->rewriteBuf = NULL;
+    aof->rewriteScheduled = false;
+    aof->rewriteTimeStart = -1;
+    aof->lastRewriteTimeSec = -1;
+    aof->lastBgrewriteStatus = 0;
 
-    char* aofFileName = get_config(server->configfile,"aof_file");
-    FILE* fp = fopen(fullPath(aofFileName), "a+");
-    if (fp == NULL) {
-        log_error("Aof (%s) open failed %s", aofFileName ,strerror(errno));
-        return ;
+    aof->filename = fullPath(server->aofFileName);
+    // 追加写; 启动时从头读取加载
+    int fd = open(aof->filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+        log_error("Aof (%s) open failed %s", server->aofFileName,strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&aof->fd, fd);
+    struct stat st;
+    atomic_init(&aof->currentSize, fstat(fd, &st) == 0 ? st.st_size : 0);
+    aof->baseSize = aof->currentSize;
+
+    aof->threadWakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    aof->syncedWakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (aof->threadWakefd == -1 || aof->syncedWakefd == -1) {
+        log_error("Create AOF eventfd failed: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (aeCreateFileEvent(server->eventLoop, aof->syncedWakefd, AE_READABLE, aofSyncedHandler, NULL) == AE_ERROR) {
+        log_error("Register AOF eventfd failed");
+        exit(EXIT_FAILURE);
     }
-    aof->fd = fileno(fp);
 
+    atomic_store(&aof->fsyncPolicy, server->aofFsync);
     pthread_t aof_thread;
-    int err = pthread_create(&aof_thread, NULL, erverySecAOF, NULL);
+    int err = pthread_create(&aof_thread, NULL, aofFlushThreadMain, server);
     if (err != 0) {
         log_error("Fatal: can't create AOF thread: %s\n", strerror(err));
+        exit(EXIT_FAILURE);
     }
     pthread_detach(aof_thread);
-    log_info("Aof thread : [%zu]", aof_thread);
+    log_info("Aof thread : [%zu], appendfsync %s", aof_thread, aofFsyncPolicyToString(server->aofFsync));
 }
 
-bool needAOF() {
-    struct AOF* aof = &(server->aof);
-    if (aof->isAofing) return false;
-    
-    char* aofAction = get_config(server->configfile,"appendfsync");
-    if (strcmp(aofAction, "everysec") == 0) {
-        if (mstime() - aof->lastAofTime > 1000) {
-            if (sdslen(aof->active_buf) > 0) 
-                return true;
+int aofFsyncPolicyFromString(const char* s)
+{
+    if (!strcasecmp(s, "always")) return AOF_FSYNC_ALWAYS;
+    if (!strcasecmp(s, "everysec")) return AOF_FSYNC_EVERYSEC;
+    if (!strcasecmp(s, "no")) return AOF_FSYNC_NO;
+    return -1;
+}
+
+const char* aofFsyncPolicyToString(int policy)
+{
+    switch (policy) {
+    case AOF_FSYNC_ALWAYS: return "always";
+    case AOF_FSYNC_NO: return "no";
+    default: return "everysec";
+    }
+}
+
+static bool writeAll(int fd, const char* p, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
         }
+        p += n;
+        len -= n;
     }
-    return false;
+    return true;
 }
 
-// everysec有一个常驻线程处理
-void* erverySecAOF(void* arg)
+static void eventfdNotify(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_error("Write AOF eventfd failed: %s", strerror(errno));
+    }
+}
+
+static void eventfdDrain(int fd)
+{
+    uint64_t n;
+    if (read(fd, &n, sizeof(n)) < 0 && errno != EAGAIN) {
+        log_error("Read AOF eventfd failed: %s", strerror(errno));
+    }
+}
+
+/**
+ * @brief 刷盘线程: fdatasync并记录耗时，之后已write的批次都已落盘
+ */
+static void aofThreadFsync(struct AOF* aof, int fd)
+{
+    unsigned long long written = atomic_load_explicit(&aof->writtenSeq, memory_order_relaxed);
+    long long start = ustime();
+    if (fdatasync(fd) == -1) {
+        log_error("AOF fsync failed: %s", strerror(errno));
+        if (atomic_load_explicit(&aof->fsyncPolicy, memory_order_relaxed) == AOF_FSYNC_ALWAYS) {
+            // 已经不能保证回复的写命令在磁盘上
+            log_error("Can't recover from AOF fsync error when the AOF fsync policy is 'always'. Exiting...");
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+    long long us = ustime() - start;
+    atomic_fetch_add_explicit(&aof->statFsyncs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&aof->statFsyncTotalUs, us, memory_order_relaxed);
+    atomic_store_explicit(&aof->statFsyncLastUs, us, memory_order_relaxed);
+    if (us > atomic_load_explicit(&aof->statFsyncMaxUs, memory_order_relaxed))
+        atomic_store_explicit(&aof->statFsyncMaxUs, us, memory_order_relaxed);
+    atomic_store_explicit(&aof->syncedSeq, written, memory_order_release);
+}
+
+/**
+ * @brief 刷盘线程: 按顺序写出队列中的批次。 always模式一次取完队列，只fdatasync一次；
+ *  everysec在距离上次fsync满一秒时fsync；no只write。 没有批次时阻塞在eventfd上
+ *
+ * @param [in] arg server
+ */
+static void* aofFlushThreadMain(void* arg)
 {
+    server = arg; // server是线程局部的
+    // 信号交给主线程处理
+    sigset_t set;
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
     struct AOF* aof = &(server->aof);
+    int fd = atomic_load(&aof->fd);
+    long long lastFsync = mstime();
+    bool dirty = false; // 有write之后还没fsync的数据
     while (true)
     {
-        pthread_mutex_lock(&aof->aof_mutex);
-        while (!needAOF())
-        {
-            pthread_cond_wait(&aof->aof_cond, &aof->aof_mutex);
+        int policy = atomic_load_explicit(&aof->fsyncPolicy, memory_order_acquire);
+        int batches = 0;
+        sds batch;
+        while ((batch = spscQueuePop(aof->queue)) != NULL) {
+            // 重写完成后主线程换了新文件，旧文件不会再有写入
+            int cur = atomic_load_explicit(&aof->fd, memory_order_acquire);
+            if (cur != fd) {
+                close(fd);
+                fd = cur;
+            }
+            size_t len = sdslen(batch);
+            if (!writeAll(fd, batch, len)) {
+                log_error("Error writing to the AOF file: %s", strerror(errno));
+                if (policy == AOF_FSYNC_ALWAYS) {
+                    log_error("Can't recover from AOF write error when the AOF fsync policy is 'always'. Exiting...");
+                    exit(EXIT_FAILURE);
+                }
+            } else {
+                atomic_fetch_add_explicit(&aof->currentSize, len, memory_order_relaxed);
+            }
+            atomic_fetch_add_explicit(&aof->writtenSeq, 1, memory_order_release);
+            sdsclear(batch);
+            // 主线程分配的内存还给主线程
+            if (!spscQueuePush(aof->freeQueue, batch))
+                sdsfree(batch);
+            batches++;
         }
-        aof->isAofing = true;
-        sds* tmpbuf = aof->active_buf; // 主线程加入的. 现在清空，刷入iobuf
-        aof->active_buf = aof->io_buf; // iobuf一定是空的。
-        aof->io_buf = tmpbuf;
-        pthread_mutex_unlock(&aof->aof_mutex);
+        if (batches > 0)
+            dirty = true;
 
-        log_info("AOF start..");
-        // do io
-        ssize_t nwritten = write(aof->fd, aof->io_buf->buf, aof->io_buf->len);
-        if (nwritten <= 0)
-            log_error("aof write error !");
-        fsync(aof->fd);
-        sdsclear(aof->io_buf);
-        log_info("AOF finished, written %u bytes", nwritten);
+        if (dirty && policy == AOF_FSYNC_ALWAYS) {
+            // 组提交: 这次取出的所有批次一次落盘
+            aofThreadFsync(aof, fd);
+            dirty = false;
+            eventfdNotify(aof->syncedWakefd);
+        } else if (dirty && policy == AOF_FSYNC_EVERYSEC && mstime() - lastFsync >= 1000) {
+            aofThreadFsync(aof, fd);
+            dirty = false;
+            lastFsync = mstime();
+        } else if (dirty && policy == AOF_FSYNC_NO) {
+            dirty = false;
+        }
+        if (batches > 0)
+            continue;
 
-        pthread_mutex_lock(&aof->aof_mutex);
-        aof->isAofing = false;
-        pthread_mutex_unlock(&aof->aof_mutex);
+        // 交出批次先入队再写eventfd，这里不会错过唤醒
+        int timeout = -1;
+        if (dirty) {
+            long long left = 1000 - (mstime() - lastFsync);
+            timeout = left > 0 ? (int)left : 0;
+        }
+        struct pollfd pfd = {.fd = aof->threadWakefd, .events = POLLIN};
+        if (poll(&pfd, 1, timeout) > 0)
+            eventfdDrain(aof->threadWakefd);
     }
+    return NULL;
 }
 
+/**
+ * @brief 刷盘线程写完还回的buf: 留一个下次复用，其余在主线程释放
+ */
+static void aofReclaimBuffers(struct AOF* aof)
+{
+    sds b;
+    while ((b = spscQueuePop(aof->freeQueue)) != NULL) {
+        if (aof->spare == NULL && sdsalloc(b) <= AOF_BUF_REUSE_MAX)
+            aof->spare = b;
+        else
+            sdsfree(b);
+    }
+}
+
+static void aofHoldClient(redisClient* c)
+{
+    if (c->ioPending & CLIENT_PENDING_FSYNC) return;
+    c->ioPending |= CLIENT_PENDING_FSYNC;
+    listAddNodeTail(server->aof.clientsWaitingFsync, listCreateNode(c));
+}
+
+/**
+ * @brief always: 从待写队列中取出回复依赖还没落盘批次的客户端，等fsync完成
+ */
+static void aofHoldPendingWrites(struct AOF* aof)
+{
+    unsigned long long synced = atomic_load_explicit(&aof->syncedSeq, memory_order_acquire);
+    listNode* node = listHead(server->clientsPendingWrite);
+    while (node != NULL) {
+        listNode* next = node->next;
+        redisClient* c = node->value;
+        if (c->aofWaitSeq > synced) {
+            listDelNode(server->clientsPendingWrite, node);
+            c->ioPending &= ~CLIENT_PENDING_WRITE;
+            aofHoldClient(c);
+        }
+        node = next;
+    }
+}
+
+/**
+ * @brief 每轮epoll_wait之前: 本轮的写命令作为一批交给刷盘线程。 刷盘线程落后、队列满时留到下一轮。
+ *  always模式下，本轮执行了写命令的客户端的回复在批次落盘后才发送
+ */
 void flushAppendOnlyFile()
 {
-    pthread_cond_signal(&server->aof.aof_cond);
+    if (!server->aofOn)
+        return;
+    struct AOF* aof = &(server->aof);
+    aofReclaimBuffers(aof);
+    if (sdslen(aof->buf) > 0) {
+        if (spscQueuePush(aof->queue, aof->buf)) {
+            aof->batchSeq++;
+            aof->buf = aof->spare ? aof->spare : sdsempty();
+            aof->spare = NULL;
+            eventfdNotify(aof->threadWakefd);
+        } else {
+            aof->statDelayedFsync++;
+        }
+    }
+    if (server->aofFsync == AOF_FSYNC_ALWAYS)
+        aofHoldPendingWrites(aof);
+}
+
+/**
+ * @brief 放行回复所依赖的批次都不超过synced的客户端
+ */
+static void aofReleaseClients(struct AOF* aof, unsigned long long synced)
+{
+    listNode* node = listHead(aof->clientsWaitingFsync);
+    while (node != NULL) {
+        listNode* next = node->next;
+        redisClient* c = node->value;
+        if (c->aofWaitSeq <= synced) {
+            listDelNode(aof->clientsWaitingFsync, node);
+            c->ioPending &= ~CLIENT_PENDING_FSYNC;
+            if (clientHasPendingReplies(c))
+                clientInstallWriteHandler(c);
+        }
+        node = next;
+    }
+}
+
+/**
+ * @brief 刷盘线程完成一次fdatasync: 放行回复所依赖的批次都已落盘的客户端
+ */
+static void aofSyncedHandler(aeEventLoop* el, int fd, void* privdata)
+{
+    struct AOF* aof = &(server->aof);
+    eventfdDrain(fd);
+    aofReleaseClients(aof, atomic_load_explicit(&aof->syncedSeq, memory_order_acquire));
+}
+
+/**
+ * @brief CONFIG SET appendfsync之后: 不再是always时放行所有等待落盘的回复，唤醒刷盘线程按新策略处理已写入的批次
+ */
+void aofFsyncPolicyChanged(void)
+{
+    if (!server->aofOn)
+        return;
+    struct AOF* aof = &(server->aof);
+    // 先发布再唤醒，刷盘线程醒来后读到新策略
+    atomic_store_explicit(&aof->fsyncPolicy, server->aofFsync, memory_order_release);
+    if (server->aofFsync != AOF_FSYNC_ALWAYS)
+        aofReleaseClients(aof, ULLONG_MAX);
+    eventfdNotify(aof->threadWakefd);
+}
+
+/**
+ * @brief 可写事件中发送回复之前检查: always模式下回复依赖的批次还没落盘时挂起，返回1
+ */
+int aofHoldClientReply(redisClient* c)
+{
+    if (!server->aofOn || server->aofFsync != AOF_FSYNC_ALWAYS)
+        return 0;
+    if (c->aofWaitSeq <= atomic_load_explicit(&server->aof.syncedSeq, memory_order_acquire))
+        return 0;
+    aofHoldClient(c);
+    return 1;
+}
+
+/**
+ * @brief 释放客户端前，从等待fsync的队列中移除
+ */
+void aofUnlinkClient(redisClient* c)
+{
+    if (!(c->ioPending & CLIENT_PENDING_FSYNC)) return;
+    listNode* node = listSearchKey(server->aof.clientsWaitingFsync, c);
+    if (node) listDelNode(server->aof.clientsWaitingFsync, node);
+    c->ioPending &= ~CLIENT_PENDING_FSYNC;
 }
 
+/**
+ * @brief 交出所有写命令，等刷盘线程全部写入。 重写完成替换文件、关闭服务器时使用
+ */
+static void aofDrain(struct AOF* aof)
+{
+    while (sdslen(aof->buf) > 0) {
+        flushAppendOnlyFile();
+        if (sdslen(aof->buf) > 0) usleep(100);
+    }
+    while (atomic_load_explicit(&aof->writtenSeq, memory_order_acquire) != aof->batchSeq)
+        usleep(100);
+}
+
+/**
+ * @brief 关闭服务器前把所有写命令写入并落盘
+ */
+void stopAppendOnly(void)
+{
+    if (!server->aofOn)
+        return;
+    struct AOF* aof = &(server->aof);
+    aofDrain(aof);
+    if (server->aofFsync != AOF_FSYNC_NO)
+        fdatasync(atomic_load(&aof->fd));
+}
+
+/**
+ * @brief 写命令追加到AOF缓冲。 数据库和上一条写命令不同时先写SELECT；
+ *  重写进行中同时追加到重写缓冲，子进程的快照里没有这些修改
+ *
+ * @param [in] dbid 命令执行的数据库
+ * @param [in] cmd 客户端发来的原始命令(RESP)
+ * @param [in] len
+ * @return unsigned long long 命令所在的批次，always模式下这个批次落盘后才能回复
+ */
+unsigned long long feedAppendOnlyFile(int dbid, const char* cmd, size_t len)
+{
+    struct AOF* aof = &(server->aof);
+    char select[64];
+    int selectLen = 0;
+    if (dbid != aof->selectedDb) {
+        char id[24];
+        int idlen = snprintf(id, sizeof(id), "%d", dbid);
+        selectLen = snprintf(select, sizeof(select), "*2\r\n$6\r\nSELECT\r\n$%d\r\n%s\r\n", idlen, id);
+        aof->selectedDb = dbid;
+    }
+
+    if (selectLen)
+        aof->buf = sdscatlen(aof->buf, select, selectLen);
+    aof->buf = sdscatlen(aof->buf, cmd, len);
+
+    if (aof->childPid != -1) {
+        if (selectLen)
+            aof->rewriteBuf = sdscatlen(aof->rewriteBuf, select, selectLen);
+        aof->rewriteBuf = sdscatlen(aof->rewriteBuf, cmd, len);
+    }
+    return aof->batchSeq + 1;
+}
+
+static void rewriteTempFileName(char* buf, size_t size, pid_t pid)
+{
+    snprintf(buf, size, "%s.rewrite-%d", server->aof.filename, (int)pid);
+}
+
+/**
+ * @brief 子进程中把当前数据库写成最少的命令：每个非空数据库一条SELECT，每个键一条SET，
+ *  有过期时间的键再跟一条PEXPIREAT(绝对时间，重放时不会延长过期)。 已经过期的键跳过
+ *
+ * @param [in] filename 临时文件
+ * @return int 0成功，-1失败
+ */
+static int rewriteAppendOnlyFile(const char* filename)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        log_error("Opening the temp file for AOF rewrite failed: %s", strerror(errno));
+        return -1;
+    }
+    long long start = ustime();
+    long long now = mstime();
+    size_t keys = 0;
+    rio r;
+    rioInitWithBufferedFD(&r, fd, AOF_IO_BUF_SIZE);
+
+    for (int i = 0; i < server->dbnum && !r.error; i++) {
+        redisDb* db = server->db + i;
+        if (dictIsEmpty(db->kv)) continue;
+
+        rioWriteBulkCount(&r, '*', 2);
+        rioWriteBulkString(&r, "SELECT", 6);
+        rioWriteBulkLongLong(&r, i);
+
+        dictIterator* di = dictGetIterator(db->kv);
+        dictEntry* entry;
+        while ((entry = dictIterNext(di)) != NULL && !r.error) {
+            sds key = entry->key;
+            robj* val = entry->v.val;
+            long long when = dbGetExpire(db, key);
+            if (when >= 0 && when < now) continue;
+            if (val->type != REDIS_STRING) continue;
 
+            rioWriteBulkCount(&r, '*', 3);
+            rioWriteBulkString(&r, "SET", 3);
+            rioWriteBulkString(&r, key, sdslen(key));
+            if (val->encoding == REDIS_ENCODING_INT) {
+                rioWriteBulkLongLong(&r, (long)val->ptr);
+            } else if (val->encoding == REDIS_ENCODING_COMPRESSED) {
+                // 命令中是原始值，重放时按value-compress-threshold重新压缩
+                sds raw = robjDecompressString(val);
+                rioWriteBulkString(&r, raw, sdslen(raw));
+                sdsfree(raw);
+            } else {
+                rioWriteBulkString(&r, val->ptr, sdslen(val->ptr));
+            }
+            if (when >= 0) {
+                rioWriteBulkCount(&r, '*', 3);
+                rioWriteBulkString(&r, "PEXPIREAT", 9);
+                rioWriteBulkString(&r, key, sdslen(key));
+                rioWriteBulkLongLong(&r, when);
+            }
+            keys++;
+        }
+        dictReleaseIterator(di);
+    }
+    rioFlush(&r);
+    size_t written = r.processedBytes;
+    int err = r.error;
+    rioFreeBufferedFD(&r);
+
+    if (err || fsync(fd) == -1) {
+        log_error("Write error writing append only file on disk: %s", strerror(errno));
+        close(fd);
+        unlink(filename);
+        return -1;
+    }
+    close(fd);
+    log_info("AOF rewrite: %zu keys, %zu bytes in %.3f seconds",
+             keys, written, (ustime() - start) / 1e6);
+    return 0;
+}
+
+/**
+ * @brief 开启子进程重写AOF。 子进程写临时文件，父进程继续服务，把新的写命令同时记录到重写缓冲
+ *
+ * @return int 0成功开始，-1已有子进程或fork失败
+ */
+int rewriteAppendOnlyFileBackground(void)
+{
+    struct AOF* aof = &(server->aof);
+    if (aof->childPid != -1 || server->isBgSaving)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        char tmpfile[PATH_MAX];
+        rewriteTempFileName(tmpfile, sizeof(tmpfile), getpid());
+        exit(rewriteAppendOnlyFile(tmpfile) == 0 ? 0 : 1);
+    } else if (pid < 0) {
+        log_error("Can't rewrite append only file in background: fork: %s", strerror(errno));
+        return -1;
+    }
+    log_info("Background append only file rewriting started by pid %d", (int)pid);
+    aof->childPid = pid;
+    aof->rewriteScheduled = false;
+    aof->rewriteTimeStart = time(NULL);
+    aof->rewriteBuf = sdsempty();
+    // 重写缓冲以SELECT开头，接在子进程写的最后一个数据库后面也能正确重放
+    aof->selectedDb = -1;
+    return 0;
+}
+
+/**
+ * @brief serverCron中检查: 执行等待中的BGREWRITEAOF，或者文件相对上次重写增长超过
+ *  auto-aof-rewrite-percentage且超过auto-aof-rewrite-min-size时自动重写
+ */
+void rewriteAppendOnlyFileIfNeeded(void)
+{
+    struct AOF* aof = &(server->aof);
+    if (aof->childPid != -1 || server->isBgSaving)
+        return;
+    if (aof->rewriteScheduled) {
+        rewriteAppendOnlyFileBackground();
+        return;
+    }
+    if (server->aofRewritePerc == 0)
+        return;
+
+    off_t current = atomic_load_explicit(&aof->currentSize, memory_order_relaxed);
+    off_t base = aof->baseSize ? aof->baseSize : 1;
+    if ((unsigned long long)current < server->aofRewriteMinSize)
+        return;
+    long long growth = (long long)current * 100 / base - 100;
+    if (growth >= server->aofRewritePerc) {
+        log_info("Starting automatic rewriting of AOF on %lld%% growth", growth);
+        rewriteAppendOnlyFileBackground();
+    }
+}
+
+/**
+ * @brief 重写子进程结束。 成功时把重写缓冲追加到临时文件，落盘后rename替换AOF，之后的写入进入新文件。
+ *  已经交出的批次都在重写缓冲中，必须全部写入旧文件之后才能替换fd，否则会在新文件中重复
+ *
+ * @param [in] ok 子进程是否成功退出
+ */
+void backgroundRewriteDoneHandler(bool ok)
+{
+    struct AOF* aof = &(server->aof);
+    char tmpfile[PATH_MAX];
+    rewriteTempFileName(tmpfile, sizeof(tmpfile), aof->childPid);
+    long long start = ustime();
+    int fd = -1;
+
+    if (!ok) {
+        log_warn("Background AOF rewrite terminated with error");
+        goto err;
+    }
+    fd = open(tmpfile, O_WRONLY | O_APPEND);
+    if (fd == -1) {
+        log_warn("Unable to open the temporary AOF produced by the child: %s", strerror(errno));
+        goto err;
+    }
+
+    aofDrain(aof);
+    if (!writeAll(fd, aof->rewriteBuf, sdslen(aof->rewriteBuf)) || fsync(fd) == -1) {
+        log_warn("Error trying to flush the parent diff to the rewritten AOF: %s", strerror(errno));
+        goto err;
+    }
+    if (rename(tmpfile, aof->filename) == -1) {
+        log_warn("Error trying to rename the temporary AOF file %s into %s: %s",
+                 tmpfile, aof->filename, strerror(errno));
+        goto err;
+    }
+    struct stat st;
+    atomic_store(&aof->currentSize, fstat(fd, &st) == 0 ? st.st_size : 0);
+    aof->baseSize = aof->currentSize;
+    // 刷盘线程空闲，下一批写入前换到新fd并关闭旧的
+    atomic_store_explicit(&aof->fd, fd, memory_order_release);
+
+    log_info("Background AOF rewrite finished successfully: %lld bytes, %zu bytes from rewrite buffer in %.3f ms",
+             (long long)aof->baseSize, sdslen(aof->rewriteBuf), (ustime() - start) / 1e3);
+    aof->lastBgrewriteStatus = 0;
+    goto cleanup;
+
+err:
+    if (fd != -1)
+        close(fd);
+    unlink(tmpfile);
+    aof->lastBgrewriteStatus = -1;
+cleanup:
+    sdsfree(aof->rewriteBuf);
+    aof->rewriteBuf = NULL;
+    aof->childPid = -1;
+    aof->lastRewriteTimeSec = time(NULL) - aof->rewriteTimeStart;
+    aof->rewriteTimeStart = -1;
+}
+
+/**
+ * @brief 关闭服务器时终止正在重写的子进程，删除它的临时文件
+ */
+void killAppendOnlyChild(void)
+{
+    struct AOF* aof = &(server->aof);
+    if (aof->childPid == -1)
+        return;
+    char tmpfile[PATH_MAX];
+    rewriteTempFileName(tmpfile, sizeof(tmpfile), aof->childPid);
+    kill(aof->childPid, SIGKILL);
+    waitpid(aof->childPid, NULL, 0);
+    unlink(tmpfile);
+    sdsfree(aof->rewriteBuf);
+    aof->rewriteBuf = NULL;
+    aof->childPid = -1;
+    log_info("Killed AOF rewrite child");
+}
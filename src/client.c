@@ -4,7 +4,11 @@
 #include "redis.h"
 #include "log.h"
 #include "net.h"
+#include "iothread.h"
+#include "shard.h"
+#include "rio.h"
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 /**
@@ -18,15 +22,31 @@ redisClient* redisFakeClientCreate()
     c->fd = -1;
     c->flags = REDIS_CLIENT_FAKE;
     c->readBuf = sdsempty();
-    c->writeBuf = sdsempty();
+    replyListInit(&c->reply);
     c->dbid = 0;
     c->db = &server->db[c->dbid];
+    respReqParserInit(&c->reqParser);
     c->argc = 0;
     c->argv = NULL;
+    c->argvlen = NULL;
+    c->argvcap = 0;
+    c->rawCmd = NULL;
+    c->rawCmdLen = 0;
+    c->propagateCmd = NULL;
+    c->replPending = NULL;
+    c->replRdbFd = -1;
+    c->reqParsed = RESP_REQ_INCOMPLETE;
+    c->ioPending = 0;
+    c->ioResult = 0;
+    c->ioErrno = 0;
+    c->aofWaitSeq = 0;
+    c->shardRequests = NULL;
     c->ip = NULL;
     c->port = -1;
     c->name = calloc(1, CLIENT_NAME_MAX);
     c->toclose = 0;
+    c->multiCmdCount = 0;
+    c->multcmds = NULL;
     return c;
 }
 /**
@@ -38,18 +58,32 @@ redisClient *redisClientCreate(int fd, char* ip, int port)
     c->fd = fd;
     c->flags = REDIS_CLIENT_NORMAL;
     c->readBuf = sdsempty();
-    c->writeBuf = sdsempty();
+    replyListInit(&c->reply);
     c->dbid = 0;
     c->db = &server->db[c->dbid];
+    respReqParserInit(&c->reqParser);
     c->argc = 0;
     c->argv = NULL;
+    c->argvlen = NULL;
+    c->argvcap = 0;
+    c->rawCmd = NULL;
+    c->rawCmdLen = 0;
+    c->propagateCmd = NULL;
+    c->replPending = NULL;
+    c->replRdbFd = -1;
+    c->reqParsed = RESP_REQ_INCOMPLETE;
+    c->ioPending = 0;
+    c->ioResult = 0;
+    c->ioErrno = 0;
+    c->aofWaitSeq = 0;
+    c->shardRequests = NULL;
     c->ip = calloc(1, IP_ADDR_MAX);
     strcpy(c->ip, ip);
     c->port = port;
     c->name = calloc(1, CLIENT_NAME_MAX);
     c->toclose = 0;
     c->multiCmdCount = 0;
-    c->multcmds = malloc(sizeof(sds* ) * 10);
+    c->multcmds = malloc(sizeof(sds) * 10);
     for (int i = 0; i < 10; ++i)
     {
         c->multcmds[i] = sdsempty();
@@ -64,14 +98,89 @@ redisClient *redisClientCreate(int fd, char* ip, int port)
  */
 void addWrite(redisClient* client, char* s)
 {
-    sdscat(client->writeBuf, s);
+    addWriteBuf(client, s, strlen(s));
+}
+/**
+ * 添加buf, 拷贝
+ */
+void addWriteBuf(redisClient* client, const char* buf, size_t len)
+{
+    // 伪客户端（AOF加载、增量同步）的回复没有人接收
+    if (client->flags & REDIS_CLIENT_FAKE) return;
+    replyListAdd(&client->reply, buf, len);
+}
+
+static void _releaseObject(void* o)
+{
+    robjDestroy(o);
+}
+/**
+ * @brief 添加字符串对象的内容。 较大的值只增加引用计数，不拷贝，发送完后释放
+ *
+ * @param [in] client
+ * @param [in] o 字符串对象, 非INT编码
+ */
+void addWriteObject(redisClient* client, robj* o)
+{
+    if (client->flags & REDIS_CLIENT_FAKE) return;
+    sds s = o->ptr;
+    o->refcount++;
+    replyListAddRef(&client->reply, s, sdslen(s), _releaseObject, o);
+}
+static void _releaseSds(void* s)
+{
+    sdsfree(s);
+}
+/**
+ * @brief 添加sds的内容并接管它，发送完后释放
+ *
+ * @param [in] client
+ * @param [in] s
+ */
+void addWriteSds(redisClient* client, sds s)
+{
+    if (client->flags & REDIS_CLIENT_FAKE) {
+        sdsfree(s);
+        return;
+    }
+    replyListAddRef(&client->reply, s, sdslen(s), _releaseSds, s);
+}
+int clientHasPendingReplies(redisClient* c)
+{
+    return replyListPending(&c->reply) > 0;
+}
+/**
+ * @brief 发送回复队列
+ *
+ * @param [in] c
+ * @return int 出错返回-1, 需要关闭客户端
+ */
+int writeToClient(redisClient* c)
+{
+    ssize_t n = replyListWrite(&c->reply, c->fd);
+    replyListReleaseSent(&c->reply);
+    if (n < 0)
+    {
+        log_error("Write to client [%d]%s:%d failed: %s", c->fd, c->ip, c->port, strerror(errno));
+        return -1;
+    }
+    return 0;
 }
 /**
- * 添加buf
+ * @brief 读取socket追加到readBuf末尾，二进制安全。 IO线程会调用，不能访问全局状态
+ *
+ * @param [in] c
+ * @return ssize_t read的返回值
  */
-void addWriteBuf(redisClient* client, char* buf, size_t len)
+ssize_t clientReadFromSocket(redisClient* c)
 {
-    sdscatlen(client->writeBuf, buf, len);
+    rio r;
+    rioInitWithFD(&r, c->fd);
+    c->readBuf = sdsMakeRoomFor(c->readBuf, REDIS_IOBUF_LEN);
+    ssize_t nread = rioRead(&r, c->readBuf + sdslen(c->readBuf), REDIS_IOBUF_LEN);
+    if (nread > 0)
+        sdsIncrLen(c->readBuf, nread);
+    return nread;
 }
 /**
  * @brief 设置client待关闭位。取消epoll
@@ -100,13 +209,30 @@ void freeClient(redisClient* client)
     if (!client)
         return;
     log_debug("free client %d", client->fd);
-    // 确保epoll fd释放
-    aeDeleteFileEvent(server->eventLoop, client->fd, AE_READABLE);
-    aeDeleteFileEvent(server->eventLoop, client->fd, AE_WRITABLE);
-    close(client->fd);
+    ioThreadsUnlinkClient(client);
+    aofUnlinkClient(client);
+    shardUnlinkClient(client);
+    // 确保epoll fd释放, 伪客户端没有fd
+    if (client->fd != -1)
+    {
+        aeDeleteFileEvent(server->eventLoop, client->fd, AE_READABLE);
+        aeDeleteFileEvent(server->eventLoop, client->fd, AE_WRITABLE);
+        close(client->fd);
+    }
+
+    // 从服务器和主断开: 复制ID、offset还在，slaveCron重连后PSYNC续传
+    if (server->master == client)
+        server->master = NULL;
 
     sdsfree(client->readBuf);
-    sdsfree(client->writeBuf);
+    sdsfree(client->propagateCmd);
+    sdsfree(client->replPending);
+    if (client->replRdbFd != -1)
+        close(client->replRdbFd);
+    replyListFree(&client->reply);
+    respReqParserFree(&client->reqParser);
+    free(client->argv);
+    free(client->argvlen);
     free(client);
 }
 
@@ -123,24 +249,20 @@ void readToReadBuf(redisClient* client)
     ssize_t n;
 
     sdsclear(client->readBuf);
-    log_debug(" 0000000011 %d", sdslen(server->master->writeBuf));
 
     printf("\n to read buf\n");
     while (1) {
         // 没必要RIO，
         n = read(client->fd, temp_buf, sizeof(temp_buf));
-        log_debug(" 0000000021 %d", sdslen(server->master->writeBuf));
 
         if (n <= 0) {
             log_error("read failed or finished %s", strerror(errno));
             if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
             return;
         }
-        sdscatlen(client->readBuf, temp_buf, n);
-        log_debug(" 0000000031 %d", sdslen(server->master->writeBuf));
+        client->readBuf = sdscatlen(client->readBuf, temp_buf, n);
 
-        ssize_t resp_len = getRespLength(client->readBuf->buf, sdslen(client->readBuf));
-        log_debug(" 0000000041 %d", sdslen(server->master->writeBuf));
+        ssize_t resp_len = getRespLength(client->readBuf, sdslen(client->readBuf));
         
         if (resp_len != -1) {
             // 读到一个RESP协议
@@ -148,12 +270,52 @@ void readToReadBuf(redisClient* client)
             break;
         }
     }
-    printf("\nread buf finished,  %s\n", client->readBuf->buf);
+    printf("\nread buf finished,  %s\n", client->readBuf);
 }
+/**
+ * @brief 当前命令的原始RESP加入事务队列
+ * 
+ * @param [in] c 
+ */
 void clientMultiAdd(redisClient* c)
 {
-    sds* cmd = c->multcmds[c->multiCmdCount];
-    sdsclear(cmd);
-    sdscatsds(cmd, c->readBuf);
+    sds* cmd = &c->multcmds[c->multiCmdCount];
+    *cmd = sdscpylen(*cmd, c->rawCmd, c->rawCmdLen);
     c->multiCmdCount++;
 }
+
+/**
+ * @brief 解析器得到一条完整命令后，设置client的参数视图。 不拷贝参数
+ * 
+ * @param [in] c 
+ * @param [in] p 
+ * @param [in] buf 解析器偏移所相对的缓冲区
+ */
+void clientSetArgv(redisClient* c, respReqParser* p, const char* buf)
+{
+    if (p->argc > c->argvcap)
+    {
+        c->argv = realloc(c->argv, sizeof(char*) * p->argc);
+        c->argvlen = realloc(c->argvlen, sizeof(size_t) * p->argc);
+        c->argvcap = p->argc;
+    }
+    for (int i = 0; i < p->argc; i++)
+    {
+        c->argv[i] = (char*)buf + p->argvoff[i];
+        c->argvlen[i] = p->argvlen[i];
+    }
+    c->argc = p->argc;
+    c->rawCmd = buf + p->cmdstart;
+    c->rawCmdLen = p->pos - p->cmdstart;
+}
+
+/**
+ * @brief 第i个参数是否等于s（忽略大小写）
+ * 
+ * @return int 
+ */
+int clientArgIs(redisClient* c, int i, const char* s)
+{
+    size_t len = strlen(s);
+    return i < c->argc && c->argvlen[i] == len && strncasecmp(c->argv[i], s, len) == 0;
+}
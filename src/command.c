@@ -0,0 +1,133 @@
+/**
+ * 命令分派表
+ *  命令名 -> redisCommand, 大小写不敏感，O(1)查找。
+ *  角色相关的权限检查在构建时预先计算到每个槽上。
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "command.h"
+#include "redis.h"
+#include "client.h"
+#include "log.h"
+
+static inline unsigned char _lower(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/**
+ * @brief FNV-1a, 按小写处理
+ *
+ * @param [in] name
+ * @param [in] len
+ * @return unsigned int
+ */
+unsigned int commandNameHash(const char* name, size_t len)
+{
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= _lower((unsigned char)name[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief 预计算: 当前服务器角色下，该命令拒绝哪些客户端
+ *
+ * @param [in] cmd
+ * @param [in] serverFlags
+ * @return int REDIS_CLIENT_*
+ */
+static int _rejectClientFlags(const redisCommand* cmd, int serverFlags)
+{
+    int reject = 0;
+    if ((serverFlags & REDIS_CLUSTER_SLAVE) && (cmd->flags & CMD_WRITE)) {
+        // 从服务器不支持来自普通客户端的写命令
+        reject |= REDIS_CLIENT_NORMAL;
+    }
+    return reject;
+}
+
+/**
+ * @brief 由命令数组构建分派表
+ *
+ * @param [in] cmds 命令数组，表只引用不拷贝，生命周期需长于表
+ * @param [in] n
+ * @param [in] serverFlags 服务器角色 REDIS_CLUSTER_*
+ * @return commandTable*
+ */
+commandTable* commandTableCreate(redisCommand* cmds, int n, int serverFlags)
+{
+    commandTable* t = malloc(sizeof(commandTable));
+    unsigned long size = 4;
+    while (size < (unsigned long)n * 2) size <<= 1;
+    t->size = size;
+    t->sizemask = size - 1;
+    t->used = 0;
+    t->slots = calloc(size, sizeof(commandTableEntry));
+
+    for (int i = 0; i < n; i++) {
+        redisCommand* cmd = &cmds[i];
+        size_t len = strlen(cmd->name);
+        if (commandTableFind(t, cmd->name, len) != NULL) {
+            log_warn("duplicate command %s ignored", cmd->name);
+            continue;
+        }
+        unsigned int h = commandNameHash(cmd->name, len);
+        unsigned long idx = h & t->sizemask;
+        while (t->slots[idx].cmd != NULL) {
+            idx = (idx + 1) & t->sizemask;
+        }
+        t->slots[idx].cmd = cmd;
+        t->slots[idx].namelen = len;
+        t->slots[idx].hash = h;
+        t->slots[idx].rejectClientFlags = _rejectClientFlags(cmd, serverFlags);
+        t->used++;
+    }
+    return t;
+}
+
+void commandTableRelease(commandTable* t)
+{
+    if (t == NULL) return;
+    free(t->slots);
+    free(t);
+}
+
+/**
+ * @brief 查找命令。 装载率不超过1/2，探测一定会遇到空槽结束
+ *
+ * @param [in] t
+ * @param [in] name 命令名视图
+ * @param [in] len
+ * @return commandTableEntry* 找不到返回NULL
+ */
+commandTableEntry* commandTableFind(const commandTable* t, const char* name, size_t len)
+{
+    unsigned int h = commandNameHash(name, len);
+    unsigned long idx = h & t->sizemask;
+    commandTableEntry* e;
+    while ((e = &t->slots[idx])->cmd != NULL) {
+        if (e->hash == h && e->namelen == len && strncasecmp(e->cmd->name, name, len) == 0) {
+            return e;
+        }
+        idx = (idx + 1) & t->sizemask;
+    }
+    return NULL;
+}
+
+/**
+ * @brief arity > 0 参数个数必须相等；arity < 0 至少-arity个
+ *
+ * @param [in] cmd
+ * @param [in] argc 包含命令名
+ * @return int 满足返回1
+ */
+int commandCheckArity(const redisCommand* cmd, int argc)
+{
+    if (cmd->arity > 0)
+        return argc == cmd->arity;
+    return argc >= -cmd->arity;
+}
@@ -0,0 +1,606 @@
+/**
+ * @file config.c
+ * @brief 配置表: 启动时解析一次配置文件，CONFIG GET/SET/REWRITE读写内存中的配置
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "config.h"
+#include "redis.h"
+#include "aof.h"
+#include "rdb.h"
+#include "repli.h"
+#include "evict.h"
+#include "iothread.h"
+#include "shard.h"
+#include "zmalloc.h"
+#include "robj.h"
+#include "resp.h"
+#include "log.h"
+#include "util.h"
+
+#define serverField(type, cfg) ((type*)((char*)server + (cfg)->offset))
+
+#define SAVE_PARAMS_MAX 16  // save最多的条件数
+
+/* ---------------- SPECIAL ---------------- */
+
+#define ROLE_FLAGS (REDIS_CLUSTER_MASTER | REDIS_CLUSTER_SLAVE | REDIS_CLUSTER_SENTINEL)
+
+static int setRole(const char* val)
+{
+    int role;
+    if (!strcasecmp(val, "master"))
+        role = REDIS_CLUSTER_MASTER;
+    else if (!strcasecmp(val, "slave"))
+        role = REDIS_CLUSTER_SLAVE;
+    else if (!strcasecmp(val, "sentinel"))
+        role = REDIS_CLUSTER_SENTINEL;
+    else
+        return -1;
+    server->flags = (server->flags & ~ROLE_FLAGS) | role;
+    return 0;
+}
+
+static sds getRole(void)
+{
+    if (server->flags & REDIS_CLUSTER_MASTER) return sdsnew("master");
+    if (server->flags & REDIS_CLUSTER_SENTINEL) return sdsnew("sentinel");
+    if (server->flags & REDIS_CLUSTER_SLAVE) return sdsnew("slave");
+    return sdsempty();
+}
+
+static int setConsistency(const char* val)
+{
+    if (!strcasecmp(val, "aof")) {
+        server->aofOn = true;
+        server->rdbOn = false;
+    } else if (!strcasecmp(val, "rdb")) {
+        server->aofOn = false;
+        server->rdbOn = true;
+    } else if (!strcasecmp(val, "none")) {
+        server->aofOn = false;
+        server->rdbOn = false;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static sds getConsistency(void)
+{
+    return sdsnew(server->aofOn ? "aof" : server->rdbOn ? "rdb" : "none");
+}
+
+/* host:port，也接受host,port */
+static int setMaster(const char* val)
+{
+    const char* sep = strpbrk(val, ":,");
+    long port;
+    if (sep == NULL || sep == val || !string2long(sep + 1, &port) || port <= 0 || port > 65535)
+        return -1;
+    server->masterhost = strndup(val, sep - val);
+    server->masterport = port;
+    return 0;
+}
+
+static sds getMaster(void)
+{
+    if (server->masterhost == NULL) return sdsempty();
+    char buf[REDIS_MAX_STRING];
+    snprintf(buf, sizeof(buf), "%s:%d", server->masterhost, server->masterport);
+    return sdsnew(buf);
+}
+
+/* save "秒 修改数 秒 修改数 ..."，空字符串表示不自动BGSAVE */
+static int setSave(const char* val)
+{
+    struct saveparam params[SAVE_PARAMS_MAX];
+    int n = 0;
+    char* copy = strdup(val);
+    char* saveptr = NULL;
+    char* sec = strtok_r(copy, " ", &saveptr);
+    while (sec != NULL) {
+        char* changes = strtok_r(NULL, " ", &saveptr);
+        long s, c;
+        if (changes == NULL || n == SAVE_PARAMS_MAX ||
+            !string2long(sec, &s) || !string2long(changes, &c) || s < 1 || c < 0 || c > INT_MAX) {
+            free(copy);
+            return -1;
+        }
+        params[n].seconds = s;
+        params[n].changes = c;
+        n++;
+        sec = strtok_r(NULL, " ", &saveptr);
+    }
+    free(copy);
+    free(server->saveParams);
+    server->saveParams = n ? malloc(sizeof(struct saveparam) * n) : NULL;
+    if (n) memcpy(server->saveParams, params, sizeof(struct saveparam) * n);
+    server->saveCondSize = n;
+    return 0;
+}
+
+static sds getSave(void)
+{
+    sds s = sdsempty();
+    for (int i = 0; i < server->saveCondSize; i++) {
+        char buf[64];
+        int n = snprintf(buf, sizeof(buf), "%s%ld %d", i ? " " : "",
+                         (long)server->saveParams[i].seconds, server->saveParams[i].changes);
+        s = sdscatlen(s, buf, n);
+    }
+    return s;
+}
+
+/* ---------------- apply ---------------- */
+
+/* 按LRU/LFU淘汰时每个值需要自己的访问信息，之后创建的整数对象不再共享 */
+static void applyMaxmemoryPolicy(void)
+{
+    robjSetShareIntegers(!(server->maxmemory && policyUsesObjectAccess(server->maxmemoryPolicy)));
+}
+
+static void applyMaxmemory(void)
+{
+    applyMaxmemoryPolicy();
+    if (server->maxmemory && zmallocUsedMemory() > server->maxmemory) {
+        log_warn("WARNING: the new maxmemory value set via CONFIG SET (%llu) is smaller than the current memory usage (%zu)",
+                 server->maxmemory, zmallocUsedMemory());
+        performEvictions();
+    }
+}
+
+static void applyCompressThreshold(void)
+{
+    robjSetCompressThreshold(server->valueCompressThreshold);
+}
+
+/* ---------------- 配置表 ---------------- */
+
+#define createBoolConfig(name, flags, field, dflt, apply) \
+    {name, CONFIG_BOOL, flags, offsetof(struct redisServer, field), dflt, 0, 0, NULL, NULL, NULL, NULL, apply}
+#define createIntConfig(name, flags, field, dflt, min, max, apply) \
+    {name, CONFIG_INT, flags, offsetof(struct redisServer, field), dflt, min, max, NULL, NULL, NULL, NULL, apply}
+#define createMemoryConfig(name, flags, field, dflt, apply) \
+    {name, CONFIG_MEMORY, flags, offsetof(struct redisServer, field), dflt, 0, 0, NULL, NULL, NULL, NULL, apply}
+#define createEnumConfig(name, flags, field, dflt, from, to, apply) \
+    {name, CONFIG_ENUM, flags, offsetof(struct redisServer, field), dflt, 0, 0, from, to, NULL, NULL, apply}
+#define createStringConfig(name, flags, field, dflt) \
+    {name, CONFIG_STRING, flags, offsetof(struct redisServer, field), dflt, 0, 0, NULL, NULL, NULL, NULL, NULL}
+#define createSpecialConfig(name, flags, dflt, set, get) \
+    {name, CONFIG_SPECIAL, flags, 0, dflt, 0, 0, NULL, NULL, set, get, NULL}
+
+// 顺序和default.conf相同，CONFIG GET按这个顺序回复。 解析在zmallocInit之前，只使用libc分配
+static standardConfig configs[] = {
+    createEnumConfig("allocator", CONFIG_IMMUTABLE, allocator, "slab", zmallocModeFromString, zmallocModeToString, NULL),
+    createMemoryConfig("arena-size", CONFIG_IMMUTABLE, arenaSize, "4gb", NULL),
+    createSpecialConfig("role", CONFIG_IMMUTABLE, "master", setRole, getRole),
+    createIntConfig("port", CONFIG_IMMUTABLE, port, "6666", 0, 65535, NULL),
+    createIntConfig("dbnum", CONFIG_IMMUTABLE, dbnum, "16", 1, INT_MAX, NULL),
+    createStringConfig("aof_file", CONFIG_IMMUTABLE, aofFileName, "data/appendonly.aof"),
+    createStringConfig("rdb_file", CONFIG_IMMUTABLE, rdbFileName, "data/dump.rdb"),
+    createSpecialConfig("consistency", CONFIG_IMMUTABLE, "none", setConsistency, getConsistency),
+    createSpecialConfig("save", 0, "900 1 300 10000 10 1", setSave, getSave),
+    createIntConfig("rdb-load-threads", 0, rdbLoadThreads, "1", 1, RDB_LOAD_THREADS_MAX, NULL),
+    createBoolConfig("rdbcompression", 0, rdbCompression, "yes", NULL),
+    createMemoryConfig("value-compress-threshold", 0, valueCompressThreshold, "0", applyCompressThreshold),
+    createEnumConfig("appendfsync", 0, aofFsync, "everysec", aofFsyncPolicyFromString, aofFsyncPolicyToString, aofFsyncPolicyChanged),
+    createIntConfig("auto-aof-rewrite-percentage", 0, aofRewritePerc, "100", 0, INT_MAX, NULL),
+    createMemoryConfig("auto-aof-rewrite-min-size", 0, aofRewriteMinSize, "64mb", NULL),
+    createBoolConfig("aof-load-truncated", 0, aofLoadTruncated, "yes", NULL),
+    createBoolConfig("activerehashing", 0, activerehashing, "yes", NULL),
+    createIntConfig("io-threads", CONFIG_IMMUTABLE, ioThreadsNum, "1", 1, IO_THREADS_MAX, NULL),
+    createIntConfig("shards", CONFIG_IMMUTABLE, shardsNum, "1", 1, SHARDS_MAX, NULL),
+    createMemoryConfig("maxmemory", 0, maxmemory, "0", applyMaxmemory),
+    createEnumConfig("maxmemory-policy", 0, maxmemoryPolicy, "noeviction", maxmemoryPolicyFromString, maxmemoryPolicyToString, applyMaxmemoryPolicy),
+    createIntConfig("maxmemory-samples", 0, maxmemorySamples, "5", 1, INT_MAX, NULL),
+    createIntConfig("lfu-log-factor", 0, lfuLogFactor, "10", 0, INT_MAX, NULL),
+    createIntConfig("lfu-decay-time", 0, lfuDecayTime, "1", 0, INT_MAX, NULL),
+    createSpecialConfig("master", CONFIG_IMMUTABLE, NULL, setMaster, getMaster),
+    createMemoryConfig("repl-backlog-size", 0, replBacklogSize, "1mb", resizeReplicationBacklog),
+    createBoolConfig("repl-diskless-sync", 0, replDisklessSync, "no", NULL),
+    createIntConfig("repl-diskless-sync-delay", 0, replDisklessSyncDelay, "5", 0, INT_MAX, NULL),
+    createStringConfig("repl_state_file", CONFIG_IMMUTABLE, replStateFileName, NULL),
+    createStringConfig("monitor", CONFIG_IMMUTABLE, sentinelMonitor, NULL),
+};
+
+#define CONFIGS_NUM ((int)(sizeof(configs) / sizeof(configs[0])))
+
+static standardConfig* lookupConfig(const char* name)
+{
+    for (int i = 0; i < CONFIGS_NUM; i++) {
+        if (!strcasecmp(configs[i].name, name)) return &configs[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief 解析val并写入配置项对应的字段。 失败时字段保持原值
+ *
+ * @param [in] cfg
+ * @param [in] val
+ * @param [out] err 失败原因
+ * @return int 成功返回0
+ */
+static int configParse(standardConfig* cfg, const char* val, const char** err)
+{
+    switch (cfg->type) {
+    case CONFIG_BOOL:
+        if (!strcasecmp(val, "yes"))
+            *serverField(int, cfg) = 1;
+        else if (!strcasecmp(val, "no"))
+            *serverField(int, cfg) = 0;
+        else {
+            *err = "argument must be 'yes' or 'no'";
+            return -1;
+        }
+        return 0;
+    case CONFIG_INT: {
+        long v;
+        if (!string2long(val, &v)) {
+            *err = "argument couldn't be parsed into an integer";
+            return -1;
+        }
+        if (v < cfg->min || v > cfg->max) {
+            *err = "argument out of range";
+            return -1;
+        }
+        *serverField(int, cfg) = v;
+        return 0;
+    }
+    case CONFIG_MEMORY: {
+        unsigned long long v;
+        if (!memtoull(val, &v)) {
+            *err = "argument must be a memory value";
+            return -1;
+        }
+        *serverField(unsigned long long, cfg) = v;
+        return 0;
+    }
+    case CONFIG_ENUM: {
+        int v = cfg->fromString(val);
+        if (v < 0) {
+            *err = "argument must be one of the allowed values";
+            return -1;
+        }
+        *serverField(int, cfg) = v;
+        return 0;
+    }
+    case CONFIG_STRING: {
+        char** field = serverField(char*, cfg);
+        free(*field);
+        *field = strdup(val);
+        return 0;
+    }
+    case CONFIG_SPECIAL:
+        if (cfg->set(val) != 0) {
+            *err = "invalid argument";
+            return -1;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+/* 内存大小按能整除的最大单位输出，写回配置文件时更易读 */
+static sds memoryToString(unsigned long long v)
+{
+    static const char* units[] = {"gb", "mb", "kb"};
+    char buf[32];
+    for (int i = 0; i < 3; i++) {
+        unsigned long long unit = 1ULL << (10 * (3 - i));
+        if (v != 0 && v % unit == 0) {
+            snprintf(buf, sizeof(buf), "%llu%s", v / unit, units[i]);
+            return sdsnew(buf);
+        }
+    }
+    snprintf(buf, sizeof(buf), "%llu", v);
+    return sdsnew(buf);
+}
+
+/**
+ * @brief 配置项的当前值
+ *
+ * @param [in] cfg
+ * @param [in] units 内存大小带单位输出
+ * @return sds
+ */
+static sds configGetString(standardConfig* cfg, bool units)
+{
+    char buf[32];
+    switch (cfg->type) {
+    case CONFIG_BOOL:
+        return sdsnew(*serverField(int, cfg) ? "yes" : "no");
+    case CONFIG_INT:
+        snprintf(buf, sizeof(buf), "%d", *serverField(int, cfg));
+        return sdsnew(buf);
+    case CONFIG_MEMORY:
+        if (units) return memoryToString(*serverField(unsigned long long, cfg));
+        snprintf(buf, sizeof(buf), "%llu", *serverField(unsigned long long, cfg));
+        return sdsnew(buf);
+    case CONFIG_ENUM:
+        return sdsnew(cfg->toString(*serverField(int, cfg)));
+    case CONFIG_STRING: {
+        char* s = *serverField(char*, cfg);
+        return s ? sdsnew(s) : sdsempty();
+    }
+    case CONFIG_SPECIAL:
+        return cfg->get();
+    }
+    return sdsempty();
+}
+
+static bool configIsDefault(standardConfig* cfg, sds val)
+{
+    if (cfg->defaultValue == NULL) return sdslen(val) == 0;
+    if (cfg->type == CONFIG_MEMORY) {
+        unsigned long long a, b;
+        return memtoull(cfg->defaultValue, &a) && memtoull(val, &b) && a == b;
+    }
+    return strcasecmp(cfg->defaultValue, val) == 0;
+}
+
+/* 去掉首尾空白，返回新的起点 */
+static char* trim(char* s)
+{
+    while (*s == ' ' || *s == '\t') s++;
+    char* end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) end--;
+    *end = '\0';
+    return s;
+}
+
+/**
+ * @brief 拆分配置行key=value，就地修改line
+ *
+ * @return int 注释、空行、没有'='返回0
+ */
+static int splitConfigLine(char* line, char** key, char** val)
+{
+    char* s = trim(line);
+    if (*s == '\0' || *s == '#') return 0;
+    char* eq = strchr(s, '=');
+    if (eq == NULL) return 0;
+    *eq = '\0';
+    *key = trim(s);
+    *val = trim(eq + 1);
+    return 1;
+}
+
+/**
+ * @brief 启动时读取配置文件，所有配置项先取默认值，再按文件中的值覆盖。 之后不再读文件
+ *
+ * @param [in] filename
+ * @return int 打不开文件返回-1
+ */
+int loadServerConfig(const char* filename)
+{
+    const char* err;
+    for (int i = 0; i < CONFIGS_NUM; i++) {
+        if (configs[i].defaultValue && configParse(&configs[i], configs[i].defaultValue, &err) != 0) {
+            log_error("Bad default value of config '%s': %s", configs[i].name, err);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    FILE* f = fopen(filename, "r");
+    if (f == NULL) {
+        log_error("Open config file failed. %s, %s", filename, strerror(errno));
+        return -1;
+    }
+    char line[CONFIG_MAX_LINE];
+    int linenum = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        linenum++;
+        char *key, *val;
+        if (!splitConfigLine(line, &key, &val)) continue;
+        standardConfig* cfg = lookupConfig(key);
+        if (cfg == NULL) {
+            log_warn("Unknown config '%s' at line %d of %s", key, linenum, filename);
+            continue;
+        }
+        if (configParse(cfg, val, &err) != 0) {
+            log_warn("Invalid %s '%s' at line %d: %s, use default %s",
+                     key, val, linenum, err, cfg->defaultValue ? cfg->defaultValue : "");
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/**
+ * @brief CONFIG SET: 修改内存中的配置并立即生效，不写文件
+ *
+ * @param [in] name
+ * @param [in] value
+ * @param [out] err 失败原因
+ * @return int 成功返回0
+ */
+int configSetValue(const char* name, const char* value, const char** err)
+{
+    standardConfig* cfg = lookupConfig(name);
+    if (cfg == NULL) {
+        *err = "Unknown option";
+        return -1;
+    }
+    if (cfg->flags & CONFIG_IMMUTABLE) {
+        *err = "can't set immutable config";
+        return -1;
+    }
+    if (configParse(cfg, value, err) != 0)
+        return -1;
+    if (cfg->apply)
+        cfg->apply();
+    return 0;
+}
+
+/**
+ * @brief CONFIG REWRITE: 把当前配置写回配置文件。 保留注释、行的顺序和不认识的行，
+ *  已有的配置项原地替换(重复的只保留第一处)，文件中没有、且不是默认值的追加到末尾。
+ *  先写临时文件并fsync，再rename替换
+ *
+ * @param [in] filename
+ * @return int 失败返回-1，errno为原因
+ */
+int configRewrite(const char* filename)
+{
+    bool seen[CONFIGS_NUM];
+    memset(seen, 0, sizeof(seen));
+    sds out = sdsempty();
+
+    FILE* in = fopen(filename, "r");
+    if (in == NULL && errno != ENOENT) {
+        sdsfree(out);
+        return -1;
+    }
+    char line[CONFIG_MAX_LINE];
+    char copy[CONFIG_MAX_LINE];
+    while (in && fgets(line, sizeof(line), in) != NULL) {
+        memcpy(copy, line, sizeof(line));
+        char *key, *val;
+        standardConfig* cfg = splitConfigLine(copy, &key, &val) ? lookupConfig(key) : NULL;
+        if (cfg == NULL) {
+            out = sdscat(out, line);
+            if (line[strlen(line) - 1] != '\n') out = sdscatlen(out, "\n", 1);
+            continue;
+        }
+        int i = cfg - configs;
+        if (seen[i]) continue;
+        seen[i] = true;
+        sds v = configGetString(cfg, true);
+        out = sdscat(out, cfg->name);
+        out = sdscatlen(out, "=", 1);
+        out = sdscatsds(out, v);
+        out = sdscatlen(out, "\n", 1);
+        sdsfree(v);
+    }
+    if (in) fclose(in);
+    for (int i = 0; i < CONFIGS_NUM; i++) {
+        if (seen[i]) continue;
+        sds v = configGetString(&configs[i], true);
+        if (!configIsDefault(&configs[i], v)) {
+            out = sdscat(out, configs[i].name);
+            out = sdscatlen(out, "=", 1);
+            out = sdscatsds(out, v);
+            out = sdscatlen(out, "\n", 1);
+        }
+        sdsfree(v);
+    }
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp-%d", filename, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        sdsfree(out);
+        return -1;
+    }
+    size_t off = 0;
+    while (off < sdslen(out)) {
+        ssize_t n = write(fd, out + off, sdslen(out) - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        off += n;
+    }
+    int saved;
+    if (off < sdslen(out) || fsync(fd) == -1 || close(fd) == -1 || rename(tmp, filename) == -1) {
+        saved = errno;
+        unlink(tmp);
+        sdsfree(out);
+        errno = saved;
+        return -1;
+    }
+    sdsfree(out);
+    return 0;
+}
+
+static char* argDup(redisClient* c, int i)
+{
+    return strndup(c->argv[i], c->argvlen[i]);
+}
+
+static sds addBulk(sds s, const char* p, size_t len)
+{
+    char hdr[32];
+    int n = snprintf(hdr, sizeof(hdr), "$%zu\r\n", len);
+    s = sdscatlen(s, hdr, n);
+    s = sdscatlen(s, p, len);
+    return sdscatlen(s, "\r\n", 2);
+}
+
+/**
+ * @brief CONFIG GET pattern: 名字匹配glob模式的配置项，回复[名字, 值, ...]
+ *
+ * @param [in] c
+ */
+void configGetCommand(redisClient* c)
+{
+    // 配置名都是小写
+    char* pattern = argDup(c, 2);
+    for (char* p = pattern; *p; p++) *p = tolower((unsigned char)*p);
+    sds body = sdsempty();
+    int matched = 0;
+    for (int i = 0; i < CONFIGS_NUM; i++) {
+        if (fnmatch(pattern, configs[i].name, 0) != 0) continue;
+        sds v = configGetString(&configs[i], false);
+        body = addBulk(body, configs[i].name, strlen(configs[i].name));
+        body = addBulk(body, v, sdslen(v));
+        sdsfree(v);
+        matched++;
+    }
+    free(pattern);
+    char hdr[32];
+    int n = snprintf(hdr, sizeof(hdr), "*%d\r\n", matched * 2);
+    sds reply = sdscatsds(sdsnewlen(hdr, n), body);
+    sdsfree(body);
+    addWriteSds(c, reply);
+}
+
+/**
+ * @brief CONFIG SET name value. 分片模式下每个分片有自己的server副本，不支持
+ *
+ * @param [in] c
+ */
+void configSetCommand(redisClient* c)
+{
+    if (server->shardsNum > 1) {
+        addWrite(c, resp.shardsUnsupported);
+        return;
+    }
+    char* name = argDup(c, 2);
+    char* value = argDup(c, 3);
+    const char* err;
+    if (configSetValue(name, value, &err) == 0) {
+        log_info("CONFIG SET %s %s", name, value);
+        addWrite(c, resp.ok);
+    } else {
+        char buf[CONFIG_MAX_LINE];
+        int n = snprintf(buf, sizeof(buf), "-ERR CONFIG SET failed (possibly related to argument '%.128s') - %s\r\n",
+                         name, err);
+        addWriteBuf(c, buf, n);
+    }
+    free(name);
+    free(value);
+}
+
+void configRewriteCommand(redisClient* c)
+{
+    if (configRewrite(server->configfile) == 0) {
+        log_info("CONFIG REWRITE executed with success");
+        addWrite(c, resp.ok);
+    } else {
+        char buf[CONFIG_MAX_LINE];
+        int n = snprintf(buf, sizeof(buf), "-ERR Rewriting config file: %s\r\n", strerror(errno));
+        addWriteBuf(c, buf, n);
+        log_warn("CONFIG REWRITE failed: %s", strerror(errno));
+    }
+}
@@ -3,6 +3,7 @@
  * 键: sds字符串
  * 值：robj对象， long整数
  */
+#include <string.h>
 #include "typedefs.h"
 #include  "db.h"
 
@@ -10,20 +11,16 @@
 #include "sds.h"
 #include "robj.h"
 #include "log.h"
+#include "redis.h"
+#include "evict.h"
 
 static unsigned long dbDictKeyHash(const void *key) {
-    unsigned long hash = 5381;
-    sds* s = (sds*) key;
-    const char *str = s->buf;
-    while (*str) {
-        hash = ((hash << 5) + hash) + *str; // hash * 33 + c
-        str++;
-    }
-    return hash;
+    sds s = (sds) key;
+    return dictGenHashFunction(s, sdslen(s));
 }
 static void dbDictKeyfree(void* data, void* key)
 {
-    sdsfree((sds*)key);
+    sdsfree((sds)key);
 }
 
 static void dbDictValfreeRobj(void* data, void* obj)
@@ -32,7 +29,12 @@ static void dbDictValfreeRobj(void* data, void* obj)
 }
 static int dbDictKeyCmp(void* data, const void* key1, const void* key2)
 {
-    return sdscmp((sds*)key1, (sds*)key2);
+    return sdscmp((sds)key1, (sds)key2);
+}
+static int dbDictKeyCmpView(void* data, const void* key, const char* buf, size_t len)
+{
+    sds s = (sds)key;
+    return sdslen(s) == len && memcmp(s, buf, len) == 0 ? 0 : 1;
 }
 static void dbDictValfreelist(void* data, void* obj)
 {
@@ -41,22 +43,27 @@ static void dbDictValfreelist(void* data, void* obj)
 dictType kvtype = {
     .hashFunction =  dbDictKeyHash,
     .keyCompare = dbDictKeyCmp,
+    .keyCompareView = dbDictKeyCmpView,
     .valDup = NULL,
     .keyDup = NULL,
     .keyDestructor = dbDictKeyfree,
     .valDestructor = dbDictValfreeRobj,
+    .engine = DICT_ENGINE_SWISS,
 };
 dictType expiretype = {
     .hashFunction =  dbDictKeyHash,
     .keyCompare = dbDictKeyCmp,
+    .keyCompareView = dbDictKeyCmpView,
     .valDup = NULL,
     .keyDup = NULL,
     .keyDestructor = dbDictKeyfree,
     .valDestructor = NULL,
+    .engine = DICT_ENGINE_SWISS,
 };
 dictType watchtype = {
     .hashFunction =  dbDictKeyHash,
     .keyCompare = dbDictKeyCmp,
+    .keyCompareView = dbDictKeyCmpView,
     .valDup = NULL,
     .keyDup = NULL,
     .keyDestructor = dbDictKeyfree,
@@ -78,76 +85,167 @@ void dbFree(redisDb* db)
     free(db);
 }
 
+/**
+ * @brief 清空数据库的键和过期时间，全量同步加载主的RDB之前调用。 监视的键保留
+ *
+ * @param [in] db
+ */
 void dbClear(redisDb* db)
 {
     dictRelease(db->kv);
-    db->kv = NULL;
+    dictRelease(db->expires);
+    db->kv = dictCreate(&kvtype, NULL);
+    db->expires = dictCreate(&expiretype, NULL);
 }
 
 /**
  * @param db
- * @param key sds对象
+ * @param key sds对象，由数据库接管。 键已存在时替换值、释放旧值，key被释放
  * @param value robj对象
  * @return
  */
-int dbAdd(redisDb* db, sds* key,void* value)
+int dbAdd(redisDb* db, sds key,void* value)
 {
     if (db == NULL || key == NULL) return DB_DICT_ERR;
+    objectInitAccess(value);
     if (!dictContains(db->kv, (void*)key))
     {
         return dictAdd(db->kv, (void*)key,(void*)value);
-    } else
-    {
-        return dictReplace(db->kv, (void*)key, (void*)value);
     }
-
-
+    int ret = dictReplace(db->kv, (void*)key, (void*)value);
+    sdsfree(key);
+    return ret;
 }
 
-void* dbGet(redisDb* db, sds* key)
+void* dbGet(redisDb* db, sds key)
 {
     if (db == NULL || key == NULL) return NULL;
     return dictFetchValue(db->kv, (void*)key);
 }
 
-int dbDelete(redisDb* db, sds* key)
+int dbDelete(redisDb* db, sds key)
 {
     if (db == NULL || key == NULL) return DB_DICT_ERR;
+    // 键删除后过期时间也失效，否则重新SET的键会被旧的过期时间删除
+    dictDelete(db->expires, (void*)key);
     return dictDelete(db->kv, (void*)key);
 }
-int dbSetExpire(redisDb *db, sds* key, long time)
+/* ---------------- 键视图API ----------------
+ * 命令处理中键来自argv，是指向readBuf的视图。 按视图查找、删除不需要构造sds，
+ * 视图的hash只计算一次，kv、expires、watched_keys共用。 只有插入新键时才分配sds
+ */
+
+void* dbLookupView(redisDb* db, const dictKeyView* key)
+{
+    dictEntry* de = dictFindByView(db->kv, key);
+    if (de == NULL) return NULL;
+    robj* o = de->v.val;
+    objectTouch(o);
+    return o;
+}
+
+/**
+ * @brief 设置键的值。 键已存在时原地替换值、释放旧值，不分配键
+ *
+ * @param [in] db
+ * @param [in] key
+ * @param [in] value robj对象，由数据库接管
+ * @return int 新插入返回1，覆盖返回0
+ */
+int dbSetView(redisDb* db, const dictKeyView* key, void* value)
+{
+    objectInitAccess(value);
+    dictEntry* de = dictFindByView(db->kv, key);
+    if (de)
+    {
+        robj* old = de->v.val;
+        de->v.val = value;
+        if (old && old != value) robjDestroy(old);
+        return 0;
+    }
+    dictAdd(db->kv, sdsnewlen(key->buf, key->len), value);
+    return 1;
+}
+
+int dbDeleteView(redisDb* db, const dictKeyView* key)
+{
+    dictDeleteByView(db->expires, key);
+    return dictDeleteByView(db->kv, key);
+}
+
+int dbSetExpireView(redisDb* db, const dictKeyView* key, long long when)
+{
+    dictEntry* de = dictFindByView(db->expires, key);
+    if (de == NULL)
+        de = dictAddRaw(db->expires, sdsnewlen(key->buf, key->len));
+    de->v.s64 = when;
+    return DICT_OK;
+}
+
+int dbRemoveExpireView(redisDb* db, const dictKeyView* key)
 {
-    return dictAdd(db->expires, (void*)key, (void*)time);
+    return dictDeleteByView(db->expires, key);
 }
+
 /**
  *  返回过期键剩余时间
  * @param db
  * @param key 过期键
- * @return
+ * @return 剩余毫秒数，没有设置过期返回-1
  */
-long dbGetTTL(redisDb *db, sds* key)
+long long dbGetTTLView(redisDb* db, const dictKeyView* key)
 {
-    long expireate = (long)dictFetchValue(db->expires, key);
-    return expireate - time(NULL);
+    dictEntry* de = dictFindByView(db->expires, key);
+    if (de == NULL) return -1;
+    long long ttl = de->v.s64 - server->mstime;
+    return ttl < 0 ? 0 : ttl;
 }
 
 /**
- * 惰性检查 key是否 国企删除
+ * 惰性检查 key是否过期删除. 使用事件循环每轮缓存的server->mstime，不需要系统调用
  * @param key key过期检查
+ * @return 过期删除返回1
  */
-void expireIfNeed(redisDb* db, sds* key)
+int expireIfNeededView(redisDb* db, const dictKeyView* key)
 {
-    if (dictContains(db->expires, key))
-    {
-        long expire_at = (long)dictFetchValue(db->expires, key);
-        time_t now = time(NULL);
-        if (now > expire_at)
-        {
-            // 过期删除键。
-            if (dictDelete(db->kv, (void*)key) > 0 && dictDelete(db->expires, (void*)key) > 0)
-                log_debug("OK.Delete expire key  %s", key->buf);
-        }
-    }
+    dictEntry* de = dictFindByView(db->expires, key);
+    if (de == NULL || server->mstime <= de->v.s64)
+        return 0;
+    // 过期删除键。
+    dictDeleteByView(db->kv, key);
+    dictDeleteByView(db->expires, key);
+    log_debug("OK.Delete expire key  %.*s", (int)key->len, key->buf);
+    return 1;
+}
+
+/**
+ * @brief 设置过期时间，已有过期时间则覆盖。 过期时间存在expires entry的s64中
+ *
+ * @param [in] db
+ * @param [in] key 拷贝一份作为expires的键，调用方仍持有key
+ * @param [in] when 过期时刻，毫秒时间戳
+ * @return int
+ */
+int dbSetExpire(redisDb *db, sds key, long long when)
+{
+    dictEntry* de = dictFind(db->expires, key);
+    if (de == NULL)
+        de = dictAddRaw(db->expires, sdsnewlen(key, sdslen(key)));
+    de->v.s64 = when;
+    return DICT_OK;
+}
+
+/**
+ * @brief 过期时刻，毫秒时间戳
+ *
+ * @param [in] db
+ * @param [in] key
+ * @return long long 没有设置过期返回-1
+ */
+long long dbGetExpire(redisDb *db, sds key)
+{
+    dictEntry* de = dictFind(db->expires, key);
+    return de ? de->v.s64 : -1;
 }
 
 /**
@@ -156,21 +254,33 @@ void expireIfNeed(redisDb* db, sds* key)
  * @param key
  * @param client
  */
-void dbAddWatch(redisDb* db, sds* key, redisClient* client)
+void dbAddWatch(redisDb* db, const dictKeyView* key, redisClient* client)
 {
     list* clients;
-    if (!dictContains(db->watched_keys, key))
+    dictEntry* de = dictFindByView(db->watched_keys, key);
+    if (de == NULL)
     {
         clients = listCreate();
-        dictAdd(db->watched_keys, key, clients);
+        dictAdd(db->watched_keys, sdsnewlen(key->buf, key->len), clients);
+    }
+    else
+    {
+        clients = de->v.val;
     }
-    clients = dictFetchValue(db->watched_keys, key);
     listAddNodeTail(clients, listCreateNode(client));
 }
 
-int dbIsWatching(redisDb* db, sds* key)
+/**
+ * @brief 监视键的客户端链表
+ *
+ * @param [in] db
+ * @param [in] key
+ * @return list* 没有客户端监视返回NULL
+ */
+list* dbWatchingClients(redisDb* db, const dictKeyView* key)
 {
-    return dictContains(db->watched_keys, key);
+    dictEntry* de = dictFindByView(db->watched_keys, key);
+    return de ? de->v.val : NULL;
 }
 
 void dbPrint(redisDb* db)
@@ -3,13 +3,97 @@
  * 键值对：void*, void*
  * 字典类型：hash函数等必要
  *
- *
+ * 两种引擎，由dictType.engine选择，对外接口相同：
+ *  链式(DICT_ENGINE_CHAINED)：桶数组 + 单链表，每个键一次malloc。
+ *  swiss(DICT_ENGINE_SWISS)：开放寻址，15个槽位为一组，组头16个控制字节，
+ *      一次SIMD比较筛出组内可能命中的槽位，键值直接存在槽位里，没有额外的节点分配。
+ * 两种引擎都是渐进式rehash：扩缩容时新建ht[1]/st[1]，之后每次操作迁移一部分。
  */
 
+#include <time.h>
 #include "dict.h"
+#include "zmalloc.h"
 #include "log.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static uint32_t dict_hash_function_seed = 5381;
+
+/**
+ * @brief MurmurHash2, 按长度读取key，二进制安全
+ *
+ * @param [in] key
+ * @param [in] len
+ * @return unsigned int
+ */
+unsigned int dictGenHashFunction(const void *key, size_t len)
+{
+    const uint32_t m = 0x5bd1e995;
+    const int r = 24;
+    uint32_t h = dict_hash_function_seed ^ (uint32_t)len;
+    const unsigned char *data = (const unsigned char *)key;
+
+    while (len >= 4)
+    {
+        uint32_t k;
+        memcpy(&k, data, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h *= m;
+        h ^= k;
+        data += 4;
+        len -= 4;
+    }
+    switch (len)
+    {
+    case 3:
+        h ^= data[2] << 16;
+        /* fall through */
+    case 2:
+        h ^= data[1] << 8;
+        /* fall through */
+    case 1:
+        h ^= data[0];
+        h *= m;
+    }
+    h ^= h >> 13;
+    h *= m;
+    h ^= h >> 15;
+    return (unsigned int)h;
+}
 // ------------static-------------------//
 
+/**
+ * @brief 链式引擎的节点
+ */
+struct dictNode {
+    dictEntry entry;
+    struct dictNode *next;
+};
+
+static inline int dictIsSwiss(dict *dict)
+{
+    return dict->type->engine == DICT_ENGINE_SWISS;
+}
+
+/**
+ * @brief 查找时比较键。 view非NULL时按键视图比较，key不使用
+ *
+ * @param [in] dict
+ * @param [in] stored 表中的键
+ * @param [in] key
+ * @param [in] view
+ * @return int 相等返回1
+ */
+static inline int _dictKeyMatch(dict *dict, const void *stored, const void *key, const dictKeyView *view)
+{
+    if (view)
+        return dict->type->keyCompareView(dict->privdata, stored, view->buf, view->len) == 0;
+    return dict->type->keyCompare(dict->privdata, stored, key) == 0;
+}
+
 /**
  * @brief 设置entry的v
  *
@@ -28,6 +112,34 @@ static void dictSetVal(dict *dict, dictEntry *entry, const void *val)
         entry->v.val = val;
     }
 }
+
+/**
+ * @brief 设置entry的key
+ *
+ * @param [in] dict
+ * @param [in] entry
+ * @param [in] key
+ */
+static void dictSetKey(dict *dict, dictEntry *entry, const void *key)
+{
+    if (dict->type->keyDup)
+    {
+        entry->key = dict->type->keyDup(dict->privdata, key);
+    }
+    else
+    {
+        entry->key = key;
+    }
+}
+
+static void dictFreeEntry(dict *dict, dictEntry *entry)
+{
+    if (dict->type->keyDestructor && entry->key)
+        dict->type->keyDestructor(dict->privdata, entry->key);
+    if (dict->type->valDestructor && entry->v.val)
+        dict->type->valDestructor(dict->privdata, entry->v.val);
+}
+
 static void _dictReset(dictHT *ht)
 {
     ht->table = NULL;
@@ -38,22 +150,19 @@ static void _dictReset(dictHT *ht)
 
 static void _dictClear(dict *dict, dictHT *ht)
 {
-    for (int i = 0; i < ht->size && ht->used > 0; i++)
+    for (unsigned long i = 0; i < ht->size && ht->used > 0; i++)
     {
-        dictEntry *entry = ht->table[i];
-        while (entry)
+        dictNode *node = ht->table[i];
+        while (node)
         {
-            dictEntry *next = entry->next;
-            if (dict->type->keyDestructor && entry->key) 
-                dict->type->keyDestructor(dict->privdata, entry->key);
-            if (dict->type->valDestructor && entry->v.val)
-                dict->type->valDestructor(dict->privdata, entry->v.val);
-            free(entry);
-            entry = next;
+            dictNode *next = node->next;
+            dictFreeEntry(dict, &node->entry);
+            zfree(node);
+            node = next;
             ht->used--;
         }
     }
-    free(ht->table);
+    zfree(ht->table);
     _dictReset(ht);
 }
 /**
@@ -73,87 +182,63 @@ static unsigned long _nextpower(unsigned long n)
     return res;
 }
 
-static double _dictLoadFactor(dict *dict)
-{
-    return (double)dict->ht[0].used / (double)dict->ht[0].size;
-}
-
 int dictIsRehashing(dict *dict)
 {
     return dict->rehashidx != -1;
 }
 
 /**
- * @brief 设置entry的key
+ * @brief 渐进式rehash: 最多迁移n个桶，每个桶整条链表一起迁移。 最多访问n*10个空桶，控制单次耗时
  *
  * @param [in] dict
- * @param [in] entry
- * @param [in] key
+ * @param [in] n
+ * @return int 1表示还没迁移完
  */
-static void dictSetKey(dict *dict, dictEntry *entry, const void *key)
+static int _dictRehash(dict *dict, int n)
 {
-    if (dict->type->keyDup)
-    {
-        entry->key = dict->type->keyDup(dict->privdata, key);
-    }
-    else
+    int emptyVisits = n * 10;
+    while (n-- && dict->ht[0].used != 0)
     {
-        entry->key = key;
-    }
-}
-/**
- * @brief 渐进式rehash
- *
- * @param [in] dict
- */
-static void _dictRehashStep(dict *dict)
-{
+        // 跳过空桶，找到第一个非空桶。 used不为0，后面一定还有非空桶
+        while (dict->ht[0].table[dict->rehashidx] == NULL)
+        {
+            dict->rehashidx++;
+            if (--emptyVisits == 0) return 1;
+        }
 
-    // 跳过空桶，找到第一个非空桶
-    while (dict->rehashidx < dict->ht[0].size && dict->ht[0].table[dict->rehashidx] == NULL)
-    {
+        // 整个桶迁移到ht[1]
+        dictNode *node = dict->ht[0].table[dict->rehashidx];
+        while (node)
+        {
+            dictNode *next = node->next;
+            unsigned int h = dict->type->hashFunction(node->entry.key);
+            unsigned int idx = h & dict->ht[1].sizemask;
+            node->next = dict->ht[1].table[idx];
+            dict->ht[1].table[idx] = node;
+            dict->ht[0].used--;
+            dict->ht[1].used++;
+            node = next;
+        }
+        dict->ht[0].table[dict->rehashidx] = NULL;
         dict->rehashidx++;
     }
-    if (dict->rehashidx == dict->ht[0].size) {
-        // 找不到非空桶， 说明rehash完了。  按理来说，不会走到这里！！！
-        // log_debug("Unexpected !!!!! size %d, rehashidx %d\n", dict->ht[0].size, dict->rehashidx);
-    }
-
-    // 迁移rehashidx桶的第一个entry，
-    dictEntry *entry = dict->ht[0].table[dict->rehashidx];
-    if (dict->ht[0].table == NULL) {
-        // log_debug("Unexpected table !!!!!!!!");
-    }
-    dict->ht[0].table[dict->rehashidx] = entry->next;
-
-    // 添加到ht[1]
-    unsigned int h = dict->type->hashFunction(entry->key);
-    unsigned int idx = h & dict->ht[1].sizemask;
-    entry->next = dict->ht[1].table[idx];
-    dict->ht[1].table[idx] = entry;
-
-    dict->ht[0].used--;
-    dict->ht[1].used++;
-
-    // log_debug("rehash : %s [%u]->[%u].  0used %d,   0size %d,     1used %d   1size %d", 
-    //     (char*)entry->key ,dict->rehashidx, idx,
-    //     dict->ht[0].used, dict->ht[0].size, dict->ht[1].used, dict->ht[1].size  // 注意，dict->ht[0]和dict->ht[1]是交换的，所以需要反转一下
-    // );
 
     // 每一次rehash都去主动检查
     if (dict->ht[0].used == 0)
     {
         // ht[0]没有元素，rehash完成，将ht[1]赋值给ht[0]
-        free(dict->ht[0].table);
+        zfree(dict->ht[0].table);
         dict->ht[0] = dict->ht[1];
         _dictReset(&dict->ht[1]);
         dict->rehashidx = -1;
-        // log_debug("rehash 完成");
-        // log_debug("REHASH ok： 0used %d, 0size %d, 1used %d, 1size %d",
-        //     dict->ht[0].used, dict->ht[0].size, dict->ht[1].used, dict->ht[1].size
-        // );
-        return;
+        return 0;
     }
+    return 1;
+}
+
+static void _dictRehashStep(dict *dict)
+{
+    _dictRehash(dict, 1);
 }
 
 /**
@@ -163,13 +248,13 @@ static void _dictRehashStep(dict *dict)
  * @param [in] newSize
  * @return int
  */
-static int dictExpand(dict *dict, unsigned long newSize)
+static int _dictExpand(dict *dict, unsigned long newSize)
 {
     dictHT dh;
     dh.size = newSize;
     dh.sizemask = newSize - 1;
     dh.used = 0;
-    dh.table = calloc(newSize, sizeof(dictEntry *));
+    dh.table = zcalloc(newSize, sizeof(dictNode *));
 
     if (dict->ht[0].table == NULL)
     {
@@ -182,20 +267,17 @@ static int dictExpand(dict *dict, unsigned long newSize)
         dict->ht[1] = dh;
         dict->rehashidx = 0;
     }
+    return DICT_OK;
 }
 
 /**
- * @brief 判断扩缩容，
+ * @brief 插入前判断扩容
  *
  * @param [in] dict
- * @param [in] newSize
  * @return int
  */
 static int dictExpandIfNeed(dict *dict)
 {
-    unsigned long newSize;
-    dictHT dh;
-
     if (dictIsRehashing(dict))
     {
         // 如果正在rehash，
@@ -204,24 +286,34 @@ static int dictExpandIfNeed(dict *dict)
     if (dict->ht[0].size == 0)
     {
         // dict还没用过，size 0 不能计算负载因子，直接扩容
-        return dictExpand(dict, DICT_INITIAL_SIZE);
+        return _dictExpand(dict, DICT_INITIAL_SIZE);
     }
     // 就扩容
     if (dict->ht[0].used == dict->ht[0].size)
     {
-        // log_debug("开始扩容");
-        return dictExpand(dict, _nextpower(dict->ht[0].used * 2));
+        return _dictExpand(dict, _nextpower(dict->ht[0].used * 2));
     }
+    return DICT_OK;
+}
 
+/**
+ * @brief 删除前判断缩容。 只在删除时缩容，dictExpand预先分配的表不会被随后的插入缩回去
+ *
+ * @param [in] dict
+ * @return int
+ */
+static int dictShrinkIfNeed(dict *dict)
+{
+    if (dictIsRehashing(dict) || dict->ht[0].size == 0)
+        return DICT_OK;
     // 小于0.1缩容
-    // log_debug("Ratio : used %d, size %d", dict->ht[0].used, dict->ht[0].size);
     if ((double)dict->ht[0].used / (double)dict->ht[0].size < DICT_LOAD_RATIO)
     {
         log_debug("开始缩容");
         // 如果缩容后小于最小size就不缩
         if (_nextpower(dict->ht[0].used) > DICT_INITIAL_SIZE)
         {
-            return dictExpand(dict, _nextpower(dict->ht[0].used));
+            return _dictExpand(dict, _nextpower(dict->ht[0].used));
         }
         log_debug("小于 initial size 不缩容");
     }
@@ -229,12 +321,12 @@ static int dictExpandIfNeed(dict *dict)
 }
 
 /**
- * @brief 添加一个entry
+ * @brief 添加一个节点
  *
  * @param [in] dict
- * @param [in] entry
+ * @param [in] node
  */
-static void dictAddEntry(dict *dict, dictEntry *entry)
+static void dictAddNode(dict *dict, dictNode *node)
 {
     unsigned int h, idx;
 
@@ -244,10 +336,10 @@ static void dictAddEntry(dict *dict, dictEntry *entry)
     if (dictIsRehashing(dict))
     {
         // 直接添加到ht[1]
-        h = dict->type->hashFunction(entry->key);
+        h = dict->type->hashFunction(node->entry.key);
         idx = h & dict->ht[1].sizemask;
-        entry->next = dict->ht[1].table[idx];
-        dict->ht[1].table[idx] = entry;
+        node->next = dict->ht[1].table[idx];
+        dict->ht[1].table[idx] = node;
         dict->ht[1].used++;
 
         // 触发一次渐进式rehash
@@ -256,65 +348,32 @@ static void dictAddEntry(dict *dict, dictEntry *entry)
     else
     {
         // 如果没有rehash，直接添加到ht[0]
-        h = dict->type->hashFunction(entry->key);
+        h = dict->type->hashFunction(node->entry.key);
         idx = h & dict->ht[0].sizemask;
-        entry->next = dict->ht[0].table[idx];
-        dict->ht[0].table[idx] = entry;
+        node->next = dict->ht[0].table[idx];
+        dict->ht[0].table[idx] = node;
         dict->ht[0].used++;
     }
 }
 
-static int _dictInit(dict *d, dictType *type, void *privData)
-{
-    if (type  == NULL || type->hashFunction == NULL || type->keyCompare == NULL)
-        return DICT_ERR;
-    _dictReset(&d->ht[0]);
-    _dictReset(&d->ht[1]);
-    d->type = type;
-    d->privdata = privData;
-    d->rehashidx = -1;
-    return DICT_OK;
-}
-
-/**
- *
- * @param type type指针
- * @param privData 携带数据
- * @return
- */
-dict *dictCreate(dictType *type, void *privData)
-{
-    dict *d = (dict *)malloc(sizeof(dict));
-    int res = _dictInit(d, type, privData);
-    return res == DICT_ERR ? NULL : d;
-}
-
-/**
- * @brief 根据key查找对应entry
- *
- * @param [in] dict
- * @param [in] key
- * @return dictEntry*
- */
-dictEntry *dictFind(dict *dict, const void *key)
+static dictEntry *_dictChainedFind(dict *dict, const void *key, const dictKeyView *view)
 {
-    if (dict == NULL || key == NULL) return NULL;
     if (dict->ht[0].size == 0)
     {
         return NULL;
     }
-    unsigned int h = dict->type->hashFunction(key);
+    unsigned int h = view ? view->hash : dict->type->hashFunction(key);
     for (int i = 0; i <= 1; i++)
     {
         unsigned int idx = h & dict->ht[i].sizemask;
-        dictEntry *entry = dict->ht[i].table[idx];
-        while (entry)
+        dictNode *node = dict->ht[i].table[idx];
+        while (node)
         {
-            if (dict->type->keyCompare(dict->privdata, entry->key, key) == 0)
+            if (_dictKeyMatch(dict, node->entry.key, key, view))
             {
-                return entry;
+                return &node->entry;
             }
-            entry = entry->next;
+            node = node->next;
         }
         // 如果在ht[0]没找到，
         // 如果正在rehash，那就去ht[1]找
@@ -326,187 +385,97 @@ dictEntry *dictFind(dict *dict, const void *key)
     }
     return NULL;
 }
-/**
- * @brief 只负责分配key，（如果key存在即返回. 不应该发生）。
- *
- * @param [in] dict
- * @param [in] key
- * @return dictEntry*
- */
-dictEntry *dictAddRaw(dict *dict, const void *key)
+
+static dictEntry *_dictChainedAddRaw(dict *dict, const void *key)
 {
-    if (dict == NULL || key == NULL) return NULL;
-    dictEntry *entry = dictFind(dict, key);
-    if (entry == NULL)
-    {
-        entry = (dictEntry *)malloc(sizeof(dictEntry));
-        entry->next = NULL;
-        dictSetKey(dict, entry, key);
-        dictSetVal(dict, entry, NULL);
-        dictAddEntry(dict, entry);
-    }
-    return entry;
+    dictNode *node = (dictNode *)zmalloc(sizeof(dictNode));
+    node->next = NULL;
+    dictSetKey(dict, &node->entry, key);
+    dictSetVal(dict, &node->entry, NULL);
+    dictAddNode(dict, node);
+    return &node->entry;
 }
 
 /**
- * @brief 如果key存在, 返回错误。
+ * @brief 随机选一个非空桶，再在链表中随机选一个节点。
+ *  rehash期间ht[0]中rehashidx之前的桶都已迁移，在ht[0][rehashidx..]和ht[1]中一起随机
  *
- * @param [in] dict
- * @param [in] key
- * @param [in] val
- * @return int 失败返回-1， 成功返回0
+ * @param [in] d
+ * @return void*
  */
-int dictAdd(dict *dict, const void *key, const void *val)
+static void *_dictChainedRandomKey(dict *d)
 {
-    if (dict == NULL || key == NULL) return DICT_ERR;
+    dictNode *node = NULL;
+    if (dictSize(d) == 0) return NULL;
+    if (dictIsRehashing(d)) _dictRehashStep(d);
 
-    dictEntry *entry = NULL;
-    entry = dictFind(dict, key);
-    if (entry) {
-        // key冲突，
-        return DICT_ERR;
-    }
-    
-    entry = dictAddRaw(dict, key);
-    dictSetVal(dict, entry, val);
-    return DICT_OK;
-}
-/**
- * @brief 更新key处的值，key必须存在
- * 
- * @param [in] dict 
- * @param [in] key 
- * @param [in] val 
- * @return int 更新成功返回0， 否则返回-1
- */
-int dictReplace(dict *dict, const void *key, const void *val)
-{
-    if (dict == NULL || key == NULL) return DICT_ERR;
-    dictEntry *entry = dictFind(dict, key);
-    if (entry) {
-        dictSetVal(dict, entry, val);
-        return DICT_OK;
+    if (dictIsRehashing(d)) {
+        unsigned long size0 = d->ht[0].size;
+        unsigned long span = size0 + d->ht[1].size - d->rehashidx;
+        do {
+            unsigned long h = d->rehashidx + (unsigned long)rand() % span;
+            node = h >= size0 ? d->ht[1].table[h - size0] : d->ht[0].table[h];
+        } while (node == NULL);
+    } else {
+        do {
+            node = d->ht[0].table[(unsigned long)rand() & d->ht[0].sizemask];
+        } while (node == NULL);
     }
-    return DICT_ERR;
-}
 
-void *dictFetchValue(dict *dict, const void *key)
-{
-    if (dict == NULL || key == NULL) return NULL;
-    // 触发一次rehash
-    if (dictIsRehashing(dict)) {
-        _dictRehashStep(dict);
-    }
-    dictEntry *entry = dictFind(dict, key);
-    if (entry) {
-        return entry->v.val;
+    // 如果 bucket 内有多个节点（链表），随机选择链表中的某个节点
+    int listLen = 0;
+    dictNode *iter = node;
+    while (iter) {
+        listLen++;
+        iter = iter->next;
     }
-    return NULL;
-}
-void *dictGetRandomKey(dict *d) {
-    if (d == NULL) return NULL;
-    dictEntry *entry;
-    int htsize, index;
-    int htidx = 0;  // 先从第一个哈希表开始
-
-    if (d->ht[0].size == 0) return NULL;
-
-
-    while (htidx < 2) {  // 遍历 0 号表，必要时再遍历 1 号表
-        htsize = d->ht[htidx].size;
-
-        // 随机选择一个 bucket（索引）
-        index = rand() % htsize;
-
-        // 如果 bucket 为空，则继续随机选择
-        if ((entry = d->ht[htidx].table[index]) == NULL) {
-            continue;
-        }
-
-        // 如果 bucket 内有多个 entry（链表），随机选择链表中的某个 entry
-        int listLen = 0;
-        dictEntry *iter = entry;
-        while (iter) {
-            listLen++;
-            iter = iter->next;
-        }
-
-        int randEntryIndex = rand() % listLen;
-        while (randEntryIndex--) {
-            entry = entry->next;
-        }
-
-        return entry->key;  // 返回找到的随机 entry
+    int randEntryIndex = rand() % listLen;
+    while (randEntryIndex--) {
+        node = node->next;
     }
-
-    return NULL;  // 不应该到这里
+    return node->entry.key;
 }
 
-
-
-
-
-
-
-/**
- * @brief Deletes a key-value pair from the dictionary.
- *
- * @param dict The dictionary from which to delete the key-value pair.
- * @param key The key of the key-value pair to delete.
- *
- * @return DICT_OK if the key-value pair was successfully deleted, DICT_ERR otherwise.
- *
- * @note This function checks if the dictionary and key are not NULL, triggers an expansion if necessary,
- *       and performs a deletion if the key is found in the dictionary. If the dictionary is currently rehashing,
- *       the function triggers a rehash step before performing the deletion. If the key is not found,
- *       the function returns DICT_ERR.
- */
-int dictDelete(dict *dict, const void *key)
+static int _dictChainedDelete(dict *dict, const void *key, const dictKeyView *view)
 {
-    if (dict == NULL || key == NULL) return DICT_ERR;   
-
-    // Check if expansion is needed
-    dictExpandIfNeed(dict);
+    dictShrinkIfNeed(dict);
 
     if (dictIsRehashing(dict))
     {
         _dictRehashStep(dict);
-    } 
-
+    }
 
+    unsigned int h = view ? view->hash : dict->type->hashFunction(key);
     for (int i = 0; i <= 1; i++)
     {
-        unsigned int h = dict->type->hashFunction(key);
         unsigned int idx = h & dict->ht[i].sizemask;
-        dictEntry *entry = dict->ht[i].table[idx];
-        dictEntry *prev = NULL;
-        while (entry)
+        dictNode *node = dict->ht[i].table[idx];
+        dictNode *prev = NULL;
+        while (node)
         {
-            if (dict->type->keyCompare(dict->privdata, entry->key, key) == 0)
+            if (_dictKeyMatch(dict, node->entry.key, key, view))
             {
-                log_debug("delete ok");
                 // Key-value pair found, perform deletion
                 if (prev == NULL)
                 {
-                    dict->ht[i].table[idx] = entry->next;
-
+                    dict->ht[i].table[idx] = node->next;
                 }
                 else
                 {
-                    prev->next = entry->next;
+                    prev->next = node->next;
                 }
                 if (dict->type->keyDestructor) {
-                    dict->type->keyDestructor(dict->privdata, entry->key);
+                    dict->type->keyDestructor(dict->privdata, node->entry.key);
                 }
                 if (dict->type->valDestructor) {
-                    dict->type->valDestructor(dict->privdata, entry->v.val);
+                    dict->type->valDestructor(dict->privdata, node->entry.v.val);
                 }
-                free(entry);
+                zfree(node);
                 dict->ht[i].used--;
                 return DICT_OK;
             }
-            prev = entry;
-            entry = entry->next;
+            prev = node;
+            node = node->next;
         }
         // If key not found in ht[0],
         // If rehashing has already moved, check ht[1]
@@ -519,51 +488,14 @@ int dictDelete(dict *dict, const void *key)
     return DICT_ERR;
 }
 
-/**
- *
- * @param dict
- * @param key
- * @return 包含返回 true
- */
-int dictContains(dict* dict, const void* key)
-{
-    return dictFind(dict, key) != NULL;
-}
-
-/**
- * @brief 释放dict
- * 
- * @param [in] dict 
- */
-void dictRelease(dict *dict)
-{
-    if (dict == NULL) return;
-    _dictClear(dict, &dict->ht[0]);
-    _dictClear(dict, &dict->ht[1]);
-    free(dict);
-}
-
-/**
- * 获取一个迭代器。
- * @param dict
- * @return
- */
-dictIterator *dictGetIterator(dict *dict)
-{
-    dictIterator *iter = (dictIterator *)malloc(sizeof(dictIterator));
-    iter->dict = dict;
-    iter->index = -1;
-    iter->entry = NULL;
-    iter->_htidx = 0;
-    return iter;
-}
-dictEntry* dictIterNext(dictIterator *iter)
+static dictEntry *_dictChainedIterNext(dictIterator *iter)
 {
     dict* d = iter->dict;
     while(iter->_htidx < 2) {
-        dictEntry* cur = iter->entry;
+        dictNode* cur = iter->node;
         if (d->ht[iter->_htidx].used == 0) {
             // 没有在使用
+            iter->index = -1;
             iter->_htidx++;
             continue;
         }
@@ -572,7 +504,7 @@ dictEntry* dictIterNext(dictIterator *iter)
             iter->index ++;
             if (iter->index == d->ht[iter->_htidx].size) {
                 // 当前ht完了，
-                iter->index = 0;
+                iter->index = -1;
                 iter->_htidx++;
                 break;
             }
@@ -581,23 +513,749 @@ dictEntry* dictIterNext(dictIterator *iter)
         }
         if (cur) {
             // 找到了
-            iter->entry = cur->next;
-            return cur;
+            iter->node = cur->next;
+            return &cur->entry;
+        }
+
+    }
+    return NULL;
+}
+
+// ------------swiss-------------------//
+
+/**
+ * 组：16个控制字节 + 15个槽位，256字节，按缓存行对齐分配。
+ *  ctrl[0..14]：槽位状态。 0为空，满槽为0x80|h2（h2是hash的7位指纹）。
+ *  ctrl[15]：溢出计数，有多少键探测经过本组(本组满了，放到了后面的组)。 饱和于255，之后不再减少。
+ *
+ * 查找：从h1所在组开始二次探测，组内用一次SIMD比较取出tag相同的槽位，逐个比较键；
+ *  组内没有命中且溢出计数为0时，说明键不在更后面的组，结束。
+ * 删除：槽位置空，探测路径上经过的组溢出计数减一。 不需要墓碑，删除后空出的槽位可以直接复用。
+ */
+#define DICT_GROUP_OVERFLOW DICT_GROUP_SLOTS    // 溢出计数所在的控制字节
+#define DICT_GROUP_MASK ((1u << DICT_GROUP_SLOTS) - 1)
+#define DICT_GROUP_ALIGN 64
+#define DICT_SWISS_MAX_LOAD 0.875   // 超过7/8扩容
+#define DICT_SWISS_EMPTY_VISITS 10  // 一次rehash最多跳过的空组数
+
+struct dictGroup {
+    uint8_t ctrl[DICT_GROUP_SLOTS + 1];
+    dictEntry slots[DICT_GROUP_SLOTS];
+};
+
+/**
+ * @brief 把hashFunction的结果打散到64位：高32位选组，另取7位作为指纹
+ *
+ * @param [in] dict
+ * @param [in] key
+ * @return uint64_t
+ */
+static inline uint64_t _swissMix(unsigned long h)
+{
+    return (uint64_t)h * 0x9E3779B97F4A7C15ull;
+}
+
+static inline uint64_t _swissHash(dict *dict, const void *key)
+{
+    return _swissMix(dict->type->hashFunction(key));
+}
+
+static inline unsigned long _swissHome(dictSwissTable *t, uint64_t hh)
+{
+    return (unsigned long)(hh >> 32) & t->groupmask;
+}
+
+static inline uint8_t _swissTag(uint64_t hh)
+{
+    return 0x80 | ((hh >> 25) & 0x7f);
+}
+
+// 二次探测(三角数步长)，组数为2的幂时能遍历所有组
+static inline unsigned long _swissNext(dictSwissTable *t, unsigned long gi, unsigned long i)
+{
+    return (gi + i + 1) & t->groupmask;
+}
+
+/**
+ * @brief 组内tag等于指定值的槽位，按位返回
+ *
+ * @param [in] g
+ * @param [in] tag
+ * @return unsigned
+ */
+static inline unsigned _groupMatch(const dictGroup *g, uint8_t tag)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_load_si128((const __m128i *)g->ctrl);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag))) & DICT_GROUP_MASK;
+#else
+    unsigned m = 0;
+    for (int i = 0; i < DICT_GROUP_SLOTS; i++)
+        if (g->ctrl[i] == tag) m |= 1u << i;
+    return m;
+#endif
+}
+
+// 满槽位：控制字节最高位为1
+static inline unsigned _groupFull(const dictGroup *g)
+{
+#ifdef __SSE2__
+    return (unsigned)_mm_movemask_epi8(_mm_load_si128((const __m128i *)g->ctrl)) & DICT_GROUP_MASK;
+#else
+    unsigned m = 0;
+    for (int i = 0; i < DICT_GROUP_SLOTS; i++)
+        if (g->ctrl[i] & 0x80) m |= 1u << i;
+    return m;
+#endif
+}
+
+static void _swissReset(dictSwissTable *t)
+{
+    t->groups = NULL;
+    t->ngroups = 0;
+    t->groupmask = 0;
+    t->used = 0;
+}
+
+static void _swissInit(dictSwissTable *t, unsigned long ngroups)
+{
+    t->groups = zalignedAlloc(DICT_GROUP_ALIGN, ngroups * sizeof(dictGroup));
+    memset(t->groups, 0, ngroups * sizeof(dictGroup));
+    t->ngroups = ngroups;
+    t->groupmask = ngroups - 1;
+    t->used = 0;
+}
+
+static void _swissClear(dict *dict, dictSwissTable *t)
+{
+    for (unsigned long gi = 0; gi < t->ngroups && t->used > 0; gi++)
+    {
+        dictGroup *g = &t->groups[gi];
+        for (unsigned m = _groupFull(g); m; m &= m - 1)
+        {
+            dictFreeEntry(dict, &g->slots[__builtin_ctz(m)]);
+            t->used--;
+        }
+    }
+    zfree(t->groups);
+    _swissReset(t);
+}
+
+/**
+ * @brief 在一张表中查找
+ *
+ * @param [in] dict
+ * @param [in] t
+ * @param [in] key
+ * @param [in] hh
+ * @param [out] group 命中槽位所在组，可为NULL
+ * @return dictEntry*
+ */
+static dictEntry *_swissLookup(dict *dict, dictSwissTable *t, const void *key, const dictKeyView *view, uint64_t hh, dictGroup **group)
+{
+    if (t->used == 0) return NULL;
+    uint8_t tag = _swissTag(hh);
+    unsigned long gi = _swissHome(t, hh);
+    for (unsigned long i = 0; i < t->ngroups; i++)
+    {
+        dictGroup *g = &t->groups[gi];
+        for (unsigned m = _groupMatch(g, tag); m; m &= m - 1)
+        {
+            dictEntry *entry = &g->slots[__builtin_ctz(m)];
+            if (_dictKeyMatch(dict, entry->key, key, view))
+            {
+                if (group) *group = g;
+                return entry;
+            }
+        }
+        if (g->ctrl[DICT_GROUP_OVERFLOW] == 0) return NULL;
+        gi = _swissNext(t, gi, i);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 为一个不存在的键占用槽位：探测路径上第一个有空位的组。 经过的满组溢出计数加一
+ *
+ * @param [in] t
+ * @param [in] hh
+ * @return dictEntry*
+ */
+static dictEntry *_swissInsert(dictSwissTable *t, uint64_t hh)
+{
+    unsigned long gi = _swissHome(t, hh);
+    for (unsigned long i = 0; i < t->ngroups; i++)
+    {
+        dictGroup *g = &t->groups[gi];
+        unsigned empty = ~_groupFull(g) & DICT_GROUP_MASK;
+        if (empty)
+        {
+            int s = __builtin_ctz(empty);
+            g->ctrl[s] = _swissTag(hh);
+            t->used++;
+            return &g->slots[s];
+        }
+        if (g->ctrl[DICT_GROUP_OVERFLOW] < UINT8_MAX) g->ctrl[DICT_GROUP_OVERFLOW]++;
+        gi = _swissNext(t, gi, i);
+    }
+    return NULL; // 装载率不超过7/8，不会走到这里
+}
+
+/**
+ * @brief 清空槽位，撤销插入时在探测路径上增加的溢出计数
+ *
+ * @param [in] t
+ * @param [in] g
+ * @param [in] entry
+ * @param [in] hh
+ */
+static void _swissErase(dictSwissTable *t, dictGroup *g, dictEntry *entry, uint64_t hh)
+{
+    g->ctrl[entry - g->slots] = 0;
+    t->used--;
+    unsigned long gi = _swissHome(t, hh);
+    for (unsigned long i = 0; &t->groups[gi] != g; i++)
+    {
+        uint8_t *overflow = &t->groups[gi].ctrl[DICT_GROUP_OVERFLOW];
+        if (*overflow < UINT8_MAX) (*overflow)--;
+        gi = _swissNext(t, gi, i);
+    }
+}
+
+/**
+ * @brief 渐进式rehash：迁移st[0]的一个非空组，最多跳过DICT_SWISS_EMPTY_VISITS个空组
+ *
+ * @param [in] dict
+ */
+static void _swissRehashStep(dict *dict)
+{
+    dictSwissTable *from = &dict->st[0];
+    dictSwissTable *to = &dict->st[1];
+    int emptyVisits = DICT_SWISS_EMPTY_VISITS;
+    while ((unsigned long)dict->rehashidx < from->ngroups)
+    {
+        dictGroup *g = &from->groups[dict->rehashidx++];
+        unsigned full = _groupFull(g);
+        if (full == 0)
+        {
+            if (--emptyVisits == 0) break;
+            continue;
         }
+        for (; full; full &= full - 1)
+        {
+            int s = __builtin_ctz(full);
+            dictEntry *entry = _swissInsert(to, _swissHash(dict, g->slots[s].key));
+            *entry = g->slots[s];
+            g->ctrl[s] = 0;
+            from->used--;
+        }
+        break;
+    }
+    if (from->used == 0)
+    {
+        zfree(from->groups);
+        dict->st[0] = dict->st[1];
+        _swissReset(&dict->st[1]);
+        dict->rehashidx = -1;
+    }
+}
+
+static int _swissRehash(dict *dict, int n)
+{
+    while (n-- && dictIsRehashing(dict)) _swissRehashStep(dict);
+    return dictIsRehashing(dict);
+}
+
+static void _swissResize(dict *dict, unsigned long ngroups)
+{
+    if (dict->st[0].groups == NULL)
+    {
+        _swissInit(&dict->st[0], ngroups);
+        return;
+    }
+    _swissInit(&dict->st[1], ngroups);
+    dict->rehashidx = 0;
+}
+
+// 容纳used个键、装载率约一半所需的组数
+static unsigned long _swissGroupsFor(unsigned long used)
+{
+    unsigned long n = _nextpower((used * 2 + DICT_GROUP_SLOTS - 1) / DICT_GROUP_SLOTS);
+    return n == 0 ? 1 : n;
+}
+
+/**
+ * @brief 插入前检查扩容。 st[0]装载率超过7/8时开始rehash到两倍组数；
+ *  rehash期间新键写入st[1]，若st[1]也快满（缩容后立刻大量写入），先一次完成rehash
+ *
+ * @param [in] dict
+ */
+static void _swissExpandIfNeeded(dict *dict)
+{
+    if (dictIsRehashing(dict))
+    {
+        dictSwissTable *t = &dict->st[1];
+        if ((double)(t->used + 1) <= DICT_SWISS_MAX_LOAD * t->ngroups * DICT_GROUP_SLOTS)
+            return;
+        while (dictIsRehashing(dict)) _swissRehashStep(dict);
+    }
+    dictSwissTable *t = &dict->st[0];
+    if (t->ngroups == 0)
+    {
+        _swissResize(dict, 1);
+        return;
+    }
+    if ((double)(t->used + 1) > DICT_SWISS_MAX_LOAD * t->ngroups * DICT_GROUP_SLOTS)
+    {
+        _swissResize(dict, t->ngroups * 2);
+    }
+}
+
+// 删除后检查缩容
+static void _swissShrinkIfNeeded(dict *dict)
+{
+    if (dictIsRehashing(dict)) return;
+    dictSwissTable *t = &dict->st[0];
+    if (t->ngroups > 1 && (double)t->used < DICT_LOAD_RATIO * t->ngroups * DICT_GROUP_SLOTS)
+    {
+        unsigned long ngroups = _swissGroupsFor(t->used);
+        if (ngroups < t->ngroups) _swissResize(dict, ngroups);
+    }
+}
 
+static dictEntry *_swissFind(dict *dict, const void *key, const dictKeyView *view, uint64_t hh, dictSwissTable **table, dictGroup **group)
+{
+    for (int i = 0; i <= 1; i++)
+    {
+        dictEntry *entry = _swissLookup(dict, &dict->st[i], key, view, hh, group);
+        if (entry)
+        {
+            if (table) *table = &dict->st[i];
+            return entry;
+        }
+        if (!dictIsRehashing(dict)) break;
     }
     return NULL;
 }
+
+/**
+ * @brief 为不存在的键分配槽位，设置key
+ *
+ * @param [in] dict
+ * @param [in] key
+ * @param [in] hh _swissHash(key)
+ * @return dictEntry*
+ */
+static dictEntry *_swissAddRaw(dict *dict, const void *key, uint64_t hh)
+{
+    _swissExpandIfNeeded(dict);
+    if (dictIsRehashing(dict)) _swissRehashStep(dict);
+    // rehash期间新键直接写入st[1]
+    dictSwissTable *t = dictIsRehashing(dict) ? &dict->st[1] : &dict->st[0];
+    dictEntry *entry = _swissInsert(t, hh);
+    dictSetKey(dict, entry, key);
+    dictSetVal(dict, entry, NULL);
+    return entry;
+}
+
+static int _swissDelete(dict *dict, const void *key, const dictKeyView *view)
+{
+    if (dictIsRehashing(dict)) _swissRehashStep(dict);
+    dictSwissTable *t;
+    dictGroup *g;
+    uint64_t hh = view ? _swissMix(view->hash) : _swissHash(dict, key);
+    dictEntry *entry = _swissFind(dict, key, view, hh, &t, &g);
+    if (entry == NULL) return DICT_ERR;
+    dictFreeEntry(dict, entry);
+    _swissErase(t, g, entry, hh);
+    _swissShrinkIfNeeded(dict);
+    return DICT_OK;
+}
+
+/**
+ * @brief 随机取槽位直到取到满槽。 装载率不低于DICT_LOAD_RATIO（否则会缩容），期望尝试次数有限
+ *
+ * @param [in] dict
+ * @return void*
+ */
+static void *_swissRandomKey(dict *dict)
+{
+    if (dictSize(dict) == 0) return NULL;
+    while (1)
+    {
+        unsigned long n = (unsigned long)rand() % dictSize(dict);
+        dictSwissTable *t = n < dict->st[0].used ? &dict->st[0] : &dict->st[1];
+        unsigned long slot = (unsigned long)rand() % (t->ngroups * DICT_GROUP_SLOTS);
+        dictGroup *g = &t->groups[slot / DICT_GROUP_SLOTS];
+        int s = slot % DICT_GROUP_SLOTS;
+        if (g->ctrl[s] & 0x80) return g->slots[s].key;
+    }
+}
+
+static dictEntry *_swissIterNext(dictIterator *iter)
+{
+    dict *d = iter->dict;
+    while (iter->_htidx < 2)
+    {
+        dictSwissTable *t = &d->st[iter->_htidx];
+        unsigned long slots = t->ngroups * DICT_GROUP_SLOTS;
+        while ((unsigned long)++iter->index < slots)
+        {
+            dictGroup *g = &t->groups[iter->index / DICT_GROUP_SLOTS];
+            int s = iter->index % DICT_GROUP_SLOTS;
+            if (s == 0 && _groupFull(g) == 0)
+            {
+                // 整组为空，跳到下一组
+                iter->index += DICT_GROUP_SLOTS - 1;
+                continue;
+            }
+            if (g->ctrl[s] & 0x80) return &g->slots[s];
+        }
+        iter->index = -1;
+        iter->_htidx++;
+    }
+    return NULL;
+}
+
+// ------------api-------------------//
+
+static int _dictInit(dict *d, dictType *type, void *privData)
+{
+    if (type  == NULL || type->hashFunction == NULL || type->keyCompare == NULL)
+        return DICT_ERR;
+    _dictReset(&d->ht[0]);
+    _dictReset(&d->ht[1]);
+    _swissReset(&d->st[0]);
+    _swissReset(&d->st[1]);
+    d->type = type;
+    d->privdata = privData;
+    d->rehashidx = -1;
+    return DICT_OK;
+}
+
+/**
+ *
+ * @param type type指针
+ * @param privData 携带数据
+ * @return
+ */
+dict *dictCreate(dictType *type, void *privData)
+{
+    dict *d = (dict *)zmalloc(sizeof(dict));
+    int res = _dictInit(d, type, privData);
+    if (res == DICT_ERR)
+    {
+        zfree(d);
+        return NULL;
+    }
+    return d;
+}
+
+/**
+ * @brief 根据key查找对应entry
+ *
+ * @param [in] dict
+ * @param [in] key
+ * @return dictEntry*
+ */
+dictEntry *dictFind(dict *dict, const void *key)
+{
+    if (dict == NULL || key == NULL) return NULL;
+    if (dictIsSwiss(dict)) return _swissFind(dict, key, NULL, _swissHash(dict, key), NULL, NULL);
+    return _dictChainedFind(dict, key, NULL);
+}
+/**
+ * @brief 只负责分配key，（如果key存在即返回. 不应该发生）。
+ *
+ * @param [in] dict
+ * @param [in] key
+ * @return dictEntry*
+ */
+dictEntry *dictAddRaw(dict *dict, const void *key)
+{
+    if (dict == NULL || key == NULL) return NULL;
+    if (dictIsSwiss(dict))
+    {
+        uint64_t hh = _swissHash(dict, key);
+        dictEntry *entry = _swissFind(dict, key, NULL, hh, NULL, NULL);
+        return entry ? entry : _swissAddRaw(dict, key, hh);
+    }
+    dictEntry *entry = _dictChainedFind(dict, key, NULL);
+    if (entry == NULL)
+    {
+        entry = _dictChainedAddRaw(dict, key);
+    }
+    return entry;
+}
+
+/**
+ * @brief 如果key存在, 返回错误。
+ *
+ * @param [in] dict
+ * @param [in] key
+ * @param [in] val
+ * @return int 失败返回-1， 成功返回0
+ */
+int dictAdd(dict *dict, const void *key, const void *val)
+{
+    if (dict == NULL || key == NULL) return DICT_ERR;
+
+    dictEntry *entry = NULL;
+    if (dictIsSwiss(dict))
+    {
+        uint64_t hh = _swissHash(dict, key);
+        if (_swissFind(dict, key, NULL, hh, NULL, NULL)) return DICT_ERR;
+        entry = _swissAddRaw(dict, key, hh);
+    }
+    else
+    {
+        entry = _dictChainedFind(dict, key, NULL);
+        if (entry) {
+            // key冲突，
+            return DICT_ERR;
+        }
+        entry = _dictChainedAddRaw(dict, key);
+    }
+    dictSetVal(dict, entry, val);
+    return DICT_OK;
+}
+/**
+ * @brief 更新key处的值，key必须存在。 旧值用valDestructor释放
+ *
+ * @param [in] dict
+ * @param [in] key
+ * @param [in] val
+ * @return int 更新成功返回0， 否则返回-1
+ */
+int dictReplace(dict *dict, const void *key, const void *val)
+{
+    if (dict == NULL || key == NULL) return DICT_ERR;
+    dictEntry *entry = dictFind(dict, key);
+    if (entry) {
+        void *old = entry->v.val;
+        dictSetVal(dict, entry, val);
+        if (dict->type->valDestructor && old && old != entry->v.val)
+            dict->type->valDestructor(dict->privdata, old);
+        return DICT_OK;
+    }
+    return DICT_ERR;
+}
+
+void *dictFetchValue(dict *dict, const void *key)
+{
+    if (dict == NULL || key == NULL) return NULL;
+    // 触发一次rehash
+    if (dictIsRehashing(dict)) {
+        if (dictIsSwiss(dict))
+            _swissRehashStep(dict);
+        else
+            _dictRehashStep(dict);
+    }
+    dictEntry *entry = dictFind(dict, key);
+    if (entry) {
+        return entry->v.val;
+    }
+    return NULL;
+}
+
+void *dictGetRandomKey(dict *d) {
+    if (d == NULL) return NULL;
+    if (dictIsSwiss(d)) return _swissRandomKey(d);
+    return _dictChainedRandomKey(d);
+}
+
+/**
+ * @brief Deletes a key-value pair from the dictionary.
+ *
+ * @param dict The dictionary from which to delete the key-value pair.
+ * @param key The key of the key-value pair to delete.
+ *
+ * @return DICT_OK if the key-value pair was successfully deleted, DICT_ERR otherwise.
+ *
+ * @note This function checks if the dictionary and key are not NULL, triggers an expansion if necessary,
+ *       and performs a deletion if the key is found in the dictionary. If the dictionary is currently rehashing,
+ *       the function triggers a rehash step before performing the deletion. If the key is not found,
+ *       the function returns DICT_ERR.
+ */
+int dictDelete(dict *dict, const void *key)
+{
+    if (dict == NULL || key == NULL) return DICT_ERR;
+    if (dictIsSwiss(dict)) return _swissDelete(dict, key, NULL);
+    return _dictChainedDelete(dict, key, NULL);
+}
+
+/**
+ * @brief 构造键视图，计算一次hash。 同一个视图可以在多个dict中查找（如kv和expires）
+ *
+ * @param [in] buf 调用方持有，视图使用期间有效
+ * @param [in] len
+ * @return dictKeyView
+ */
+dictKeyView dictMakeView(const char *buf, size_t len)
+{
+    dictKeyView view = {buf, len, dictGenHashFunction(buf, len)};
+    return view;
+}
+
+/**
+ * @brief 按键视图查找，不构造键对象。 dictType必须设置keyCompareView
+ *
+ * @param [in] dict
+ * @param [in] view
+ * @return dictEntry*
+ */
+dictEntry *dictFindByView(dict *dict, const dictKeyView *view)
+{
+    if (dict == NULL || view == NULL) return NULL;
+    if (dictIsSwiss(dict)) return _swissFind(dict, NULL, view, _swissMix(view->hash), NULL, NULL);
+    return _dictChainedFind(dict, NULL, view);
+}
+
+dictEntry *dictFindView(dict *dict, const char *key, size_t len)
+{
+    dictKeyView view = dictMakeView(key, len);
+    return dictFindByView(dict, &view);
+}
+
+int dictDeleteByView(dict *dict, const dictKeyView *view)
+{
+    if (dict == NULL || view == NULL) return DICT_ERR;
+    if (dictIsSwiss(dict)) return _swissDelete(dict, NULL, view);
+    return _dictChainedDelete(dict, NULL, view);
+}
+
+/**
+ *
+ * @param dict
+ * @param key
+ * @return 包含返回 true
+ */
+int dictContains(dict* dict, const void* key)
+{
+    return dictFind(dict, key) != NULL;
+}
+
+/**
+ * @brief 释放dict
+ *
+ * @param [in] dict
+ */
+void dictRelease(dict *dict)
+{
+    if (dict == NULL) return;
+    _dictClear(dict, &dict->ht[0]);
+    _dictClear(dict, &dict->ht[1]);
+    _swissClear(dict, &dict->st[0]);
+    _swissClear(dict, &dict->st[1]);
+    zfree(dict);
+}
+
+/**
+ * @brief 主动rehash: 迁移n个桶(swiss为组)
+ *
+ * @param [in] dict
+ * @param [in] n
+ * @return int 1表示还没完成
+ */
+int dictRehash(dict *dict, int n)
+{
+    if (!dictIsRehashing(dict)) return 0;
+    if (dictIsSwiss(dict)) return _swissRehash(dict, n);
+    return _dictRehash(dict, n);
+}
+
+/**
+ * @brief 预先分配能容纳size个键的表，批量插入（如加载RDB）时不再逐步扩容、rehash
+ *
+ * @param [in] dict
+ * @param [in] size 预计的键数
+ * @return int 正在rehash或表已经足够大时返回DICT_ERR
+ */
+int dictExpand(dict *dict, unsigned long size)
+{
+    if (dictIsRehashing(dict) || size <= dictSize(dict)) return DICT_ERR;
+    if (dictIsSwiss(dict))
+    {
+        unsigned long ngroups = _swissGroupsFor(size);
+        if (ngroups <= dict->st[0].ngroups) return DICT_ERR;
+        _swissResize(dict, ngroups);
+        return DICT_OK;
+    }
+    unsigned long realSize = _nextpower(size);
+    if (realSize <= dict->ht[0].size) return DICT_ERR;
+    return _dictExpand(dict, realSize);
+}
+
+static long long _dictTimeInMilliseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 在ms毫秒内按每批100个桶rehash，直到完成或超时。 用于空闲时由定时任务推进rehash
+ *
+ * @param [in] dict
+ * @param [in] ms
+ * @return int 迁移的桶数(按批计)
+ */
+int dictRehashMilliseconds(dict *dict, int ms)
+{
+    long long start = _dictTimeInMilliseconds();
+    int rehashes = 0;
+    while (dictIsRehashing(dict))
+    {
+        dictRehash(dict, 100);
+        rehashes += 100;
+        if (_dictTimeInMilliseconds() - start > ms) break;
+    }
+    return rehashes;
+}
+
+/**
+ * @brief rehash进度: 旧表已迁移的比例，没有rehash时为1
+ *
+ * @param [in] dict
+ * @return double
+ */
+double dictRehashProgress(dict *dict)
+{
+    if (!dictIsRehashing(dict)) return 1.0;
+    unsigned long total = dictIsSwiss(dict) ? dict->st[0].ngroups : dict->ht[0].size;
+    return (double)dict->rehashidx / (double)total;
+}
+
+/**
+ * 获取一个迭代器。 遍历期间不能修改字典
+ * @param dict
+ * @return
+ */
+dictIterator *dictGetIterator(dict *dict)
+{
+    dictIterator *iter = (dictIterator *)zmalloc(sizeof(dictIterator));
+    iter->dict = dict;
+    iter->index = -1;
+    iter->node = NULL;
+    iter->_htidx = 0;
+    return iter;
+}
+dictEntry* dictIterNext(dictIterator *iter)
+{
+    if (dictIsSwiss(iter->dict)) return _swissIterNext(iter);
+    return _dictChainedIterNext(iter);
+}
 void dictReleaseIterator(dictIterator* iter)
 {
-    free(iter);
+    zfree(iter);
 }
 int dictIsEmpty(dict* dict)
 {
-    return dict->ht[0].used == 0;
+    return dictSize(dict) == 0;
 }
 
 size_t dictSize(dict* dict)
 {
+    if (dictIsSwiss(dict)) return dict->st[0].used + dict->st[1].used;
     return dict->ht[0].used + dict->ht[1].used;
-}
\ No newline at end of file
+}
@@ -0,0 +1,296 @@
+/**
+ * @file evict.c
+ * @brief maxmemory淘汰: 近似LRU、随机、最快过期
+ */
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "evict.h"
+#include "redis.h"
+#include "zmalloc.h"
+#include "log.h"
+
+static const char* policyNames[] = {
+    [MAXMEMORY_NO_EVICTION] = "noeviction",
+    [MAXMEMORY_ALLKEYS_LRU] = "allkeys-lru",
+    [MAXMEMORY_VOLATILE_LRU] = "volatile-lru",
+    [MAXMEMORY_ALLKEYS_RANDOM] = "allkeys-random",
+    [MAXMEMORY_VOLATILE_TTL] = "volatile-ttl",
+    [MAXMEMORY_ALLKEYS_LFU] = "allkeys-lfu",
+    [MAXMEMORY_VOLATILE_LFU] = "volatile-lfu",
+};
+
+/**
+ * @brief 当前LRU时钟。 使用事件循环缓存的server->mstime，不需要系统调用
+ *
+ * @return unsigned int
+ */
+unsigned int lruClock(void)
+{
+    return (unsigned int)((server->mstime / LRU_CLOCK_RESOLUTION) & LRU_CLOCK_MAX);
+}
+
+/**
+ * @brief 对象空闲时间，毫秒。 时钟回绕过一次时按回绕计算
+ *
+ * @param [in] o
+ * @return unsigned long long
+ */
+unsigned long long estimateObjectIdleTime(robj* o)
+{
+    unsigned long long clock = lruClock();
+    if (clock >= o->lru)
+        return (clock - o->lru) * LRU_CLOCK_RESOLUTION;
+    return (clock + (LRU_CLOCK_MAX - o->lru)) * LRU_CLOCK_RESOLUTION;
+}
+
+/* ---------------- LFU ---------------- */
+
+// 分钟精度的时间，16位
+static unsigned long lfuTimeInMinutes(void)
+{
+    return (unsigned long)(server->mstime / 60000) & 65535;
+}
+
+// 距离上次衰减过了多少分钟，16位回绕
+static unsigned long lfuElapsedMinutes(unsigned long ldt)
+{
+    unsigned long now = lfuTimeInMinutes();
+    if (now >= ldt) return now - ldt;
+    return 65535 - ldt + now;
+}
+
+/**
+ * @brief 对数计数器加一：计数越大，递增概率越低
+ *
+ * @param [in] counter
+ * @return uint8_t
+ */
+static uint8_t lfuLogIncr(uint8_t counter)
+{
+    if (counter == 255) return 255;
+    double r = (double)rand() / RAND_MAX;
+    double baseval = counter > LFU_INIT_VAL ? counter - LFU_INIT_VAL : 0;
+    double p = 1.0 / (baseval * server->lfuLogFactor + 1);
+    if (r < p) counter++;
+    return counter;
+}
+
+/**
+ * @brief 按经过的衰减周期数减小计数，返回衰减后的计数。 不修改对象
+ *
+ * @param [in] o
+ * @return unsigned long
+ */
+unsigned long lfuDecrAndReturn(robj* o)
+{
+    unsigned long ldt = o->lru >> 8;
+    unsigned long counter = o->lru & 255;
+    unsigned long periods = server->lfuDecayTime ? lfuElapsedMinutes(ldt) / server->lfuDecayTime : 0;
+    if (periods)
+        counter = periods > counter ? 0 : counter - periods;
+    return counter;
+}
+
+int policyIsLFU(int policy)
+{
+    return policy == MAXMEMORY_ALLKEYS_LFU || policy == MAXMEMORY_VOLATILE_LFU;
+}
+
+/**
+ * @brief 策略是否依赖每个对象的访问信息(LRU时间/LFU计数)
+ *
+ * @param [in] policy
+ * @return int
+ */
+int policyUsesObjectAccess(int policy)
+{
+    return policyIsLFU(policy) || policy == MAXMEMORY_ALLKEYS_LRU || policy == MAXMEMORY_VOLATILE_LRU;
+}
+
+/**
+ * @brief 新写入的对象：LFU策略下为初始计数，否则为当前LRU时钟。 共享对象只读，不记录
+ *
+ * @param [in] o
+ */
+void objectInitAccess(robj* o)
+{
+    if (robjIsShared(o)) return;
+    if (policyIsLFU(server->maxmemoryPolicy))
+        o->lru = (lfuTimeInMinutes() << 8) | LFU_INIT_VAL;
+    else
+        o->lru = lruClock();
+}
+
+/**
+ * @brief 访问对象：LFU策略下先衰减再递增计数，否则更新LRU时间
+ *
+ * @param [in] o
+ */
+void objectTouch(robj* o)
+{
+    if (robjIsShared(o)) return;
+    if (policyIsLFU(server->maxmemoryPolicy)) {
+        unsigned long counter = lfuLogIncr(lfuDecrAndReturn(o));
+        o->lru = (lfuTimeInMinutes() << 8) | counter;
+    } else {
+        o->lru = lruClock();
+    }
+}
+
+int maxmemoryPolicyFromString(const char* s)
+{
+    for (int i = 0; i < (int)(sizeof(policyNames) / sizeof(policyNames[0])); i++) {
+        if (strcasecmp(s, policyNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char* maxmemoryPolicyToString(int policy)
+{
+    return policyNames[policy];
+}
+
+evictionPoolEntry* evictionPoolCreate(void)
+{
+    return zcalloc(EVPOOL_SIZE, sizeof(evictionPoolEntry));
+}
+
+static int policyIsLRU(int policy)
+{
+    return policy == MAXMEMORY_ALLKEYS_LRU || policy == MAXMEMORY_VOLATILE_LRU;
+}
+
+static int policyIsAllkeys(int policy)
+{
+    return policy == MAXMEMORY_ALLKEYS_LRU || policy == MAXMEMORY_ALLKEYS_RANDOM ||
+           policy == MAXMEMORY_ALLKEYS_LFU;
+}
+
+/**
+ * @brief 从sampledict抽样，按idle插入淘汰池。 池满时比池中所有候选都新的键丢弃，否则挤掉最新的
+ *
+ * @param [in] db
+ * @param [in] sampledict kv或expires
+ * @param [in] pool
+ */
+static void evictionPoolPopulate(redisDb* db, dict* sampledict, evictionPoolEntry* pool)
+{
+    for (int j = 0; j < server->maxmemorySamples; j++) {
+        sds key = dictGetRandomKey(sampledict);
+        if (key == NULL) break;
+        unsigned long long idle;
+        if (policyIsLRU(server->maxmemoryPolicy) || policyIsLFU(server->maxmemoryPolicy)) {
+            robj* o = dictFetchValue(db->kv, key);
+            if (o == NULL) continue;
+            // 访问频率越低idle越大
+            idle = policyIsLFU(server->maxmemoryPolicy) ? 255 - lfuDecrAndReturn(o) : estimateObjectIdleTime(o);
+        } else {
+            // 越早过期idle越大
+            idle = ULLONG_MAX - (unsigned long long)dbGetExpire(db, key);
+        }
+
+        // 第一个idle不小于它的位置
+        int k = 0;
+        while (k < EVPOOL_SIZE && pool[k].key && pool[k].idle < idle) k++;
+        if (k < EVPOOL_SIZE && pool[k].key && pool[k].dbid == db->id && sdscmp(pool[k].key, key) == 0)
+            continue;   // 已在池中
+        if (k == 0 && pool[EVPOOL_SIZE - 1].key != NULL)
+            continue;   // 池满，比所有候选都新
+        if (k < EVPOOL_SIZE && pool[k].key == NULL) {
+            // 插入空位
+        } else if (pool[EVPOOL_SIZE - 1].key == NULL) {
+            // 右边有空位，右移
+            memmove(pool + k + 1, pool + k, sizeof(pool[0]) * (EVPOOL_SIZE - k - 1));
+        } else {
+            // 池满，丢掉最左边(最新)的，左移
+            k--;
+            sdsfree(pool[0].key);
+            memmove(pool, pool + 1, sizeof(pool[0]) * k);
+        }
+        pool[k].key = sdsnewlen(key, sdslen(key));
+        pool[k].idle = idle;
+        pool[k].dbid = db->id;
+    }
+}
+
+/**
+ * @brief 按策略选一个要淘汰的键
+ *
+ * @param [out] dbid
+ * @return sds 键的拷贝，调用方释放。 没有可淘汰的键返回NULL
+ */
+static sds evictSelectKey(int* dbid)
+{
+    int policy = server->maxmemoryPolicy;
+    int allkeys = policyIsAllkeys(policy);
+    if (policy == MAXMEMORY_ALLKEYS_RANDOM) {
+        // 轮流从各数据库随机选，避免总是淘汰同一个数据库
+        for (int i = 0; i < server->dbnum; i++) {
+            int j = (++server->evictDb) % server->dbnum;
+            sds key = dictGetRandomKey(server->db[j].kv);
+            if (key) {
+                *dbid = j;
+                return sdsnewlen(key, sdslen(key));
+            }
+        }
+        return NULL;
+    }
+
+    evictionPoolEntry* pool = server->evictionPool;
+    while (1) {
+        unsigned long total = 0;
+        for (int i = 0; i < server->dbnum; i++) {
+            redisDb* db = &server->db[i];
+            dict* d = allkeys ? db->kv : db->expires;
+            if (dictSize(d) == 0) continue;
+            total += dictSize(d);
+            evictionPoolPopulate(db, d, pool);
+        }
+        if (total == 0) return NULL;
+
+        // 从最久没访问的开始，跳过已经被删除的候选
+        for (int k = EVPOOL_SIZE - 1; k >= 0; k--) {
+            if (pool[k].key == NULL) continue;
+            sds key = pool[k].key;
+            int id = pool[k].dbid;
+            pool[k].key = NULL;
+            redisDb* db = &server->db[id];
+            if (dictFind(allkeys ? db->kv : db->expires, key)) {
+                *dbid = id;
+                return key;
+            }
+            sdsfree(key);
+        }
+    }
+}
+
+/**
+ * @brief 内存超过maxmemory时淘汰键，直到降到maxmemory以下。 写命令执行前调用
+ *
+ * @return int EVICT_OK: 没有超过或已降到限制以下。 EVICT_FAIL: noeviction或没有可淘汰的键
+ */
+int performEvictions(void)
+{
+    if (server->maxmemory == 0 || zmallocUsedMemory() <= server->maxmemory)
+        return EVICT_OK;
+    if (server->maxmemoryPolicy == MAXMEMORY_NO_EVICTION)
+        return EVICT_FAIL;
+
+    while (zmallocUsedMemory() > server->maxmemory) {
+        int dbid;
+        sds key = evictSelectKey(&dbid);
+        if (key == NULL) {
+            log_warn("maxmemory reached and no key can be evicted by %s",
+                     maxmemoryPolicyToString(server->maxmemoryPolicy));
+            return EVICT_FAIL;
+        }
+        propagateDeletion(&server->db[dbid], key, sdslen(key));
+        dbDelete(&server->db[dbid], key);
+        sdsfree(key);
+        server->statEvictedKeys++;
+    }
+    return EVICT_OK;
+}
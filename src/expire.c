@@ -0,0 +1,90 @@
+/**
+ * @file expire.c
+ * @brief 主动过期：抽样expires，删除过期键
+ */
+#include "expire.h"
+#include "redis.h"
+#include "db.h"
+#include "util.h"
+
+/**
+ * @brief 键已过期就从kv、expires中删除
+ *
+ * @param [in] db
+ * @param [in] key expires中的键
+ * @param [in] now 毫秒时间戳
+ * @return int 删除返回1
+ */
+static int activeExpireTryKey(redisDb* db, sds key, long long now)
+{
+    if (now <= dbGetExpire(db, key))
+        return 0;
+    propagateDeletion(db, key, sdslen(key));
+    dictDelete(db->kv, key);
+    // expires中的key最后释放
+    dictDelete(db->expires, key);
+    return 1;
+}
+
+void activeExpireCycle(int type)
+{
+    long long start = ustime();
+    long long timelimit;
+    if (type == ACTIVE_EXPIRE_CYCLE_FAST)
+    {
+        // 上一次没有用完预算，且过期键已经不多，不需要快周期
+        if (!server->expireTimelimitHit && server->statExpiredStalePerc < ACTIVE_EXPIRE_CYCLE_ACCEPTABLE_STALE)
+            return;
+        // 两次快周期之间至少间隔一个快周期的时长
+        if (start < server->expireLastFastCycle + ACTIVE_EXPIRE_CYCLE_FAST_DURATION * 2)
+            return;
+        server->expireLastFastCycle = start;
+        timelimit = ACTIVE_EXPIRE_CYCLE_FAST_DURATION;
+    }
+    else
+    {
+        timelimit = (long long)ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC * SERVER_CRON_PERIOD_MS * 1000 / 100;
+    }
+
+    long long now = server->mstime;
+    long sampledTotal = 0, expiredTotal = 0;
+    int iteration = 0;
+    server->expireTimelimitHit = 0;
+    for (int j = 0; j < server->dbnum && !server->expireTimelimitHit; j++)
+    {
+        redisDb* db = &server->db[server->expireDb];
+        server->expireDb = (server->expireDb + 1) % server->dbnum;
+        int sampled, expired;
+        do
+        {
+            unsigned long num = dictSize(db->expires);
+            if (num == 0)
+                break;
+            if (num > ACTIVE_EXPIRE_CYCLE_KEYS_PER_LOOP)
+                num = ACTIVE_EXPIRE_CYCLE_KEYS_PER_LOOP;
+            sampled = expired = 0;
+            while (num--)
+            {
+                sds key = dictGetRandomKey(db->expires);
+                if (key == NULL)
+                    break;
+                sampled++;
+                expired += activeExpireTryKey(db, key, now);
+            }
+            sampledTotal += sampled;
+            expiredTotal += expired;
+            // 取时间有开销，每16轮检查一次
+            if ((++iteration & 0xf) == 0 && ustime() - start > timelimit)
+            {
+                server->expireTimelimitHit = 1;
+                server->statExpiredTimeCapReached++;
+                break;
+            }
+        } while (sampled > 0 && expired * 100 > sampled * ACTIVE_EXPIRE_CYCLE_ACCEPTABLE_STALE);
+    }
+
+    server->statExpiredKeys += expiredTotal;
+    // 过期比例的滑动平均，决定是否需要快周期
+    double stalePerc = sampledTotal ? (double)expiredTotal * 100 / sampledTotal : 0;
+    server->statExpiredStalePerc = stalePerc * 0.05 + server->statExpiredStalePerc * 0.95;
+}
@@ -0,0 +1,292 @@
+/**
+ * @file iothread.c
+ * @brief IO线程: 并行socket读取/解析、回复发送。 命令执行仍在主线程
+ *
+ * 一轮事件循环：
+ *  aeApiPoll -> readFromClient只把客户端加入clientsPendingRead
+ *  beforeSleep -> handleClientsWithPendingReads: 分给IO线程read+解析, 等待完成，主线程依次执行命令
+ *              -> handleClientsWithPendingWrites: 分给IO线程writev，等待完成，没写完的注册可写事件
+ *
+ * 主线程与IO线程通过每个线程的pending计数交接：主线程填好任务后写pending，
+ * IO线程处理完后清零，主线程自旋等待全部清零。同一时刻一个客户端只被一个线程访问。
+ * 待处理客户端较少时不值得唤醒线程，IO线程挂起在各自的互斥锁上。
+ */
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include "iothread.h"
+#include "redis.h"
+#include "client.h"
+#include "log.h"
+#include "net.h"
+
+#define IO_THREADS_OP_READ 0
+#define IO_THREADS_OP_WRITE 1
+#define IO_THREADS_SPIN 1000000  // 空闲时先自旋，再挂起到互斥锁
+#define IO_THREADS_YIELD_EVERY 1024 // 自旋多少次让出一次CPU, 2的幂
+
+typedef struct ioJobs {
+    redisClient** clients;
+    int count;
+    int cap;
+} ioJobs;
+
+static int ioThreadsNum = 1;    // 包括主线程
+static int ioThreadsActive = 0; // IO线程是否在工作。 不工作时持有各自的互斥锁
+static int ioThreadsOp;
+static pthread_t ioThreads[IO_THREADS_MAX];
+static pthread_mutex_t ioThreadsMutex[IO_THREADS_MAX];
+static _Atomic unsigned long ioThreadsPending[IO_THREADS_MAX];
+static ioJobs ioThreadsJobs[IO_THREADS_MAX];    // 0 为主线程
+
+/**
+ * @brief 自旋等待中定期让出CPU。 线程数超过CPU核数时，避免空转的线程抢占干活的线程
+ *
+ * @param [in] spins 已自旋次数
+ */
+static inline void ioThreadsRelax(int spins)
+{
+    if ((spins & (IO_THREADS_YIELD_EVERY - 1)) == IO_THREADS_YIELD_EVERY - 1)
+        sched_yield();
+}
+
+static void ioJobsAdd(ioJobs* jobs, redisClient* c)
+{
+    if (jobs->count == jobs->cap) {
+        jobs->cap = jobs->cap ? jobs->cap * 2 : 16;
+        jobs->clients = realloc(jobs->clients, sizeof(redisClient*) * jobs->cap);
+    }
+    jobs->clients[jobs->count++] = c;
+}
+
+/**
+ * @brief IO线程读取：读socket，并解析出第一条完整命令。 不访问全局状态
+ *
+ * @param [in] c
+ */
+static void ioReadClient(redisClient* c)
+{
+    c->ioResult = clientReadFromSocket(c);
+    c->ioErrno = errno;
+    if (c->ioResult <= 0) return;
+
+    respReqParser* p = &c->reqParser;
+    sds qb = c->readBuf;
+    if (c->reqParsed != RESP_REQ_INCOMPLETE || p->pos >= sdslen(qb)) return;
+    char first = qb[p->pos];
+    // 与processClientQueryBuf一致: 单行响应由主线程跳过
+    if (p->multibulklen == 0 && (first == '+' || first == '-' || first == ':')) return;
+    int ret = respParseRequest(p, qb, sdslen(qb));
+    if (ret != RESP_REQ_INCOMPLETE) c->reqParsed = ret;
+}
+
+static void ioWriteClient(redisClient* c)
+{
+    c->ioResult = replyListWrite(&c->reply, c->fd);
+    c->ioErrno = errno;
+}
+
+static void ioProcessJobs(ioJobs* jobs, int op)
+{
+    for (int i = 0; i < jobs->count; i++) {
+        if (op == IO_THREADS_OP_READ)
+            ioReadClient(jobs->clients[i]);
+        else
+            ioWriteClient(jobs->clients[i]);
+    }
+}
+
+static void* ioThreadMain(void* arg)
+{
+    long id = (long)arg;
+    // IO线程没有server，信号交给主线程处理
+    sigset_t set;
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    while (1) {
+        for (int j = 0; j < IO_THREADS_SPIN; j++) {
+            if (atomic_load_explicit(&ioThreadsPending[id], memory_order_acquire) != 0) break;
+            ioThreadsRelax(j);
+        }
+        if (atomic_load_explicit(&ioThreadsPending[id], memory_order_acquire) == 0) {
+            // 主线程停止IO线程时持有锁，这里挂起
+            pthread_mutex_lock(&ioThreadsMutex[id]);
+            pthread_mutex_unlock(&ioThreadsMutex[id]);
+            continue;
+        }
+        ioProcessJobs(&ioThreadsJobs[id], ioThreadsOp);
+        atomic_store_explicit(&ioThreadsPending[id], 0, memory_order_release);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 创建IO线程，初始为停止状态
+ *
+ * @param [in] num 包括主线程在内的IO线程数
+ */
+void initIOThreads(int num)
+{
+    if (num < 1) num = 1;
+    if (num > IO_THREADS_MAX) num = IO_THREADS_MAX;
+    ioThreadsNum = num;
+    for (long i = 1; i < num; i++) {
+        pthread_mutex_init(&ioThreadsMutex[i], NULL);
+        pthread_mutex_lock(&ioThreadsMutex[i]);
+        atomic_store(&ioThreadsPending[i], 0);
+        if (pthread_create(&ioThreads[i], NULL, ioThreadMain, (void*)i) != 0) {
+            log_error("Create io thread %ld failed: %s", i, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    log_info("IO threads: %d", num);
+}
+
+static void startIOThreads(void)
+{
+    if (ioThreadsActive) return;
+    for (int i = 1; i < ioThreadsNum; i++)
+        pthread_mutex_unlock(&ioThreadsMutex[i]);
+    ioThreadsActive = 1;
+}
+
+static void stopIOThreads(void)
+{
+    if (!ioThreadsActive) return;
+    for (int i = 1; i < ioThreadsNum; i++)
+        pthread_mutex_lock(&ioThreadsMutex[i]);
+    ioThreadsActive = 0;
+}
+
+/**
+ * @brief 分配任务并等待完成。 待处理客户端少于线程数的2倍时只用主线程
+ *
+ * @param [in] clients
+ * @param [in] op
+ */
+static void ioThreadsRun(list* clients, int op)
+{
+    if (ioThreadsNum == 1) {
+        // 没有IO线程时直接处理，不经过任务数组。 分片模式下多个事件循环线程会同时走到这里
+        for (listNode* node = listHead(clients); node; node = node->next) {
+            if (op == IO_THREADS_OP_READ)
+                ioReadClient(node->value);
+            else
+                ioWriteClient(node->value);
+        }
+        return;
+    }
+    int nthreads = ioThreadsNum;
+    if (listLength(clients) < (unsigned long)ioThreadsNum * 2) {
+        stopIOThreads();
+        nthreads = 1;
+    } else {
+        startIOThreads();
+    }
+
+    int i = 0;
+    for (listNode* node = listHead(clients); node; node = node->next) {
+        ioJobsAdd(&ioThreadsJobs[i % nthreads], node->value);
+        i++;
+    }
+    ioThreadsOp = op;
+    for (int j = 1; j < nthreads; j++) {
+        atomic_store_explicit(&ioThreadsPending[j], ioThreadsJobs[j].count, memory_order_release);
+    }
+    ioProcessJobs(&ioThreadsJobs[0], op);
+    for (int j = 1; j < nthreads; j++) {
+        for (int k = 0; atomic_load_explicit(&ioThreadsPending[j], memory_order_acquire) != 0; k++) {
+            ioThreadsRelax(k);
+        }
+    }
+    for (int j = 0; j < nthreads; j++) {
+        ioThreadsJobs[j].count = 0;
+    }
+}
+
+/**
+ * @brief 普通客户端在开启IO线程时延迟读取。 主从连接有自己的状态机，仍在主线程读取
+ *
+ * @param [in] c
+ * @return int
+ */
+int postponeClientRead(redisClient* c)
+{
+    if (ioThreadsNum == 1 || c->flags != REDIS_CLIENT_NORMAL) return 0;
+    if (c->ioPending & CLIENT_PENDING_READ) return 1;
+    c->ioPending |= CLIENT_PENDING_READ;
+    listAddNodeTail(server->clientsPendingRead, listCreateNode(c));
+    return 1;
+}
+
+void clientInstallWriteHandler(redisClient* c)
+{
+    if (c->fd == -1 || (c->ioPending & CLIENT_PENDING_WRITE)) return;
+    c->ioPending |= CLIENT_PENDING_WRITE;
+    listAddNodeTail(server->clientsPendingWrite, listCreateNode(c));
+}
+
+void handleClientsWithPendingReads(void)
+{
+    list* clients = server->clientsPendingRead;
+    if (listLength(clients) == 0) return;
+    ioThreadsRun(clients, IO_THREADS_OP_READ);
+
+    // 主线程按顺序执行命令
+    listNode* node;
+    while ((node = listHead(clients)) != NULL) {
+        redisClient* c = node->value;
+        listDelNode(clients, node);
+        c->ioPending &= ~CLIENT_PENDING_READ;
+        if (c->flags & CLIENT_TO_CLOSE) continue;
+        errno = c->ioErrno;
+        clientReadDone(c, c->ioResult);
+    }
+}
+
+void handleClientsWithPendingWrites(void)
+{
+    list* clients = server->clientsPendingWrite;
+    if (listLength(clients) == 0) return;
+    ioThreadsRun(clients, IO_THREADS_OP_WRITE);
+
+    listNode* node;
+    while ((node = listHead(clients)) != NULL) {
+        redisClient* c = node->value;
+        listDelNode(clients, node);
+        c->ioPending &= ~CLIENT_PENDING_WRITE;
+        // 对象引用计数只在主线程修改
+        replyListReleaseSent(&c->reply);
+        if (c->flags & CLIENT_TO_CLOSE) continue;
+        if (c->ioResult < 0) {
+            log_error("Write to client [%d]%s:%d failed: %s", c->fd, c->ip, c->port, strerror(c->ioErrno));
+            clientToclose(c);
+            continue;
+        }
+        if (clientHasPendingReplies(c)) {
+            // 没写完，等待可写事件继续
+            if (aeCreateFileEvent(server->eventLoop, c->fd, AE_WRITABLE, sendToClient, c) == AE_ERROR) {
+                clientToclose(c);
+            }
+            continue;
+        }
+        clientReplySent(c);
+    }
+}
+
+void ioThreadsUnlinkClient(redisClient* c)
+{
+    listNode* node;
+    if (c->ioPending & CLIENT_PENDING_READ) {
+        node = listSearchKey(server->clientsPendingRead, c);
+        if (node) listDelNode(server->clientsPendingRead, node);
+    }
+    if (c->ioPending & CLIENT_PENDING_WRITE) {
+        node = listSearchKey(server->clientsPendingWrite, c);
+        if (node) listDelNode(server->clientsPendingWrite, node);
+    }
+    c->ioPending = 0;
+}
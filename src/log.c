@@ -107,6 +107,11 @@ void log_set_level(int level) {
 }
 
 
+int log_get_level(void) {
+  return L.level;
+}
+
+
 void log_set_quiet(bool enable) {
   L.quiet = enable;
 }
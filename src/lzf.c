@@ -0,0 +1,146 @@
+/**
+ * LZF 压缩/解压
+ *
+ * 压缩用一张哈希表记录每个3字节前缀上次出现的位置，命中且在8KB以内就向后延长匹配，
+ * 输出回溯引用，否则输出字面量。 不追求最高压缩率，换取和memcpy同一个量级的速度。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "lzf.h"
+
+#define LZF_HLOG 13
+#define LZF_HSIZE (1 << LZF_HLOG)
+#define LZF_MAX_LIT 32
+
+static inline unsigned _lzfHash(const uint8_t* p)
+{
+    uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return (v * 2654435761u) >> (32 - LZF_HLOG);
+}
+
+/**
+ * @brief 压缩
+ *
+ * @param [in] in
+ * @param [in] inLen
+ * @param [out] out
+ * @param [in] outLen 输出缓冲大小。 通常传inLen减去期望至少节省的字节数
+ * @return size_t 压缩后的长度，放不进outLen(压缩没有收益)时返回0
+ */
+size_t lzfCompress(const void* in, size_t inLen, void* out, size_t outLen)
+{
+    // 记录位置+1，0表示空。 表放在栈上，多线程可以同时压缩
+    uint32_t htab[LZF_HSIZE];
+    memset(htab, 0, sizeof(htab));
+
+    const uint8_t* ip = in;
+    const uint8_t* inEnd = ip + inLen;
+    uint8_t* op = out;
+    uint8_t* outEnd = op + outLen;
+    uint8_t* litCtrl = NULL;    // 当前字面量块的控制字节
+    unsigned lit = 0;
+
+    while (ip < inEnd) {
+        if (inEnd - ip >= 3) {
+            unsigned h = _lzfHash(ip);
+            uint32_t pos = htab[h];
+            htab[h] = (uint32_t)(ip - (const uint8_t*)in) + 1;
+            const uint8_t* ref = pos ? (const uint8_t*)in + pos - 1 : NULL;
+            size_t dist = ref ? (size_t)(ip - ref) : 0;
+            if (ref && dist <= LZF_MAX_OFF && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+                size_t maxLen = inEnd - ip < LZF_MAX_REF ? (size_t)(inEnd - ip) : LZF_MAX_REF;
+                size_t len = 3;
+                while (len < maxLen && ref[len] == ip[len]) len++;
+
+                // 结束当前字面量块，写回溯引用
+                if (lit) {
+                    *litCtrl = lit - 1;
+                    lit = 0;
+                }
+                if (outEnd - op < 3) return 0;
+                size_t off = dist - 1, l = len - 2;
+                if (l < 7) {
+                    *op++ = (uint8_t)((off >> 8) + (l << 5));
+                } else {
+                    *op++ = (uint8_t)((off >> 8) + (7 << 5));
+                    *op++ = (uint8_t)(l - 7);
+                }
+                *op++ = (uint8_t)off;
+
+                // 只把匹配末尾的两个位置放进表，和liblzf一样，匹配内部的位置跳过
+                ip += len;
+                for (const uint8_t* p = ip - 2; p < ip; p++) {
+                    if (inEnd - p >= 3)
+                        htab[_lzfHash(p)] = (uint32_t)(p - (const uint8_t*)in) + 1;
+                }
+                continue;
+            }
+        }
+        // 字面量
+        if (lit == 0) {
+            if (op >= outEnd) return 0;
+            litCtrl = op++;
+        }
+        if (op >= outEnd) return 0;
+        *op++ = *ip++;
+        if (++lit == LZF_MAX_LIT) {
+            *litCtrl = lit - 1;
+            lit = 0;
+        }
+    }
+    if (lit) *litCtrl = lit - 1;
+    return op - (uint8_t*)out;
+}
+
+/**
+ * @brief 解压。 检查每个块的边界，损坏的输入不会越界读写
+ *
+ * @param [in] in
+ * @param [in] inLen
+ * @param [out] out
+ * @param [in] outLen
+ * @return size_t 解压后的长度，输入损坏或输出放不下时返回0
+ */
+size_t lzfDecompress(const void* in, size_t inLen, void* out, size_t outLen)
+{
+    const uint8_t* ip = in;
+    const uint8_t* inEnd = ip + inLen;
+    uint8_t* op = out;
+    uint8_t* outEnd = op + outLen;
+
+    while (ip < inEnd) {
+        unsigned ctrl = *ip++;
+        if (ctrl < LZF_MAX_LIT) {
+            size_t len = ctrl + 1;
+            if (inEnd - ip >= LZF_MAX_LIT && outEnd - op >= LZF_MAX_LIT) {
+                // 两边都有余量时按定长复制，编译为几条向量指令，不调用memcpy
+                memcpy(op, ip, LZF_MAX_LIT);
+            } else {
+                if ((size_t)(inEnd - ip) < len || (size_t)(outEnd - op) < len) return 0;
+                memcpy(op, ip, len);
+            }
+            op += len;
+            ip += len;
+            continue;
+        }
+        size_t len = ctrl >> 5;
+        if (len == 7) {
+            if (ip >= inEnd) return 0;
+            len += *ip++;
+        }
+        if (ip >= inEnd) return 0;
+        size_t dist = ((size_t)(ctrl & 0x1f) << 8) + *ip++ + 1;
+        len += 2;
+        if (dist > (size_t)(op - (uint8_t*)out) || (size_t)(outEnd - op) < len) return 0;
+        const uint8_t* ref = op - dist;
+        if (dist >= 8 && (size_t)(outEnd - op) >= len + 8) {
+            // 每次8字节，距离不小于8时读到的都是已经写好的字节，多写的字节在输出长度之外或随后被覆盖
+            for (size_t k = 0; k < len; k += 8) memcpy(op + k, ref + k, 8);
+            op += len;
+        } else {
+            // 引用和输出重叠（重复的短模式）或者接近输出末尾，逐字节复制
+            while (len--) *op++ = *ref++;
+        }
+    }
+    return op - (uint8_t*)out;
+}
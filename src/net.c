@@ -79,6 +79,23 @@ static int anetSetReuseAddr(int fd)
     return NET_OK;
 }
 
+/**
+ * @brief 设置SO_REUSEPORT, 多个socket绑定同一端口，由内核把新连接分散到各个socket
+ *
+ * @param [in] fd
+ * @return int
+ */
+static int anetSetReusePort(int fd)
+{
+    int yes = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1)
+    {
+        log_error("set reuse port, %s", strerror(errno));
+        return NET_ERR;
+    }
+    return NET_OK;
+}
+
 /**
  * @brief 设置非阻塞
  *
@@ -161,12 +178,13 @@ static int anetKeepAlive(int fd, int interval)
 /**
  * @brief 创建TCP服务器
  * 封装了socket，bind，listen
- * @param [in] err 错误信息
  * @param [in] port
  * @param [in] bindaddr
+ * @param [in] backlog
+ * @param [in] reuseport 是否设置SO_REUSEPORT
  * @return int 监听fd
  */
-int anetTcpServer(int port, char *bindaddr, int backlog)
+static int _anetTcpServer(int port, char *bindaddr, int backlog, int reuseport)
 {
     int sockfd, rv;
     char _port[6]; // 端口号最大65535
@@ -194,6 +212,11 @@ int anetTcpServer(int port, char *bindaddr, int backlog)
             continue;
         }
         anetSetReuseAddr(sockfd);
+        if (reuseport && anetSetReusePort(sockfd) == NET_ERR)
+        {
+            close(sockfd);
+            continue;
+        }
         if (bind(sockfd, p->ai_addr, p->ai_addrlen) == -1)
         {
             log_debug("TRY bind() failed%s", strerror(errno));
@@ -217,6 +240,19 @@ int anetTcpServer(int port, char *bindaddr, int backlog)
     return sockfd;
 }
 
+int anetTcpServer(int port, char *bindaddr, int backlog)
+{
+    return _anetTcpServer(port, bindaddr, backlog, 0);
+}
+
+/**
+ * @brief 创建SO_REUSEPORT的TCP服务器。 分片模式下每个分片各自监听同一端口
+ */
+int anetTcpServerReusePort(int port, char *bindaddr, int backlog)
+{
+    return _anetTcpServer(port, bindaddr, backlog, 1);
+}
+
 /**
  * @brief 获取客户fd的 ip和host
  *
@@ -459,7 +495,8 @@ bool checkSockErr(int sockfd)
             log_error("Socket [%d] error:  %s", sockfd, strerror(err));  // 打印错误信息
             return false;
         }
-    } else {
+    } else if (errno != ENOTSOCK) {
+        // eventfd、pipe没有socket错误状态，不算错误
         log_error("Socket getsockopt failed: [%d] %s", sockfd,strerror(errno));
         return false;
     }
@@ -3,14 +3,20 @@
  *
  * RDB 文件格式
  * REDIS 标识
- * 0001 版本
+ * 0002 版本
  * ---database 0 ---
  * SELECTDB 标识
- * 1 数据库编号1字节
- * type,key,val
+ * 数据库编号(长度编码)
+ * RESIZEDB 键数、过期键数(长度编码)，加载时预先分配dict
+ * [EXPIRETIME_MS 8字节] type,key,val
+ *   字符串: 长度+字节，整数编码，或LZF: ENC_LZF 压缩长度 原始长度 压缩数据
  * ----------
  * EOF
- * CHECKSUM
+ * CHECKSUM 前面所有字节的CRC64，8字节小端
+ *
+ * 保存经过带缓冲的rio，边写边算校验和，不回读文件，大小不受限制。
+ * 保存先写临时文件，fsync后rename，中途失败不影响原有的RDB。
+ * 加载时mmap整个文件直接解析，各数据库段可以由多个线程并行加载。
  */
 
 
@@ -20,84 +26,130 @@
 
 #include <fcntl.h>
 #include <stdint.h>
+#include <limits.h>
 #include "log.h"
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include "crypto.h"
+#include "rio.h"
 #include "util.h"
+#include "zmalloc.h"
+#include "crc64.h"
+#include "lzf.h"
+#include <pthread.h>
+#include <sys/mman.h>
 /**
  * @brief 1字节。对象类型、RDB操作符
  * 
- * @param [in] fp 
+ * @param [in] r 
  * @param [in] type 
  */
-void _rdbSaveType(FILE *fp, unsigned char type)
+static void _rdbSaveType(rio *r, unsigned char type)
 {
-    fwrite(&type, 1, 1, fp);
+    rioWrite(r, &type, 1);
 }
 
 /**
- * @brief Save the length of the given unsigned long value to the RDB file.
- *
- * This function writes the length of the given unsigned long value to the specified file pointer.
- * The length is encoded in a variable-length format, using 1, 2, or 5 bytes depending on the value.
- *
- * @param [in] fp The file pointer to write the length to.
- * @param [in] len The unsigned long value to save.
+ * @brief 长度编码，见rdb.h。 按长度占用1、2、5、9字节
  *
- * @return int
- * 
- * @note len最长为4字节
- *  len < 64 : 占用1字节，6位存储， 标记00xxxxxx
- *  len < 1<<14 : 占用2字节，14位存储，标记01xxxxxx xxxxxxxx
- *  len : 占用5字节，#1标记，剩余存储。    标记11111110 xxxxxxxx xxxxxxxx xxxxxxxx xxxxxxxx
- *  非法：标记11000000
+ * @param [in] r
+ * @param [in] len
  */
-int _rdbSaveLen(FILE* fp, uint32_t len)
+static void _rdbSaveLen(rio *r, uint64_t len)
 {
-    unsigned char buf[5];
-    if (len < (1<<6)) { 
-        buf[0] = len & 0x3F; // 获取低6位 
-        return fwrite(buf, 1, 1, fp);
-    } else if (len < (1<<14)) { 
-        buf[0] = 0x80 |((len >> 8) & 0x3F);
+    unsigned char buf[9];
+    if (len < (1 << 6)) {
+        buf[0] = RDB_6BITLEN | len;
+        rioWrite(r, buf, 1);
+    } else if (len < (1 << 14)) {
+        buf[0] = RDB_14BITLEN | (len >> 8);
         buf[1] = len & 0xFF;
-        return fwrite(buf, 1, 2, fp);
-    } else { 
-        buf[0] = 0XFE;
-        
-        memcpy(buf + 1, &len, 4);
-        return fwrite(buf, 1, 5, fp);
+        rioWrite(r, buf, 2);
+    } else if (len <= UINT32_MAX) {
+        uint32_t v = len;
+        buf[0] = RDB_32BITLEN;
+        memcpy(buf + 1, &v, 4);
+        rioWrite(r, buf, 5);
+    } else {
+        buf[0] = RDB_64BITLEN;
+        memcpy(buf + 1, &len, 8);
+        rioWrite(r, buf, 9);
     }
 }
 
+static void _rdbSaveLzfString(rio *r, const void *lzf, size_t lzfLen, size_t rawLen)
+{
+    _rdbSaveType(r, RDB_ENC_LZF);
+    _rdbSaveLen(r, lzfLen);
+    _rdbSaveLen(r, rawLen);
+    rioWrite(r, lzf, lzfLen);
+}
 
-static void _rdbSaveStringObject(FILE *fp, robj* obj)
+/**
+ * @brief 开启rdbcompression时，超过RDB_LZF_MIN_LEN的字符串尝试LZF压缩，至少节省4字节才使用
+ *
+ * @return int 1已经按压缩格式写入
+ */
+static int _rdbTrySaveLzfString(rio *r, const char *s, size_t len)
+{
+    if (!server->rdbCompression || len <= RDB_LZF_MIN_LEN) return 0;
+    size_t outLen = len - 4;
+    void *buf = zmalloc(outLen);
+    size_t n = lzfCompress(s, len, buf, outLen);
+    if (n) _rdbSaveLzfString(r, buf, n, len);
+    zfree(buf);
+    return n != 0;
+}
+
+static void _rdbSaveRawString(rio *r, const char *s, size_t len)
+{
+    if (_rdbTrySaveLzfString(r, s, len)) return;
+    _rdbSaveLen(r, len);
+    rioWrite(r, s, len);
+}
+
+static void _rdbSaveStringObject(rio *r, robj* obj)
 {
     switch (obj->encoding)
     {
     case REDIS_ENCODING_INT:
-        int val = (int)(obj->ptr);
-        if (val <= (1<<7)) {
-            // 8bit
-            _rdbSaveType(fp, RDB_ENC_INT8);
-            fwrite(&val, 1, 1, fp);
-        } else if (val <= (1<< 15)) {
-            // 16bit
-            _rdbSaveType(fp, RDB_ENC_INT16);
-            fwrite(&val, 1, 2, fp);
+        long val = (long)(obj->ptr);
+        // 按有符号范围选最短编码，INCR/DECR会产生负数和超过32位的值
+        if (val >= INT8_MIN && val <= INT8_MAX) {
+            unsigned char buf[2] = {RDB_ENC_INT8, (unsigned char)(int8_t)val};
+            rioWrite(r, buf, 2);
+        } else if (val >= INT16_MIN && val <= INT16_MAX) {
+            unsigned char buf[3] = {RDB_ENC_INT16};
+            int16_t v = val;
+            memcpy(buf + 1, &v, 2);
+            rioWrite(r, buf, 3);
+        } else if (val >= INT32_MIN && val <= INT32_MAX) {
+            unsigned char buf[5] = {RDB_ENC_INT32};
+            int32_t v = val;
+            memcpy(buf + 1, &v, 4);
+            rioWrite(r, buf, 5);
         } else {
-            // 32bit
-            _rdbSaveType(fp, RDB_ENC_INT32);
-            fwrite(&val, 1, 4, fp);
+            // 超过32位保存为十进制字符串，加载时重新编码为INT
+            char buf[24];
+            int n = snprintf(buf, sizeof(buf), "%ld", val);
+            _rdbSaveRawString(r, buf, n);
         }
         break;
     case REDIS_ENCODING_EMBSTR:
     case REDIS_ENCODING_RAW:
-        int len = sdslen(obj->ptr);
-        _rdbSaveLen(fp, len);
-        fwrite(((sds*)(obj->ptr))->buf, 1, len, fp);
+        _rdbSaveRawString(r, obj->ptr, sdslen(obj->ptr));
+        break;
+    case REDIS_ENCODING_COMPRESSED:
+        // 内存中已经是LZF格式，直接写入，不重新压缩
+        if (server->rdbCompression) {
+            sds lzf = obj->ptr;
+            _rdbSaveLzfString(r, lzf + OBJ_COMPRESS_HDR, sdslen(lzf) - OBJ_COMPRESS_HDR,
+                              robjCompressedRawLen(obj));
+        } else {
+            sds raw = robjDecompressString(obj);
+            _rdbSaveRawString(r, raw, sdslen(raw));
+            sdsfree(raw);
+        }
         break;
     default:
         break;
@@ -105,12 +157,12 @@ static void _rdbSaveStringObject(FILE *fp, robj* obj)
 
 }
 
-void _rdbSaveValue(FILE* fp, robj *obj)
+static void _rdbSaveValue(rio *r, robj *obj)
 {
     switch (obj->type)
     {
     case REDIS_STRING:
-        _rdbSaveStringObject(fp, obj);
+        _rdbSaveStringObject(r, obj);
         break;
     
     default:
@@ -118,100 +170,140 @@ void _rdbSaveValue(FILE* fp, robj *obj)
         break;
     }
 }
-void _rdbSaveKey(FILE *fp, sds* key)
-{
-    _rdbSaveLen(fp, sdslen(key));
-    fwrite(key->buf, 1, sdslen(key), fp);
-}
-
 
-// 全量保存
-void rdbSave()
+/**
+ * @brief 把所有数据库写入rio，末尾追加校验和。 出错记录在r->error
+ *
+ * @param [in] r 需要设置updateCksum
+ * @return int 0成功，-1失败
+ */
+static int rdbSaveRio(rio *r)
 {
-    log_debug("======RDB Save(child:%u)======", getpid());
-    int nwritten = 0;
-    int nread = 0;
-    FILE* fp = fopen(server->rdbfile, "w+");
-    if (!fp) {
-        perror("rdbSave can't open file"); 
-        return;
-    }
-    if ((nwritten = fwrite("REDIS0001", 1, 9, fp))< 9) {
-        perror("rdbSave can't write : REDIS0001");
-        exit(1);
-        return;
-    }
+    rioWrite(r, RDB_MAGIC RDB_VERSION, 9);
 
-    for (int i = 0; i < server->dbnum; i++) {
+    for (int i = 0; i < server->dbnum && !r->error; i++) {
         redisDb* db = server->db + i;
         if (dictIsEmpty(db->kv)) continue;
 
-        _rdbSaveType(fp, RDB_SELECTDB); // 1字节
-
-        fwrite(&db->id, 1, 1, fp); //
+        _rdbSaveType(r, RDB_SELECTDB);
+        _rdbSaveLen(r, db->id);
+        _rdbSaveType(r, RDB_RESIZEDB);
+        _rdbSaveLen(r, dictSize(db->kv));
+        _rdbSaveLen(r, dictSize(db->expires));
 
         dictIterator* di = dictGetIterator(db->kv);
         dictEntry* entry;
-        while ((entry = dictIterNext(di))!= NULL) {
-            sds *key = entry->key;
+        while ((entry = dictIterNext(di))!= NULL && !r->error) {
+            sds key = entry->key;
             robj *val = entry->v.val;
 
-            if (dictContains(db->expires, key))
+            long long when = dbGetExpire(db, key);
+            if (when >= 0)
             {
-                uint8_t flag = 0xFD;
-                fwrite(&flag, 1, 1, fp);
-                long time = (long)dictFetchValue(db->expires, key);
-                fwrite(&time, 8, 1, fp);
+                unsigned char buf[9] = {RDB_EXPIRETIME_MS};
+                int64_t ms = when;
+                memcpy(buf + 1, &ms, 8);
+                rioWrite(r, buf, 9);
             }
 
-            _rdbSaveType(fp, val->type);
-            _rdbSaveKey(fp, key);
-            _rdbSaveValue(fp, val);
+            _rdbSaveType(r, val->type);
+            _rdbSaveRawString(r, key, sdslen(key));
+            _rdbSaveValue(r, val);
         }
         dictReleaseIterator(di);
     }
-    // 3. 写入EOF
-    _rdbSaveType(fp, RDB_EOF); // 1字节
-
-    fflush(fp); // 确保写入文件
-    fseek(fp, 0, SEEK_SET); // 移动到开头
-
-    // 4. 校验和 
-    char buf[RDB_MAX_SIZE] = {0};
-    nread = fread(buf,1, RDB_MAX_SIZE, fp);
-    assert(nread > 0);
-    char hash[RDB_CHECKSUM_LEN];
-    compute_sha256(buf, nread, hash); 
-    
-    int ret = verify_sha256(buf, nread, hash);
-    if (ret == 1) log_debug("Verify success!");
-    else log_error("Verify failed!!");
+    _rdbSaveType(r, RDB_EOF);
 
-    fseek(fp, 0, SEEK_END); // 移动到末尾写入
-    fwrite(hash, 1, RDB_CHECKSUM_LEN, fp);
+    // 校验和覆盖EOF之前的所有字节，本身不参与计算
+    uint64_t cksum = r->cksum;
+    r->updateCksum = NULL;
+    rioWrite(r, &cksum, RDB_CHECKSUM_LEN);
+    return r->error ? -1 : 0;
+}
 
-    fflush(fp);
-    fclose(fp);
-    log_debug("Save the RDB file success");
+/**
+ * @brief 全量保存到server->rdbfile。 先写临时文件，落盘后rename替换
+ *
+ * @return int 0成功，-1失败
+ */
+int rdbSave()
+{
+    log_debug("======RDB Save(child:%u)======", getpid());
+    char tmpfile[PATH_MAX];
+    snprintf(tmpfile, sizeof(tmpfile), "%s.tmp-%d", server->rdbfile, (int)getpid());
+    int fd = open(tmpfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log_error("rdbSave can't open %s: %s", tmpfile, strerror(errno));
+        return -1;
+    }
+
+    long long start = ustime();
+    rio r;
+    rioInitWithBufferedFD(&r, fd, RDB_IO_BUF_SIZE);
+    r.updateCksum = rioGenericUpdateChecksum;
+    rdbSaveRio(&r);
+    rioFlush(&r);
+    size_t written = r.processedBytes;
+    int err = r.error;
+    rioFreeBufferedFD(&r);
+
+    if (err || fsync(fd) == -1) {
+        log_error("Write error saving DB on disk: %s", strerror(errno));
+        close(fd);
+        unlink(tmpfile);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmpfile, server->rdbfile) == -1) {
+        log_error("rename %s to %s failed: %s", tmpfile, server->rdbfile, strerror(errno));
+        unlink(tmpfile);
+        return -1;
+    }
+    double secs = (ustime() - start) / 1e6;
+    log_info("DB saved on disk: %zu bytes in %.3f seconds (%.0f MB/s)",
+             written, secs, secs > 0 ? written / secs / (1024 * 1024) : 0);
+    return 0;
+}
+
+/**
+ * @brief 不落盘，把RDB直接写入fd。 无盘复制的子进程写管道
+ *
+ * @param [in] fd 阻塞fd
+ * @return int 0成功，-1失败
+ */
+int rdbSaveToFd(int fd)
+{
+    rio r;
+    rioInitWithBufferedFD(&r, fd, RDB_IO_BUF_SIZE);
+    r.updateCksum = rioGenericUpdateChecksum;
+    rdbSaveRio(&r);
+    rioFlush(&r);
+    int err = r.error;
+    rioFreeBufferedFD(&r);
+    return err ? -1 : 0;
 }
 
 /**
  * 开启一个子进程，做rdbsave
  * @warning 需要控制资源开销，调整bgsave。
  * @details 每次fork都相当于内存快照。
+ * @return int 0子进程已启动，-1 fork失败
  */
-void bgsave()
+int bgsave()
 {
     pid_t pid = fork();
     if (pid == 0) {
-        rdbSave();
-        exit(0);
+        exit(rdbSave() == 0 ? 0 : 1);
     } else if (pid < 0) {
-        log_debug("Error: fork failed");
+        log_error("Can't save in background: fork: %s", strerror(errno));
+        return -1;
     }
     // 父亲进程continue
+    server->dirtyBeforeBgsave = server->dirty;
     server->rdbChildPid = pid;
+    server->rdbChildType = RDB_CHILD_TYPE_DISK;
     server->isBgSaving = 1;
+    return 0;
 }
 
 void bgSaveIfNeeded()
@@ -221,6 +313,11 @@ void bgSaveIfNeeded()
         log_debug("BGSAVE is running, no need....");
         return;
     }
+    // 同时只有一个子进程，避免两份写时复制和磁盘竞争
+    if (server->aof.childPid != -1) {
+        log_debug("AOF rewrite is running, delay BGSAVE");
+        return;
+    }
 
     /*  bgsave：  满足一个就可以bgsave
      *  服务器在距离上次save秒内，对数据库进行了至少n此修改。就
@@ -237,206 +334,409 @@ void bgSaveIfNeeded()
     }
 }
 
-int eof(FILE* fp)
+/**
+ * @brief 加载失败：文件截断、格式错误或校验和不符，数据库只加载了一部分，不能继续运行
+ */
+static void rdbLoadFail(const char *reason)
 {
-    unsigned char c;
-    fread(&c, 1, 1, fp);
-    return c == RDB_EOF; // 1字节
+    log_error("Bad RDB file %s: %s. Unrecoverable error, aborting now.", server->rdbfile, reason);
+    exit(EXIT_FAILURE);
 }
 
-uint32_t _rdbLoadLen(FILE* fp)
+/* 加载游标：在mmap的文件上直接解析，每次取数据前检查边界 */
+typedef struct rdbCursor {
+    const unsigned char *p;
+    const unsigned char *end;
+} rdbCursor;
+
+static const unsigned char* _rdbTake(rdbCursor *c, size_t len)
 {
-    unsigned char buf[5];
-    memset(buf, 0, sizeof(buf));
-    if (fread(buf, 1, 1, fp) == 0) return 0;  // 读取失败
-
-    // 0xC0:11000000 提取高两位
-    if ((buf[0] & 0xC0) == 0x00) {  // 1 字节编码 (00xxxxxx)
-        return buf[0] & 0x3F;
-    } else if ((buf[0] & 0xC0) == 0x80) {  // 2 字节编码 (10xxxxxx xxxxxxxx)
-        if (fread(buf + 1, 1, 1, fp) == 0) return 0;
-        return ((buf[0] & 0x3F) << 8) | buf[1];
-    } else if (buf[0] == 0xFE) {  // 5 字节编码 (11111110 + 4 字节数据)
-        if (fread(buf + 1, 4, 1, fp) == 0) return 0;
+    if ((size_t)(c->end - c->p) < len)
+        rdbLoadFail("unexpected end of file");
+    const unsigned char *p = c->p;
+    c->p += len;
+    return p;
+}
+
+static unsigned char _rdbPeekType(rdbCursor *c)
+{
+    if (c->p == c->end)
+        rdbLoadFail("unexpected end of file");
+    return *c->p;
+}
+
+static int64_t _rdbLoadMillis(rdbCursor *c)
+{
+    int64_t ms;
+    memcpy(&ms, _rdbTake(c, 8), 8);
+    return ms;
+}
+
+/**
+ * @brief 读取长度编码
+ *
+ * @param [in] c
+ * @param [out] encoded 不为NULL时，遇到特殊编码置1，返回编码类型(RDB_ENC_*)
+ * @return uint64_t
+ */
+static uint64_t _rdbLoadLen(rdbCursor *c, int *encoded)
+{
+    if (encoded) *encoded = 0;
+    unsigned char first = *_rdbTake(c, 1);
+    switch (first & 0xC0) {
+    case RDB_6BITLEN:
+        return first & 0x3F;
+    case RDB_14BITLEN:
+        return ((uint64_t)(first & 0x3F) << 8) | *_rdbTake(c, 1);
+    case RDB_ENCVAL:
+        if (encoded == NULL) rdbLoadFail("unexpected encoded length");
+        *encoded = 1;
+        return first;
+    }
+    if (first == RDB_32BITLEN) {
         uint32_t len;
-        memcpy(&len, buf + 1, 4);
+        memcpy(&len, _rdbTake(c, 4), 4);
+        return len;
+    }
+    if (first == RDB_64BITLEN) {
+        uint64_t len;
+        memcpy(&len, _rdbTake(c, 8), 8);
         return len;
+    }
+    rdbLoadFail("invalid length encoding");
+    return 0;
+}
+
+/* 解析出的字符串，字节都指向映射区 */
+typedef struct rdbString {
+    int encoding;               // 0为原始字节，否则为RDB_ENC_*
+    const unsigned char *buf;   // 原始字节或LZF压缩数据
+    size_t len;                 // buf的长度
+    size_t rawLen;              // LZF: 解压后的长度
+    long val;                   // 整数编码的值
+} rdbString;
+
+static void _rdbLoadString(rdbCursor *c, rdbString *str)
+{
+    int encoded;
+    uint64_t n = _rdbLoadLen(c, &encoded);
+    str->encoding = encoded ? (int)n : 0;
+    if (!encoded) {
+        str->len = n;
+        str->buf = _rdbTake(c, n);
+    } else if (n == RDB_ENC_INT8) {
+        str->val = (int8_t)*_rdbTake(c, 1);
+    } else if (n == RDB_ENC_INT16) {
+        int16_t v;
+        memcpy(&v, _rdbTake(c, 2), 2);
+        str->val = v;
+    } else if (n == RDB_ENC_INT32) {
+        int32_t v;
+        memcpy(&v, _rdbTake(c, 4), 4);
+        str->val = v;
+    } else if (n == RDB_ENC_LZF) {
+        str->len = _rdbLoadLen(c, NULL);
+        str->rawLen = _rdbLoadLen(c, NULL);
+        str->buf = _rdbTake(c, str->len);
     } else {
-        return 0;  // 错误
+        rdbLoadFail("unknown string encoding");
     }
+}
 
+/**
+ * @brief 解压LZF字符串到新的sds
+ */
+static sds _rdbDecompress(const rdbString *str)
+{
+    sds s = sdsnewlen(NULL, str->rawLen);
+    if (lzfDecompress(str->buf, str->len, s, str->rawLen) != str->rawLen)
+        rdbLoadFail("invalid LZF data");
+    return s;
 }
 
-robj* _rdbLoadStringObject(FILE* fp)
+static robj* _rdbLoadStringObject(rdbCursor *c)
 {
-    unsigned char c;
-    fread(&c, 1, 1, fp);
-    if (c == RDB_ENC_INT8) {
-        unsigned char val;
-        char buf[12];
-        fread(&val, 1, 1, fp);
-        snprintf(buf, 11, "%d", val);
-        // log_debug("Load STRING(int) %d", val);
-        return robjCreateStringObject(buf);
-    } else if (c == RDB_ENC_INT16) {
-        /* code */
-        int16_t val;
-        char buf[12];
-        fread(&val, 1, 2, fp);
-        snprintf(buf, 11, "%d", val);
-        // log_debug("Load STRING(int) %d", val);
-
-        return robjCreateStringObject(buf);
-    } else if (c == RDB_ENC_INT32) {
-        /* code */
-        int val;
-        char buf[12];
-        fread(&val, 1, 4, fp);
-        snprintf(buf, 11, "%d", val);
-        // log_debug("Load STRING(int) %d", val);
-
-        return robjCreateStringObject(buf);
-    }else {
-        // RAW, EMBSTR字符串
-        fseek(fp, -1, SEEK_CUR);    // 回退一个字节，
-        uint32_t len = _rdbLoadLen(fp);
-        char * buf = malloc(len + 1);
-        fread(buf, 1, len, fp);
-        buf[len] = '\0';
-        // log_debug("Load STRING() %s", buf);
-
-        robj* obj = robjCreateStringObject(buf);
-        free(buf);
+    rdbString str;
+    _rdbLoadString(c, &str);
+    switch (str.encoding) {
+    case 0:
+        // 直接从映射区创建，短字符串仍可能编码为INT或EMBSTR
+        return robjCreateStringObjectLen((const char *)str.buf, str.len);
+    case RDB_ENC_LZF: {
+        // 内存中也压缩保存时直接使用文件中的压缩数据，不解压
+        size_t threshold = robjCompressThreshold();
+        if (threshold && str.rawLen >= threshold && str.rawLen <= UINT32_MAX)
+            return robjCreateCompressedStringObject(str.buf, str.len, str.rawLen);
+        sds raw = _rdbDecompress(&str);
+        robj *obj = robjCreateStringObjectLen(raw, sdslen(raw));
+        sdsfree(raw);
         return obj;
-    } 
+    }
+    default:
+        return robjCreateStringObjectFromLong(str.val);
+    }
 }
 
-unsigned char _rdbLoadType(FILE* fp)
+static sds _rdbLoadKey(rdbCursor *c)
 {
-    unsigned char c;
-    fread(&c, 1, 1, fp);
-    return c; // 1字节
-    
+    rdbString str;
+    _rdbLoadString(c, &str);
+    if (str.encoding == 0)
+        return sdsnewlen(str.buf, str.len);
+    if (str.encoding == RDB_ENC_LZF)
+        return _rdbDecompress(&str);
+    char buf[24];
+    return sdsnewlen(buf, snprintf(buf, sizeof(buf), "%ld", str.val));
 }
-sds*  _rdbLoadKey(FILE *fp)
-{
 
-    uint32_t len = _rdbLoadLen(fp);
-    sds* key = sdsempty();
-    char buf[1024];
-    size_t nread= fread(buf, 1, len, fp);
-    sdscatlen(key, buf, nread);
-    return key;
-}
-robj* _rdbLoadObject(FILE* fp, unsigned char type)
+static robj* _rdbLoadObject(rdbCursor *c, unsigned char type)
 {
-    robj* obj;
     switch (type)
     {
     case RDB_TYPE_STRING:
-        obj = _rdbLoadStringObject(fp);
-        break;
-    
+        return _rdbLoadStringObject(c);
     default:
-        break;
+        rdbLoadFail("unknown object type");
+        return NULL;
     }
-    return obj;
 }
 
 /**
- * @brief 将本地.rdb加载到数据库
- * 
+ * @brief 解析一个数据库段：从SELECTDB之后到下一个SELECTDB或EOF（不消耗）
+ *
+ * @param [in] c
+ * @param [in] db
+ * @return long long 加载的键数
  */
-void rdbLoad()
+static long long _rdbLoadSection(rdbCursor *c, redisDb *db)
 {
-    // TODO rdb加载不起来？？？
-    FILE *fp = fopen(server->rdbfile, "r+");
-    if (fp == NULL)
+    long long keys = 0;
+    int64_t expire = -1; // 毫秒
+    while (1) {
+        unsigned char type = _rdbPeekType(c);
+        if (type == RDB_EOF || type == RDB_SELECTDB) break;
+        c->p++;
+
+        if (type == RDB_RESIZEDB) {
+            // 按保存时的大小预先分配，加载过程中不再扩容rehash
+            uint64_t kvSize = _rdbLoadLen(c, NULL);
+            uint64_t expiresSize = _rdbLoadLen(c, NULL);
+            if (kvSize) dictExpand(db->kv, kvSize);
+            if (expiresSize) dictExpand(db->expires, expiresSize);
+            continue;
+        }
+        if (type == RDB_EXPIRETIME) {
+            expire = _rdbLoadMillis(c) * 1000;
+            continue;
+        }
+        if (type == RDB_EXPIRETIME_MS) {
+            expire = _rdbLoadMillis(c);
+            continue;
+        }
+        // 正常数据
+        sds key = _rdbLoadKey(c);
+        robj* val = _rdbLoadObject(c, type);
+        if (expire >= 0)
+        {
+            dbSetExpire(db, key, expire);
+            expire = -1;
+        }
+        dbAdd(db, key, val);
+        keys++;
+    }
+    return keys;
+}
+
+static void _rdbSkipString(rdbCursor *c)
+{
+    rdbString str;
+    _rdbLoadString(c, &str);
+}
+
+/**
+ * @brief 只跳过不解析，找到数据库段的结尾。 比解析快得多，在解析线程工作时由主线程完成
+ *
+ * @param [in] c
+ */
+static void _rdbScanSection(rdbCursor *c)
+{
+    while (1) {
+        unsigned char type = _rdbPeekType(c);
+        if (type == RDB_EOF || type == RDB_SELECTDB) break;
+        c->p++;
+        if (type == RDB_RESIZEDB) {
+            _rdbLoadLen(c, NULL);
+            _rdbLoadLen(c, NULL);
+        } else if (type == RDB_EXPIRETIME || type == RDB_EXPIRETIME_MS) {
+            _rdbTake(c, 8);
+        } else if (type == RDB_TYPE_STRING) {
+            _rdbSkipString(c);
+            _rdbSkipString(c);
+        } else {
+            rdbLoadFail("unknown object type");
+        }
+    }
+}
+
+/* 一个数据库段的并行加载任务，每个线程只写自己的数据库，不需要合并 */
+typedef struct rdbLoadJob {
+    pthread_t tid;
+    rdbCursor cur;
+    redisDb *db;
+    struct redisServer *server;
+    long long keys;
+} rdbLoadJob;
+
+static void* rdbLoadThreadMain(void *arg)
+{
+    rdbLoadJob *job = arg;
+    server = job->server; // 对象初始化要读取淘汰策略和时钟
+    job->keys = _rdbLoadSection(&job->cur, job->db);
+    return NULL;
+}
+
+/**
+ * @brief 将本地.rdb加载到数据库。
+ *  整个文件mmap后按指针解析，字符串直接从映射区创建，不经过读缓冲。
+ *  rdb-load-threads大于1时，每个数据库段交给一个线程解析，主线程跳读找到下一段并计算校验和
+ *
+ * @return int 0成功，-1文件头不对(没有加载任何键)。 文件内容损坏直接退出
+ */
+int rdbLoad()
+{
+    int ret = -1;
+    int fd = open(server->rdbfile, O_RDONLY);
+    if (fd < 0)
     {
         log_error("rdb load failed. %s, %s", server->rdbfile, strerror(errno));
         exit(EXIT_FAILURE);
     }
-    
-    // 1. read magic
-    char buf[10];
-    size_t n= fread(buf, 1, 9, fp);
-    if (n != 9)
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < 9 + 1 + RDB_CHECKSUM_LEN)
     {
-        if (ferror(fp)) perror("rdb load magic failed");
-        if (ferror(fp)) perror("rdb load magic EOF");
+        log_error("Wrong signature trying to load DB from file %s", server->rdbfile);
+        close(fd);
+        return -1;
     }
-    buf[9] = '\0';
-    if (strcmp(buf, "REDIS0001") != 0) return;
-
-    // 2. read the dbs
-    uint8_t dbid;
-    long expire = 0;
-    while (1) {
-        unsigned char type = _rdbLoadType(fp); // 
-        
-        if (type == RDB_EOF) break;
+    size_t size = st.st_size;
+    const unsigned char *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        log_error("mmap %s failed: %s", server->rdbfile, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    madvise((void *)base, size, MADV_WILLNEED);
+    long long start = ustime();
 
-        if (type == RDB_SELECTDB) {
+    // 1. magic、版本
+    if (memcmp(base, RDB_MAGIC, 5) != 0)
+    {
+        log_error("Wrong signature trying to load DB from file %s", server->rdbfile);
+        goto out;
+    }
+    if (memcmp(base + 5, RDB_VERSION, 4) != 0)
+    {
+        log_error("Can't handle RDB format version %.4s", base + 5);
+        goto out;
+    }
 
-            // 读取数据库num
-            fread(&dbid, 1, 1, fp);
-            if (dbid < 0 || dbid > server->dbnum) {
-                log_debug("Error loading dbid %d", dbid);;
-                exit(1);
+    // 2. 逐段加载。 校验和之前的最后一个字节必须是EOF
+    rdbCursor c = {base + 9, base + size - RDB_CHECKSUM_LEN};
+    int nthreads = server->rdbLoadThreads;
+    rdbLoadJob *jobs = zcalloc(server->dbnum, sizeof(*jobs));
+    char *seen = zcalloc(server->dbnum, 1);
+    int njobs = 0, nsections = 0;
+    long long keys = 0;
+    uint64_t dbid = 0;
+    while (_rdbPeekType(&c) != RDB_EOF) {
+        if (_rdbPeekType(&c) == RDB_SELECTDB) {
+            c.p++;
+            dbid = _rdbLoadLen(&c, NULL);
+            if (dbid >= (uint64_t)server->dbnum) {
+                log_error("FATAL: Data file was created with a Redis server configured to handle "
+                          "more than %d databases. Exiting", server->dbnum);
+                exit(EXIT_FAILURE);
             }
-            continue;
         }
-        if (type == RDB_EXPIRETIME)
-        {
-            fread(&expire, 8, 1, fp);
+        // 两个线程不能写同一个数据库
+        if (seen[dbid]) rdbLoadFail("duplicate database section");
+        seen[dbid] = 1;
+        nsections++;
+        if (nthreads <= 1) {
+            keys += _rdbLoadSection(&c, server->db + dbid);
             continue;
         }
-        // 正常数据
-        sds* key = _rdbLoadKey(fp);
-        robj* val = _rdbLoadObject(fp, type);
-        dbAdd(server->db + dbid, key, val);
-        if (expire > 0)
-        {
-            dbSetExpire(server->db + dbid, key, expire);
-            expire = 0;
+        if (njobs >= nthreads) {
+            // 线程数不超过rdb-load-threads，等最早的一个结束
+            pthread_join(jobs[njobs - nthreads].tid, NULL);
         }
+        rdbLoadJob *job = jobs + njobs;
+        job->cur = c;
+        job->db = server->db + dbid;
+        job->server = server;
+        if (pthread_create(&job->tid, NULL, rdbLoadThreadMain, job) != 0) {
+            log_error("Can't create rdb load thread: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        njobs++;
+        _rdbScanSection(&c);
     }
-
-    // 校验
-    size_t nread = 0;
-    size_t datalen = ftell(fp); // 当前长度
-    // 读取校验码
-    unsigned char hash[RDB_CHECKSUM_LEN] = {0};
-    nread = fread(hash, 1, RDB_CHECKSUM_LEN, fp);
-    assert(RDB_CHECKSUM_LEN == nread);
-
-    fseek(fp, 0, SEEK_SET);
-    char data[RDB_MAX_SIZE];
-    nread = fread(data, 1, datalen, fp);
-    assert(nread == datalen);
-    
-    int ret = verify_sha256(data, datalen, hash);
-    assert(ret == 1);
+    c.p++;
+    if (c.p != c.end) rdbLoadFail("trailing bytes after EOF");
+
+    // 3. 校验和: 0表示保存时没有计算
+    uint64_t expected;
+    memcpy(&expected, c.end, RDB_CHECKSUM_LEN);
+    if (expected != 0 && crc64(0, base, size - RDB_CHECKSUM_LEN) != expected)
+        rdbLoadFail("wrong checksum");
+
+    for (int i = 0; i < njobs; i++) {
+        if (i >= njobs - nthreads) pthread_join(jobs[i].tid, NULL);
+        keys += jobs[i].keys;
+    }
+    zfree(jobs);
+    zfree(seen);
+    double secs = (ustime() - start) / 1e6;
+    int used = nthreads <= 1 ? 1 : (njobs < nthreads ? njobs : nthreads);
+    log_info("DB loaded from disk: %lld keys in %d dbs, %zu bytes in %.3f seconds "
+             "(%.0f keys/s, %d threads)", keys, nsections, size, secs,
+             secs > 0 ? keys / secs : 0, used);
+    ret = 0;
+out:
+    munmap((void *)base, size);
+    return ret;
 }
 
 /**
- * @brief 将主的RDB文件复制为自己的RDB
+ * @brief 将主的RDB文件复制为自己的RDB。 先写临时文件，落盘后rename替换
  * 
  */
-void receiveRDBfile(char* buf, int n)
+void receiveRDBfile(const char* buf, size_t n)
 {
-    // TODO 不应该直接覆盖，应该通过一个临时完整文件 去覆盖
     log_debug("Receive RDB to: %s", server->rdbfile);
-    FILE* fp = fopen(server->rdbfile, "w+");
+    char tmpfile[PATH_MAX];
+    snprintf(tmpfile, sizeof(tmpfile), "%s.sync-%d", server->rdbfile, (int)getpid());
+    FILE* fp = fopen(tmpfile, "w");
     if (fp == NULL)
     {
-        log_error("Open rdb failed. %s, %s", server->rdbfile, strerror(errno));
+        log_error("Open rdb failed. %s, %s", tmpfile, strerror(errno));
         exit(EXIT_FAILURE);
     }
-    size_t  nwrite =  fwrite(buf, 1, n, fp);
-    if (nwrite != n)
+    size_t nwrite = fwrite(buf, 1, n, fp);
+    if (nwrite != n || fflush(fp) != 0 || fsync(fileno(fp)) == -1)
     {
-        log_error("Save buf to rdb uncomplete!");
+        log_error("Save buf to rdb uncomplete! %s", strerror(errno));
+        fclose(fp);
+        unlink(tmpfile);
+        exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+    if (rename(tmpfile, server->rdbfile) == -1)
+    {
+        log_error("rename %s to %s failed: %s", tmpfile, server->rdbfile, strerror(errno));
+        unlink(tmpfile);
+        exit(EXIT_FAILURE);
     }
     log_debug("Save the RDB file success");
 }
@@ -14,8 +14,12 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
-#include <sys/sendfile.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <ctype.h>
+#include <math.h>
+#include <errno.h>
+#include <limits.h>
 
 #include "redis.h"
 #include "rdb.h"
@@ -23,12 +27,17 @@
 #include "rio.h"
 #include "repli.h"
 #include "net.h"
-#include "conf.h"
+#include "config.h"
 #include "util.h"
 #include "aof.h"
 #include "resp.h"
 #include "ringbuffer.h"
-struct redisServer *server;
+#include "iothread.h"
+#include "shard.h"
+#include "expire.h"
+#include "evict.h"
+#include "zmalloc.h"
+__thread struct redisServer *server;
 
 extern struct RespShared resp;
 
@@ -42,37 +51,59 @@ static void commandByeProc(redisClient *client);
 static void commandSlaveofProc(redisClient *client);
 static void commandPingProc(redisClient *client);
 static void commandReplconfProc(redisClient *client);
-static void commandSyncProc(redisClient *client);
+static void commandPsyncProc(redisClient *client);
 static void commandReplACKProc(redisClient *client);
 static void commandInfoProc(redisClient *client);
 static void commandHeartBeatProc(redisClient *client);
 static void commandSelectProc(redisClient *client);
 static void commandExpireProc(redisClient *client);
 static void commandTtlProc(redisClient *client);
+static void commandPexpireProc(redisClient *client);
+static void commandPexpireatProc(redisClient *client);
+static void commandPttlProc(redisClient *client);
+static void commandPersistProc(redisClient *client);
+static void commandIncrProc(redisClient *client);
+static void commandDecrProc(redisClient *client);
+static void commandIncrbyProc(redisClient *client);
+static void commandDecrbyProc(redisClient *client);
+static void commandIncrbyfloatProc(redisClient *client);
 static void commandMultiProc(redisClient *client);
 static void commandExecProc(redisClient *client);
 static void commandWatchProc(redisClient *client);
+static void commandBgrewriteaofProc(redisClient *client);
+static void commandConfigProc(redisClient *client);
 
 // 全局命令表，包含sentinel等所有命令
 redisCommand commandsTable[] = {
-    {CMD_WRITE | CMD_MASTER | CMD_SLAVE, "SET", commandSetProc, 3},
-    {CMD_READ | CMD_MASTER | CMD_SLAVE, "GET", commandGetProc, 2},
-    {CMD_WRITE | CMD_MASTER, "DEL", commandDelProc, 2},
-    {CMD_READ | CMD_MASTER | CMD_SLAVE, "OBJECT", commandObjectProc, 3},
-    {CMD_MASTER | CMD_SLAVE, "BYE", commandByeProc, 1},
-    {CMD_MASTER, "SLAVEOF", commandSlaveofProc, 3},
-    {CMD_MASTER | CMD_SLAVE, "PING", commandPingProc, 1},
-    {CMD_MASTER | CMD_SLAVE, "REPLCONF", commandReplconfProc, 3},
-    {CMD_MASTER | CMD_SLAVE, "SYNC", commandSyncProc, 2},
-    {CMD_MASTER | CMD_SLAVE, "REPLACK", commandReplACKProc, 1},
-    {CMD_MASTER | CMD_SLAVE, "INFO", commandInfoProc, 1},
-    {CMD_MASTER | CMD_SLAVE, "HEARTBEAT", commandHeartBeatProc, 1},
-    {CMD_MASTER | CMD_SLAVE, "SELECT", commandSelectProc, 2},
-    {CMD_WRITE | CMD_MASTER, "EXPIRE", commandExpireProc, 3},
-    {CMD_READ | CMD_MASTER, "TTL", commandTtlProc, 2},
-    {CMD_MASTER, "MULTI", commandMultiProc, 1},
-    {CMD_MASTER, "EXEC", commandExecProc, 1},
-    {CMD_MASTER, "WATCH", commandWatchProc, 1},
+    {CMD_WRITE | CMD_DENYOOM | CMD_MASTER | CMD_SLAVE, "SET", commandSetProc, -3, 1},
+    {CMD_READ | CMD_MASTER | CMD_SLAVE, "GET", commandGetProc, 2, 1},
+    {CMD_WRITE | CMD_MASTER, "DEL", commandDelProc, 2, 1},
+    {CMD_READ | CMD_MASTER | CMD_SLAVE, "OBJECT", commandObjectProc, 3, 2},
+    {CMD_MASTER | CMD_SLAVE, "BYE", commandByeProc, 1, 0},
+    {CMD_MASTER | CMD_SLAVE, "SLAVEOF", commandSlaveofProc, -2, 0},
+    {CMD_MASTER | CMD_SLAVE, "PING", commandPingProc, 1, 0},
+    {CMD_MASTER | CMD_SLAVE, "REPLCONF", commandReplconfProc, 3, 0},
+    {CMD_MASTER | CMD_SLAVE, "PSYNC", commandPsyncProc, 3, 0},
+    {CMD_MASTER | CMD_SLAVE, "REPLACK", commandReplACKProc, 2, 0},
+    {CMD_MASTER | CMD_SLAVE, "INFO", commandInfoProc, 1, 0},
+    {CMD_MASTER | CMD_SLAVE, "HEARTBEAT", commandHeartBeatProc, 1, 0},
+    {CMD_MASTER | CMD_SLAVE, "SELECT", commandSelectProc, 2, 0},
+    {CMD_WRITE | CMD_MASTER, "EXPIRE", commandExpireProc, 3, 1},
+    {CMD_READ | CMD_MASTER, "TTL", commandTtlProc, 2, 1},
+    {CMD_WRITE | CMD_MASTER, "PEXPIRE", commandPexpireProc, 3, 1},
+    {CMD_WRITE | CMD_MASTER, "PEXPIREAT", commandPexpireatProc, 3, 1},
+    {CMD_READ | CMD_MASTER, "PTTL", commandPttlProc, 2, 1},
+    {CMD_WRITE | CMD_MASTER, "PERSIST", commandPersistProc, 2, 1},
+    {CMD_WRITE | CMD_DENYOOM | CMD_MASTER, "INCR", commandIncrProc, 2, 1},
+    {CMD_WRITE | CMD_DENYOOM | CMD_MASTER, "DECR", commandDecrProc, 2, 1},
+    {CMD_WRITE | CMD_DENYOOM | CMD_MASTER, "INCRBY", commandIncrbyProc, 3, 1},
+    {CMD_WRITE | CMD_DENYOOM | CMD_MASTER, "DECRBY", commandDecrbyProc, 3, 1},
+    {CMD_WRITE | CMD_DENYOOM | CMD_MASTER, "INCRBYFLOAT", commandIncrbyfloatProc, 3, 1},
+    {CMD_MASTER, "MULTI", commandMultiProc, 1, 0},
+    {CMD_MASTER, "EXEC", commandExecProc, 1, 0},
+    {CMD_MASTER | CMD_SHARD_LOCAL, "WATCH", commandWatchProc, -2, 1},
+    {CMD_MASTER, "BGREWRITEAOF", commandBgrewriteaofProc, 1, 0},
+    {CMD_MASTER | CMD_SLAVE, "CONFIG", commandConfigProc, -2, 0},
 };
 
 // command dictType
@@ -139,17 +170,9 @@ dictType commandDictType = {
  */
 void loadCommands()
 {
-    if (server->commands != NULL)
-    {
-        dictRelease(server->commands);
-    }
-    server->commands = dictCreate(&commandDictType, NULL);
-    for (int i = 0; i < sizeof(commandsTable) / sizeof(commandsTable[0]); i++)
-    {
-        redisCommand *cmd = malloc(sizeof(redisCommand));
-        memcpy(cmd, &commandsTable[i], sizeof(redisCommand));
-        dictAdd(server->commands, cmd->name, cmd);
-    }
+    // 角色变化后重建，预计算的权限随角色变化
+    commandTableRelease(server->commands);
+    server->commands = commandTableCreate(commandsTable, sizeof(commandsTable) / sizeof(commandsTable[0]), server->flags);
     char *rolestr = getRoleStr(server->flags);
     log_info("Load commands for role %s", rolestr);
     free(rolestr);
@@ -168,65 +191,158 @@ void _encodingStr(int encoding, char *buf, int maxlen)
     case REDIS_ENCODING_RAW:
         strncpy(buf, "raw", maxlen - 1);
         break;
+    case REDIS_ENCODING_COMPRESSED:
+        strncpy(buf, "compressed", maxlen - 1);
+        break;
     default:
         strncpy(buf, "unknown", maxlen - 1);
         break;
     }
 }
 
+#define SET_NX (1<<0)   // 键不存在才设置
+#define SET_XX (1<<1)   // 键存在才设置
+
 /**
+ * @brief 追加 PEXPIREAT key when 命令(RESP)，用于把相对过期时间改写为绝对时刻传播
  *
+ * @param [in] s
+ * @param [in] key
+ * @param [in] keylen
+ * @param [in] when 毫秒时间戳
+ * @return sds
+ */
+static sds catPexpireatCommand(sds s, const char *key, size_t keylen, long long when)
+{
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%lld", when);
+    const char *argv[] = {"PEXPIREAT", key, buf};
+    const size_t argvlen[] = {9, keylen, (size_t)n};
+    return respCatCommand(s, 3, argv, argvlen);
+}
+
+/**
+ * SET key value [EX seconds | PX milliseconds] [NX | XX]
+ * 不带EX/PX时清除键原有的过期时间
  * @param client
  * @warning set命令 值必须传入
  */
 void commandSetProc(redisClient *client)
 {
-  
-    log_debug("Set proc..key: %s", client->argv[1]);
-    if (client->argc == 2)
-    {
-        // TODO 在之前通过arity校验
-        client->last_errno = ERR_VALUE_MISSED;
-        sprintf(client->err_msg, "%s", resp.valmissed);
-        addWrite(client, resp.valmissed);
-    }
-    else
+    log_debug("Set proc..key: %.*s", (int)client->argvlen[1], client->argvlen[1] ? client->argv[1] : "");
+    int flags = 0;
+    long long when = -1;
+    for (int j = 3; j < client->argc; j++)
     {
-        sds *key = sdsnew(client->argv[1]);
-        robj *v = robjCreateStringObject(client->argv[2]);
-        int retcode = dbAdd(client->db, key, v);
-        if (retcode == DICT_OK)
+        int ex = clientArgIs(client, j, "EX");
+        if (clientArgIs(client, j, "NX") && !(flags & SET_XX))
+        {
+            flags |= SET_NX;
+        }
+        else if (clientArgIs(client, j, "XX") && !(flags & SET_NX))
         {
-            addWrite(client, resp.ok);
-            server->dirty++;
+            flags |= SET_XX;
+        }
+        else if ((ex || clientArgIs(client, j, "PX")) && when < 0 && j + 1 < client->argc)
+        {
+            long v;
+            long long ms;
+            // 秒换算毫秒、加上当前时间都可能溢出
+            if (!string2longLen(client->argv[j + 1], client->argvlen[j + 1], &v) || v <= 0 ||
+                __builtin_mul_overflow((long long)v, ex ? 1000LL : 1LL, &ms) ||
+                __builtin_add_overflow(server->mstime, ms, &when))
+            {
+                addWrite(client, resp.invalidExpire);
+                return;
+            }
+            j++;
         }
         else
         {
-            client->last_errno = ERR_KEY_EXISTS;
-            sprintf(client->err_msg, "-ERR:Duplicate key\r\n");
-            addWrite(client, resp.dupkey);
+            addWrite(client, resp.syntaxErr);
+            return;
         }
     }
+
+    const dictKeyView *key = &client->keyView;
+    int exists = dbLookupView(client->db, key) != NULL;
+    if (((flags & SET_NX) && exists) || ((flags & SET_XX) && !exists))
+    {
+        addWrite(client, resp.nullBulk);
+        return;
+    }
+    if (when >= 0)
+        dbSetExpireView(client->db, key, when);
+    else if (exists)
+        dbRemoveExpireView(client->db, key);
+
+    robj *v = robjCreateStringObjectLen(client->argv[2], client->argvlen[2]);
+    dbSetView(client->db, key, v);
+    addWrite(client, resp.ok);
+    server->dirty++;
+    if (when >= 0)
+    {
+        // EX/PX是相对时间，重放时会从重放时刻重新计时。 改写为 SET key value + PEXPIREAT key 绝对时刻
+        const char *argv[] = {"SET", client->argv[1], client->argv[2]};
+        const size_t argvlen[] = {3, client->argvlen[1], client->argvlen[2]};
+        client->propagateCmd = respCatCommand(sdsempty(), 3, argv, argvlen);
+        client->propagateCmd = catPexpireatCommand(client->propagateCmd,
+                                                   client->argv[1], client->argvlen[1], when);
+    }
+}
+
+/**
+ * @brief 字符串对象编码为$回复，按长度写入，二进制安全
+ *
+ * @param [in] client
+ * @param [in] o
+ */
+static void addWriteBulkObject(redisClient *client, robj *o)
+{
+    char hdr[32];
+    int n;
+    if (o->encoding == REDIS_ENCODING_INT)
+    {
+        char num[24];
+        int len = snprintf(num, sizeof(num), "%ld", (long)o->ptr);
+        n = snprintf(hdr, sizeof(hdr), "$%d\r\n", len);
+        addWriteBuf(client, hdr, n);
+        addWriteBuf(client, num, len);
+    }
+    else if (o->encoding == REDIS_ENCODING_COMPRESSED)
+    {
+        // 解压到新的sds，发送完释放，库里仍然是压缩的
+        sds s = robjDecompressString(o);
+        n = snprintf(hdr, sizeof(hdr), "$%zu\r\n", sdslen(s));
+        addWriteBuf(client, hdr, n);
+        addWriteSds(client, s);
+    }
+    else
+    {
+        sds s = o->ptr;
+        n = snprintf(hdr, sizeof(hdr), "$%zu\r\n", sdslen(s));
+        addWriteBuf(client, hdr, n);
+        addWriteObject(client, o);
+    }
+    addWriteBuf(client, "\r\n", 2);
 }
 
 void commandGetProc(redisClient *client)
 {
-    sds *k = sdsnew(client->argv[1]);
-    robj *res = (robj *)dbGet(client->db, k);
+    robj *res = (robj *)dbLookupView(client->db, &client->keyView);
     if (res == NULL)
     {
         addWrite(client, resp.keyNotFound);
     }
     else
     {
-        addWrite(client, respEncodeBulkString(robjGetValStr(res)));
+        addWriteBulkObject(client, res);
     }
 }
 
 void commandDelProc(redisClient *client)
 {
-    sds *k = sdsnew(client->argv[1]);
-    int retcode = dbDelete(client->db, k);
+    int retcode = dbDeleteView(client->db, &client->keyView);
     if (retcode == DICT_OK)
     {
         server->dirty++;
@@ -238,13 +354,44 @@ void commandDelProc(redisClient *client)
     }
 }
 
+/**
+ * OBJECT ENCODING|IDLETIME|FREQ key
+ *  不经过dbLookupView，查看对象不更新它的LRU时间/LFU计数
+ * @param client
+ */
 void commandObjectProc(redisClient *client)
 {
-    char *key = client->argv[2];
-    char *op = client->argv[1];
-    if (strcasecmp(op, "ENCODING") == 0)
+    dictEntry *de = dictFindByView(client->db->kv, &client->keyView);
+    if (de == NULL)
+    {
+        addWrite(client, resp.keyNotFound);
+        return;
+    }
+    robj *val = de->v.val;
+    if (clientArgIs(client, 1, "FREQ"))
+    {
+        if (!policyIsLFU(server->maxmemoryPolicy))
+        {
+            addWrite(client, resp.lfuNotSelected);
+            return;
+        }
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), ":%lu\r\n", lfuDecrAndReturn(val));
+        addWriteBuf(client, buf, n);
+    }
+    else if (clientArgIs(client, 1, "IDLETIME"))
+    {
+        if (policyIsLFU(server->maxmemoryPolicy))
+        {
+            addWrite(client, resp.lruNotSelected);
+            return;
+        }
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), ":%llu\r\n", estimateObjectIdleTime(val) / 1000);
+        addWriteBuf(client, buf, n);
+    }
+    else if (clientArgIs(client, 1, "ENCODING"))
     {
-        robj *val = dbGet(client->db, sdsnew(key));
         if (val == NULL)
         {
             addWrite(client, resp.keyNotFound);
@@ -274,16 +421,53 @@ void masterToSlave(const char *ip, int port)
     server->flags |= REDIS_CLUSTER_SLAVE;
     server->masterhost = ip;
     server->masterport = port;
+    replicationLoadState(false);
     loadCommands();
 }
 
-// 127.0.0.1:6668
+// 127.0.0.1:6668 或 NO ONE
 void commandSlaveofProc(redisClient *client)
 {
-    char *s = strdup(client->argv[1]);
+    if (server->shardsNum > 1)
+    {
+        addWrite(client, resp.shardsUnsupported);
+        return;
+    }
+    if (client->argc == 3 && clientArgIs(client, 1, "NO") && clientArgIs(client, 2, "ONE"))
+    {
+        // 从提升为主
+        if (server->flags & REDIS_CLUSTER_SLAVE)
+            replicationUnsetMaster();
+        addWrite(client, resp.ok);
+        return;
+    }
+    if (client->argc != 2)
+    {
+        addWrite(client, resp.syntaxErr);
+        return;
+    }
+    char *s = strndup(client->argv[1], client->argvlen[1]);
     char *ip = strtok(s, ":");
-    int port = atoi(strtok(NULL, ":"));
-    masterToSlave(ip, port);
+    char *port = strtok(NULL, ":");
+    if (ip == NULL || port == NULL)
+    {
+        free(s);
+        addWrite(client, resp.syntaxErr);
+        return;
+    }
+    if (server->flags & REDIS_CLUSTER_SLAVE)
+    {
+        // 切换到新的主。 复制ID和offset保留，新主是同一个主提升的从(故障切换)时可以续传
+        log_info("Switch master to %s:%s", ip, port);
+        freeClient(server->master);
+        server->master = NULL;
+        server->masterhost = ip;
+        server->masterport = atoi(port);
+    }
+    else
+    {
+        masterToSlave(ip, atoi(port));
+    }
 
     addWrite(client, resp.ok);
     connectMaster();
@@ -296,41 +480,43 @@ void commandPingProc(redisClient *client)
     addWrite(client, resp.pong);
 }
 
-void commandSyncProc(redisClient *client)
+/**
+ * @brief PSYNC <replid> <offset>: 能续传时回复+CONTINUE和积压数据，否则全量同步
+ *
+ * @param [in] client 从
+ */
+void commandPsyncProc(redisClient *client)
 {
-    long offset = atoi(client->argv[1]);
-
-    
-    if (offset < 0 || offset < server->begin_offset || offset >= server->last_offset)
+    if (server->shardsNum > 1)
     {
-        // 第一次连接 或者 过旧的offset， 或者其他， 都全同步
-        client->replState = REPL_STATE_MASTER_SEND_FULLSYNC; // 状态等待clientbuf 发送出FULLSYNC
-        addWrite(client, resp.fullsync);
-    }  else 
+        // 每个分片只有一部分数据
+        addWrite(client, resp.shardsUnsupported);
+        return;
+    }
+    long offset = -1;
+    string2longLen(client->argv[2], client->argvlen[2], &offset);
+    char replid[REPL_ID_SIZE + 1];
+    snprintf(replid, sizeof(replid), "%.*s", (int)client->argvlen[1], client->argv[1]);
+
+    client->flags = REDIS_CLIENT_SLAVE;
+    client->lastinteraction = server->unixtime;
+    if (masterTryPartialResync(client, replid, offset))
     {
-        if (offset >= server->begin_offset && offset < server->last_offset)
-        {
-            // 可以增量同步。
-            // 从缺失一部分数据，考虑增量同步
-            client->replState = REPL_STATE_MASTER_SEND_APPENDSYNC; 
-            addWrite(client, resp.appendsync);
-            // 跟着repli_buffer
-            addWriteBuf(client, server->repli_buffer + offset + 1, server->last_offset - offset);
-        }else
-        {
-            log_error("unknown sync offset!!error!!");
-            exit(EXIT_FAILURE);
-            // 不需要同步
-            addWrite(client, resp.nosync);
-        }
+        client->replState = REPL_STATE_MASTER_CONNECTED;
+        return;
     }
+    // 第一次连接、复制ID不同、offset已经不在积压缓冲区内，都全同步
+    if (server->replDisklessSync)
+        replicationWaitDisklessSync(client);
+    else
+        replicationWaitBgsave(client);
 }
 
 void commandReplconfProc(redisClient *client)
 {
     //  暂不处理，不影响
+    // PSYNC之后才把对端标记为slave，之前不能收到命令传播，否则会夹在同步回复前面
     addWrite(client, resp.ok);
-    client->flags = REDIS_CLIENT_SLAVE; // 设置对端为slave
 }
 
 
@@ -358,13 +544,177 @@ char *getRoleStr(int role)
     return buf;
 }
 
+#define INFO_REHASH_LINES 4
+#define INFO_EXPIRE_LINES 3
+#define INFO_MEMORY_LINES 9
+#define INFO_PERSISTENCE_LINES 10
+#define INFO_REPLICATION_LINES 6
+
+/**
+ * @brief rehash相关INFO: 是否开启主动rehash、正在rehash的dict数及进度、主动rehash累计迁移的桶数和耗时
+ *
+ * @param [out] argv
+ */
+static void generateInfoRehash(char **argv)
+{
+    char buf[REDIS_MAX_STRING] = {0};
+    size_t len = 0;
+    int rehashing = 0;
+    for (int i = 0; i < server->dbnum; i++)
+    {
+        dict *dicts[2] = {server->db[i].kv, server->db[i].expires};
+        const char *names[2] = {"kv", "expires"};
+        for (int j = 0; j < 2; j++)
+        {
+            if (!dictIsRehashing(dicts[j]))
+                continue;
+            rehashing++;
+            if (len < sizeof(buf))
+                len += snprintf(buf + len, sizeof(buf) - len, "%sdb%d.%s=%d%%", len ? "," : "",
+                                i, names[j], (int)(dictRehashProgress(dicts[j]) * 100));
+        }
+    }
+    argv[0] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[0], REDIS_MAX_STRING, "rehashing_dicts:%d", rehashing);
+    argv[1] = malloc(REDIS_MAX_STRING + 32);
+    snprintf(argv[1], REDIS_MAX_STRING + 32, "rehash_progress:%s", buf);
+    argv[2] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[2], REDIS_MAX_STRING, "active_rehashing:%s", server->activerehashing ? "yes" : "no");
+    argv[3] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[3], REDIS_MAX_STRING, "active_rehash:buckets=%lld,time_us=%lld",
+             server->statActiveRehashes, server->statActiveRehashUs);
+}
+
+/**
+ * @brief 过期相关INFO: 过期删除的键数、主动过期抽样中过期键比例、用完时间预算的次数
+ *
+ * @param [out] argv
+ */
+static void generateInfoExpire(char **argv)
+{
+    argv[0] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[0], REDIS_MAX_STRING, "expired_keys:%lld", server->statExpiredKeys);
+    argv[1] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[1], REDIS_MAX_STRING, "expired_stale_perc:%.2f", server->statExpiredStalePerc);
+    argv[2] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[2], REDIS_MAX_STRING, "expired_time_cap_reached_count:%lld", server->statExpiredTimeCapReached);
+}
+
+/**
+ * @brief 内存相关INFO: zmalloc统计的已用内存、常驻内存及碎片率、分配器和各slab大小级占用、maxmemory及策略、淘汰的键数
+ *
+ * @param [out] argv
+ */
+static void generateInfoMemory(char **argv)
+{
+    size_t used = zmallocUsedMemory();
+    size_t rss = zmallocGetRss();
+    argv[0] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[0], REDIS_MAX_STRING, "used_memory:%zu", used);
+    argv[1] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[1], REDIS_MAX_STRING, "used_memory_human:%.2fM", used / (1024.0 * 1024));
+    argv[2] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[2], REDIS_MAX_STRING, "used_memory_rss:%zu", rss);
+    argv[3] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[3], REDIS_MAX_STRING, "mem_fragmentation_ratio:%.2f", used ? (double)rss / used : 0);
+    argv[4] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[4], REDIS_MAX_STRING, "mem_allocator:%s", zmallocModeName());
+
+    // 每个用到的大小级: 对象大小=已分配对象数/页中可容纳的对象数
+    char buf[REDIS_MAX_STRING] = {0};
+    size_t len = 0;
+    for (int i = 0; i < ZMALLOC_SLAB_CLASSES; i++)
+    {
+        size_t size, pages, inuse;
+        zmallocClassStats(i, &size, &pages, &inuse);
+        if (pages == 0 || len >= sizeof(buf))
+            continue;
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%zu=%zu/%zu", len ? "," : "",
+                        size, inuse, pages * (ZMALLOC_SLAB_PAGE_SIZE / size));
+    }
+    argv[5] = malloc(REDIS_MAX_STRING + 32);
+    snprintf(argv[5], REDIS_MAX_STRING + 32, "slab_occupancy:%s", buf);
+
+    argv[6] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[6], REDIS_MAX_STRING, "maxmemory:%llu", server->maxmemory);
+    argv[7] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[7], REDIS_MAX_STRING, "maxmemory_policy:%s", maxmemoryPolicyToString(server->maxmemoryPolicy));
+    argv[8] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[8], REDIS_MAX_STRING, "evicted_keys:%lld", server->statEvictedKeys);
+}
+
+/**
+ * @brief 持久化相关INFO: AOF是否开启、重写是否进行中、当前大小和上次重写后的大小、上次重写耗时和结果、
+ *  fsync策略、fsync次数和耗时、等待刷盘线程的批次数、刷盘线程落后而推迟交出批次的次数
+ *
+ * @param [out] argv
+ */
+static void generateInfoPersistence(char **argv)
+{
+    struct AOF *aof = &server->aof;
+    long long current = 0, base = 0, fsyncs = 0, totalUs = 0, lastUs = 0, maxUs = 0, pending = 0;
+    if (server->aofOn)
+    {
+        current = atomic_load(&aof->currentSize);
+        base = aof->baseSize;
+        fsyncs = atomic_load(&aof->statFsyncs);
+        totalUs = atomic_load(&aof->statFsyncTotalUs);
+        lastUs = atomic_load(&aof->statFsyncLastUs);
+        maxUs = atomic_load(&aof->statFsyncMaxUs);
+        pending = aof->batchSeq - atomic_load(&aof->writtenSeq);
+    }
+    argv[0] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[0], REDIS_MAX_STRING, "aof_enabled:%d", server->aofOn ? 1 : 0);
+    argv[1] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[1], REDIS_MAX_STRING, "aof_rewrite_in_progress:%d", aof->childPid != -1);
+    argv[2] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[2], REDIS_MAX_STRING, "aof_current_size:%lld", current);
+    argv[3] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[3], REDIS_MAX_STRING, "aof_base_size:%lld", base);
+    argv[4] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[4], REDIS_MAX_STRING, "aof_last_rewrite_time_sec:%lld", server->aofOn ? aof->lastRewriteTimeSec : -1);
+    argv[5] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[5], REDIS_MAX_STRING, "aof_last_bgrewrite_status:%s", aof->lastBgrewriteStatus == 0 ? "ok" : "err");
+    argv[6] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[6], REDIS_MAX_STRING, "aof_fsync_policy:%s", aofFsyncPolicyToString(server->aofFsync));
+    argv[7] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[7], REDIS_MAX_STRING, "aof_fsync:count=%lld,avg_us=%lld,last_us=%lld,max_us=%lld",
+             fsyncs, fsyncs ? totalUs / fsyncs : 0, lastUs, maxUs);
+    argv[8] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[8], REDIS_MAX_STRING, "aof_pending_batches:%lld", pending);
+    argv[9] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[9], REDIS_MAX_STRING, "aof_delayed_fsync:%lld", server->aofOn ? aof->statDelayedFsync : 0);
+}
+
+/**
+ * @brief 复制相关INFO: 复制ID、offset、积压缓冲区
+ *
+ * @param [out] argv
+ */
+static void generateInfoReplication(char **argv)
+{
+    RingBuffer *bl = server->replBacklog;
+    argv[0] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[0], REDIS_MAX_STRING, "master_replid:%s", server->replid);
+    argv[1] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[1], REDIS_MAX_STRING, "master_replid2:%s", server->replid2);
+    argv[2] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[2], REDIS_MAX_STRING, "master_repl_offset:%ld", server->offset);
+    argv[3] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[3], REDIS_MAX_STRING, "second_repl_offset:%ld", server->secondReplidOffset);
+    argv[4] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[4], REDIS_MAX_STRING, "repl_backlog_size:%ld", bl ? bl->size - 1 : 0);
+    argv[5] = malloc(REDIS_MAX_STRING);
+    snprintf(argv[5], REDIS_MAX_STRING, "repl_backlog_histlen:%ld", bl ? ringBufferSize(bl) : 0);
+}
+
 void generateInfoRespContent(int *argc, char **argv[])
 {
-    assert(server->flags & REDIS_CLUSTER_MASTER);
     listNode *node;
     redisClient *c;
 
-    *argc = 2; // runid, role
+    *argc = 2 + INFO_REHASH_LINES + INFO_EXPIRE_LINES + INFO_MEMORY_LINES + INFO_PERSISTENCE_LINES +
+            INFO_REPLICATION_LINES; // runid, role, rehash, expire, memory, persistence, replication
     // slaves
     node = listHead(server->clients);
     while (node != NULL)
@@ -414,6 +764,25 @@ void generateInfoRespContent(int *argc, char **argv[])
         }
         node = node->next;
     }
+
+    // 4. rehash
+    generateInfoRehash(*argv + argi);
+    argi += INFO_REHASH_LINES;
+
+    // 5. expire
+    generateInfoExpire(*argv + argi);
+    argi += INFO_EXPIRE_LINES;
+
+    // 6. memory
+    generateInfoMemory(*argv + argi);
+    argi += INFO_MEMORY_LINES;
+
+    // 7. persistence
+    generateInfoPersistence(*argv + argi);
+    argi += INFO_PERSISTENCE_LINES;
+
+    // 8. replication
+    generateInfoReplication(*argv + argi);
 }
 
 void commandInfoProc(redisClient *client)
@@ -426,6 +795,45 @@ void commandInfoProc(redisClient *client)
     addWrite(client, res);
 }
 
+/**
+ * @brief BGREWRITEAOF: 子进程按当前数据库重写AOF。 BGSAVE进行中时等它结束后再开始
+ *
+ * @param [in] client
+ */
+static void commandBgrewriteaofProc(redisClient *client)
+{
+    if (!server->aofOn)
+        addWrite(client, resp.aofDisabled);
+    else if (server->aof.childPid != -1)
+        addWrite(client, resp.aofRewriteInProgress);
+    else if (server->isBgSaving)
+    {
+        server->aof.rewriteScheduled = true;
+        addWrite(client, resp.aofRewriteScheduled);
+    }
+    else if (rewriteAppendOnlyFileBackground() == 0)
+        addWrite(client, resp.aofRewriteStarted);
+    else
+        addWrite(client, resp.err);
+}
+
+/**
+ * @brief CONFIG GET pattern | CONFIG SET name value | CONFIG REWRITE
+ *
+ * @param [in] client
+ */
+static void commandConfigProc(redisClient *client)
+{
+    if (clientArgIs(client, 1, "GET") && client->argc == 3)
+        configGetCommand(client);
+    else if (clientArgIs(client, 1, "SET") && client->argc == 4)
+        configSetCommand(client);
+    else if (clientArgIs(client, 1, "REWRITE") && client->argc == 2)
+        configRewriteCommand(client);
+    else
+        addWrite(client, resp.syntaxErr);
+}
+
 void commandHeartBeatProc(redisClient *client)
 {
     addWrite(client, resp.ok);
@@ -434,9 +842,9 @@ void commandHeartBeatProc(redisClient *client)
 void commandSelectProc(redisClient *client)
 {
     //
-    char *s = client->argv[1];
     long dbid;
-    if (!string2long(s, &dbid))
+    if (!string2longLen(client->argv[1], client->argvlen[1], &dbid) ||
+        dbid < 0 || dbid >= server->dbnum)
     {
         addWrite(client, resp.err);
     }
@@ -450,6 +858,43 @@ void commandSelectProc(redisClient *client)
     }
 }
 
+/**
+ * @brief EXPIRE/PEXPIRE/PEXPIREAT: 过期时刻 = basetime + 参数 * unit，毫秒
+ *
+ * @param [in] client
+ * @param [in] basetime 相对时间的基准，绝对时间为0
+ * @param [in] unit 参数换算成毫秒的倍数
+ */
+static void expireGenericCommand(redisClient *client, long long basetime, long long unit)
+{
+    long v;
+    long long when;
+    if (!string2longLen(client->argv[2], client->argvlen[2], &v))
+    {
+        addWrite(client, resp.err);
+        return;
+    }
+    if (__builtin_mul_overflow((long long)v, unit, &when) ||
+        __builtin_add_overflow(basetime, when, &when))
+    {
+        addWrite(client, resp.invalidExpire);
+        return;
+    }
+    if (dbLookupView(client->db, &client->keyView) == NULL)
+    {
+        addWrite(client, resp.keyNotFound);
+    }
+    else
+    {
+        dbSetExpireView(client->db, &client->keyView, when);
+        server->dirty++;
+        addWrite(client, resp.ok);
+        // 相对过期时间改写为绝对时刻传播，重放和从服务器上过期时刻不变
+        if (basetime != 0 || unit != 1)
+            client->propagateCmd = catPexpireatCommand(sdsempty(), client->argv[1], client->argvlen[1], when);
+    }
+}
+
 /**
  * expire key ns
  * 秒为单位
@@ -457,42 +902,235 @@ void commandSelectProc(redisClient *client)
  */
 void commandExpireProc(redisClient *client)
 {
-    sds *key = sdsnew(client->argv[1]);
-    char *expire = client->argv[2]; //
-    long expireat;
-    if (string2long(expire, &expireat))
+    expireGenericCommand(client, server->mstime, 1000);
+}
+
+// pexpire key ms
+void commandPexpireProc(redisClient *client)
+{
+    expireGenericCommand(client, server->mstime, 1);
+}
+
+// pexpireat key ms-timestamp
+void commandPexpireatProc(redisClient *client)
+{
+    expireGenericCommand(client, 0, 1);
+}
+
+/**
+ * @brief TTL/PTTL: 剩余时间，没有设置过期返回key not found
+ *
+ * @param [in] client
+ * @param [in] ms 以毫秒返回
+ */
+static void ttlGenericCommand(redisClient *client, int ms)
+{
+    long long ttl = dbGetTTLView(client->db, &client->keyView);
+    if (ttl < 0)
     {
-        expireat += time(NULL);
-        if (dbSetExpire(client->db, key, expireat) == 0)
-        {
-            server->dirty++;
-            addWrite(client, resp.ok);
-        }
-        else
+        addWrite(client, resp.keyNotFound);
+        return;
+    }
+    // 直接格式化成$回复，不经过respEncodeBulkString分配
+    char val[48], buf[64];
+    int len = ms ? snprintf(val, sizeof(val), "pttl:%lldms", ttl)
+                 : snprintf(val, sizeof(val), "ttl:%llds", (ttl + 500) / 1000);
+    int n = snprintf(buf, sizeof(buf), "$%d\r\n%s\r\n", len, val);
+    addWriteBuf(client, buf, n);
+}
+
+void commandTtlProc(redisClient *client)
+{
+    ttlGenericCommand(client, 0);
+}
+
+void commandPttlProc(redisClient *client)
+{
+    ttlGenericCommand(client, 1);
+}
+
+// persist key: 去掉过期时间，成功返回1
+void commandPersistProc(redisClient *client)
+{
+    if (dbRemoveExpireView(client->db, &client->keyView) == DICT_OK)
+    {
+        server->dirty++;
+        addWrite(client, resp.cone);
+    }
+    else
+    {
+        addWrite(client, resp.czero);
+    }
+}
+
+/**
+ * @brief INCR/DECR/INCRBY/DECRBY: 键不存在时按0计算，值必须是INT编码的整数
+ *  独占的INT对象直接在原对象上修改，不分配也不释放；共享对象或键不存在时按结果新建(小整数为共享对象)。
+ *  写入AOF、传播给从服务器的都是原始命令
+ * @param [in] client
+ * @param [in] incr
+ */
+static void incrDecrCommand(redisClient *client, long incr)
+{
+    dictEntry *de = dictFindByView(client->db->kv, &client->keyView);
+    robj *o = de ? de->v.val : NULL;
+    long value = 0;
+    if (o)
+    {
+        if (o->type != REDIS_STRING || o->encoding != REDIS_ENCODING_INT)
         {
-            addWrite(client, resp.err);
+            addWrite(client, resp.notInteger);
+            return;
         }
+        objectTouch(o);
+        value = (long)o->ptr;
+    }
+    if (__builtin_add_overflow(value, incr, &value))
+    {
+        addWrite(client, resp.incrOverflow);
+        return;
     }
+
+    if (o && !robjIsShared(o))
+        o->ptr = (void *)value;
     else
+        dbSetView(client->db, &client->keyView, robjCreateStringObjectFromLong(value));
+    server->dirty++;
+
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), ":%ld\r\n", value);
+    addWriteBuf(client, buf, n);
+}
+
+void commandIncrProc(redisClient *client)
+{
+    incrDecrCommand(client, 1);
+}
+
+void commandDecrProc(redisClient *client)
+{
+    incrDecrCommand(client, -1);
+}
+
+void commandIncrbyProc(redisClient *client)
+{
+    long incr;
+    if (!string2longLen(client->argv[2], client->argvlen[2], &incr))
     {
-        addWrite(client, resp.err);
+        addWrite(client, resp.notInteger);
+        return;
     }
+    incrDecrCommand(client, incr);
 }
 
-void commandTtlProc(redisClient *client)
+void commandDecrbyProc(redisClient *client)
+{
+    long decr;
+    if (!string2longLen(client->argv[2], client->argvlen[2], &decr))
+    {
+        addWrite(client, resp.notInteger);
+        return;
+    }
+    if (decr == LONG_MIN)
+    {
+        addWrite(client, resp.incrOverflow);
+        return;
+    }
+    incrDecrCommand(client, -decr);
+}
+
+#define MAX_LONG_DOUBLE_CHARS (5 * 1024)   // %.17Lf格式化long double的最大长度
+
+/**
+ * @brief 整个(s,len)解析为long double，不允许前后空白、NaN
+ *
+ * @param [in] s
+ * @param [in] len
+ * @param [out] out
+ * @return int
+ */
+static int string2ldLen(const char *s, size_t len, long double *out)
+{
+    char buf[MAX_LONG_DOUBLE_CHARS];
+    if (len == 0 || len >= sizeof(buf) || isspace((unsigned char)s[0]))
+        return 0;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    char *end;
+    errno = 0;
+    long double v = strtold(buf, &end);
+    if (*end != '\0' || errno == ERANGE || isnan(v))
+        return 0;
+    *out = v;
+    return 1;
+}
+
+/**
+ * INCRBYFLOAT key increment
+ *  结果按十进制保存为字符串，去掉小数部分末尾的0；整数结果会编码为INT
+ * @param client
+ */
+void commandIncrbyfloatProc(redisClient *client)
 {
-    sds *key = sdsnew(client->argv[1]);
-    if (dictContains(server->db->expires, key))
+    long double value = 0, incr;
+    robj *o = dbLookupView(client->db, &client->keyView);
+    if (o)
+    {
+        int ok = o->type == REDIS_STRING;
+        if (ok && o->encoding == REDIS_ENCODING_INT)
+            value = (long)o->ptr;
+        else if (ok && o->encoding == REDIS_ENCODING_COMPRESSED)
+        {
+            sds s = robjDecompressString(o);
+            ok = string2ldLen(s, sdslen(s), &value);
+            sdsfree(s);
+        }
+        else if (ok)
+            ok = string2ldLen(o->ptr, sdslen(o->ptr), &value);
+        if (!ok)
+        {
+            addWrite(client, resp.notFloat);
+            return;
+        }
+    }
+    if (!string2ldLen(client->argv[2], client->argvlen[2], &incr))
     {
-        long ttl = dbGetTTL(client->db, key);
-        char buf[64] = {0};
-        snprintf(buf, sizeof(buf), "ttl:%lds", ttl);
-        addWrite(client, respEncodeBulkString(buf));
+        addWrite(client, resp.notFloat);
+        return;
     }
-    else
+    value += incr;
+    if (isnan(value) || isinf(value))
     {
-        addWrite(client, resp.keyNotFound);
+        addWrite(client, resp.nanOrInfinity);
+        return;
     }
+
+    char buf[MAX_LONG_DOUBLE_CHARS];
+    int len = snprintf(buf, sizeof(buf), "%.17Lf", value);
+    if (strchr(buf, '.'))
+    {
+        while (buf[len - 1] == '0')
+            len--;
+        if (buf[len - 1] == '.')
+            len--;
+        buf[len] = '\0';
+    }
+    dbSetView(client->db, &client->keyView, robjCreateStringObjectLen(buf, len));
+    server->dirty++;
+    // 浮点运算结果在不同机器上可能不同，传播计算结果 SET key value。 SET会清除过期时间，有过期时间时补上PEXPIREAT
+    const char *argv[] = {"SET", client->argv[1], buf};
+    const size_t argvlen[] = {3, client->argvlen[1], (size_t)len};
+    client->propagateCmd = respCatCommand(sdsempty(), 3, argv, argvlen);
+    long long ttl = dbGetTTLView(client->db, &client->keyView);
+    if (ttl >= 0)
+        client->propagateCmd = catPexpireatCommand(client->propagateCmd, client->argv[1], client->argvlen[1],
+                                                   server->mstime + ttl);
+
+    char hdr[32];
+    int n = snprintf(hdr, sizeof(hdr), "$%d\r\n", len);
+    addWriteBuf(client, hdr, n);
+    addWriteBuf(client, buf, len);
+    addWriteBuf(client, "\r\n", 2);
 }
 
 void commandMultiProc(redisClient *client)
@@ -513,13 +1151,18 @@ void commandExecProc(redisClient *client)
     }
     else
     {
-        // 执行事务队列的命令
+        // 执行事务队列的命令. 不能借用readBuf，它后面可能还有pipeline的命令
+        respReqParser p;
+        respReqParserInit(&p);
         for (int i = 0; i < client->multiCmdCount; ++i)
         {
-            sds *cmd = client->multcmds[i];
-            sdsclear(client->readBuf);
-            sdscatsds(client->readBuf, cmd);
-            processClientQueryBuf(client);
+            sds cmd = client->multcmds[i];
+            if (respParseRequest(&p, cmd, sdslen(cmd)) == RESP_REQ_OK)
+            {
+                clientSetArgv(client, &p, cmd);
+                processCommand(client);
+            }
+            respReqParserFree(&p);
             sdsclear(cmd);
         }
         addWrite(client, respEncodeBulkString("Exec ok"));
@@ -539,20 +1182,12 @@ void commandWatchProc(redisClient *client)
 {
     for (int i = 1; i < client->argc; ++i)
     {
-        sds *key = sdsnew(client->argv[i]);
-        dbAddWatch(client->db, key, client);
+        dictKeyView key = dictMakeView(client->argv[i], client->argvlen[i]);
+        dbAddWatch(client->db, &key, client);
     }
     addWrite(client, resp.ok);
 }
 
-void appendServerSaveParam(time_t sec, int changes)
-{
-    server->saveParams = realloc(server->saveParams, sizeof(struct saveparam) * (server->saveCondSize + 1));
-    server->saveParams[server->saveCondSize].seconds = sec;
-    server->saveParams[server->saveCondSize].changes = changes;
-    server->saveCondSize++;
-}
-
 /**
  * @brief 初始化服务器配置
  *
@@ -560,43 +1195,43 @@ void appendServerSaveParam(time_t sec, int changes)
  */
 void initServerConfig()
 {
-    // 加载配置文件必要参数
-    char *role = get_config(server->configfile, "role");
-    if (!strncasecmp(role, "sentinel", 8))
-        server->flags |= REDIS_CLUSTER_SENTINEL;
-    if (!strncasecmp(role, "master", 6))
-        server->flags |= REDIS_CLUSTER_MASTER;
-    if (!strncasecmp(role, "slave", 5))
-        server->flags |= REDIS_CLUSTER_SLAVE;
-    char *port = get_config(server->configfile, "port");
-    server->port = atoi(port);
-    char *consistency = get_config(server->configfile, "consistency");
-    if (!strncasecmp(consistency, "rdb", 3))
-        server->rdbOn = true;
-    if (!strncasecmp(consistency, "aof", 3))
-        server->aofOn = true;
-    char *dbnum = get_config(server->configfile, "dbnum");
-    server->dbnum = atoi(dbnum);
-    char *rdbfile = get_config(server->configfile, "rdb_file");
-    server->rdbfile = fullPath(rdbfile);
+    // 只读这一次配置文件
+    if (loadServerConfig(server->configfile) != 0)
+        exit(EXIT_FAILURE);
+    // 分配器模式要在其他分配之前确定
+    zmallocInit(server->allocator, server->arenaSize);
 
+    server->rdbfile = fullPath(server->rdbFileName);
+    server->replStateFd = -1;
+    if (server->replStateFileName == NULL)
+    {
+        char buf[REDIS_MAX_STRING];
+        snprintf(buf, sizeof(buf), "data/%d.repl", server->port);
+        server->replStateFileName = strdup(buf);
+    }
     if (server->flags & REDIS_CLUSTER_SLAVE)
     {
-        // 加载master
-        char *master = get_config(server->configfile, "master");
-        char *ip = strtok(master, ":");
-        int port = atoi(strtok(NULL, ":"));
-        server->masterhost = ip;
-        server->masterport = port;
-        log_debug("Slave load master: %s:%d", ip, port);
+        if (server->masterhost == NULL)
+        {
+            log_error("Slave requires config master=host:port");
+            exit(EXIT_FAILURE);
+        }
+        log_debug("Slave load master: %s:%d", server->masterhost, server->masterport);
     }
 
-    // bagsave
-    server->saveCondSize = 0;
-    server->saveParams = NULL;
-    appendServerSaveParam(900, 1);
-    appendServerSaveParam(300, 10000);
-    appendServerSaveParam(10, 1); // 10秒内修改一次
+    if (server->shardsNum > 1 &&
+        (!(server->flags & REDIS_CLUSTER_MASTER) || server->rdbOn || server->aofOn))
+    {
+        // 分片之间没有统一的快照和命令流
+        log_warn("shards requires role=master and consistency=none, fall back to 1 shard");
+        server->shardsNum = 1;
+    }
+    if (server->shardsNum > 1 && server->ioThreadsNum > 1)
+    {
+        log_warn("io-threads is ignored in shards mode");
+        server->ioThreadsNum = 1;
+    }
+    server->shardId = 0;
 
     server->maxclients = REDIS_MAX_CLIENTS;
     loadCommands();
@@ -604,10 +1239,13 @@ void initServerConfig()
     log_debug("√ init server config.  ");
 }
 
+/**
+ * @brief 缓存当前时间。 每轮事件循环epoll_wait返回后、serverCron中更新，命令执行期间直接读取
+ */
 void updateServerTime()
 {
-    server->unixtime = time(NULL);
     server->mstime = mstime();
+    server->unixtime = server->mstime / 1000;
 }
 
 void closeClients()
@@ -642,7 +1280,12 @@ void closeClients()
 
 void prepareShutdown()
 {
+    // 重写没有完成，旧AOF仍然完整
+    killAppendOnlyChild();
+    stopAppendOnly();
     bgSaveIfNeeded();
+    // AOF已经写完，offset和AOF一致，下次启动可以续传
+    replicationSaveState();
 
     // TODO :
 
@@ -691,7 +1334,7 @@ void sentinelReadInfo(aeEventLoop *el, int fd, void *privdata)
     ssize_t nread = rioRead(&r, buf, sizeof(buf));
     if (checkSockReadWrite(client, nread))
     {
-        sdscat(client->readBuf, buf);
+        client->readBuf = sdscat(client->readBuf, buf);
         log_debug("Sentinel read info : %s", buf);
         client->lastinteraction = server->unixtime;
         sdsclear(client->readBuf);
@@ -769,56 +1412,113 @@ int masterCron(struct aeEventLoop *eventLoop, long long id, void *clientData)
 }
 
 /**
- * @brief 服务器定时： 主/从/sentinel  都有各自的
+ * @brief 数据库定时任务：主动过期、主动rehash。
+ *  客户端不访问的dict不会推进渐进式rehash，一直占着两张表。
+ *  每次在一个数据库上花费ACTIVE_REHASH_MS，下一次从下一个数据库开始，轮流推进
+ */
+static void databasesCron(void)
+{
+    activeExpireCycle(ACTIVE_EXPIRE_CYCLE_SLOW);
+
+    if (!server->activerehashing)
+        return;
+    for (int i = 0; i < server->dbnum; i++)
+    {
+        redisDb *db = &server->db[server->rehashDb];
+        server->rehashDb = (server->rehashDb + 1) % server->dbnum;
+        dict *d = dictIsRehashing(db->kv) ? db->kv : dictIsRehashing(db->expires) ? db->expires : NULL;
+        if (d == NULL)
+            continue;
+        long long start = ustime();
+        server->statActiveRehashes += dictRehashMilliseconds(d, ACTIVE_REHASH_MS);
+        server->statActiveRehashUs += ustime() - start;
+        break;
+    }
+}
+
+/**
+ * @brief 服务器定时： 每SERVER_CRON_PERIOD_MS执行一次，主/从/sentinel 各自的任务按自己的周期执行
  *
  * @param [in] eventLoop
  * @param [in] id
  * @param [in] clientData
  * @return int 周期时间
  */
+static void checkChildrenDone(void);
+
 int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData)
 {
-    int period = 3000;
+    // 更新server时间
+    updateServerTime();
+
     if (server->flags & REDIS_CLUSTER_MASTER)
     {
-        period = masterCron(eventLoop, id, clientData);
+        run_with_period(10000) masterCron(eventLoop, id, clientData);
     }
     if (server->flags & REDIS_CLUSTER_SLAVE)
     {
-        period = slaveCron(eventLoop, id, clientData);
+        run_with_period(5000) slaveCron(eventLoop, id, clientData);
     }
-    // 更新server时间
-    updateServerTime();
+
+    if (server->isBgSaving || server->aof.childPid != -1)
+        checkChildrenDone();
+    // 等待无盘同步的从: 延迟到了、没有子进程时fork
+    replicationSyncCron();
+    if (server->aofOn)
+        rewriteAppendOnlyFileIfNeeded();
 
     // TODO 由于ae中优先处理文件事件，这就会导致，epollwait会有些待关闭的fd，会产生错误
     closeClients();
 
+    databasesCron();
+
     if (server->shutdownAsap)
     {
         // 检测到需要关闭。在shutdown中exit。
         prepareShutdown();
     }
-    return period;
+    server->cronloops++;
+    return SERVER_CRON_PERIOD_MS;
 }
 
-void sigChildHandler(int sig)
+/**
+ * @brief 回收结束的BGSAVE、BGREWRITEAOF子进程。 在serverCron中轮询，不在SIGCHLD处理函数中做：
+ *  处理函数会打断持有日志锁的主线程，再写日志就会死锁
+ */
+static void checkChildrenDone(void)
 {
     pid_t pid;
     int stat;
     // 匹配任意子进程结束
     while ((pid = waitpid(-1, &stat, WNOHANG)) > 0)
     {
-        if (server->rdbChildPid == pid)
+        if (server->rdbChildPid == pid && server->rdbChildType == RDB_CHILD_TYPE_SOCKET)
+        {
+            server->rdbChildPid = -1;
+            server->isBgSaving = 0;
+            replicationDisklessDone(WIFEXITED(stat) && WEXITSTATUS(stat) == 0);
+        }
+        else if (server->rdbChildPid == pid)
         {
             // 检查退出状态
             if (WIFEXITED(stat) && WEXITSTATUS(stat) == 0)
             {
                 server->lastSave = server->unixtime;
+                // 保存期间的修改不在快照里，保留计数
+                server->dirty -= server->dirtyBeforeBgsave;
                 log_debug("server know %d finished", pid);
             }
+            else
+            {
+                log_warn("Background saving error");
+            }
             server->rdbChildPid = -1;
-            server->dirty = 0;
             server->isBgSaving = 0;
+            replicationBgsaveDone(WIFEXITED(stat) && WEXITSTATUS(stat) == 0);
+        }
+        else if (server->aof.childPid == pid)
+        {
+            backgroundRewriteDoneHandler(WIFEXITED(stat) && WEXITSTATUS(stat) == 0);
         }
     }
 }
@@ -843,20 +1543,63 @@ void sigIntHandler(int sig)
     }
 }
 
+static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void logLock(bool lock, void *udata)
+{
+    if (lock)
+        pthread_mutex_lock(udata);
+    else
+        pthread_mutex_unlock(udata);
+}
+
+/* fork时其他线程(AOF线程、IO线程)可能正持有日志锁，子进程中没有线程会释放它。
+ * fork前先拿到锁，父子进程各自释放 */
+static void logLockBeforeFork(void)
+{
+    pthread_mutex_lock(&logMutex);
+}
+
+static void logUnlockAfterFork(void)
+{
+    pthread_mutex_unlock(&logMutex);
+}
+
 void initServerSignalHandlers()
 {
-    signal(SIGCHLD, sigChildHandler);
     signal(SIGINT, sigIntHandler);
+    signal(SIGPIPE, SIG_IGN); // 对端关闭后写入返回EPIPE，而不是终止进程
 }
 
-void initServer()
+/**
+ * @brief 每轮epoll_wait之前: 处理延迟的读取、刷AOF缓冲、发送回复
+ *
+ * @param [in] el
+ */
+static void afterSleep(aeEventLoop *el)
 {
-    initServerSignalHandlers();
-
-    robjInit();
+    updateServerTime();
+}
 
-    server->id = getpid();
+static void beforeSleep(aeEventLoop *el)
+{
+    // 上一次主动过期没做完，短时间继续清理
+    activeExpireCycle(ACTIVE_EXPIRE_CYCLE_FAST);
+    handleClientsWithPendingReads();
+    // 本轮转发给其他分片的请求、回复，批量交付
+    if (server->shardsNum > 1)
+        shardsBeforeSleep();
+    // 本轮的写命令作为一批交给AOF刷盘线程，always模式下扣下等待落盘的回复，再回复客户端
+    flushAppendOnlyFile();
+    handleClientsWithPendingWrites();
+}
 
+/**
+ * @brief 初始化一个事件循环独占的状态：数据库、客户端链表、事件循环、监听socket、定时任务。
+ *  分片模式下每个分片线程各调用一次
+ */
+void initServerEventLoop()
+{
     server->unixtime = time(NULL);
     server->mstime = mstime();
 
@@ -868,21 +1611,18 @@ void initServer()
     server->dirty = 0;
     server->lastSave = server->unixtime;
 
-    server->rdbChildPid = -1;
-    server->isBgSaving = 0;
-    server->rdbfd = -1; //
-    if (server->rdbOn)
-    {
-        log_debug("load rdb from %s", server->rdbfile);
-        rdbLoad();
-    }
-
     server->clients = listCreate();
     server->clientsToClose = listCreate();
+    server->clientsPendingRead = listCreate();
+    server->clientsPendingWrite = listCreate();
 
     server->eventLoop = aeCreateEventLoop(server->maxclients);
+    aeSetBeforeSleepProc(server->eventLoop, beforeSleep);
+    aeSetAfterSleepProc(server->eventLoop, afterSleep);
     server->bindaddr = NULL;
-    int fd = anetTcpServer(server->port, server->bindaddr, server->maxclients);
+    // 分片各自监听同一端口，由内核分配连接
+    int fd = server->shardsNum > 1 ? anetTcpServerReusePort(server->port, server->bindaddr, server->maxclients)
+                                   : anetTcpServer(server->port, server->bindaddr, server->maxclients);
     if (fd == -1)
     {
         exit(EXIT_FAILURE);
@@ -896,14 +1636,60 @@ void initServer()
     }
     log_debug(" create file event for ACCEPT, listening.....");
     // 注册定时任务
-    aeCreateTimeEvent(server->eventLoop, 1000, serverCron, NULL);
+    server->cronloops = 0;
+    server->rehashDb = 0;
+    server->statActiveRehashes = 0;
+    server->statActiveRehashUs = 0;
+    server->expireDb = 0;
+    server->expireTimelimitHit = 0;
+    server->expireLastFastCycle = 0;
+    server->statExpiredKeys = 0;
+    server->statExpiredStalePerc = 0;
+    server->statExpiredTimeCapReached = 0;
+    server->evictionPool = evictionPoolCreate();
+    server->evictDb = 0;
+    server->statEvictedKeys = 0;
+    aeCreateTimeEvent(server->eventLoop, SERVER_CRON_PERIOD_MS, serverCron, NULL);
     log_debug(" create time event for serverCron");
+}
+
+void initServer()
+{
+    initServerSignalHandlers();
+    // AOF线程、分片线程也会写日志
+    log_set_lock(logLock, &logMutex);
+    pthread_atfork(logLockBeforeFork, logUnlockAfterFork, logUnlockAfterFork);
+
+    robjInit();
+    // 按LRU/LFU淘汰时每个值需要自己的访问信息，不共享整数对象
+    robjSetShareIntegers(!(server->maxmemory && policyUsesObjectAccess(server->maxmemoryPolicy)));
+    robjSetCompressThreshold(server->valueCompressThreshold);
+
+    server->id = getpid();
+
+    initServerEventLoop();
+
+    server->rdbChildPid = -1;
+    server->isBgSaving = 0;
+    server->rdbPipeFd = -1;
+    server->aof.childPid = -1;
+    if (server->rdbOn)
+    {
+        log_debug("load rdb from %s", server->rdbfile);
+        // 不认识的文件(如旧版本格式)不能当作空库启动，否则下次BGSAVE会用空库覆盖它
+        if (rdbLoad() != 0)
+        {
+            log_error("Fatal error loading the DB %s, exiting", server->rdbfile);
+            exit(EXIT_FAILURE);
+        }
+    }
+    initIOThreads(server->ioThreadsNum);
 
     // sentinel特性，
     if (server->flags& REDIS_CLUSTER_SENTINEL)
     {
-        char *monitor = get_config(server->configfile, "monitor");
-        assert(monitor != NULL);
+        assert(server->sentinelMonitor != NULL);
+        char *monitor = strdup(server->sentinelMonitor);
         dictType commandDictType = {
             .hashFunction = commandDictHashFunction,
             .keyCompare = commandDictKeyCompare,
@@ -934,77 +1720,55 @@ void initServer()
         aof_init();
         aof_load();
     }
-    // master维持的复制积压缓冲区
-    memset(server->repli_buffer, 0, MASTER_REPLI_RINGBUFFER_SIZE);
-    server->begin_offset = 0;
-    server->last_offset = 0;
-    
+    // 复制ID和积压缓冲区，主从都维护。 从的ID和offset随后从复制状态文件读取
+    changeReplicationId();
+    clearReplicationId2();
+    server->offset = 0;
+    createReplicationBacklog();
+
     //
     if (server->flags & REDIS_CLUSTER_SLAVE)
     {
+        replicationLoadState(true);
         connectMaster();
     }
-    log_info("√ server init finished.  ROLE:%s.", getRoleStr(server->flags));
-}
-
-/**
- * @brief server, client 匹配
- *
- * @param client
- * @param cmd
- * @return int 支持返回1， 不支持返回0
- */
-int isSupportedCmd(redisClient *c, redisCommand *cmd)
-{
-    assert(c);
-    assert(cmd);
-    if ((server->flags & REDIS_CLUSTER_SLAVE) &&
-        (c->flags & REDIS_CLIENT_NORMAL) &&
-        (cmd->flags & CMD_WRITE))
+    // 当前线程作为分片0，启动其他分片
+    if (server->shardsNum > 1)
     {
-        // 从服务器不支持来自普通客户端的写命令
-        return 0;
+        initShards(server->shardsNum);
     }
-
-    return 1;
+    log_info("√ server init finished.  ROLE:%s.", getRoleStr(server->flags));
 }
+
 /**
- * 查询命令, 命令权限控制
+ * 查询命令, 命令权限控制. O(1), 不分配内存
  * @param client
- * @param name
+ * @param name 命令名视图，不以'\0'结尾
+ * @param len
  * @return 如果不可以，返回null
  */
-redisCommand *lookupCommand(redisClient *c, const char *name)
+redisCommand *lookupCommand(redisClient *c, const char *name, size_t len)
 {
     assert(c);
     assert(name);
     assert(server->commands);
-    dictIterator *iter = dictGetIterator(server->commands);
-    dictEntry *entry;
-    while ((entry = dictIterNext(iter)) != NULL)
+    commandTableEntry *e = commandTableFind(server->commands, name, len);
+    if (e == NULL || (c->flags & e->rejectClientFlags))
     {
-        redisCommand *cmd = entry->v.val;
-        assert(cmd);
-        if (isSupportedCmd(c, cmd) && strcasecmp(cmd->name, name) == 0)
-        {
-            dictReleaseIterator(iter);
-            return cmd;
-        }
+        log_debug("cant lookup cmd ! %.*s", (int)len, name);
+        return NULL;
     }
-    log_debug("cant lookup cmd ! %s", name);
-    dictReleaseIterator(iter);
-    return NULL;
+    return e->cmd;
 }
-
 /**
  * @brief 主向从命令传播
  *
  * @param [in] s 原封不动的resp字符串
  */
-void commandPropagate(sds *s)
+void commandPropagate(const char *buf, size_t len)
 {
     log_debug("Command propagate !");
-    assert(s);
+    assert(buf);
     assert(server);
     assert(server->flags & REDIS_CLUSTER_MASTER);
     redisClient *c;
@@ -1014,12 +1778,19 @@ void commandPropagate(sds *s)
     {
         c = node->value;
         assert(c);
-        if (c->flags == REDIS_CLIENT_SLAVE)
+        // 正在全量同步的从: fork之后的命令暂存，RDB发完后接在后面发送。 还在等待fork的从不需要
+        if (c->flags == REDIS_CLIENT_SLAVE &&
+            (c->replState == REPL_STATE_MASTER_WAIT_BGSAVE_END || c->replState == REPL_STATE_MASTER_SEND_RDB ||
+             c->replState == REPL_STATE_MASTER_SEND_BULK))
+        {
+            c->replPending = sdscatlen(c->replPending ? c->replPending : sdsempty(), buf, len);
+        }
+        else if (c->flags == REDIS_CLIENT_SLAVE && c->replState == REPL_STATE_MASTER_CONNECTED)
         {
             slaves++;
             // 对端是slave
-            sdscat(c->writeBuf, s->buf);
-            log_debug("Propagate to %d slave, [%d]-%s:%d, %d bytes", slaves, c->fd, c->ip, c->port, c->writeBuf->len);
+            addWriteBuf(c, buf, len);
+            log_debug("Propagate to %d slave, [%d]-%s:%d, %zu bytes", slaves, c->fd, c->ip, c->port, replyListPending(&c->reply));
             if (aeCreateFileEvent(server->eventLoop, c->fd, AE_READABLE, readFromClient, c) == AE_ERROR)
             {
                 log_debug("command propagate ae failed! ");
@@ -1042,10 +1813,9 @@ void commandPropagate(sds *s)
  */
 void touchWatchKey(redisClient *client)
 {
-    sds *key = sdsnew(client->argv[1]);
-    if (dbIsWatching(client->db, key))
+    list *clients = dbWatchingClients(client->db, &client->keyView);
+    if (clients)
     {
-        list *clients = dictFetchValue(client->db->watched_keys, key);
         listNode *node = listHead(clients);
         while (node)
         {
@@ -1055,34 +1825,69 @@ void touchWatchKey(redisClient *client)
             node = listHead(clients);
         }
     }
+}
+void checkProcCanDo()
+{
+    
 }
 /**
- * [Master]添加到环形积压缓冲区，更新主的offset
+ * @brief 写命令执行后写入AOF、积压缓冲区，并传播给从服务器
+ *
+ * proc设置了propagateCmd(如相对过期时间改写为绝对时间)时传播改写后的命令，否则传播原始命令。
+ * 和redis一样，只有修改了数据库(dirty变化)的命令才传播，失败的命令重放时不会有不同结果。
+ *
+ * @param [in] c
+ * @param [in] dirty 命令是否修改了数据库
  */
-void addRepliBuf(uint8_t buf[], long size)
+static void propagateCommand(redisClient *c, bool dirty)
 {
-    // 数据在 [begin_index, last_index) 之间
-    long last_index = (server->last_offset + MASTER_REPLI_RINGBUFFER_SIZE) % MASTER_REPLI_RINGBUFFER_SIZE;
-    long begin_index = (server->begin_offset + MASTER_REPLI_RINGBUFFER_SIZE) % MASTER_REPLI_RINGBUFFER_SIZE;
-    
-    if (last_index + size >= MASTER_REPLI_RINGBUFFER_SIZE) {
-        // 回环覆盖
-        long n = MASTER_REPLI_RINGBUFFER_SIZE - last_index - 1;
-        memcpy(server->repli_buffer + last_index + 1, buf, n);
-        memcpy(server->repli_buffer, buf + n, size - n);
-        if (begin_index < size - n )
-            // 如果溢出，移动旧offset
-            server->begin_offset += size -n - begin_index;
-    } else {
-        // 
-        memcpy(server->repli_buffer + last_index + 1, buf, size);
-    }
-    server->last_offset += size;
-    log_debug("add repli buf. %lu bytes. Begin: %ld, Last: %ld", size, server->begin_offset, server->last_offset);
+    const char *buf = c->propagateCmd ? c->propagateCmd : c->rawCmd;
+    size_t len = c->propagateCmd ? sdslen(c->propagateCmd) : c->rawCmdLen;
+    // 伪客户端执行的命令(AOF加载、分片执行器)已经在AOF和从服务器的数据里，不再传播
+    if (dirty && !(c->flags & REDIS_CLIENT_FAKE))
+    {
+        if (server->aofOn)
+            c->aofWaitSeq = feedAppendOnlyFile(c->dbid, buf, len);
+        if (server->flags & REDIS_CLUSTER_MASTER)
+        {
+            // 命令添加到积压缓冲区，推进offset
+            replicationFeedBacklog(buf, len);
+            // 主服务器对 写命令进行传播
+            commandPropagate(buf, len);
+        }
+    }
+    if ((server->flags & REDIS_CLUSTER_SLAVE) && (c->flags & REDIS_CLIENT_MASTER))
+    {
+        // 写命令来自主传播，更新自己的offset。 原样记入积压缓冲区，和主的offset一致，提升为主后其他从可以续传
+        replicationFeedBacklog(c->rawCmd, c->rawCmdLen);
+    }
+    sdsfree(c->propagateCmd);
+    c->propagateCmd = NULL;
 }
-void checkProcCanDo()
+/**
+ * @brief 过期、淘汰删除的键以 DEL key 写入AOF、积压缓冲区并传播给从服务器，
+ *  重放AOF和从服务器上不会留下主已经删除的键。 需要在键删除前调用(key可能是库中的键)
+ *
+ * @param [in] db
+ * @param [in] key
+ * @param [in] len
+ */
+void propagateDeletion(redisDb *db, const char *key, size_t len)
 {
-    
+    // 加载AOF时删除的键，重放时同样会被删除
+    if (server->loading)
+        return;
+    const char *argv[] = {"DEL", key};
+    const size_t argvlen[] = {3, len};
+    sds cmd = respCatCommand(sdsempty(), 2, argv, argvlen);
+    if (server->aofOn)
+        feedAppendOnlyFile(db->id, cmd, sdslen(cmd));
+    if (server->flags & REDIS_CLUSTER_MASTER)
+    {
+        replicationFeedBacklog(cmd, sdslen(cmd));
+        commandPropagate(cmd, sdslen(cmd));
+    }
+    sdsfree(cmd);
 }
 /**
  * @brief 调用执行命令。已有argc,argv[]
@@ -1093,59 +1898,58 @@ void processCommand(redisClient *c)
 {
     redisCommand *cmd;
     assert(c);
-    // argv[0] 一定是字符串，sds
-    char *cmdname = c->argv[0];
-    // log_debug("process CMD %s", cmdname);
-    cmd = lookupCommand(c, cmdname);
+    if (c->argc == 0)
+        return;
+    cmd = lookupCommand(c, c->argv[0], c->argvlen[0]);
     if (cmd == NULL)
     {
         log_debug("Will ret invalid!");
         addWrite(c, resp.invalidCommand);
+        return;
     }
-    else
+    // proc执行前校验参数个数，proc内可以直接访问argv[arity-1]
+    if (!commandCheckArity(cmd, c->argc))
     {
-        // 写命令写入aof
-        if (!(c->flags & REDIS_CLIENT_FAKE) && 
-            server->aofOn &&
-              (cmd->flags & CMD_WRITE))
-        {
-            sdscatsds(server->aof.active_buf, c->readBuf);
-        }
-        // 读写数据库时候，惰性删除 访问的键
-        if (cmd->flags & (CMD_READ | CMD_WRITE))
-        {
-            expireIfNeed(c->db, sdsnew(c->argv[1]));
-        }
-        cmd->proc(c);
-        // 监视键更新
-        if (cmd->flags & CMD_WRITE)
-        {
-            touchWatchKey(c);
-        }
+        addWrite(c, resp.wrongArity);
+        return;
+    }
+    // 分片模式下不转发的命令（事务中、WATCH），键必须属于本分片
+    if (server->shardsNum > 1 && !shardCommandIsLocal(c, cmd))
+    {
+        addWrite(c, resp.crossShard);
+        return;
     }
-    if (cmd && 
-        (cmd->flags & CMD_WRITE) && 
-        (server->flags & REDIS_CLUSTER_MASTER))
+    // 超过maxmemory时，写命令执行前先淘汰。 主服务器传播来的写命令照常执行，由主服务器淘汰
+    if (server->maxmemory && (cmd->flags & CMD_WRITE) && !(c->flags & REDIS_CLIENT_MASTER))
     {
-        // 命令添加到缓冲区
-        addRepliBuf(c->readBuf->buf, c->readBuf->len);
-        // 主服务器对 写命令进行传播
-        commandPropagate(c->readBuf);
+        if (performEvictions() == EVICT_FAIL && (cmd->flags & CMD_DENYOOM))
+        {
+            addWrite(c, resp.oom);
+            return;
+        }
     }
-    if (cmd && 
-            (cmd->flags & CMD_WRITE) && 
-            (server->flags & REDIS_CLUSTER_SLAVE))
+    // 第一个键只计算一次hash，惰性过期、proc、监视键共用这个视图
+    int haskey = cmd->firstkey > 0 && c->argc > cmd->firstkey;
+    if (haskey)
+        c->keyView = dictMakeView(c->argv[cmd->firstkey], c->argvlen[cmd->firstkey]);
+    // 读写数据库时候，惰性删除 访问的键
+    if ((cmd->flags & (CMD_READ | CMD_WRITE)) && haskey)
     {
-        // 写命令来自主传播，更新自己的offset
-        slaveUpdateOffset(server->offset + c->readBuf->len);
+        if (expireIfNeededView(c->db, &c->keyView))
+        {
+            propagateDeletion(c->db, c->keyView.buf, c->keyView.len);
+            server->statExpiredKeys++;
+        }
     }
-    // log_debug("Process ok , clear!");
-    sdsclear(c->readBuf);
-    for (int i = 0; i < c->argc; ++i)
+    long long dirty = server->dirty;
+    cmd->proc(c);
+    // 监视键更新
+    if ((cmd->flags & CMD_WRITE) && haskey)
     {
-        free(c->argv[i]);
+        touchWatchKey(c);
     }
-    c->argc = 0;
+    if (cmd->flags & CMD_WRITE)
+        propagateCommand(c, server->dirty != dirty);
 }
 
 void multiInQueue(redisClient *c)
@@ -1153,7 +1957,40 @@ void multiInQueue(redisClient *c)
 }
 
 /**
- * @brief 处理一次RESP协议的请求。
+ * @brief 执行解析器中的一条完整命令
+ *
+ * @param [in] client
+ * @return int 0表示命令暂不能执行（分片模式下等待转发的回复），解析结果保留
+ */
+static int processParsedCommand(redisClient *client)
+{
+    respReqParser *p = &client->reqParser;
+    clientSetArgv(client, p, client->readBuf);
+    int route = SHARD_ROUTE_LOCAL;
+
+    // 如果处于事务状态，设置事务队列，暂不执行
+    if ((client->flags & REDIS_MULTI) && !clientArgIs(client, 0, "exec"))
+    {
+        // 加入事务队列(即暂存一条原始resp)，返回queued
+        clientMultiAdd(client);
+        addWrite(client, respEncodeBulkString("queued"));
+    }
+    else
+    {
+        if (server->shardsNum > 1)
+            route = shardRouteCommand(client);
+        if (route == SHARD_ROUTE_LOCAL)
+            processCommand(client);
+    }
+    client->argc = 0;
+    client->rawCmd = NULL;
+    client->rawCmdLen = 0;
+    return route != SHARD_ROUTE_WAIT;
+}
+
+/**
+ * @brief 处理readBuf内所有完整的RESP请求（pipeline），半包留在readBuf等待下次read。
+ *  解析从上次的游标继续，处理完成后一次性裁剪掉已消费部分。
  * @param [in] client
  *
  */
@@ -1161,48 +1998,69 @@ void processClientQueryBuf(redisClient *client)
 {
     if (client->readBuf == NULL)
         return;
-    sds *s = (sds *)(client->readBuf);
-    sds *scpy = sdsdump(s);
-    int argc;
-    char **argv;
-    int ret = resp_decode(scpy->buf, &argc, &argv);
-    if (ret == 0)
-    {
-        // 按照命令执行
+    respReqParser *p = &client->reqParser;
+    sds qb = client->readBuf;
 
-        // 如果处于事务状态，设置事务队列，暂不执行
-        if ((client->flags & REDIS_MULTI) && strncasecmp(argv[0], "exec", 4) != 0)
+    while (!(client->flags & CLIENT_TO_CLOSE) && !client->toclose)
+    {
+        // IO线程可能已经解析出第一条命令
+        int ret = client->reqParsed;
+        client->reqParsed = RESP_REQ_INCOMPLETE;
+        if (ret == RESP_REQ_INCOMPLETE)
         {
-            // 加入事务队列(即readbuf暂存一条resp)，返回queued
-            clientMultiAdd(client);
-            addWrite(client, respEncodeBulkString("queued"));
-            sdsclear(client->readBuf);
+            if (p->pos >= sdslen(qb))
+                break;
+            char first = qb[p->pos];
+            if (p->multibulklen == 0 && (first == '+' || first == '-' || first == ':'))
+            {
+                // 按照响应执行，跳过一行
+                // slave从 会在这里收到响应。
+                char *nl = memchr(qb + p->pos, '\n', sdslen(qb) - p->pos);
+                if (nl == NULL)
+                    break;
+                p->pos = nl - qb + 1;
+                respReqParserReset(p);
+                if (client->flags & REDIS_CLIENT_MASTER)
+                {
+                    server->master->lastinteraction = server->unixtime;
+                }
+                continue;
+            }
+            ret = respParseRequest(p, qb, sdslen(qb));
+            if (ret == RESP_REQ_INCOMPLETE)
+                break;
         }
-        else
+        if (ret == RESP_REQ_ERR)
         {
-            // 执行命令
-            client->argv = argv;
-            client->argc = argc;
-            processCommand(client);
+            log_warn("Protocol error from client [%d]%s:%d", client->fd, client->ip, client->port);
+            addWrite(client, resp.protoerr);
+            client->toclose = 1; // 回复后关闭
+            p->pos = sdslen(qb);
+            respReqParserReset(p);
+            break;
         }
-        if (aeCreateFileEvent(server->eventLoop, client->fd, AE_WRITABLE, sendToClient, client) == AE_ERROR)
+        if (!processParsedCommand(client))
         {
-            log_debug("process client query buf ae failed!!");
-            clientToclose(client);
+            // 保留这条已解析的命令，转发的回复全部到达后继续
+            client->reqParsed = ret;
+            break;
         }
-    
+        respReqParserReset(p);
     }
-    else if (*scpy->buf == '+' || *scpy->buf == '-')
+
+    // 裁剪已经处理的命令，保留半包
+    if (p->cmdstart > 0)
     {
-        // 按照响应执行
-        // log_info("Get RESP from client %s", resp_str(scpy->buf));
-        // slave从 会在这里收到响应。
-        if (client->flags & REDIS_CLIENT_MASTER)
-        {
-            server->master->lastinteraction = server->unixtime;
-        }
+        size_t consumed = p->cmdstart;
+        sdsrange(qb, consumed, sdslen(qb) - 1);
+        respReqParserShift(p, consumed);
+    }
+
+    // 回复在beforeSleep中直接发送，没发送完才注册可写事件
+    if (client->fd != -1 && clientHasPendingReplies(client))
+    {
+        clientInstallWriteHandler(client);
     }
-    sdsfree(scpy);
 }
 
 /**
@@ -1246,125 +2104,78 @@ void readRespFromClient(aeEventLoop *el, int fd, void *privData)
 void readFromClient(aeEventLoop *el, int fd, void *privData)
 {
     redisClient *client = (redisClient *)privData;
-    char buf[1024] = {0};
-    rio r;
-    rioInitWithFD(&r, fd);
-    ssize_t nread = rioRead(&r, buf, sizeof(buf));
-    if (checkSockReadWrite(client, nread))
-    {
-        sdscat(client->readBuf, buf);
-        processClientQueryBuf(client);
-     
-        sdsclear(client->readBuf);
-    }
-    else
-    {
-        log_debug("read from client failed");
-        clientToclose(client);
-    }
+    // 开启IO线程时，读取延迟到beforeSleep并行完成
+    if (postponeClientRead(client))
+        return;
+    // 直接读到readBuf末尾，不经过中间缓冲，二进制安全
+    ssize_t nread = clientReadFromSocket(client);
+    clientReadDone(client, nread);
 }
 
 /**
- * @brief 主读取RDB文件发送到slave, 切换fd写事件处理为 sendRDB
+ * @brief 读取之后的处理：检查连接，执行命令
  *
  * @param [in] client
+ * @param [in] nread read返回值，出错时errno有效
  */
-void saveRDBToSlave(redisClient *client)
+void clientReadDone(redisClient *client, ssize_t nread)
 {
-    log_debug("Will send rdb to slave! %s:%u", client->ip, client->port);
-    struct stat st;
-    long rdb_len;
-    char length_buf[64];
-    size_t length_len;
-    rio sio;
-    size_t nwritten = 0;
-
-    if (server->rdbfd == -1)
-    {
-        server->rdbfd = open(server->rdbfile, O_RDWR);
-    }
-
-    if (fstat(server->rdbfd, &st) == -1)
-    {
-        log_error("Stat RDB file: %s failed: %s", server->rdbfile, strerror(errno));
-        return;
-    }
-
-    rdb_len = st.st_size;
-
-    // 发送 $length\r\n
-    sprintf(length_buf, "$%lu\r\n", rdb_len);
-    length_len = strlen(length_buf);
-    rioInitWithSocket(&sio, client->fd);
-    nwritten = rioWrite(&sio, length_buf, length_len);
-    log_debug("send RDB length field: %d", rdb_len);
-    if (nwritten == 0 && sio.error)
+    if (nread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
     {
-        close(client->fd);
         return;
     }
-    if (nwritten != length_len)
+    if (checkSockReadWrite(client, nread))
     {
-        log_error("nwritten != length_len");
-        return;
+        client->lastinteraction = server->unixtime;
+        processClientQueryBuf(client);
     }
-
-    // 发送 RDB 数据, 通过sendfile,
-    off_t offset = 0;
-    ssize_t sent = sendfile(client->fd, server->rdbfd, &offset, rdb_len);
-    if (sent < 0)
+    else
     {
-        log_error("Failed to send RDB FILE to client %d: %s", client->fd, strerror(errno));
-        return;
+        log_debug("read from client failed");
+        clientToclose(client);
     }
-    // \r\n
-    char crlf[2] ;
-    crlf[0] = '\r';
-    crlf[1] = '\n';
-    rioWrite(&sio, crlf, 2);
-    log_debug("Send rdb data to slave %d, size:%ld", client->fd, rdb_len);
 }
 
 void sendToClient(aeEventLoop *el, int fd, void *privdata)
 {
     redisClient *client = (redisClient *)privdata;
-    char *msg = client->writeBuf->buf;
 
-    size_t msg_len = sdslen(client->writeBuf);
-    ssize_t nwritten;
-
-    nwritten = write(client->fd, msg, msg_len);
-    if (!checkSockReadWrite(client, nwritten))
+    // appendfsync always: 新的回复依赖还没落盘的写命令，落盘后由beforeSleep发送
+    if (aofHoldClientReply(client))
     {
-        log_debug("Send to client failed");
-        clientToclose(client);
+        aeDeleteFileEvent(el, fd, AE_WRITABLE);
         return;
     }
-
-    // 更新缓冲区
-    if (nwritten == msg_len)
+    if (writeToClient(client) < 0)
     {
-        sdsclear(client->writeBuf); // 全部发送完毕
+        log_debug("Send to client failed");
+        clientToclose(client);
+        return;
     }
-    else
+    if (clientHasPendingReplies(client))
     {
-        // sdsrange(client->writeBuf, nwritten, -1); // 删除已发送部分
-        log_error("unexpected. 没发送完. need todo");
-        return; // 等待下次写事件发送剩余数据
+        return; // socket缓冲满或达到单次上限，保持可写事件，下次继续发送
     }
+    clientReplySent(client);
+}
 
-    // 写完FULLSYNC之后触发状态转移
-    if (client->replState == REPL_STATE_MASTER_SEND_FULLSYNC)
-    {
-        client->replState = REPL_STATE_MASTER_SEND_RDB;
-        saveRDBToSlave(client); // 发送 RDB
-    }
-  
-    aeDeleteFileEvent(el, fd, AE_WRITABLE); // 普通命令回复结束
+/**
+ * @brief 回复全部发送完毕: 取消可写事件，需要时关闭
+ *
+ * @param [in] client
+ */
+void clientReplySent(redisClient *client)
+{
+    aeDeleteFileEvent(server->eventLoop, client->fd, AE_WRITABLE); // 普通命令回复结束
+    // 无盘同步的从发完了积压的RDB数据，继续读管道；磁盘同步的从继续读RDB文件
+    if (client->replState == REPL_STATE_MASTER_SEND_RDB)
+        replicationRdbPipeResume();
+    else if (client->replState == REPL_STATE_MASTER_SEND_BULK && !client->toclose)
+        replicationSendBulk(client);
     if (client->toclose)
     {
         // 发送完再关闭
         clientToclose(client);
-        aeDeleteFileEvent(el, fd, AE_READABLE); // epoll 删除fd 防止后续epoll一直对他读就绪
+        aeDeleteFileEvent(server->eventLoop, client->fd, AE_READABLE); // epoll 删除fd 防止后续epoll一直对他读就绪
     }
 }
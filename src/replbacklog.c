@@ -0,0 +1,97 @@
+/**
+ * @file replbacklog.c
+ * @brief 复制积压缓冲区: 主从共用的写命令流，以及主处理PSYNC时的增量同步判断。
+ *  只依赖server、回复队列和环形缓冲区，单元测试可以直接链接
+ */
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "redis.h"
+#include "repli.h"
+#include "client.h"
+#include "log.h"
+#include "ringbuffer.h"
+
+#define BACKLOG_CHUNK_SIZE (16 * 1024)  // 积压缓冲区拷贝到回复队列的块大小
+
+/**
+ * @brief 写命令进入复制流: 记入积压缓冲区，推进offset。
+ *  主对自己执行的写命令、从对主传播来的写命令调用，两边的offset按相同的字节数推进
+ *
+ * @param [in] buf 原封不动的resp命令
+ * @param [in] len
+ */
+void replicationFeedBacklog(const char* buf, size_t len)
+{
+    if (server->replBacklog)
+        ringBufferWrite(server->replBacklog, (const uint8_t*)buf, len);
+    server->offset += len;
+}
+
+/**
+ * @brief 把积压缓冲区中[offset, server->offset)的命令流放进从的回复队列
+ *
+ * @param [in] c 从
+ * @param [in] offset
+ * @return bool offset已经不在积压缓冲区内返回false
+ */
+static bool addReplyBacklog(redisClient* c, long offset)
+{
+    RingBuffer* bl = server->replBacklog;
+    if (bl == NULL)
+        return false;
+    long start = server->offset - ringBufferSize(bl);
+    if (offset < start || offset > server->offset)
+        return false;
+    // 按块拷贝，回环由ringBufferPeek处理
+    uint8_t chunk[BACKLOG_CHUNK_SIZE];
+    long skip = offset - start, left = server->offset - offset;
+    while (left > 0)
+    {
+        long len = left < (long)sizeof(chunk) ? left : (long)sizeof(chunk);
+        ringBufferPeek(bl, skip, chunk, len);
+        addWriteBuf(c, (const char*)chunk, len);
+        skip += len;
+        left -= len;
+    }
+    return true;
+}
+
+/**
+ * @brief 主处理PSYNC: 复制ID相同(或者是replid2且offset没有超过切换时的offset)并且offset还在积压缓冲区内时，
+ *  回复+CONTINUE，把[offset, server->offset)的命令流放进回复队列
+ *
+ * @param [in] c 从
+ * @param [in] replid 从的复制ID
+ * @param [in] offset 从的offset
+ * @return bool 不能增量同步返回false，由调用方全量同步
+ */
+bool masterTryPartialResync(redisClient* c, const char* replid, long offset)
+{
+    RingBuffer* bl = server->replBacklog;
+    if (bl == NULL || offset < 0)
+        return false;
+    if (strcasecmp(replid, server->replid) != 0 &&
+        (strcasecmp(replid, server->replid2) != 0 || offset > server->secondReplidOffset))
+    {
+        log_info("Partial resync for %s:%d rejected: replid %s doesn't match %s",
+                 c->ip, c->port, replid, server->replid);
+        return false;
+    }
+    long histlen = ringBufferSize(bl);
+    long start = server->offset - histlen;
+    if (offset < start || offset > server->offset)
+    {
+        log_info("Partial resync for %s:%d rejected: offset %ld out of backlog [%ld, %ld]",
+                 c->ip, c->port, offset, start, server->offset);
+        return false;
+    }
+
+    char line[REPL_ID_SIZE + 32];
+    int n = snprintf(line, sizeof(line), "+CONTINUE %s\r\n", server->replid);
+    addWriteBuf(c, line, n);
+    addReplyBacklog(c, offset);
+    log_info("Partial resync for %s:%d accepted, sending %ld bytes of backlog from offset %ld",
+             c->ip, c->port, server->offset - offset, offset);
+    return true;
+}
@@ -1,7 +1,7 @@
 /**
  * @file repli.c
  * @author your name (you@domain.com)
- * @brief 从服务器（主的客户端）
+ * @brief 从服务器（主的客户端），以及主从共用的复制ID、积压缓冲区
  * @version 0.1
  * @date 2025-02-28
  * @details
@@ -11,20 +11,30 @@
  * >> 接受pong。确定连接已经建立。
  * << 发送从自己的信息，replconf: port-6666
  * >> 主返回replconf ok。
- * << 从发送sync，请求开始同步
- * >> 主返回FULLSYNC，开始同步数据
- * >> 主开始做rdb。向从传输rdb数据.
- * << 从接受rdb完成，返回replack。表示复制成功
+ * << 从发送PSYNC <replid> <offset>，没有同步过时为 PSYNC ? -1
+ * >> 复制ID匹配且offset还在主的积压缓冲区内: +CONTINUE <replid>，之后是从offset开始缺失的命令流
+ * >> 否则 +FULLRESYNC <replid> <offset>，之后是 $<len>\r\n<RDB>\r\n，RDB对应主的offset
+ *    主fork子进程BGSAVE，完成后分块发送RDB文件，等待期间每秒发送一个换行保活
+ *    repl-diskless-sync: 子进程把RDB写入管道，长度事先未知，改为 $EOF:<40字节标记>\r\n<RDB><标记>
+ *    fork之后的写命令暂存在从的replPending，接在RDB后面发送
+ * << 从进入CONNECTED，主传播的写命令按普通客户端执行，每条推进offset
  * << 持续heartbeat
- * 为了重连：持久化server部分信息到conf，如role，master,offset信息
- * 在这个过程中，主服务和从服务器都没有新开线程/进程。可能会耗时。
+ * 复制ID: 主启动时随机生成。 从提升为主(SLAVEOF NO ONE)时原来的ID成为replid2，
+ *  跟随同一个主的其他从切换到新主后，用旧ID和offset仍然可以续传。
+ * 为了重连：role、master持久化到conf；复制ID、offset持久化到复制状态文件
  *
  * @copyright Copyright (c) 2025
  * 
  */
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
  #include "redis.h"
 #include "repli.h"
 #include "rio.h"
@@ -33,8 +43,16 @@
 #include "net.h"
 #include "util.h"
 #include "client.h"
-#include "conf.h"
+#include "replstate.h"
+#include "config.h"
 #include "resp.h"
+#include "ringbuffer.h"
+
+#define REPL_READ_BUF_SIZE (16 * 1024)  // 从读取主连接的单次read大小，RDB可能很大
+
+static long masterInitialOffset = -1;   // FULLRESYNC中主的offset，RDB加载完成后成为从的offset
+static char masterInitialReplid[REPL_ID_SIZE + 1];  // FULLRESYNC中主的复制ID，RDB加载完成后成为从的复制ID
+static size_t rdbEofScanned;            // 无盘同步: RDB中已经确认没有结束标记的字节数
 
 void sendPingToMaster()
 {
@@ -43,26 +61,24 @@ void sendPingToMaster()
 
 void sendSyncToMaster()
 {
-    char offset[16] = {0};
+    //  PSYNC <replid> <offset>。 没有同步过时发送 ? -1，主直接全量同步
+    char offset[32];
     snprintf(offset, sizeof(offset), "%ld", server->offset);
-    char* argv[2];
-    argv[0] = "SYNC";
-    argv[1] = strdup(offset);
-    char* buf = respEncodeArrayString(2, argv);
-    //  SYNC <OFFSET>
+    char* argv[3] = {"PSYNC", server->offset == -1 ? "?" : server->replid, offset};
+    char* buf = respEncodeArrayString(3, argv);
     addWrite(server->master, buf);
     free(buf);
-    log_debug("Slave -> sync %ld", server->offset);
+    log_debug("Slave -> psync %s %ld", argv[1], server->offset);
 }
 
 void sendReplAckToMaster()
 {
-    char* argv[2];
-    argv[0] = "REPLACK";
-    char buf[1024];
-    snprintf(buf, sizeof(buf), "%ld", server->offset);
-    argv[1] = strdup(buf);
-    addWrite(server->master, respEncodeArrayString(2, argv));
+    char offset[32];
+    snprintf(offset, sizeof(offset), "%ld", server->offset);
+    char* argv[2] = {"REPLACK", offset};
+    char* buf = respEncodeArrayString(2, argv);
+    addWrite(server->master, buf);
+    free(buf);
     log_debug("Send replack(heartbeat) %ld", server->offset);
 }
 
@@ -78,28 +94,6 @@ void sendReplconfToMaster()
     free(portstr);
     free(buf);
 }
-/** 
- * 做增量同步
- * 参考使用fake加载aof
- */
-void doAppendSync()
-{
-    log_debug("do append sync");
-    sds* sbuf = server->master->readBuf;
-    long oldlen = sdslen(sbuf);
-    redisClient* fkc = redisFakeClientCreate();
-    // 从buf中读取一些完整的resp
-    char* endptr;
-    while (( endptr = respParse(sbuf->buf, sbuf->len)) != NULL)
-    {
-        sdscatlen(fkc->readBuf, sbuf->buf, endptr - sbuf->buf + 1);
-        // 找到了一个有效的resp
-        processClientQueryBuf(fkc);
-        sdsrange(sbuf, endptr - sbuf->buf + 1, sdslen(sbuf) - 1);
-    }
-    log_debug("do append done");
-    slaveUpdateOffset(server->offset + oldlen - sdslen(sbuf));
-}
 /**
  * @brief 从服务器的 主fd写处理
  * 
@@ -110,59 +104,193 @@ void doAppendSync()
 void repliWriteHandler(aeEventLoop *el, int fd, void* privData)
 {
     redisClient* c = privData; // 就是server.master
-    switch (server->replState)
-    {
-    case REPL_STATE_SLAVE_CONNECTING:
-        sendPingToMaster();
-        log_debug(">> 1. [REPL_STATE_SLAVE_CONNECTING] send ping to master");
-        break;
-    case REPL_STATE_SLAVE_SEND_REPLCONF:
-        sendReplconfToMaster();
-        log_debug(">> 2. [REPL_STATE_SLAVE_SEND_REPLCONF] send replconf to master");
-        break;
-    case REPL_STATE_SLAVE_SEND_SYNC:
-        //  发送SYNC
-        /* TODO 为了断线后增量同步（缺失的命令传播）， SYNC应该伴随自己的同步偏移（状态），
-         * 主判断如何给他同步返回FULLSYNC,或者增量SYNC，
-         * 从根据请求方法进行请求， 读取/处理数据。
-         * 增量同步：
-         */
-        sendSyncToMaster();
-        log_debug(">> 3. [REPL_STATE_SLAVE_SEND_SYNC] send sync to master");
-        break;
-    case REPL_STATE_SLAVE_CONNECTED:
-        //  发送REPLCONF ACK (心跳)
-        sendReplAckToMaster();
-        // log_debug(">> 4. [REPL_STATE_SLAVE_CONNECTED] send REPLACK to master");
-        break;
-    default:
-        break;
+    // 上一条消息还没有发送完时，先发送剩余部分，不生成新消息
+    if (!clientHasPendingReplies(c))
+    {
+        switch (server->replState)
+        {
+        case REPL_STATE_SLAVE_CONNECTING:
+            sendPingToMaster();
+            log_debug(">> 1. [REPL_STATE_SLAVE_CONNECTING] send ping to master");
+            break;
+        case REPL_STATE_SLAVE_SEND_REPLCONF:
+            sendReplconfToMaster();
+            log_debug(">> 2. [REPL_STATE_SLAVE_SEND_REPLCONF] send replconf to master");
+            break;
+        case REPL_STATE_SLAVE_SEND_SYNC:
+            //  发送PSYNC，主根据复制ID和offset决定增量还是全量同步
+            sendSyncToMaster();
+            log_debug(">> 3. [REPL_STATE_SLAVE_SEND_SYNC] send psync to master");
+            break;
+        case REPL_STATE_SLAVE_CONNECTED:
+            //  发送REPLCONF ACK (心跳)
+            sendReplAckToMaster();
+            // log_debug(">> 4. [REPL_STATE_SLAVE_CONNECTED] send REPLACK to master");
+            break;
+        default:
+            break;
+        }
     }
     // 其他的状态，如心跳
 
-    char* msg = c->writeBuf->buf;
-    if (sdslen(c->writeBuf) == 0) {
+    if (!clientHasPendingReplies(c)) {
         // 如果没有数据，不可写
         log_debug("NO buffer available");
         aeDeleteFileEvent(el, fd, AE_WRITABLE);
         return;
     }
-    size_t nwritten;
-    rio sio;
-    rioInitWithSocket(&sio, fd);
-    nwritten = rioWrite(&sio, msg, strlen(msg));
-    if (nwritten == 0 && sio.error) { 
-        log_error("write failed");
-        close(fd);
+    if (writeToClient(c) < 0) {
+        reconnectMaster();
         return;
-    }   
-    sdsclear(c->writeBuf);
+    }
+    if (!clientHasPendingReplies(c)) {
+        aeDeleteFileEvent(el, fd, AE_WRITABLE);
+    }
+}
 
-    aeDeleteFileEvent(el, fd, AE_WRITABLE);
+/* readBuf中第一行(含\r\n)的长度，行不完整返回-1 */
+static long _replLineLen(sds buf)
+{
+    char* nl = memchr(buf, '\n', sdslen(buf));
+    return nl == NULL ? -1 : nl - buf + 1;
+}
+
+/**
+ * @brief 同步完成: 之后主传来的是普通的写命令流，交给readFromClient按普通客户端执行，call中推进offset
+ *
+ * @param [in] c 主客户端
+ */
+static void slaveSetConnected(redisClient* c)
+{
+    server->replState = REPL_STATE_SLAVE_CONNECTED;
+    if (aeCreateFileEvent(server->eventLoop, c->fd, AE_READABLE, readFromClient, c) == AE_ERROR)
+    {
+        reconnectMaster();
+        return;
+    }
+    // 和同步回复一起读到的命令
+    if (sdslen(c->readBuf) > 0)
+        processClientQueryBuf(c);
 }
 
 /**
- * 从服务器的 主fd 读处理
+ * @brief 处理PSYNC的回复行: +FULLRESYNC <replid> <offset> 或 +CONTINUE <replid>
+ *
+ * @param [in] c 主客户端
+ * @param [in] line 回复行，不含\r\n
+ * @return int 0成功，-1主拒绝了PSYNC
+ */
+static int slaveHandlePsyncReply(redisClient* c, const char* line)
+{
+    char replid[REPL_ID_SIZE + 1];
+    long offset;
+    if (sscanf(line, "+FULLRESYNC %40s %ld", replid, &offset) == 2 && strlen(replid) == REPL_ID_SIZE)
+    {
+        // 收到FULLRESYNC, 后面就跟着RDB文件。 RDB加载完成后才换成主的复制ID和offset，
+        // 接收中断时数据没变，重连仍然可以用原来的ID和offset续传
+        memcpy(masterInitialReplid, replid, sizeof(replid));
+        masterInitialOffset = offset;
+        rdbEofScanned = 0;
+        server->replState = REPL_STATE_SLAVE_RECEIVE_RDB;
+        log_info("Full resync from master: %s:%ld", replid, offset);
+        return 0;
+    }
+    if (sscanf(line, "+CONTINUE %40s", replid) == 1 && strlen(replid) == REPL_ID_SIZE)
+    {
+        if (strcmp(replid, server->replid) != 0)
+        {
+            // 主换了复制ID(跟随的是新提升的主)，旧ID作为replid2，级联的从用旧ID仍然可以续传
+            memcpy(server->replid2, server->replid, sizeof(server->replid));
+            server->secondReplidOffset = server->offset;
+            memcpy(server->replid, replid, sizeof(replid));
+        }
+        log_info("Partial resync from master: %s, continue from offset %ld", replid, server->offset);
+        slaveSetConnected(c);
+        return 0;
+    }
+    log_error("PSYNC rejected by master: %s", line);
+    return -1;
+}
+
+/**
+ * @brief 无盘同步的RDB长度事先未知，以 $EOF:<标记>\r\n 开头，RDB之后是同一个标记
+ *
+ * @param [in] c 主客户端
+ * @param [in] linelen 首行长度
+ * @return long RDB长度，-1表示标记还没收到
+ */
+static long _rdbEofPayloadLen(redisClient* c, long linelen)
+{
+    // 从上次没找到的位置继续，标记可能跨两次read
+    return memFindIncremental(c->readBuf + linelen, sdslen(c->readBuf) - linelen,
+                              c->readBuf + 5, REPL_ID_SIZE, &rdbEofScanned);
+}
+
+/**
+ * @brief 接收RDB: $<len>\r\n<RDB>\r\n 或者无盘同步的 $EOF:<标记>\r\n<RDB><标记>，全部到达后保存、加载。
+ *  磁盘同步时前面可能有保活的换行
+ *
+ * @param [in] c 主客户端
+ * @return int 1加载完成，0数据还没收完，-1格式错误
+ */
+static int slaveReceiveRDB(redisClient* c)
+{
+    // 主等待BGSAVE期间每秒发送的保活换行
+    size_t keepalive = 0;
+    while (keepalive < sdslen(c->readBuf) && c->readBuf[keepalive] == '\n')
+        keepalive++;
+    if (keepalive > 0)
+        sdsrange(c->readBuf, keepalive, -1);
+    long linelen = _replLineLen(c->readBuf);
+    if (linelen < 0)
+        return 0;
+    long len, consumed;
+    if (linelen == 5 + REPL_ID_SIZE + 2 && strncmp(c->readBuf, "$EOF:", 5) == 0)
+    {
+        if ((len = _rdbEofPayloadLen(c, linelen)) < 0)
+            return 0;
+        consumed = linelen + len + REPL_ID_SIZE;
+    }
+    else
+    {
+        if (c->readBuf[0] != '$' || linelen < 4 ||
+            !string2longLen(c->readBuf + 1, linelen - 3, &len) || len < 0)
+        {
+            log_error("<< 4. [REPL_STATE_SLAVE_RECEIVE_RDB] bad bulk length");
+            return -1;
+        }
+        if (sdslen(c->readBuf) < (size_t)(linelen + len + 2))
+            return 0;
+        consumed = linelen + len + 2;
+    }
+    log_debug("start transfer ..., len %ld", len);
+    receiveRDBfile(c->readBuf + linelen, len);
+    // 主的RDB是完整的数据集，清空原有的键再加载。 清空后原来的offset不再对应数据
+    for (int i = 0; i < server->dbnum; i++)
+        dbClear(server->db + i);
+    server->offset = -1;
+    if (rdbLoad() != 0)
+    {
+        log_error("<< 4. [REPL_STATE_SLAVE_RECEIVE_RDB] failed to load RDB from master");
+        return -1;
+    }
+    sdsrange(c->readBuf, consumed, -1);
+    rdbEofScanned = 0;
+    // 加载成功后才换成主的复制ID和offset，积压缓冲区之前的内容不再连续
+    memcpy(server->replid, masterInitialReplid, sizeof(masterInitialReplid));
+    clearReplicationId2();
+    slaveUpdateOffset(masterInitialOffset);
+    if (server->replBacklog)
+        ringBufferClear(server->replBacklog);
+    // AOF里只有同步之前的命令，按加载后的数据重写，重启后才能从offset续传
+    if (server->aofOn && rewriteAppendOnlyFileBackground() != 0)
+        server->aof.rewriteScheduled = true;
+    log_debug("<< 4. [REPL_STATE_SLAVE_RECEIVE_RDB] finished. => [REPL_STATE_SLAVE_CONNECTED]");
+    return 1;
+}
+
+/**
+ * 从服务器的 主fd 读处理. 同步完成之前的握手和RDB，之后交给readFromClient
  *
  * @param el
  * @param fd 主fd
@@ -172,139 +300,91 @@ void repliReadHandler(aeEventLoop *el, int fd, void* privData)
 {
     // 也就是server.master
     redisClient* c = privData;
-    rio sio;
-    rioInitWithSocket(&sio, fd);
-    char buf[NET_BUF_MAX_SIZE];
-    ssize_t nread = rioRead(&sio, buf, NET_BUF_MAX_SIZE);
-    
-    assert(nread > 0);
-    sdscatlen(c->readBuf, buf, nread);
-    
+    char buf[REPL_READ_BUF_SIZE];
+    ssize_t nread = read(fd, buf, sizeof(buf));
+    if (nread == -1 && errno == EAGAIN)
+        return;
+    if (nread <= 0)
+    {
+        log_warn("Lost connection with master: %s", nread == 0 ? "closed" : strerror(errno));
+        reconnectMaster();
+        return;
+    }
+    c->readBuf = sdscatlen(c->readBuf, buf, nread);
+    c->lastinteraction = server->unixtime;
+
+    // 握手回复都是一行，半行等待下次read
     while (sdslen(c->readBuf) > 0)
     {
+        long linelen;
         switch (server->replState) {
             case REPL_STATE_SLAVE_CONNECTING:
+            case REPL_STATE_SLAVE_SEND_REPLCONF:
+            case REPL_STATE_SLAVE_SEND_SYNC:
                 {
-                    if (strncmp(c->readBuf->buf, "+PONG\r\n", 7) != 0) {
-                        // 死等正确的响应
-                        break;
+                    if ((linelen = _replLineLen(c->readBuf)) < 0)
+                        return;
+                    sds line = sdsnewlen(c->readBuf, linelen - (linelen > 1 && c->readBuf[linelen - 2] == '\r' ? 2 : 1));
+                    sdsrange(c->readBuf, linelen, -1);
+                    int state = server->replState;
+                    if (state == REPL_STATE_SLAVE_CONNECTING && strcmp(line, "+PONG") == 0)
+                    {
+                        // 收到PONG, 转到REPLCONF
+                        server->replState = REPL_STATE_SLAVE_SEND_REPLCONF;
+                        log_debug("<< 1. [REPL_STATE_SLAVE_CONNECTING] receive pong. => [REPL_STATE_SLAVE_SEND_REPLCONF]");
                     }
-                    // 收到PONG, 转到REPLCONF
-                    server->replState = REPL_STATE_SLAVE_SEND_REPLCONF;
-                    log_debug("<< 1. [REPL_STATE_SLAVE_CONNECTING] receive pong. => [REPL_STATE_SLAVE_SEND_REPLCONF]");
-                    sdsrange(c->readBuf, 7, sdslen(c->readBuf) - 1);
-                    if (aeCreateFileEvent(server->eventLoop, fd, AE_WRITABLE, repliWriteHandler, c) == AE_ERROR)
+                    else if (state == REPL_STATE_SLAVE_SEND_REPLCONF && strcmp(line, "+OK") == 0)
                     {
-                        reconnectMaster();
+                        server->replState = REPL_STATE_SLAVE_SEND_SYNC;
+                        log_debug("<< 2. [REPL_STATE_SLAVE_SEND_REPLCONF] receive REPLCONF OK. => [REPL_STATE_SLAVE_SEND_SYNC]");
+                        // 确认主从关系后，应该持久化。 role、master已在内存中，写回配置文件
+                        if (configRewrite(server->configfile) == 0)
+                            log_info("Save master relationship!.");
+                        else
+                            log_warn("Save master relationship failed: %s", strerror(errno));
                     }
-                    break;
-                }
-            case REPL_STATE_SLAVE_SEND_REPLCONF:
-                {
-                    if (strncmp(c->readBuf->buf, "+OK\r\n", 5) != 0) {
+                    else if (state == REPL_STATE_SLAVE_SEND_SYNC)
+                    {
+                        int ret = slaveHandlePsyncReply(c, line);
+                        sdsfree(line);
+                        if (ret != 0 || server->replState == REPL_STATE_SLAVE_CONNECTED)
+                            return;
                         break;
                     }
-                    server->replState = REPL_STATE_SLAVE_SEND_SYNC;
-                    log_debug("<< 2. [REPL_STATE_SLAVE_SEND_REPLCONF] receive REPLCONF OK. => [REPL_STATE_SLAVE_SEND_SYNC]");
-
-                    // 确认主从关系后，应该持久化
-                    update_config(server->configfile, "role", "slave");
-                    char master[128] = {0};
-                    snprintf(master, sizeof(master), "%s:%d", server->masterhost, server->masterport);
-                    update_config(server->configfile, "master", master);
-                    log_info("Save master relationship!.");
-                    sdsrange(c->readBuf, 5, sdslen(c->readBuf) - 1);
+                    else
+                    {
+                        // 死等正确的响应
+                        log_warn("Unexpected reply from master in state %d: %s", state, line);
+                        sdsfree(line);
+                        break;
+                    }
+                    sdsfree(line);
                     if (aeCreateFileEvent(server->eventLoop, fd, AE_WRITABLE, repliWriteHandler, c) == AE_ERROR)
                     {
                         reconnectMaster();
+                        return;
                     }
                     break;
                 }
-
-            case REPL_STATE_SLAVE_SEND_SYNC:
-                {
-                    // +FULLSYNC\r\n$<length>\r\n<RDB binary data>
-                    if (strncmp(c->readBuf->buf, resp.fullsync, strlen(resp.fullsync)) == 0) {
-                        sdsrange(c->readBuf, strlen(resp.fullsync), sdslen(c->readBuf)-1);
-                        // 收到FULLSYNC, 后面就跟着RDB文件, 切换传输状态
-                        server->replState = REPL_STATE_SLAVE_RECEIVE_RDB;
-                        log_debug("<< 3. [REPL_STATE_SLAVE_SEND_SYNC] receive FULLSYNC. => [REPL_STATE_SLAVE_RECEIVE_RDB]");
-                    }
-                    if (strncmp(c->readBuf->buf, resp.appendsync, strlen(resp.appendsync)) == 0) {
-                        sdsrange(c->readBuf, strlen(resp.appendsync), sdslen(c->readBuf)-1);
-                        // 收到APPENDSYNC, 后面就跟着resp命令, 切换传输状态
-                        server->replState = REPL_STATE_SLAVE_RECEIVE_APPENDSYNC;
-                        log_debug("<< 3. [REPL_STATE_SLAVE_SEND_SYNC] receive appendSYNC. => [REPL_STATE_SLAVE_RECEIVE_APPENDSYNC]");
-                    }
-                    if (strncmp(c->readBuf->buf, resp.nosync, strlen(resp.nosync)) == 0) {
-                        sdsrange(c->readBuf, strlen(resp.nosync), sdslen(c->readBuf)-1);
-                        // nosync, 不需要同步
-                        server->replState = REPL_STATE_SLAVE_CONNECTED;
-                        log_debug("<< 3. [REPL_STATE_SLAVE_SEND_SYNC] receive NOSYNC. => [REPL_STATE_SLAVE_CONNECTED]");
-                    }
-                    break;
-                }
-            case REPL_STATE_SLAVE_RECEIVE_APPENDSYNC:
-                // 增量同步传来一些resp写命令, 转为connected状态，正常处理
-                log_debug("appendsync receive %ld bytes", sdslen(c->readBuf));
-                doAppendSync();
-                server->replState = REPL_STATE_SLAVE_CONNECTED;
-                log_debug("<< 4. [REPL_STATE_SLAVE_RECEIVE_APPENDSYNC] => [REPL_STATE_SLAVE_CONNECTED]");
-                break;
             case REPL_STATE_SLAVE_RECEIVE_RDB:
                 {
-                    // printBuf("$<length>\r\n<RDB DATA> ", c->readBuf->buf, sdslen(c->readBuf));
-                    //  $<length>\r\n<RDB DATA>
-                    int len = 0;
-                    int lenLength = 0;
-                    if (sscanf(c->readBuf->buf + 1, "%d%n", &len, &lenLength) != 1)
+                    int ret = slaveReceiveRDB(c);
+                    if (ret == 0)
+                        return;
+                    if (ret < 0)
                     {
-                        // 没有解析到。 重新sync
-                        log_error("<< 4.[REPL_STATE_SLAVE_RECEIVE_RDB] receive failed.Sync again.  =>[REPL_STATE_SLAVE_SEND_SYNC]");
-                        server->replState = REPL_STATE_SLAVE_SEND_SYNC;
-                        sdsclear(c->readBuf);
-                    } else {
-                        sdsrange(c->readBuf, 1 + lenLength + 2, sdslen(c->readBuf) - 1);
-                        log_debug("start transfer ..., len %u", len);
-                        receiveRDBfile(c->readBuf->buf, len);
-                        log_debug("receive finished.");
-                        rdbLoad();
-                        log_debug("rdbload finished.");
-                        server->replState = REPL_STATE_SLAVE_CONNECTED;
-                        log_debug("<< 4. [REPL_STATE_SLAVE_RECEIVE_RDB] finished. => [REPL_STATE_SLAVE_CONNECTED]");
-                        // 更新offset
-                        slaveUpdateOffset(0);
-                        sdsrange(c->readBuf, len + 2, sdslen(c->readBuf) - 1);
-                        if (aeCreateFileEvent(server->eventLoop, fd, AE_WRITABLE, repliWriteHandler, c) == AE_ERROR)
-                        {
-                            reconnectMaster();
-                        } 
+                        reconnectMaster();
+                        return;
                     }
-                    break;
-                }
-            case REPL_STATE_SLAVE_CONNECTED:
-                if (strncmp(c->readBuf->buf, resp.ok, strlen(resp.ok)) != 0) {
-                    break;
-                }
-                log_debug("<< 5. [REPL_STATE_SLAVE_CONNECTED] receive ok.  Normally slave !! √");
-                sdsrange(c->readBuf, strlen(resp.ok), sdslen(c->readBuf) - 1);
-                if (aeCreateFileEvent(el, fd, AE_READABLE, readFromClient, c) == AE_ERROR)
-                {
-                    reconnectMaster();
+                    slaveSetConnected(c);
+                    return;
                 }
-                break;
             default:
+                // CONNECTED之后由readFromClient读取
                 log_error("Unknow state!");
-                break;
-        }
-        // 如果buf残留不能继续读取了，即半包。break 继续读取
-        if (respParse(c->readBuf->buf, c->readBuf->len) == NULL) {
-            
-            break;
+                return;
         }
     }
-       
-    server->master->lastinteraction = server->unixtime;
 }
 
 /**
@@ -334,6 +414,11 @@ int slaveCron(aeEventLoop* eventLoop, long long id, void* clientData)
         log_warn("Master heartbeat timeout, will reconnect...");
         reconnectMaster();
     }
+    else if (server->master == NULL)
+    {
+        // 上次连接失败(主还没启动或网络中断)，重试。 重连后PSYNC续传
+        connectMaster();
+    }
     return 5000;
 }
 /**
@@ -374,14 +459,7 @@ void connectMaster()
 
     // 每次从服务器启动 都要尝试同步
     server->replState = REPL_STATE_SLAVE_CONNECTING;
-    // 上次同步位置
-    char *endptr;
-    long offset = -1;
-    if (!string2long(get_config(server->configfile, "offset"), &offset)) {
-        log_error("string2long failed. offset!");
-        update_config(server->configfile, "offset", "-1");
-    }
-    server->offset = offset;
+    // 上次同步的复制ID、offset在内存中，启动时从复制状态文件读取
     // 不能调换顺序。 epoll一个fd必须先read然后write， 否则epoll_wait监听不到就绪。
     if (aeCreateFileEvent(server->eventLoop, fd, AE_READABLE, repliReadHandler, server->master) == AE_ERROR)
     {
@@ -396,15 +474,593 @@ void connectMaster()
     log_debug("Connected Master fd %d", fd);
 }
 /**
- * 从更新同步的offset
- * @param len 更新len个字节数据
+ * 从更新同步的offset。 全量同步完成时调用，之后每条写命令由replicationFeedBacklog推进，只更新内存，
+ * 正常关闭时写入复制状态文件
+ * @param new_offset
  */
 void slaveUpdateOffset(long new_offset)
 {
     server->offset = new_offset;
-    // 写入config
-    char val[1024] = {0};
-    snprintf(val, sizeof(val) - 1, "%ld", server->offset);
-    update_config(server->configfile, "offset", val);
-    log_debug("slave update offset: %ld", server->offset);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 打开复制状态文件，读取上次同步到的复制ID和offset。 文件为空、损坏或者没有开启AOF时offset为-1，连接后全量同步。
+ *  记录随即作废: 只有正常关闭时AOF和offset一致，运行中宕机的下次启动必须全量同步
+ *
+ * @param [in] resume false: 只打开文件，使用内存中的复制ID和offset。
+ *  主切换为从(SLAVEOF)时是自己作为主的ID和offset，新主是原来的从时可以续传
+ */
+void replicationLoadState(bool resume)
+{
+    if (server->replStateFd == -1)
+    {
+        char *path = fullPath(server->replStateFileName);
+        server->replStateFd = replStateOpen(path);
+        if (server->replStateFd == -1)
+        {
+            log_error("Open replication state file %s failed: %s", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        free(path);
+    }
+    replState st;
+    bool loaded = resume && replStateRead(server->replStateFd, &st) == 0 && strlen(st.replid) == REPL_ID_SIZE;
+    // AOF按批次落盘，offset随每条命令更新，运行中两者对不上: 宕机后AOF可能多于或少于记录的offset。
+    // 读过的记录和SLAVEOF之前留下的记录都作废，直到正常关闭再写入
+    replState invalid = {.offset = -1, .replid = ""};
+    if (replStateWrite(server->replStateFd, &invalid) != 0)
+    {
+        log_error("Invalidate replication state failed: %s", strerror(errno));
+        loaded = false;
+    }
+    if (!resume)
+        return;
+    server->offset = -1;
+    if (!loaded)
+    {
+        log_info("No replication state, full sync from %s:%d", server->masterhost, server->masterport);
+        return;
+    }
+    if (!server->aofOn)
+    {
+        // 只有AOF记录了应用过的每条命令，RDB或没有持久化时本地数据和offset对不上
+        log_info("Replication state ignored without AOF, full sync from %s:%d", server->masterhost, server->masterport);
+        return;
+    }
+    memcpy(server->replid, st.replid, sizeof(server->replid));
+    server->offset = st.offset;
+    log_info("Replication state loaded: replid %s, offset %lld", st.replid, st.offset);
+}
+
+/**
+ * @brief 写入复制状态文件: 一次pwrite + fdatasync。 只在正常关闭、AOF写完之后调用，此时AOF正好包含offset之前的命令
+ */
+void replicationSaveState(void)
+{
+    if (!(server->flags & REDIS_CLUSTER_SLAVE) || server->replStateFd == -1)
+        return;
+    replState st;
+    st.offset = server->offset;
+    snprintf(st.replid, sizeof(st.replid), "%s", server->replid);
+    if (replStateWrite(server->replStateFd, &st) != 0)
+    {
+        log_warn("Write replication state failed: %s", strerror(errno));
+        return;
+    }
+}
+
+/**
+ * @brief SLAVEOF NO ONE: 从提升为主。 跟随的主的复制ID成为replid2，生成新的复制ID，
+ *  积压缓冲区和offset保留，原来同一个主的其他从可以在这里续传
+ */
+void replicationUnsetMaster(void)
+{
+    log_info("Slave => Master");
+    memcpy(server->replid2, server->replid, sizeof(server->replid));
+    server->secondReplidOffset = server->offset;
+    changeReplicationId();
+    log_info("Replication id shifted: new %s, old %s valid up to offset %ld",
+             server->replid, server->replid2, server->secondReplidOffset);
+    if (server->offset < 0)
+        server->offset = 0;
+
+    freeClient(server->master);
+    server->master = NULL;
+    server->flags &= ~REDIS_CLUSTER_SLAVE;
+    server->flags |= REDIS_CLUSTER_MASTER;
+    server->replState = REPL_STATE_SLAVE_NONE;
+    loadCommands();
+    if (configRewrite(server->configfile) != 0)
+        log_warn("Save role failed: %s", strerror(errno));
+}
+
+/* ---------------- 复制ID、积压缓冲区(主从共用) ---------------- */
+
+/**
+ * @brief 生成新的复制ID。 主启动、从提升为主时调用
+ */
+void changeReplicationId(void)
+{
+    getRandomHexChars(server->replid, REPL_ID_SIZE);
+    server->replid[REPL_ID_SIZE] = '\0';
+}
+
+void clearReplicationId2(void)
+{
+    memset(server->replid2, '0', REPL_ID_SIZE);
+    server->replid2[REPL_ID_SIZE] = '\0';
+    server->secondReplidOffset = -1;
+}
+
+static long _backlogBufferSize(void)
+{
+    unsigned long long size = server->replBacklogSize;
+    if (size < REPL_BACKLOG_MIN_SIZE)
+        size = REPL_BACKLOG_MIN_SIZE;
+    return (long)size + 1; // 环形缓冲少用一个字节
+}
+
+/**
+ * @brief 创建积压缓冲区。 分片模式不支持复制，不创建
+ */
+void createReplicationBacklog(void)
+{
+    if (server->shardsNum > 1)
+        return;
+    server->replBacklog = ringBufferCreateSize(_backlogBufferSize());
+}
+
+/**
+ * @brief CONFIG SET repl-backlog-size: 重新分配，保留最近的数据
+ */
+void resizeReplicationBacklog(void)
+{
+    RingBuffer* old = server->replBacklog;
+    if (old == NULL)
+        return;
+    RingBuffer* rb = ringBufferCreateSize(_backlogBufferSize());
+    long histlen = ringBufferSize(old);
+    long keep = histlen < rb->size - 1 ? histlen : rb->size - 1;
+    uint8_t chunk[REPL_READ_BUF_SIZE];
+    for (long skip = histlen - keep; skip < histlen; )
+    {
+        long n = histlen - skip < (long)sizeof(chunk) ? histlen - skip : (long)sizeof(chunk);
+        ringBufferPeek(old, skip, chunk, n);
+        ringBufferWrite(rb, chunk, n);
+        skip += n;
+    }
+    server->replBacklog = rb;
+    ringBufferFree(old);
+}
+
+/* 全量同步期间暂存的写命令接在RDB后面，放进从的回复队列 */
+static void addReplyPending(redisClient* c)
+{
+    if (c->replPending)
+        addWriteSds(c, c->replPending);
+    c->replPending = NULL;
+}
+
+/* 无盘同步的数据放进从的回复队列，注册可写事件 */
+static void feedSlave(redisClient* c, const char* buf, size_t len)
+{
+    addWriteBuf(c, buf, len);
+    if (aeCreateFileEvent(server->eventLoop, c->fd, AE_WRITABLE, sendToClient, c) == AE_ERROR)
+        clientToclose(c);
+}
+
+static void rdbPipeClose(void)
+{
+    aeDeleteFileEvent(server->eventLoop, server->rdbPipeFd, AE_READABLE);
+    close(server->rdbPipeFd);
+    server->rdbPipeFd = -1;
+    server->rdbPipePaused = 0;
+}
+
+/**
+ * @brief 读取一次子进程写入管道的RDB，转入所有正在无盘同步的从。 有从的回复队列积压太多时暂停读取，
+ *  管道满了子进程就阻塞，内存占用不会随RDB大小增长
+ *
+ * @return ssize_t 读到的字节数，0表示管道已关闭，-1表示暂时没有数据
+ */
+static ssize_t rdbPipeFeedSlaves(void)
+{
+    char buf[REPL_READ_BUF_SIZE];
+    ssize_t nread = read(server->rdbPipeFd, buf, sizeof(buf));
+    if (nread == -1 && (errno == EAGAIN || errno == EINTR))
+        return -1;
+    if (nread <= 0)
+    {
+        // 子进程写完(或者出错)关闭了写端，由checkChildrenDone回收子进程后收尾
+        if (nread < 0)
+            log_warn("Diskless sync: read from child pipe failed: %s", strerror(errno));
+        rdbPipeClose();
+        return 0;
+    }
+
+    int slaves = 0;
+    bool pause = false;
+    listNode* node = listHead(server->clients);
+    while (node)
+    {
+        redisClient* c = node->value;
+        if (c->flags == REDIS_CLIENT_SLAVE && c->replState == REPL_STATE_MASTER_SEND_RDB)
+        {
+            slaves++;
+            feedSlave(c, buf, nread);
+            if (replyListPending(&c->reply) > REPL_RDB_PIPE_MAX_PENDING)
+                pause = true;
+        }
+        node = node->next;
+    }
+    if (slaves == 0)
+    {
+        // 从都断开了，不再需要这份RDB
+        if (server->rdbChildPid != -1)
+        {
+            log_warn("Diskless sync: no slaves left, killing child %d", server->rdbChildPid);
+            kill(server->rdbChildPid, SIGKILL);
+        }
+        rdbPipeClose();
+        return 0;
+    }
+    if (pause)
+    {
+        aeDeleteFileEvent(server->eventLoop, server->rdbPipeFd, AE_READABLE);
+        server->rdbPipePaused = 1;
+    }
+    return nread;
+}
+
+static void rdbPipeReadHandler(aeEventLoop* el, int fd, void* privData)
+{
+    (void)el;
+    (void)fd;
+    (void)privData;
+    rdbPipeFeedSlaves();
+}
+
+/**
+ * @brief 暂停读取管道后，所有正在无盘同步的从的回复队列都降到上限以下时继续读取
+ */
+void replicationRdbPipeResume(void)
+{
+    if (!server->rdbPipePaused || server->rdbPipeFd == -1)
+        return;
+    listNode* node = listHead(server->clients);
+    while (node)
+    {
+        redisClient* c = node->value;
+        if (c->flags == REDIS_CLIENT_SLAVE && c->replState == REPL_STATE_MASTER_SEND_RDB &&
+            replyListPending(&c->reply) > REPL_RDB_PIPE_MAX_PENDING)
+            return;
+        node = node->next;
+    }
+    if (aeCreateFileEvent(server->eventLoop, server->rdbPipeFd, AE_READABLE, rdbPipeReadHandler, NULL) == AE_ERROR)
+    {
+        log_error("Diskless sync: can't watch child pipe");
+        return;
+    }
+    server->rdbPipePaused = 0;
+}
+
+/* 把等待中的从都断开，重连后重新PSYNC */
+static void closeWaitingSlaves(int state)
+{
+    listNode* node = listHead(server->clients);
+    while (node)
+    {
+        redisClient* c = node->value;
+        if (c->flags == REDIS_CLIENT_SLAVE && c->replState == state)
+            clientToclose(c);
+        node = node->next;
+    }
+}
+
+/**
+ * @brief fork子进程，把RDB写入管道。 所有等待的从先收到 +FULLRESYNC 和 $EOF:<标记>，
+ *  RDB对应fork时的offset，之后传播的写命令暂存在各个从的replPending里，同步结束时补上
+ */
+static void startDisklessSync(void)
+{
+    int slaves = 0;
+    listNode* node = listHead(server->clients);
+    while (node)
+    {
+        redisClient* c = node->value;
+        if (c->flags == REDIS_CLIENT_SLAVE && c->replState == REPL_STATE_MASTER_WAIT_BGSAVE_START)
+            slaves++;
+        node = node->next;
+    }
+    server->replDisklessWaitStart = 0;
+    if (slaves == 0)
+        return;
+
+    int fds[2];
+    if (pipe(fds) == -1)
+    {
+        log_error("Diskless sync: pipe failed: %s", strerror(errno));
+        closeWaitingSlaves(REPL_STATE_MASTER_WAIT_BGSAVE_START);
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        exit(rdbSaveToFd(fds[1]) == 0 ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid < 0)
+    {
+        log_error("Diskless sync: fork failed: %s", strerror(errno));
+        close(fds[0]);
+        closeWaitingSlaves(REPL_STATE_MASTER_WAIT_BGSAVE_START);
+        return;
+    }
+    anetNonBlock(fds[0]);
+    if (aeCreateFileEvent(server->eventLoop, fds[0], AE_READABLE, rdbPipeReadHandler, NULL) == AE_ERROR)
+        log_error("Diskless sync: can't watch child pipe");
+    server->rdbChildPid = pid;
+    server->rdbChildType = RDB_CHILD_TYPE_SOCKET;
+    server->isBgSaving = 1;
+    server->rdbPipeFd = fds[0];
+    server->rdbPipePaused = 0;
+    getRandomHexChars(server->rdbEofMark, REPL_ID_SIZE);
+
+    char header[2 * REPL_ID_SIZE + 64];
+    int n = snprintf(header, sizeof(header), "+FULLRESYNC %s %ld\r\n$EOF:%.*s\r\n",
+                     server->replid, server->offset, REPL_ID_SIZE, server->rdbEofMark);
+    node = listHead(server->clients);
+    while (node)
+    {
+        redisClient* c = node->value;
+        if (c->flags == REDIS_CLIENT_SLAVE && c->replState == REPL_STATE_MASTER_WAIT_BGSAVE_START)
+        {
+            c->replState = REPL_STATE_MASTER_SEND_RDB;
+            feedSlave(c, header, n);
+        }
+        node = node->next;
+    }
+    log_info("Diskless sync started by child %d for %d slaves, offset %ld", pid, slaves, server->offset);
+}
+
+/**
+ * @brief PSYNC需要全量同步并且开启了repl-diskless-sync: 等待repl-diskless-sync-delay秒，
+ *  期间到达的从共用一次fork
+ *
+ * @param [in] c 从
+ */
+void replicationWaitDisklessSync(redisClient* c)
+{
+    c->replState = REPL_STATE_MASTER_WAIT_BGSAVE_START;
+    if (server->replDisklessWaitStart == 0)
+        server->replDisklessWaitStart = server->unixtime;
+    log_info("Slave %s:%d waiting for diskless sync", c->ip, c->port);
+    replicationSyncCron();
+}
+
+/**
+ * @brief fork子进程BGSAVE。 所有等待的从先收到 +FULLRESYNC <replid> <offset>，RDB对应fork时的offset，
+ *  之后传播的写命令暂存在各个从的replPending里，RDB文件发完后补上
+ */
+static void startDiskSync(void)
+{
+    int slaves = 0;
+    listNode* node = listHead(server->clients);
+    while (node)
+    {
+        redisClient* c = node->value;
+        if (c->flags == REDIS_CLIENT_SLAVE && c->replState == REPL_STATE_MASTER_WAIT_BGSAVE_START)
+            slaves++;
+        node = node->next;
+    }
+    server->replDisklessWaitStart = 0;
+    if (slaves == 0)
+        return;
+    if (bgsave() != 0)
+    {
+        closeWaitingSlaves(REPL_STATE_MASTER_WAIT_BGSAVE_START);
+        return;
+    }
+    server->rdbChildOffset = server->offset;
+
+    char header[REPL_ID_SIZE + 64];
+    int n = snprintf(header, sizeof(header), "+FULLRESYNC %s %ld\r\n", server->replid, server->offset);
+    node = listHead(server->clients);
+    while (node)
+    {
+        redisClient* c = node->value;
+        if (c->flags == REDIS_CLIENT_SLAVE && c->replState == REPL_STATE_MASTER_WAIT_BGSAVE_START)
+        {
+            c->replState = REPL_STATE_MASTER_WAIT_BGSAVE_END;
+            feedSlave(c, header, n);
+        }
+        node = node->next;
+    }
+    log_info("Full resync started by BGSAVE child %d for %d slaves, offset %ld",
+             server->rdbChildPid, slaves, server->offset);
+}
+
+/**
+ * @brief PSYNC需要全量同步、没有开启repl-diskless-sync: 正在为其他从BGSAVE时共用这次fork，
+ *  复制它暂存的命令；否则没有子进程时立即fork
+ *
+ * @param [in] c 从
+ */
+void replicationWaitBgsave(redisClient* c)
+{
+    c->replState = REPL_STATE_MASTER_WAIT_BGSAVE_START;
+    if (server->isBgSaving && server->rdbChildType == RDB_CHILD_TYPE_DISK)
+    {
+        listNode* node = listHead(server->clients);
+        while (node)
+        {
+            redisClient* other = node->value;
+            node = node->next;
+            if (other == c || other->flags != REDIS_CLIENT_SLAVE ||
+                other->replState != REPL_STATE_MASTER_WAIT_BGSAVE_END)
+                continue;
+            c->replState = REPL_STATE_MASTER_WAIT_BGSAVE_END;
+            c->replPending = other->replPending ? sdsnewlen(other->replPending, sdslen(other->replPending)) : NULL;
+            char header[REPL_ID_SIZE + 64];
+            int n = snprintf(header, sizeof(header), "+FULLRESYNC %s %ld\r\n",
+                             server->replid, server->rdbChildOffset);
+            feedSlave(c, header, n);
+            log_info("Slave %s:%d attached to running BGSAVE for full resync", c->ip, c->port);
+            return;
+        }
+    }
+    log_info("Slave %s:%d waiting for BGSAVE", c->ip, c->port);
+    replicationSyncCron();
+}
+
+/**
+ * @brief 在serverCron中调用: 没有其他子进程时为等待的从开始全量同步(无盘同步要等延迟到了)，
+ *  等待BGSAVE的从每秒发一个换行保活
+ */
+void replicationSyncCron(void)
+{
+    static time_t lastKeepalive;
+    // 被断开的从不会触发clientReplySent，这里兜底
+    replicationRdbPipeResume();
+    if (server->isBgSaving && server->unixtime != lastKeepalive)
+    {
+        lastKeepalive = server->unixtime;
+        listNode* node = listHead(server->clients);
+        while (node)
+        {
+            redisClient* c = node->value;
+            if (c->flags == REDIS_CLIENT_SLAVE && c->replState == REPL_STATE_MASTER_WAIT_BGSAVE_END)
+                feedSlave(c, "\n", 1);
+            node = node->next;
+        }
+    }
+    // 同时只有一个子进程。 正在同步的从完成之后，等待的从再fork一次
+    if (server->isBgSaving || server->aof.childPid != -1)
+        return;
+    if (!server->replDisklessSync)
+    {
+        startDiskSync();
+        return;
+    }
+    if (server->replDisklessWaitStart == 0)
+        return;
+    if (server->unixtime - server->replDisklessWaitStart < server->replDisklessSyncDelay)
+        return;
+    startDisklessSync();
+}
+
+/**
+ * @brief 磁盘同步: 从RDB文件读一块放进从的回复队列。 回复队列发完(clientReplySent)后再读下一块，
+ *  内存占用不随RDB大小增长。 文件发完后接上暂存的命令，从进入CONNECTED
+ *
+ * @param [in] c 从
+ */
+void replicationSendBulk(redisClient* c)
+{
+    off_t left = c->replRdbSize - c->replRdbOff;
+    if (left > 0)
+    {
+        size_t len = left < REPL_RDB_BULK_CHUNK ? (size_t)left : REPL_RDB_BULK_CHUNK;
+        sds chunk = sdsnewlen(NULL, len);
+        ssize_t nread = pread(c->replRdbFd, chunk, len, c->replRdbOff);
+        if (nread <= 0)
+        {
+            log_error("Full resync for slave %s:%d: read RDB failed: %s",
+                      c->ip, c->port, nread == 0 ? "short read" : strerror(errno));
+            sdsfree(chunk);
+            clientToclose(c);
+            return;
+        }
+        sdssetlen(chunk, nread);
+        c->replRdbOff += nread;
+        addWriteSds(c, chunk);
+    }
+    if (c->replRdbOff == c->replRdbSize)
+    {
+        close(c->replRdbFd);
+        c->replRdbFd = -1;
+        size_t pending = c->replPending ? sdslen(c->replPending) : 0;
+        addWriteBuf(c, "\r\n", 2);
+        addReplyPending(c);
+        c->replState = REPL_STATE_MASTER_CONNECTED;
+        log_info("Full resync for slave %s:%d finished, RDB %lld bytes, %zu bytes of commands after RDB",
+                 c->ip, c->port, (long long)c->replRdbSize, pending);
+    }
+    if (aeCreateFileEvent(server->eventLoop, c->fd, AE_WRITABLE, sendToClient, c) == AE_ERROR)
+        clientToclose(c);
+}
+
+/**
+ * @brief BGSAVE子进程退出。 成功时等待的从收到 $<len>，开始分块发送RDB文件；失败时断开这些从，重连后重新同步
+ *
+ * @param [in] ok 子进程是否成功保存
+ */
+void replicationBgsaveDone(bool ok)
+{
+    listNode* node = listHead(server->clients);
+    while (node)
+    {
+        redisClient* c = node->value;
+        node = node->next;
+        if (c->flags != REDIS_CLIENT_SLAVE || c->replState != REPL_STATE_MASTER_WAIT_BGSAVE_END)
+            continue;
+        struct stat st;
+        int fd = -1;
+        if (!ok || (fd = open(server->rdbfile, O_RDONLY)) == -1 || fstat(fd, &st) == -1)
+        {
+            log_warn("Full resync for slave %s:%d failed: %s", c->ip, c->port,
+                     ok ? strerror(errno) : "BGSAVE error");
+            if (fd != -1)
+                close(fd);
+            clientToclose(c);
+            continue;
+        }
+        c->replRdbFd = fd;
+        c->replRdbOff = 0;
+        c->replRdbSize = st.st_size;
+        c->replState = REPL_STATE_MASTER_SEND_BULK;
+        char header[32];
+        int n = snprintf(header, sizeof(header), "$%lld\r\n", (long long)st.st_size);
+        addWriteBuf(c, header, n);
+        replicationSendBulk(c);
+    }
+}
+
+/**
+ * @brief 无盘同步的子进程退出。 成功时把管道剩下的数据、结束标记和fork之后暂存的命令发给从，
+ *  从进入CONNECTED开始接收命令传播；失败时断开这些从，重连后重新同步
+ *
+ * @param [in] ok 子进程是否成功写完RDB
+ */
+void replicationDisklessDone(bool ok)
+{
+    // 子进程已经退出，管道里剩下的数据不会超过管道容量，一次读完
+    while (ok && server->rdbPipeFd != -1 && rdbPipeFeedSlaves() > 0)
+        ;
+    if (server->rdbPipeFd != -1)
+        rdbPipeClose();
+
+    listNode* node = listHead(server->clients);
+    while (node)
+    {
+        redisClient* c = node->value;
+        node = node->next;
+        if (c->flags != REDIS_CLIENT_SLAVE || c->replState != REPL_STATE_MASTER_SEND_RDB)
+            continue;
+        if (!ok)
+        {
+            log_warn("Diskless sync for slave %s:%d failed in child", c->ip, c->port);
+            clientToclose(c);
+            continue;
+        }
+        addWriteBuf(c, server->rdbEofMark, REPL_ID_SIZE);
+        size_t pending = c->replPending ? sdslen(c->replPending) : 0;
+        addReplyPending(c);
+        c->replState = REPL_STATE_MASTER_CONNECTED;
+        if (aeCreateFileEvent(server->eventLoop, c->fd, AE_WRITABLE, sendToClient, c) == AE_ERROR)
+            clientToclose(c);
+        log_info("Diskless sync for slave %s:%d finished, %zu bytes of commands after RDB",
+                 c->ip, c->port, pending);
+    }
+}
@@ -0,0 +1,80 @@
+/**
+ * @file replstate.c
+ * @brief 从服务器复制状态文件: 定长记录，pwrite + fdatasync
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "replstate.h"
+#include "crc64.h"
+
+/* 磁盘上的记录。 不超过一个扇区，一次pwrite写入 */
+typedef struct replStateRecord {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    int64_t offset;
+    char replid[REPL_STATE_REPLID_LEN];
+    uint64_t crc;   // 前面所有字节的CRC64
+} replStateRecord;
+
+/**
+ * @brief 打开(不存在则创建)状态文件，之后一直使用这个fd
+ *
+ * @param [in] path
+ * @return int fd，失败返回-1
+ */
+int replStateOpen(const char* path)
+{
+    return open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+}
+
+/**
+ * @brief 覆盖写入状态并落盘
+ *
+ * @param [in] fd
+ * @param [in] st
+ * @return int 成功返回0，失败返回-1，errno为原因
+ */
+int replStateWrite(int fd, const replState* st)
+{
+    replStateRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    memcpy(rec.magic, REPL_STATE_MAGIC, sizeof(rec.magic));
+    rec.version = REPL_STATE_VERSION;
+    rec.offset = st->offset;
+    snprintf(rec.replid, sizeof(rec.replid), "%s", st->replid);
+    rec.crc = crc64(0, &rec, offsetof(replStateRecord, crc));
+
+    ssize_t n = pwrite(fd, &rec, sizeof(rec), 0);
+    if (n != (ssize_t)sizeof(rec)) {
+        if (n >= 0) errno = EIO;
+        return -1;
+    }
+    return fdatasync(fd);
+}
+
+/**
+ * @brief 读取状态
+ *
+ * @param [in] fd
+ * @param [out] st
+ * @return int 成功返回0；空文件、版本不对或记录损坏返回-1
+ */
+int replStateRead(int fd, replState* st)
+{
+    replStateRecord rec;
+    if (pread(fd, &rec, sizeof(rec), 0) != (ssize_t)sizeof(rec))
+        return -1;
+    if (memcmp(rec.magic, REPL_STATE_MAGIC, sizeof(rec.magic)) != 0 ||
+        rec.version != REPL_STATE_VERSION ||
+        rec.crc != crc64(0, &rec, offsetof(replStateRecord, crc)))
+        return -1;
+    st->offset = rec.offset;
+    memcpy(st->replid, rec.replid, sizeof(st->replid));
+    st->replid[sizeof(st->replid) - 1] = '\0';
+    return 0;
+}
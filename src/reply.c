@@ -0,0 +1,219 @@
+/**
+ * 客户端回复队列
+ *  小回复拷贝到内联缓冲，不需要分配；大回复进入块链表。
+ *  大的不可变数据（对象值）以引用块入队，避免拷贝。
+ *  发送使用writev，部分写时记录进度，下一次可写事件继续。
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "reply.h"
+
+void replyListInit(replyList* l)
+{
+    l->bufpos = 0;
+    l->sentlen = 0;
+    l->head = NULL;
+    l->tail = NULL;
+    l->pending = 0;
+    l->sent = NULL;
+}
+
+static void _replyBlockFree(replyBlock* b)
+{
+    if (b->release) b->release(b->owner);
+    free(b);
+}
+
+void replyListFree(replyList* l)
+{
+    replyListReleaseSent(l);
+    replyBlock* b = l->head;
+    while (b) {
+        replyBlock* next = b->next;
+        _replyBlockFree(b);
+        b = next;
+    }
+    replyListInit(l);
+}
+
+static void _replyListAppendBlock(replyList* l, replyBlock* b)
+{
+    b->next = NULL;
+    if (l->tail)
+        l->tail->next = b;
+    else
+        l->head = b;
+    l->tail = b;
+}
+
+/**
+ * @brief 拷贝追加。 链表为空时优先内联缓冲，其次填满尾部拷贝块，剩余的分配新块
+ *
+ * @param [in] l
+ * @param [in] data
+ * @param [in] len
+ */
+void replyListAdd(replyList* l, const void* data, size_t len)
+{
+    const char* p = data;
+    if (len == 0) return;
+    l->pending += len;
+
+    if (l->head == NULL) {
+        size_t avail = REPLY_CHUNK_BYTES - l->bufpos;
+        size_t n = len < avail ? len : avail;
+        memcpy(l->buf + l->bufpos, p, n);
+        l->bufpos += n;
+        p += n;
+        len -= n;
+        if (len == 0) return;
+    }
+
+    replyBlock* tail = l->tail;
+    if (tail && tail->size > 0 && tail->len < tail->size) {
+        size_t avail = tail->size - tail->len;
+        size_t n = len < avail ? len : avail;
+        memcpy(tail->buf + tail->len, p, n);
+        tail->len += n;
+        p += n;
+        len -= n;
+        if (len == 0) return;
+    }
+
+    size_t size = len > REPLY_BLOCK_BYTES ? len : REPLY_BLOCK_BYTES;
+    replyBlock* b = malloc(sizeof(replyBlock) + size);
+    b->data = b->buf;
+    b->len = len;
+    b->size = size;
+    b->release = NULL;
+    b->owner = NULL;
+    memcpy(b->buf, p, len);
+    _replyListAppendBlock(l, b);
+}
+
+/**
+ * @brief 追加不可变数据。 调用方已经为owner持有一份引用，由队列负责释放
+ *
+ * @param [in] l
+ * @param [in] data 在release之前保持有效且不被修改
+ * @param [in] len
+ * @param [in] release 可以为NULL（静态数据）
+ * @param [in] owner
+ */
+void replyListAddRef(replyList* l, const char* data, size_t len, replyRelease* release, void* owner)
+{
+    if (len < REPLY_REF_MIN_BYTES) {
+        // 短数据拷贝比分配一个引用块便宜
+        replyListAdd(l, data, len);
+        if (release) release(owner);
+        return;
+    }
+    replyBlock* b = malloc(sizeof(replyBlock));
+    b->data = data;
+    b->len = len;
+    b->size = 0;
+    b->release = release;
+    b->owner = owner;
+    _replyListAppendBlock(l, b);
+    l->pending += len;
+}
+
+/**
+ * @brief 已发送n字节，推进sentlen。 发送完的拷贝块直接释放，引用块挂到sent等待主线程release
+ *
+ * @param [in] l
+ * @param [in] n
+ */
+static void _replyListConsume(replyList* l, size_t n)
+{
+    l->pending -= n;
+    if (l->bufpos > 0) {
+        size_t left = l->bufpos - l->sentlen;
+        if (n < left) {
+            l->sentlen += n;
+            return;
+        }
+        n -= left;
+        l->bufpos = 0;
+        l->sentlen = 0;
+    }
+    while (n > 0) {
+        replyBlock* b = l->head;
+        size_t left = b->len - l->sentlen;
+        if (n < left) {
+            l->sentlen += n;
+            return;
+        }
+        n -= left;
+        l->sentlen = 0;
+        l->head = b->next;
+        if (l->head == NULL) l->tail = NULL;
+        if (b->release) {
+            b->next = l->sent;
+            l->sent = b;
+        } else {
+            free(b);
+        }
+    }
+}
+
+void replyListCopy(const replyList* l, char* dst)
+{
+    size_t sentlen = l->sentlen;
+    if (l->bufpos > 0) {
+        memcpy(dst, l->buf + sentlen, l->bufpos - sentlen);
+        dst += l->bufpos - sentlen;
+        sentlen = 0;
+    }
+    for (replyBlock* b = l->head; b; b = b->next) {
+        memcpy(dst, b->data + sentlen, b->len - sentlen);
+        dst += b->len - sentlen;
+        sentlen = 0;
+    }
+}
+
+void replyListReleaseSent(replyList* l)
+{
+    replyBlock* b = l->sent;
+    while (b) {
+        replyBlock* next = b->next;
+        _replyBlockFree(b);
+        b = next;
+    }
+    l->sent = NULL;
+}
+
+ssize_t replyListWrite(replyList* l, int fd)
+{
+    struct iovec iov[REPLY_MAX_IOV];
+    ssize_t total = 0;
+
+    while (l->pending > 0 && total < REPLY_MAX_WRITE_PER_EVENT) {
+        int iovcnt = 0;
+        size_t sentlen = l->sentlen;
+        if (l->bufpos > 0) {
+            iov[iovcnt].iov_base = l->buf + sentlen;
+            iov[iovcnt].iov_len = l->bufpos - sentlen;
+            iovcnt++;
+            sentlen = 0;
+        }
+        for (replyBlock* b = l->head; b && iovcnt < REPLY_MAX_IOV; b = b->next) {
+            iov[iovcnt].iov_base = (char*)b->data + sentlen;
+            iov[iovcnt].iov_len = b->len - sentlen;
+            iovcnt++;
+            sentlen = 0;
+        }
+
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        _replyListConsume(l, n);
+        total += n;
+    }
+    return total;
+}
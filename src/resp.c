@@ -38,13 +38,30 @@ struct RespShared resp = {
     .keyNotFound = "-ERR key not found\r\n",
     .bye = "-bye\r\n",
     .invalidCommand = "-Invalid command\r\n",
-    .fullsync = "+FULLSYNC\r\n",
-    .appendsync = "+APPENDSYNC\r\n",
-    .nosync = "+NOSYNC\r\n",
     .dupkey = "-ERR:Duplicate key\r\n",
     .ping = "*1\r\n$4\r\nPING\r\n",
     .info = "*1\r\n$4\r\nINFO\r\n",
-    .valmissed = "-ERR: Value missed\r\n"
+    .valmissed = "-ERR: Value missed\r\n",
+    .protoerr = "-ERR Protocol error\r\n",
+    .wrongArity = "-ERR wrong number of arguments\r\n",
+    .crossShard = "-ERR key belongs to another shard\r\n",
+    .shardsUnsupported = "-ERR not supported in shards mode\r\n",
+    .nullBulk = "$-1\r\n",
+    .czero = ":0\r\n",
+    .cone = ":1\r\n",
+    .syntaxErr = "-ERR syntax error\r\n",
+    .invalidExpire = "-ERR invalid expire time\r\n",
+    .oom = "-OOM command not allowed when used memory > 'maxmemory'\r\n",
+    .lfuNotSelected = "-ERR An LFU maxmemory policy is not selected, access frequency not tracked\r\n",
+    .lruNotSelected = "-ERR An LFU maxmemory policy is selected, idle time not tracked\r\n",
+    .notInteger = "-ERR value is not an integer or out of range\r\n",
+    .incrOverflow = "-ERR increment or decrement would overflow\r\n",
+    .notFloat = "-ERR value is not a valid float\r\n",
+    .nanOrInfinity = "-ERR increment would produce NaN or Infinity\r\n",
+    .aofDisabled = "-ERR append only file is not enabled\r\n",
+    .aofRewriteInProgress = "-ERR Background append only file rewriting already in progress\r\n",
+    .aofRewriteStarted = "+Background append only file rewriting started\r\n",
+    .aofRewriteScheduled = "+Background append only file rewriting scheduled\r\n"
 };
 
 /**
@@ -64,12 +81,15 @@ char* respEncodeArrayString(int argc, char* argv[])
     for (int i = 0; i < argc; ++i)
     {
         int arglen = strlen(argv[i]);
-        len += snprintf(buf + len, cap - len, "$%d\r\n", arglen);
-        if (len + arglen + 2 >= cap)
+        // 头部、参数、CRLF和结尾'\0'都放得下再写。 头部被snprintf截断时中间留下'\0'，按字符串发送的回复会被截短
+        size_t need = len + 32 + arglen + 3;
+        if (need > cap)
         {
-            cap *= 2;
+            while (cap < need)
+                cap *= 2;
             buf = realloc(buf, cap);
         }
+        len += snprintf(buf + len, cap - len, "$%d\r\n", arglen);
         memcpy(buf + len, argv[i], arglen);
         len += arglen;
         memcpy(buf + len, "\r\n", 2);
@@ -79,6 +99,30 @@ char* respEncodeArrayString(int argc, char* argv[])
     return buf;
 }
 
+/**
+ * @brief 命令编码为RESP数组追加到s。 改写后写入AOF、传播给从的命令使用
+ *
+ * @param [in] s
+ * @param [in] argc
+ * @param [in] argv 参数，不要求'\0'结尾
+ * @param [in] argvlen 参数长度
+ * @return sds 追加后的s
+ */
+sds respCatCommand(sds s, int argc, const char** argv, const size_t* argvlen)
+{
+    char hdr[32];
+    int n = snprintf(hdr, sizeof(hdr), "*%d\r\n", argc);
+    s = sdscatlen(s, hdr, n);
+    for (int i = 0; i < argc; i++)
+    {
+        n = snprintf(hdr, sizeof(hdr), "$%zu\r\n", argvlen[i]);
+        s = sdscatlen(s, hdr, n);
+        s = sdscatlen(s, argv[i], argvlen[i]);
+        s = sdscatlen(s, "\r\n", 2);
+    }
+    return s;
+}
+
 /**
  * 编码为$字符串
  * @param s
@@ -86,9 +130,11 @@ char* respEncodeArrayString(int argc, char* argv[])
  */
 char* respEncodeBulkString(const char* s)
 {
-    char buf[1024] = {0};
-    sprintf(buf, "$%lu\r\n%s\r\n", strlen((s)), s);
-    return strdup(buf);
+    size_t len = strlen(s);
+    size_t cap = len + 32;
+    char* buf = malloc(cap);
+    snprintf(buf, cap, "$%zu\r\n%s\r\n", len, s);
+    return buf;
 }
 
 /**
@@ -341,3 +387,144 @@ char* respParse(char* buf, size_t len)
     }
 
 }
+
+/**
+ * @brief 解析[s, s+len)内的非负十进制整数。
+ *
+ * @return 成功返回1，非法或溢出返回0
+ */
+static int parseLength(const char* s, size_t len, long* out)
+{
+    long v = 0;
+    int neg = 0;
+    if (len == 0) return 0;
+    if (*s == '-') {
+        neg = 1;
+        s++;
+        len--;
+        if (len == 0) return 0;
+    }
+    if (len > 18) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') return 0;
+        v = v * 10 + (s[i] - '0');
+    }
+    *out = neg ? -v : v;
+    return 1;
+}
+
+/**
+ * @brief 从pos开始读取一行 <prefix><number>\r\n
+ *
+ * @param [out] out 数值
+ * @return RESP_REQ_OK 读到一行并移动pos；RESP_REQ_INCOMPLETE；RESP_REQ_ERR
+ */
+static int parseHeaderLine(respReqParser* p, const char* buf, size_t len, char prefix, long* out)
+{
+    if (p->pos >= len) return RESP_REQ_INCOMPLETE;
+    if (buf[p->pos] != prefix) return RESP_REQ_ERR;
+    const char* start = buf + p->pos + 1;
+    const char* cr = memchr(start, '\r', len - p->pos - 1);
+    if (cr == NULL) {
+        return len - p->pos > RESP_MAX_INLINE ? RESP_REQ_ERR : RESP_REQ_INCOMPLETE;
+    }
+    if (cr + 1 >= buf + len) return RESP_REQ_INCOMPLETE;
+    if (cr[1] != '\n') return RESP_REQ_ERR;
+    if (!parseLength(start, cr - start, out)) return RESP_REQ_ERR;
+    p->pos = cr + 2 - buf;
+    return RESP_REQ_OK;
+}
+
+static void parserEnsureArgs(respReqParser* p, long n)
+{
+    if (n <= p->argcap) return;
+    p->argvoff = realloc(p->argvoff, sizeof(size_t) * n);
+    p->argvlen = realloc(p->argvlen, sizeof(size_t) * n);
+    p->argcap = n;
+}
+
+void respReqParserInit(respReqParser* p)
+{
+    memset(p, 0, sizeof(*p));
+    p->bulklen = -1;
+}
+
+void respReqParserFree(respReqParser* p)
+{
+    free(p->argvoff);
+    free(p->argvlen);
+    respReqParserInit(p);
+}
+
+/**
+ * @brief 一条命令处理完成后调用，准备解析下一条。 游标不动。
+ */
+void respReqParserReset(respReqParser* p)
+{
+    p->cmdstart = p->pos;
+    p->multibulklen = 0;
+    p->bulklen = -1;
+    p->argc = 0;
+}
+
+/**
+ * @brief 缓冲区前n字节被裁剪掉后，调整所有偏移。 n不能超过cmdstart
+ */
+void respReqParserShift(respReqParser* p, size_t n)
+{
+    assert(n <= p->cmdstart);
+    p->pos -= n;
+    p->cmdstart -= n;
+    for (int i = 0; i < p->argc; i++) {
+        p->argvoff[i] -= n;
+    }
+}
+
+/**
+ * @brief 从游标处继续解析一条请求：*N\r\n($len\r\n<data>\r\n)*N
+ *  可以被多次调用：数据不完整时保存进度返回，下次从断点继续，已解析的参数不会重复扫描，
+ *  批量字符串内容只按长度跳过，不逐字节扫描，因此二进制安全。
+ *
+ * @param [in] p 解析状态
+ * @param [in] buf 缓冲区起始（偏移都相对于它）
+ * @param [in] len 缓冲区有效长度
+ * @return int RESP_REQ_OK: 一条完整命令，参数在p->argc/argvoff/argvlen，原始字节为[cmdstart,pos)
+ *      RESP_REQ_INCOMPLETE: 需要更多数据
+ *      RESP_REQ_ERR: 协议错误
+ */
+int respParseRequest(respReqParser* p, const char* buf, size_t len)
+{
+    int ret;
+    while (p->multibulklen == 0) {
+        long n;
+        p->cmdstart = p->pos;
+        ret = parseHeaderLine(p, buf, len, '*', &n);
+        if (ret != RESP_REQ_OK) return ret;
+        if (n > RESP_MAX_MULTIBULK) return RESP_REQ_ERR;
+        if (n <= 0) continue; // *0\r\n, *-1\r\n 空命令， 跳过
+        parserEnsureArgs(p, n);
+        p->multibulklen = n;
+        p->argc = 0;
+    }
+
+    while (p->multibulklen > 0) {
+        if (p->bulklen == -1) {
+            long n;
+            ret = parseHeaderLine(p, buf, len, '$', &n);
+            if (ret != RESP_REQ_OK) return ret;
+            if (n < 0 || n > RESP_MAX_BULK) return RESP_REQ_ERR;
+            p->bulklen = n;
+        }
+        if (len - p->pos < (size_t)p->bulklen + 2) return RESP_REQ_INCOMPLETE;
+        if (buf[p->pos + p->bulklen] != '\r' || buf[p->pos + p->bulklen + 1] != '\n') {
+            return RESP_REQ_ERR;
+        }
+        p->argvoff[p->argc] = p->pos;
+        p->argvlen[p->argc] = p->bulklen;
+        p->argc++;
+        p->pos += p->bulklen + 2;
+        p->bulklen = -1;
+        p->multibulklen--;
+    }
+    return RESP_REQ_OK;
+}
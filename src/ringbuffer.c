@@ -3,51 +3,87 @@
 #include <string.h>
 
 RingBuffer* ringBufferCreate()
+{
+    return ringBufferCreateSize(RBUFFER_SIZE);
+}
+/**
+ * @brief 创建环形缓冲
+ *
+ * @param [in] size 数据区字节数，最多保存size-1字节
+ * @return RingBuffer*
+ */
+RingBuffer* ringBufferCreateSize(long size)
 {
     RingBuffer* rb = malloc(sizeof(RingBuffer));
+    rb->data = calloc(1, size);
+    rb->size = size;
     rb->tail = 0;
     rb->head = 0;
-    memset(rb->data, 0, RBUFFER_SIZE);
     return rb;
 }
+void ringBufferFree(RingBuffer* rb)
+{
+    if (!rb) return;
+    free(rb->data);
+    free(rb);
+}
+void ringBufferClear(RingBuffer* rb)
+{
+    rb->head = rb->tail = 0;
+}
 long ringBufferSize(RingBuffer* rb)
-{ 
-    return (rb->tail + RBUFFER_SIZE - rb->head) % RBUFFER_SIZE ;
+{
+    return (rb->tail + rb->size - rb->head) % rb->size;
 }
-bool ringBufferIsEmpty(RingBuffer* rb) 
+bool ringBufferIsEmpty(RingBuffer* rb)
 {
     return rb->head == rb->tail;
 }
 bool ringBufferIsFull(RingBuffer* rb)
 {
-    return ringBufferSize(rb) >= RBUFFER_SIZE - 1;
+    return ringBufferSize(rb) >= rb->size - 1;
+}
+
+/* 从下标pos开始拷贝出size字节，处理回环 */
+static void _copyOut(RingBuffer* rb, long pos, uint8_t data[], long size)
+{
+    long n = rb->size - pos;
+    if (size <= n) {
+        memcpy(data, rb->data + pos, size);
+    } else {
+        memcpy(data, rb->data + pos, n);
+        memcpy(data + n, rb->data, size - n);
+    }
+}
+
+/* 从tail开始写入size字节并移动tail，调用方保证size < rb->size */
+static void _copyIn(RingBuffer* rb, const uint8_t data[], long size)
+{
+    long n = rb->size - rb->tail;
+    if (size <= n) {
+        memcpy(rb->data + rb->tail, data, size);
+    } else {
+        memcpy(rb->data + rb->tail, data, n);
+        memcpy(rb->data, data + n, size - n);
+    }
+    rb->tail = (rb->tail + size) % rb->size;
 }
 
 bool ringBufferEnQeueue(RingBuffer* rb, uint8_t data)
 {
     if (!rb) return false;
-    if (ringBufferSize(rb) + 1 > RBUFFER_SIZE - 1) return false;
+    if (ringBufferSize(rb) + 1 > rb->size - 1) return false;
 
     rb->data[rb->tail] = data;
-    rb->tail = (rb->tail + 1) % RBUFFER_SIZE;
+    rb->tail = (rb->tail + 1) % rb->size;
     return true;
 }
 bool ringBufferEnQeueueBulk(RingBuffer* rb, uint8_t data[], long size)
 {
     if (!rb) return false;
-    if (ringBufferSize(rb) + size > RBUFFER_SIZE - 1) return false;
-    
-    long last_tail = (rb->tail + size) % RBUFFER_SIZE;
-
-    if (last_tail > rb->head) {
-        memcpy(rb->data + rb->tail, data, size);
-    } else {
-        long n = RBUFFER_SIZE - rb->tail;
-        memcpy(rb->data + rb->tail, data, n);
-        memcpy(rb->data, data + n, size - n);
-    }
-    rb->tail = last_tail;
+    if (ringBufferSize(rb) + size > rb->size - 1) return false;
 
+    _copyIn(rb, data, size);
     return true;
 }
 /**
@@ -61,16 +97,9 @@ bool ringBufferDequeueBulk(RingBuffer* rb, uint8_t data[], long size)
 {
     if (!rb) return false;
     if (size > ringBufferSize(rb)) return false;
-    
-    if (rb->head < rb->tail) {
-        memcpy(data, rb->data + rb->head, size);
-        rb->head = rb->head + size;
-    } else {
-        long n = RBUFFER_SIZE - rb->head;
-        memcpy(data, rb->data + rb->head, n);
-        memcpy(data + n, rb->data, size - n);
-        rb->head = size - n;
-    }
+
+    _copyOut(rb, rb->head, data, size);
+    rb->head = (rb->head + size) % rb->size;
     return true;
 }
 bool ringBufferDequeue(RingBuffer* rb, uint8_t *data)
@@ -78,6 +107,43 @@ bool ringBufferDequeue(RingBuffer* rb, uint8_t *data)
     if (!rb) return false;
     if (ringBufferSize(rb) < 1) return false;
     *data = rb->data[rb->head];
-    rb->head = (rb->head + 1) % RBUFFER_SIZE;
+    rb->head = (rb->head + 1) % rb->size;
+    return true;
+}
+
+/**
+ * @brief 写入数据，空间不够时丢弃最旧的数据。 超过容量时只保留最后size-1字节
+ *
+ * @param [in] rb
+ * @param [in] data
+ * @param [in] size
+ */
+void ringBufferWrite(RingBuffer* rb, const uint8_t data[], long size)
+{
+    long cap = rb->size - 1;
+    if (size > cap) {
+        data += size - cap;
+        size = cap;
+    }
+    long drop = ringBufferSize(rb) + size - cap;
+    if (drop > 0)
+        rb->head = (rb->head + drop) % rb->size;
+    _copyIn(rb, data, size);
+}
+
+/**
+ * @brief 读取数据但不出队
+ *
+ * @param [in] rb
+ * @param [in] skip 从head跳过的字节数
+ * @param [out] data
+ * @param [in] size
+ * @return bool [skip, skip+size)超出已有数据时返回false
+ */
+bool ringBufferPeek(RingBuffer* rb, long skip, uint8_t data[], long size)
+{
+    if (!rb) return false;
+    if (skip < 0 || size < 0 || skip + size > ringBufferSize(rb)) return false;
+    _copyOut(rb, (rb->head + skip) % rb->size, data, size);
     return true;
 }
@@ -16,6 +16,8 @@
 #include "rio.h"
 #include <errno.h>
 #include <stdint.h>
+#include "crc64.h"
+#include "zmalloc.h"
 /* 基于文件io函数 */
 ssize_t rioReadFromFile(rio* rio, void* buf, size_t len)
 {
@@ -50,9 +52,9 @@ void rioFlushToFile(rio* rio)
  * @return size_t 读到的字节数
  */
 ssize_t rioReadFromBuffer(rio *r, void *buf, size_t len) {
-    sds *b = (sds *)r->data;
+    sds b = (sds)r->data;
     size_t nread = len > sdslen(b) ? sdslen(b) : len;
-    memcpy(buf, b->buf, nread);
+    memcpy(buf, b, nread);
     sdsrange(b, nread, sdslen(b));  // 
     return nread;
 }
@@ -66,8 +68,8 @@ ssize_t rioReadFromBuffer(rio *r, void *buf, size_t len) {
  * @note 不产生错误，因为动态扩展
  */
 ssize_t rioWriteToBuffer(rio *r, const void *buf, size_t len) {
-    sds *b = (sds *)r->data;
-    sdscatlen(b, buf, len);
+    // 扩展后sds地址可能变化，以r->data为准
+    r->data = sdscatlen((sds)r->data, buf, len);
     return len;
 }
 off_t rioTellFromBuffer(rio *r) {
@@ -116,8 +118,100 @@ void rioFlushToFD(rio *r) {
     // 对于 fd，flush 通常无效，POSIX `write` 直接写入内核
 }
 
+/*带用户态缓冲的 fd rio*/
+typedef struct rioFDBuffer {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t len;     // 写：已缓冲的字节数；读：缓冲中的有效字节数
+    size_t pos;     // 读：下一个未读的字节
+    int writing;    // 写过数据，flush时需要写出
+} rioFDBuffer;
+
+static int fdWriteAll(rio *r, int fd, const char *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            r->error = RIO_ERR_WRITE;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+ssize_t rioWriteToBufferedFD(rio *r, const void *buf, size_t len) {
+    rioFDBuffer *b = r->data;
+    if (r->error) return -1;
+    b->writing = 1;
+    if (b->len + len > b->cap) {
+        if (fdWriteAll(r, b->fd, b->buf, b->len) < 0) return -1;
+        b->len = 0;
+        // 比缓冲还大的数据直接写，不经过拷贝
+        if (len >= b->cap)
+            return fdWriteAll(r, b->fd, buf, len) < 0 ? -1 : (ssize_t)len;
+    }
+    memcpy(b->buf + b->len, buf, len);
+    b->len += len;
+    return len;
+}
+
+/**
+ * @brief 读满len字节，只有到达文件末尾或出错时才返回更少
+ */
+ssize_t rioReadFromBufferedFD(rio *r, void *buf, size_t len) {
+    rioFDBuffer *b = r->data;
+    size_t done = 0;
+    while (done < len) {
+        if (b->pos == b->len) {
+            char *dst = len - done >= b->cap ? (char *)buf + done : b->buf;
+            size_t want = dst == b->buf ? b->cap : len - done;
+            ssize_t n = read(b->fd, dst, want);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                r->error = RIO_ERR_READ;
+                return done ? (ssize_t)done : -1;
+            }
+            if (n == 0) break;
+            if (dst != b->buf) {
+                done += n;
+                continue;
+            }
+            b->pos = 0;
+            b->len = n;
+        }
+        size_t m = len - done < b->len - b->pos ? len - done : b->len - b->pos;
+        memcpy((char *)buf + done, b->buf + b->pos, m);
+        b->pos += m;
+        done += m;
+    }
+    return done;
+}
+
+off_t rioTellFromBufferedFD(rio *r) {
+    return r->processedBytes;
+}
+
+void rioFlushToBufferedFD(rio *r) {
+    rioFDBuffer *b = r->data;
+    if (!b->writing || r->error) return;
+    if (fdWriteAll(r, b->fd, b->buf, b->len) == 0)
+        b->len = 0;
+}
+
+static void rioInitCommon(rio *r)
+{
+    r->error = RIO_OK;
+    r->updateCksum = NULL;
+    r->cksum = 0;
+    r->processedBytes = 0;
+}
 
 void rioInitWithFile(rio *r, FILE *fp) {
+    rioInitCommon(r);
     r->read = rioReadFromFile;
     r->write = rioWriteToFile;
     r->tell = rioTellFromFile;
@@ -125,8 +219,9 @@ void rioInitWithFile(rio *r, FILE *fp) {
     r->data = fp;
 }
 
-void rioInitWithBuf(rio *r, sds *buffer) 
+void rioInitWithBuf(rio *r, sds buffer) 
 {
+    rioInitCommon(r);
     r->read = rioReadFromBuffer;
     r->write = rioWriteToBuffer;
     r->tell = rioTellFromBuffer;
@@ -135,23 +230,53 @@ void rioInitWithBuf(rio *r, sds *buffer)
 }
 
 void rioInitWithSocket(rio *r, int socket) {
+    rioInitCommon(r);
     r->read = rioReadFromSocket;
     r->write = rioWriteToSocket;
     r->tell = rioTellFromSocket;
     r->flush = rioFlushToSocket;
-    r->data = malloc(sizeof(int));
     r->data = (void*)(intptr_t)socket;
 }
 void rioInitWithFD(rio *r, int fd) 
 {
+    rioInitCommon(r);
     r->read = rioReadFromFD;
     r->write = rioWriteToFD;
     r->tell = rioTellFromFD;
     r->flush = rioFlushToFD;
-    r->data = malloc(sizeof(int));
     r->data = (void*)(intptr_t)fd;
 }
 
+void rioInitWithBufferedFD(rio *r, int fd, size_t bufsize)
+{
+    rioInitCommon(r);
+    rioFDBuffer *b = zcalloc(1, sizeof(*b));
+    b->fd = fd;
+    b->cap = bufsize;
+    b->buf = zmalloc(bufsize);
+    r->read = rioReadFromBufferedFD;
+    r->write = rioWriteToBufferedFD;
+    r->tell = rioTellFromBufferedFD;
+    r->flush = rioFlushToBufferedFD;
+    r->data = b;
+}
+
+void rioFreeBufferedFD(rio *r)
+{
+    rioFDBuffer *b = r->data;
+    zfree(b->buf);
+    zfree(b);
+    r->data = NULL;
+}
+
+/**
+ * @brief 累计CRC64，赋值给updateCksum使用
+ */
+void rioGenericUpdateChecksum(rio *r, const void *buf, size_t len)
+{
+    r->cksum = crc64(r->cksum, buf, len);
+}
+
 /**
  * @brief 
  * 
@@ -172,6 +297,8 @@ size_t rioWrite(rio *r, const void *buf, size_t len)
         log_error("rioWrite error %s", strerror(errno));
         return 0; 
     }
+    if (r->updateCksum) r->updateCksum(r, buf, nwritten);
+    r->processedBytes += nwritten;
     // log_debug("rioWrite %zu bytes", nwritten);
     return (size_t)nwritten;
 }
@@ -189,7 +316,12 @@ ssize_t rioRead(rio *r, void *buf, size_t len)
         log_error(" rioread NULL pointer");
         return 0;
     }
-    return r->read(r, buf, len);
+    ssize_t nread = r->read(r, buf, len);
+    if (nread > 0) {
+        if (r->updateCksum) r->updateCksum(r, buf, nread);
+        r->processedBytes += nread;
+    }
+    return nread;
 }
 /**
  * @brief 偏移量
@@ -217,3 +349,45 @@ void rioFlush(rio *r)
     }
     r->flush(r);
 }
+
+/**
+ * @brief 写出 "*<count>\r\n" 或 "$<count>\r\n"
+ *
+ * @param [in] r
+ * @param [in] prefix '*'或'$'
+ * @param [in] count
+ * @return size_t 写入的字节数，0表示出错
+ */
+size_t rioWriteBulkCount(rio *r, char prefix, long count)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%c%ld\r\n", prefix, count);
+    return rioWrite(r, buf, len) == (size_t)len ? (size_t)len : 0;
+}
+
+/**
+ * @brief 写出一个bulk字符串 "$<len>\r\n<buf>\r\n"
+ *
+ * @param [in] r
+ * @param [in] buf
+ * @param [in] len
+ * @return size_t 写入的字节数，0表示出错
+ */
+size_t rioWriteBulkString(rio *r, const char *buf, size_t len)
+{
+    size_t nwritten = rioWriteBulkCount(r, '$', (long)len);
+    if (nwritten == 0) return 0;
+    if (len > 0 && rioWrite(r, buf, len) != len) return 0;
+    if (rioWrite(r, "\r\n", 2) != 2) return 0;
+    return nwritten + len + 2;
+}
+
+/**
+ * @brief 整数按十进制字符串写成bulk字符串
+ */
+size_t rioWriteBulkLongLong(rio *r, long long value)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%lld", value);
+    return rioWriteBulkString(r, buf, len);
+}
@@ -9,10 +9,12 @@
 #include "robj.h"
 #include <stdlib.h>
 #include "sds.h"
+#include "zmalloc.h"
 #include <errno.h>
 #include "redis.h"
 #include <limits.h>
 #include "log.h"
+#include "lzf.h"
 
 
 /**
@@ -24,7 +26,8 @@ static void _freeStringObject(robj *obj)
 {
     switch (obj->encoding) {
         case REDIS_ENCODING_RAW:
-            sdsfree((sds*)(obj->ptr));
+        case REDIS_ENCODING_COMPRESSED:
+            sdsfree((sds)(obj->ptr));
             break;
         case REDIS_ENCODING_INT:
             break;
@@ -35,35 +38,37 @@ static void _freeStringObject(robj *obj)
     }
 }
 /**
- * @brief 创建embedded str 编码的字符串对象. 嵌入的是sds
- * | robj 结构体 | sds 头部 | 字符串缓冲区 (len + 1) |
-    ^             ^          ^
-    obj           obj->ptr   ss->buf
+ * @brief 创建embedded str 编码的字符串对象. 嵌入的是sds, 一次分配
+ * | robj 结构体 | sdshdr8 | 字符串缓冲区 (len + 1) |
+    ^                      ^
+    obj                    obj->ptr
  * @param [in] s 
+ * @param [in] len 必须小于256
  * @return robj* 
  */
-robj* _createEmbeddedString(const char*s)
+robj* _createEmbeddedString(const char*s, size_t len)
 {
-    sds* ss = NULL;
-    unsigned long len = strlen(s);
-    robj* obj = calloc(1, sizeof(robj) + sizeof(sds) + len + 1);
+    assert(len < 1 << 8);
+    robj* obj = zmalloc(sizeof(robj) + sizeof(struct sdshdr8) + len + 1);
+    struct sdshdr8* sh = (void*)(obj + 1);
     obj->type = REDIS_STRING;
     obj->encoding = REDIS_ENCODING_EMBSTR;
-    obj->ptr = (char*)obj + sizeof(robj);
-    ss = obj->ptr;
-    ss->len = 0;
-    ss->free = len;
-    ss->buf = (char*)obj + sizeof(robj) + sizeof(sds);
-
-    sdscpy(ss, s);
+    obj->refcount = 1;
+    obj->ptr = sh->buf;
+    sh->len = len;
+    sh->alloc = len;
+    sh->flags = SDS_TYPE_8;
+    memcpy(sh->buf, s, len);
+    sh->buf[len] = '\0';
     return obj;
 }
-robj* _createRawString(const char* s)
+robj* _createRawString(const char* s, size_t len)
 {
-    robj* obj = malloc(sizeof(robj));
+    robj* obj = zmalloc(sizeof(robj));
     obj->type = REDIS_STRING;
     obj->encoding = REDIS_ENCODING_RAW;
-    obj->ptr = sdsnew(s);
+    obj->refcount = 1;
+    obj->ptr = sdsnewlen(s, len);
     return obj;    
 }
 
@@ -73,11 +78,15 @@ robj* _createRawString(const char* s)
  * @param succeed
  * @return
  */
-long _string2l(const char* s, int *succeed) {
-    if (!s || !*s) {  // 空指针或空字符串直接失败
+long _string2l(const char* s, size_t len, int *succeed) {
+    char buf[32];
+    if (!s || len == 0 || len >= sizeof(buf)) {  // 空字符串或者超出long表示范围直接失败
         *succeed = 0;
         return 0;
     }
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    s = buf;
 
     int base = 10;
     char *endptr;
@@ -117,26 +126,148 @@ long _string2l(const char* s, int *succeed) {
 static  robj* _createLongString(long value)
 {
     // 
-    robj* obj = malloc(sizeof(robj) );
+    robj* obj = zmalloc(sizeof(robj) );
     obj->type = REDIS_STRING;
     obj->encoding = REDIS_ENCODING_INT;
+    obj->refcount = 1;
     obj->ptr = (void*)value;
     return obj;
 }
 
 
 
+/* 共享整数对象 [0, REDIS_SHAREAD_MAX_INT]: 计数器、标志位等小整数不必每次分配。
+ * 引用计数固定为OBJ_SHARED_REFCOUNT，只读，多个分片线程可以同时引用 */
+static robj sharedIntegers[REDIS_SHAREAD_MAX_INT + 1];
+static int shareIntegers = 0;
+
 /**
- * 对象系统初始化
+ * 对象系统初始化：创建共享整数对象
  */
 void robjInit()
 {
+    for (long i = 0; i <= REDIS_SHAREAD_MAX_INT; i++) {
+        sharedIntegers[i].type = REDIS_STRING;
+        sharedIntegers[i].encoding = REDIS_ENCODING_INT;
+        sharedIntegers[i].lru = 0;
+        sharedIntegers[i].refcount = OBJ_SHARED_REFCOUNT;
+        sharedIntegers[i].ptr = (void*)i;
+    }
+    shareIntegers = 1;
+}
+
+/**
+ * @brief 是否使用共享整数对象。 按对象记录LRU/LFU的淘汰策略下关闭，否则所有键共用一份访问信息
+ *
+ * @param [in] enable
+ */
+void robjSetShareIntegers(int enable)
+{
+    shareIntegers = enable;
+}
+
+int robjIsShared(const robj* obj)
+{
+    return obj->refcount == OBJ_SHARED_REFCOUNT;
+}
+
+/**
+ * @brief 整数字符串对象，小整数返回共享对象
+ *
+ * @param [in] value
+ * @return robj*
+ */
+robj* robjCreateStringObjectFromLong(long value)
+{
+    if (shareIntegers && value >= 0 && value <= REDIS_SHAREAD_MAX_INT)
+        return &sharedIntegers[value];
+    return _createLongString(value);
+}
+
+/* 压缩字符串: 不小于阈值的值LZF压缩后保存，读取时解压。 0表示不压缩 */
+static size_t compressThreshold = 0;
+
+/**
+ * @brief 设置内存中压缩字符串的长度阈值，配置value-compress-threshold
+ *
+ * @param [in] minSize 0表示关闭
+ */
+void robjSetCompressThreshold(size_t minSize)
+{
+    compressThreshold = minSize;
+}
+
+size_t robjCompressThreshold(void)
+{
+    return compressThreshold;
+}
+
+/**
+ * @brief 用已经压缩好的数据创建压缩字符串，加载RDB时不需要先解压再压缩
+ *
+ * @param [in] lzf
+ * @param [in] lzfLen
+ * @param [in] rawLen 解压后的长度
+ * @return robj*
+ */
+robj* robjCreateCompressedStringObject(const void* lzf, size_t lzfLen, size_t rawLen)
+{
+    assert(rawLen <= UINT32_MAX);
+    uint32_t hdr = rawLen;
+    sds s = sdsnewlen(NULL, OBJ_COMPRESS_HDR + lzfLen);
+    memcpy(s, &hdr, OBJ_COMPRESS_HDR);
+    memcpy(s + OBJ_COMPRESS_HDR, lzf, lzfLen);
+    robj* obj = zmalloc(sizeof(robj));
+    obj->type = REDIS_STRING;
+    obj->encoding = REDIS_ENCODING_COMPRESSED;
+    obj->refcount = 1;
+    obj->ptr = s;
+    return obj;
+}
+
+/**
+ * @brief 尝试压缩，至少节省1/8才值得读取时付出解压的代价
+ *
+ * @return robj* 没有收益时返回NULL
+ */
+static robj* _tryCreateCompressedString(const char* s, size_t len)
+{
+    if (len > UINT32_MAX) return NULL;
+    size_t outLen = len - len / 8;
+    void* buf = zmalloc(outLen);
+    size_t n = lzfCompress(s, len, buf, outLen);
+    robj* obj = n ? robjCreateCompressedStringObject(buf, n, len) : NULL;
+    zfree(buf);
+    return obj;
+}
+
+size_t robjCompressedRawLen(const robj* obj)
+{
+    uint32_t hdr;
+    memcpy(&hdr, obj->ptr, OBJ_COMPRESS_HDR);
+    return hdr;
+}
+
+/**
+ * @brief 解压为新的sds，由调用者释放
+ *
+ * @param [in] obj REDIS_ENCODING_COMPRESSED编码的字符串
+ * @return sds
+ */
+sds robjDecompressString(const robj* obj)
+{
+    size_t rawLen = robjCompressedRawLen(obj);
+    sds s = sdsnewlen(NULL, rawLen);
+    size_t n = lzfDecompress((char*)obj->ptr + OBJ_COMPRESS_HDR, sdslen(obj->ptr) - OBJ_COMPRESS_HDR,
+                             s, rawLen);
+    assert(n == rawLen);
+    return s;
 }
 
 /* robj */
 robj* robjCreate(int type, void *ptr)
 {
-    robj* obj = malloc(sizeof(robj));
+    robj* obj = zmalloc(sizeof(robj));
     obj->type = type;
     obj->encoding = REDIS_ENCODING_RAW;
     obj->refcount = 1;
@@ -151,6 +282,7 @@ robj* robjCreate(int type, void *ptr)
  */
 void robjDestroy(robj* obj)
 {
+    if (obj->refcount == OBJ_SHARED_REFCOUNT) return;
     if (obj->refcount <= 1) {
         switch (obj->type) {
             case REDIS_STRING:
@@ -161,24 +293,40 @@ void robjDestroy(robj* obj)
             default:
                 break;
         }
-        free(obj);
+        zfree(obj);
     } else {
         obj->refcount--;
     }
 }
 
 robj* robjCreateStringObject(const char*s)
+{
+    return robjCreateStringObjectLen(s, strlen(s));
+}
+
+/**
+ * @brief 从二进制安全的(s,len)创建字符串对象。 s无需'\0'结尾
+ * 
+ * @param [in] s 
+ * @param [in] len 
+ * @return robj* 
+ */
+robj* robjCreateStringObjectLen(const char* s, size_t len)
 {
     int succeed = 0;
-    long value = _string2l(s, &succeed);
+    long value = _string2l(s, len, &succeed);
     if (succeed) {
-        return _createLongString(value);
+        return robjCreateStringObjectFromLong(value);
+    }
+    if (compressThreshold && len >= compressThreshold) {
+        robj* obj = _tryCreateCompressedString(s, len);
+        if (obj) return obj;
     }
     // TODO 为什么是32字节？
-    if (strlen(s) < 32) {
-        return _createEmbeddedString(s);
+    if (len < 32) {
+        return _createEmbeddedString(s, len);
     }
-    return _createRawString(s);
+    return _createRawString(s, len);
 }
 
 char* robjGetValStr(robj* obj)
@@ -190,9 +338,13 @@ char* robjGetValStr(robj* obj)
     case REDIS_STRING:
         if (obj->encoding == REDIS_ENCODING_INT) {
             snprintf(buf, sizeof(buf), "%ld", (long)(obj->ptr));
+        } else if (obj->encoding == REDIS_ENCODING_COMPRESSED) {
+            sds s = robjDecompressString(obj);
+            strncpy(buf, s, sizeof(buf) - 1);
+            sdsfree(s);
         } else {
-            sds* s = (sds*)(obj->ptr);
-            strncpy(buf, s->buf, sizeof(buf) - 1);
+            sds s = (sds)(obj->ptr);
+            strncpy(buf, s, sizeof(buf) - 1);
         }
         break;
     
@@ -1,224 +1,329 @@
 #include "sds.h"
+#include "sdsalloc.h"
+#include <limits.h>
+
+// 小于该长度时扩容翻倍，否则每次多分配SDS_MAX_PREALLOC
+#define SDS_MAX_PREALLOC (1024*1024)
+
+static inline int _sdsHdrSize(char type)
+{
+    switch (type & SDS_TYPE_MASK) {
+        case SDS_TYPE_8: return sizeof(struct sdshdr8);
+        case SDS_TYPE_16: return sizeof(struct sdshdr16);
+        case SDS_TYPE_32: return sizeof(struct sdshdr32);
+        case SDS_TYPE_64: return sizeof(struct sdshdr64);
+    }
+    return 0;
+}
+
+/**
+ * @brief 能容纳size长度的最小头部类型
+ *
+ * @param [in] size
+ * @return char
+ */
+static inline char _sdsReqType(size_t size)
+{
+    if (size < 1 << 8)
+        return SDS_TYPE_8;
+    if (size < 1 << 16)
+        return SDS_TYPE_16;
+#if (LONG_MAX == LLONG_MAX)
+    if (size < 1ll << 32)
+        return SDS_TYPE_32;
+    return SDS_TYPE_64;
+#else
+    return SDS_TYPE_32;
+#endif
+}
+
 /**
- * @brief 
- * 
- * @param [in] init 
+ * @brief 头部和buf一次分配
+ *
+ * @param [in] init 为NULL时内容填充0
  * @param [in] len 字符串长度
- * @return sds* 
+ * @return sds
  */
-static sds* _sdsnewWithLen(const char* init, int len)
-{
-    sds* ss;
-    int bufLen = 0;
-    bufLen = len < 1024 ? len * 2 + 1 : len + 1024 + 1;
-    ss = calloc(1, sizeof(sds));
-    ss->buf = calloc(bufLen, sizeof(char));
-    ss->len = len;
-    ss->free = bufLen - len - 1;
-    memcpy(ss->buf, init, len);
-    return ss;
+sds sdsnewlen(const void* init, size_t len)
+{
+    char type = _sdsReqType(len);
+    int hdrlen = _sdsHdrSize(type);
+    void* sh = s_malloc(hdrlen + len + 1);
+    if (sh == NULL) return NULL;
+    sds s = (char*)sh + hdrlen;
+    s[-1] = type;
+    sdssetlen(s, len);
+    sdssetalloc(s, len);
+    if (len) {
+        if (init)
+            memcpy(s, init, len);
+        else
+            memset(s, 0, len);
+    }
+    s[len] = '\0';
+    return s;
 }
 
 /**
- * @brief 
- * 
- * @param [in] s 
- * @return sdshdr* 
+ * @brief
+ *
+ * @param [in] s
+ * @return sds
  */
-sds* sdsnew(const char* s)
+sds sdsnew(const char* s)
 {
     if (s == NULL)  return NULL;
-    return _sdsnewWithLen(s, strlen(s));
+    return sdsnewlen(s, strlen(s));
 }
-sds* sdsempty()
+sds sdsempty(void)
 {
-    return _sdsnewWithLen("", 0);
+    return sdsnewlen("", 0);
 }
-void sdsfree(sds* ss)
+void sdsfree(sds s)
 {
-    if (ss == NULL) return;
-    if (ss->buf == NULL) return;
-    free(ss->buf);
-    free(ss);
+    if (s == NULL) return;
+    s_free(s - _sdsHdrSize(s[-1]));
 }
-int sdslen(const sds* ss)
+sds sdsdump(const sds s)
 {
-    if (ss == NULL) return 0;
-    return ss->len;
+    if (s == NULL) return NULL;
+    return sdsnewlen(s, sdslen(s));
 }
-int sdsavail(const sds* ss)
+void sdsclear(sds s)
 {
-    if (ss == NULL) return 0;
-    return ss->free;
+    if (s == NULL) return;
+    sdssetlen(s, 0);
+    s[0] = '\0';
 }
-sds* sdsdump(const sds* ss)
+
+/**
+ * @brief 扩展空闲空间，至少addlen字节。 头部类型可能随之变大
+ *
+ * @param [in] s
+ * @param [in] addlen
+ * @return sds 新的sds
+ */
+sds sdsMakeRoomFor(sds s, size_t addlen)
 {
-    if (ss == NULL) return NULL;
-    sds* res = sdsempty();
-    res->buf = calloc(ss->len + ss->free + 1, sizeof(char));
-    // 显示复制
-    res->len = ss->len;
-    res->free = ss->free;
-    memcpy(res->buf,  ss->buf, ss->len + ss->free + 1);
-    return res; 
+    size_t avail = sdsavail(s);
+    if (avail >= addlen) return s;
+
+    size_t len = sdslen(s);
+    char oldtype = s[-1] & SDS_TYPE_MASK;
+    int oldhdrlen = _sdsHdrSize(oldtype);
+    void* sh = s - oldhdrlen;
+    size_t newlen = len + addlen;
+    if (newlen < SDS_MAX_PREALLOC)
+        newlen *= 2;
+    else
+        newlen += SDS_MAX_PREALLOC;
+
+    char type = _sdsReqType(newlen);
+    int hdrlen = _sdsHdrSize(type);
+    if (type == oldtype) {
+        sh = s_realloc(sh, hdrlen + newlen + 1);
+        if (sh == NULL) return NULL;
+        s = (char*)sh + hdrlen;
+    } else {
+        // 头部大小变化，需要搬移内容
+        void* newsh = s_malloc(hdrlen + newlen + 1);
+        if (newsh == NULL) return NULL;
+        memcpy((char*)newsh + hdrlen, s, len + 1);
+        s_free(sh);
+        s = (char*)newsh + hdrlen;
+        s[-1] = type;
+        sdssetlen(s, len);
+    }
+    sdssetalloc(s, newlen);
+    return s;
 }
-void sdsclear(sds* ss)
+
+/**
+ * @brief 直接写入buf后调整长度。 incr不能超过空闲空间
+ *
+ * @param [in] s
+ * @param [in] incr
+ */
+void sdsIncrLen(sds s, ssize_t incr)
 {
-    // 防御性清除。
-    if (ss == NULL) return;
-    ss->free = ss->len + ss->free ;
-    memset(ss->buf, 0, ss->len);
-    ss->len = 0;
+    size_t len = sdslen(s);
+    assert((incr >= 0 && (size_t)incr <= sdsavail(s)) || (incr < 0 && len >= (size_t)(-incr)));
+    len += incr;
+    sdssetlen(s, len);
+    s[len] = '\0';
+}
+
+size_t sdsAllocSize(const sds s)
+{
+    return _sdsHdrSize(s[-1]) + sdsalloc(s) + 1;
 }
 
 /**
  * @brief 添加一些buf, 二进制数组
- * 
- * @param [in] dest 
- * @param [in] buf 
- * @param [in] n 
+ *
+ * @param [in] s
+ * @param [in] buf
+ * @param [in] len
+ * @return sds 新的sds
  */
-void sdscatlen(sds* dest, const char* buf, int n)
-{
-    if (dest == NULL) return;
-    if (buf == NULL) return;
-    int len = sdslen(dest);
-    int newlen = len + n;
-    int newbuflen;
-    if (n > sdsavail(dest)) {
-        // 需要扩展
-        newbuflen = newlen < 1024 ? newlen * 2 + 1 : newlen + 1024 + 1;
-        dest->buf = realloc(dest->buf, newbuflen);
-        dest->free = newbuflen - newlen - 1;
-        dest->len = newlen;
-        // 分配后填充0
-        memset(dest->buf + len, 0, newbuflen - len);
-        memcpy(dest->buf + len, buf, n);
-    } else {
-        memcpy(dest->buf + len, buf, n);
-        dest->len = newlen;
+sds sdscatlen(sds s, const void* buf, size_t len)
+{
+    if (s == NULL) return NULL;
+    // 快速路径: 空间足够时只解析一次头部
+#define SDS_CAT_FAST(T) do { \
+        SDS_HDR_VAR(T, s); \
+        size_t curlen = sh->len; \
+        if ((size_t)(sh->alloc - curlen) >= len) { \
+            memcpy(s + curlen, buf, len); \
+            sh->len = curlen + len; \
+            s[curlen + len] = '\0'; \
+            return s; \
+        } \
+    } while (0)
+    switch (s[-1] & SDS_TYPE_MASK) {
+        case SDS_TYPE_8: SDS_CAT_FAST(8); break;
+        case SDS_TYPE_16: SDS_CAT_FAST(16); break;
+        case SDS_TYPE_32: SDS_CAT_FAST(32); break;
+        case SDS_TYPE_64: SDS_CAT_FAST(64); break;
     }
-}
+#undef SDS_CAT_FAST
 
+    size_t curlen = sdslen(s);
+    s = sdsMakeRoomFor(s, len);
+    if (s == NULL) return NULL;
+    memcpy(s + curlen, buf, len);
+    sdssetlen(s, curlen + len);
+    s[curlen + len] = '\0';
+    return s;
+}
 
 /**
- * @brief 
- * 
- * @param [in] dest 
- * @param [in] s 字符串
+ * @brief
+ *
+ * @param [in] s
+ * @param [in] t 字符串
+ * @return sds 新的sds
  */
-void sdscat(sds* dest, const char* s)
+sds sdscat(sds s, const char* t)
 {
-    if (s == NULL) return;
-    int len = sdslen(dest);
-    int newlen = len + strlen(s);
-    int newbuflen;
-    if (strlen(s) > sdsavail(dest)) {
-        // 需要扩展
-        newbuflen = newlen < 1024 ? newlen * 2 + 1 : newlen + 1024 + 1;
-        dest->buf = realloc(dest->buf, newbuflen);
-        dest->free = newbuflen - newlen - 1;
-        dest->len = newlen;
-        // 分配后填充0
-        memset(dest->buf + len, 0, newbuflen - len);
-        memcpy(dest->buf + len, s, strlen(s));
-
-    } else {
-        memcpy(dest->buf + len, s, strlen(s));
-        dest->len = newlen;
-    }
-
+    if (t == NULL) return s;
+    return sdscatlen(s, t, strlen(t));
 }
-void sdscatsds(sds* dest, sds* src)
+sds sdscatsds(sds s, const sds t)
 {
-    if (src == NULL) return;
-    sdscatlen(dest, src->buf, src->len);
-    src->free = src->len + src->free + 1;
-    src->len = 0;
-    src->buf[0] = '\0';
+    if (t == NULL) return s;
+    return sdscatlen(s, t, sdslen(t));
 }
 /**
- * @brief char*字符串  到dest 
- * @param [in] dest 
- * @param [in] s 
+ * @brief 二进制buf覆盖写入
+ * @param [in] s
+ * @param [in] t
+ * @param [in] len
+ * @return sds 新的sds
  */
-void sdscpy(sds* dest, const char* s)
+sds sdscpylen(sds s, const char* t, size_t len)
 {
-    sdsclear(dest);
-    sdscat(dest, s);
+    if (sdsalloc(s) < len) {
+        s = sdsMakeRoomFor(s, len - sdslen(s));
+        if (s == NULL) return NULL;
+    }
+    memcpy(s, t, len);
+    s[len] = '\0';
+    sdssetlen(s, len);
+    return s;
 }
-void sdsgrowzero(sds* ss, int newlen)
+/**
+ * @brief char*字符串  到dest
+ * @param [in] s
+ * @param [in] t
+ * @return sds 新的sds
+ */
+sds sdscpy(sds s, const char* t)
 {
-    if (ss == NULL) return;
-    int len = sdslen(ss);
-    if (newlen <= len) {
-        return;
+    if (t == NULL) {
+        sdsclear(s);
+        return s;
     }
-    int free = sdsavail(ss);
-    int n = newlen - len;
-    // 如果有空间扩展, 默认都是'\0'
-    if (free >= n) {
-        // 直接返回
-        memset(ss->buf + len, 0, n);
-        return;
-    }
-    int newbuflen = newlen < 1024 ? newlen * 2 + 1 : newlen + 1024 + 1;
-    ss = realloc(ss, sizeof(sds) + newbuflen);
-    ss->free = newbuflen - newlen - 1;
-    ss->len = newlen;
-    memset(ss->buf + len, 0, n);
-    return;
+    return sdscpylen(s, t, strlen(t));
+}
+sds sdsgrowzero(sds s, size_t len)
+{
+    if (s == NULL) return NULL;
+    size_t curlen = sdslen(s);
+    if (len <= curlen) return s;
+    s = sdsMakeRoomFor(s, len - curlen);
+    if (s == NULL) return NULL;
+    // 包括'\0'
+    memset(s + curlen, 0, len - curlen + 1);
+    sdssetlen(s, len);
+    return s;
 }
 
 /**
- * @brief 裁剪保留[start, end] 
+ * @brief 裁剪保留[start, end]，原地修改，不重新分配
  *  "helloworld"
  *  [2,10]
- * @param [in] ss 
- * @param [in] start 下标索引 
- * @param [in] end 下标索引
+ * @param [in] s
+ * @param [in] start 下标索引, 负数表示从末尾计算
+ * @param [in] end 下标索引, 负数表示从末尾计算, 超出部分截断
  * @return void
- * 
- * @note 如果 start>end, 成为空字符串
+ *
+ * @note 如果 start>end 或 start越界, 成为空字符串
  */
-void sdsrange(sds* ss, int start, int end)
-{
-    if (ss == NULL) return;
-    int len = sdslen(ss);
-    int newLen;
-    if (start < 0) start = len + start;
-    if (end < 0) end = len + end;
-    if (start < 0 || end >= len)
-        return;
-    newLen = end - start + 1;
-    if (newLen > 0) {
-        memmove(ss->buf, ss->buf + start, newLen);
+void sdsrange(sds s, ssize_t start, ssize_t end)
+{
+    if (s == NULL) return;
+    size_t len = sdslen(s);
+    size_t newlen;
+    if (len == 0) return;
+    if (start < 0) {
+        start = len + start;
+        if (start < 0) start = 0;
+    }
+    if (end < 0) {
+        end = len + end;
+        if (end < 0) end = 0;
     }
-    ss->buf[newLen] = '\0';
-    ss->len = newLen;
-    ss->free = ss->free + len - newLen ;
-    assert(ss->len >= 0);
-    return;
-}
-void sdstrim(sds* sds, const char* s)
-{
-    int start = 0;
-    int end = sdslen(sds) - 1;
-    while (start < end && strchr(s, sds->buf[start]))
-        start++;
-    while (end >= start && strchr(s, sds->buf[end]))
-        end--;
-    if (start > 0 || end < sdslen(sds) - 1)
-        sdsrange(sds, start, end);
-    return;
-}
-int sdscmp(const sds* sds1, const sds* sds2)
-{
-    if (sds1 == NULL || sds2 == NULL) return -1;
-    int len1 = sdslen(sds1);
-    int len2 = sdslen(sds2);
-    if (len1!= len2) {
-        return len1 - len2;
+    newlen = (start > end) ? 0 : (end - start) + 1;
+    if (newlen != 0) {
+        if (start >= (ssize_t)len) {
+            newlen = 0;
+        } else if (end >= (ssize_t)len) {
+            end = len - 1;
+            newlen = (end - start) + 1;
+        }
     }
-    return strcmp(sds1->buf, sds2->buf);
+    if (start && newlen) memmove(s, s + start, newlen);
+    s[newlen] = '\0';
+    sdssetlen(s, newlen);
+}
+void sdstrim(sds s, const char* cset)
+{
+    char *sp, *ep, *start, *end;
+    if (s == NULL) return;
+    sp = start = s;
+    ep = end = s + sdslen(s) - 1;
+    while (sp <= end && strchr(cset, *sp)) sp++;
+    while (ep > sp && strchr(cset, *ep)) ep--;
+    size_t len = (sp > ep) ? 0 : ((ep - sp) + 1);
+    if (s != sp) memmove(s, sp, len);
+    s[len] = '\0';
+    sdssetlen(s, len);
+}
+/**
+ * @brief 按字节比较，长度不同时短的更小
+ *
+ * @param [in] s1
+ * @param [in] s2
+ * @return int 相同返回0
+ */
+int sdscmp(const sds s1, const sds s2)
+{
+    if (s1 == NULL || s2 == NULL) return -1;
+    size_t l1 = sdslen(s1);
+    size_t l2 = sdslen(s2);
+    size_t minlen = (l1 < l2) ? l1 : l2;
+    int cmp = memcmp(s1, s2, minlen);
+    if (cmp == 0) return l1 > l2 ? 1 : (l1 < l2 ? -1 : 0);
+    return cmp;
 }
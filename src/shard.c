@@ -0,0 +1,354 @@
+/**
+ * @file shard.c
+ * @brief 分片模式: 每个分片一个线程、一个事件循环、一部分键空间，跨分片命令通过SPSC队列转发
+ *
+ * 一条转发请求的生命周期：
+ *  来源分片 shardRouteCommand -> 拷贝原始命令，挂到客户端的shardRequests，放入(来源->目标)队列
+ *  来源分片 beforeSleep -> shardsBeforeSleep 唤醒目标
+ *  目标分片 shardWakeHandler -> shardExecute 在无连接的执行客户端上执行，回复拷贝到请求中，放入(目标->来源)队列
+ *  来源分片 shardWakeHandler -> 请求标记完成，按顺序把已完成的回复追加到客户端
+ *
+ * 请求只在来源分片创建和释放，目标分片只读写cmd、reply。 客户端在回复到达前释放时，请求的client置空，回复到达后丢弃。
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "shard.h"
+#include "spsc.h"
+#include "redis.h"
+#include "client.h"
+#include "command.h"
+#include "iothread.h"
+#include "log.h"
+
+/**
+ * @brief 转发请求，同时也是回复消息
+ */
+typedef struct shardRequest {
+    redisClient* client;    // 发起请求的客户端，客户端已释放时为NULL
+    int origin;             // 来源分片
+    int dbid;
+    int done;               // 回复已到达（只在来源分片访问）
+    sds cmd;                // 原始RESP命令
+    sds reply;              // 目标分片填写的回复
+} shardRequest;
+
+typedef struct shard {
+    int id;
+    pthread_t thread;
+    struct redisServer* server;
+    int wakefd;                 // eventfd, 其他分片发来消息时写入
+    redisClient* executor;      // 执行转发来的命令，回复不发送，收集后送回来源
+    list* outbox[SHARDS_MAX];   // 目标队列满时暂存，下一轮重试
+    int notify[SHARDS_MAX];     // 本轮向哪些分片发送过消息，需要唤醒
+} shard;
+
+static shard* shards;
+static int shardsNum = 1;
+static spscQueue** shardQueues;     // [from * shardsNum + to]
+
+static inline spscQueue* shardQueue(int from, int to)
+{
+    return shardQueues[from * shardsNum + to];
+}
+
+static inline shard* currentShard(void)
+{
+    return &shards[server->shardId];
+}
+
+/**
+ * @brief 键所属分片. 使用与dict不同的hash(FNV-1a)，避免同一分片内的键在dict桶上分布不均
+ *
+ * @param [in] key
+ * @param [in] len
+ * @return int
+ */
+int shardKeyOwner(const char* key, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return (int)(h % (uint32_t)shardsNum);
+}
+
+static void shardRequestFree(shardRequest* r)
+{
+    sdsfree(r->cmd);
+    sdsfree(r->reply);
+    free(r);
+}
+
+static void shardSend(int target, shardRequest* r)
+{
+    shard* me = currentShard();
+    list* outbox = me->outbox[target];
+    // outbox非空时必须排在它后面，保持同一方向的消息顺序
+    if (listLength(outbox) > 0 || !spscQueuePush(shardQueue(me->id, target), r)) {
+        listAddNodeTail(outbox, listCreateNode(r));
+    }
+    me->notify[target] = 1;
+}
+
+static void shardWake(int id)
+{
+    uint64_t one = 1;
+    if (write(shards[id].wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_error("Wake shard %d failed: %s", id, strerror(errno));
+    }
+}
+
+/**
+ * @brief 在执行客户端上执行一条完整的RESP命令，返回回复
+ *
+ * @param [in] buf
+ * @param [in] len
+ * @param [in] dbid
+ * @return sds
+ */
+static sds shardExecute(const char* buf, size_t len, int dbid)
+{
+    redisClient* c = currentShard()->executor;
+    respReqParser* p = &c->reqParser;
+    if (respParseRequest(p, buf, len) == RESP_REQ_OK) {
+        c->dbid = dbid;
+        c->db = &server->db[dbid];
+        clientSetArgv(c, p, buf);
+        processCommand(c);
+    }
+    // 下一条命令从新缓冲区开头解析
+    respReqParserReset(p);
+    respReqParserShift(p, p->cmdstart);
+    c->argc = 0;
+    c->rawCmd = NULL;
+    c->rawCmdLen = 0;
+
+    sds reply = sdsnewlen(NULL, replyListPending(&c->reply));
+    replyListCopy(&c->reply, reply);
+    replyListFree(&c->reply);
+    return reply;
+}
+
+/**
+ * @brief 把客户端已完成的回复按命令顺序追加。 全部完成后恢复被暂停的pipeline
+ *
+ * @param [in] c
+ */
+static void shardClientFlush(redisClient* c)
+{
+    listNode* node;
+    while ((node = listHead(c->shardRequests)) != NULL) {
+        shardRequest* r = node->value;
+        if (!r->done) break;
+        addWriteBuf(c, r->reply, sdslen(r->reply));
+        listDelNode(c->shardRequests, node);
+        shardRequestFree(r);
+    }
+    if (listLength(c->shardRequests) == 0 && c->reqParsed == RESP_REQ_OK) {
+        processClientQueryBuf(c);
+    } else if (clientHasPendingReplies(c)) {
+        clientInstallWriteHandler(c);
+    }
+}
+
+static void shardHandleMessage(shardRequest* r)
+{
+    shard* me = currentShard();
+    if (r->origin != me->id) {
+        // 其他分片转发来的请求
+        r->reply = shardExecute(r->cmd, sdslen(r->cmd), r->dbid);
+        sdsfree(r->cmd);
+        r->cmd = NULL;
+        shardSend(r->origin, r);
+        return;
+    }
+    // 自己发出的请求的回复
+    if (r->client == NULL) {
+        shardRequestFree(r);
+        return;
+    }
+    r->done = 1;
+    shardClientFlush(r->client);
+}
+
+static void shardWakeHandler(aeEventLoop* el, int fd, void* privdata)
+{
+    shard* me = privdata;
+    uint64_t n;
+    if (read(fd, &n, sizeof(n)) < 0 && errno != EAGAIN) {
+        log_error("Read shard wakefd failed: %s", strerror(errno));
+    }
+    int more = 0;
+    for (int from = 0; from < shardsNum; from++) {
+        if (from == me->id) continue;
+        spscQueue* q = shardQueue(from, me->id);
+        shardRequest* r;
+        int i;
+        for (i = 0; i < SHARD_POP_PER_EVENT && (r = spscQueuePop(q)) != NULL; i++) {
+            shardHandleMessage(r);
+        }
+        if (i == SHARD_POP_PER_EVENT) more = 1;
+    }
+    // 没取完，下一轮继续
+    if (more) shardWake(me->id);
+}
+
+int shardRouteCommand(redisClient* c)
+{
+    int pending = c->shardRequests != NULL && listLength(c->shardRequests) > 0;
+    if (c->fd == -1 || !(c->flags & REDIS_CLIENT_NORMAL))
+        return SHARD_ROUTE_LOCAL;
+
+    redisCommand* cmd = lookupCommand(c, c->argv[0], c->argvlen[0]);
+    if (cmd == NULL || cmd->firstkey == 0 || (cmd->flags & CMD_SHARD_LOCAL) ||
+        !commandCheckArity(cmd, c->argc))
+    {
+        return pending ? SHARD_ROUTE_WAIT : SHARD_ROUTE_LOCAL;
+    }
+    shard* me = currentShard();
+    int owner = shardKeyOwner(c->argv[cmd->firstkey], c->argvlen[cmd->firstkey]);
+    if (owner == me->id && !pending)
+        return SHARD_ROUTE_LOCAL;
+
+    shardRequest* r = calloc(1, sizeof(shardRequest));
+    r->client = c;
+    r->origin = me->id;
+    r->dbid = c->dbid;
+    if (c->shardRequests == NULL)
+        c->shardRequests = listCreate();
+    listAddNodeTail(c->shardRequests, listCreateNode(r));
+    if (owner == me->id) {
+        // 前面还有转发没回复，回复排在它们之后
+        r->reply = shardExecute(c->rawCmd, c->rawCmdLen, c->dbid);
+        r->done = 1;
+    } else {
+        r->cmd = sdsnewlen(c->rawCmd, c->rawCmdLen);
+        shardSend(owner, r);
+    }
+    return SHARD_ROUTE_QUEUED;
+}
+
+int shardCommandIsLocal(redisClient* c, redisCommand* cmd)
+{
+    if (cmd->firstkey == 0 || c->argc <= cmd->firstkey)
+        return 1;
+    int last = (cmd->flags & CMD_SHARD_LOCAL) ? c->argc - 1 : cmd->firstkey;
+    for (int i = cmd->firstkey; i <= last; i++) {
+        if (shardKeyOwner(c->argv[i], c->argvlen[i]) != server->shardId)
+            return 0;
+    }
+    return 1;
+}
+
+void shardsBeforeSleep(void)
+{
+    shard* me = currentShard();
+    int retry = 0;
+    for (int t = 0; t < shardsNum; t++) {
+        list* outbox = me->outbox[t];
+        if (outbox == NULL) continue;
+        listNode* node;
+        while ((node = listHead(outbox)) != NULL && spscQueuePush(shardQueue(me->id, t), node->value)) {
+            listDelNode(outbox, node);
+        }
+        if (listLength(outbox) > 0) retry = 1;
+        if (me->notify[t]) {
+            me->notify[t] = 0;
+            shardWake(t);
+        }
+    }
+    // 对方队列满，不能阻塞在epoll_wait上，唤醒自己下一轮重试
+    if (retry) shardWake(me->id);
+}
+
+void shardUnlinkClient(redisClient* c)
+{
+    if (c->shardRequests == NULL) return;
+    listNode* node;
+    while ((node = listHead(c->shardRequests)) != NULL) {
+        shardRequest* r = node->value;
+        if (r->done)
+            shardRequestFree(r);
+        else
+            r->client = NULL; // 还在其他分片处理，回复到达后释放
+        listDelNode(c->shardRequests, node);
+    }
+    listRelease(c->shardRequests);
+    c->shardRequests = NULL;
+}
+
+/**
+ * @brief 在当前线程的事件循环上注册唤醒fd，创建执行客户端
+ *
+ * @param [in] s
+ */
+static void shardInitLoop(shard* s)
+{
+    s->executor = redisFakeClientCreate();
+    s->executor->flags = REDIS_CLIENT_NORMAL; // 需要收集回复
+    if (aeCreateFileEvent(server->eventLoop, s->wakefd, AE_READABLE, shardWakeHandler, s) == AE_ERROR) {
+        log_error("Shard %d register wakefd failed", s->id);
+        exit(EXIT_FAILURE);
+    }
+    log_info("Shard %d ready", s->id);
+}
+
+static void* shardThreadMain(void* arg)
+{
+    shard* s = arg;
+    server = s->server;
+    initServerEventLoop();
+    shardInitLoop(s);
+    aeMain(server->eventLoop);
+    return NULL;
+}
+
+/**
+ * @brief 主线程作为分片0，已完成初始化。 创建分片间队列，启动其他分片线程
+ *
+ * @param [in] num
+ */
+void initShards(int num)
+{
+    shardsNum = num;
+    shards = calloc(num, sizeof(shard));
+    shardQueues = calloc((size_t)num * num, sizeof(spscQueue*));
+    for (int from = 0; from < num; from++) {
+        for (int to = 0; to < num; to++) {
+            if (from != to) shardQueues[from * num + to] = spscQueueCreate(SHARD_QUEUE_SIZE);
+        }
+    }
+    for (int i = 0; i < num; i++) {
+        shard* s = &shards[i];
+        s->id = i;
+        s->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (s->wakefd == -1) {
+            log_error("Create shard eventfd failed: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        for (int t = 0; t < num; t++) {
+            s->outbox[t] = listCreate();
+        }
+    }
+
+    shards[0].server = server;
+    shardInitLoop(&shards[0]);
+    for (int i = 1; i < num; i++) {
+        shard* s = &shards[i];
+        // 配置从分片0复制，事件循环相关状态在线程中重新初始化
+        s->server = malloc(sizeof(struct redisServer));
+        memcpy(s->server, server, sizeof(struct redisServer));
+        s->server->shardId = i;
+        if (pthread_create(&s->thread, NULL, shardThreadMain, s) != 0) {
+            log_error("Create shard thread %d failed: %s", i, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    log_info("Shards: %d", num);
+}
@@ -0,0 +1,66 @@
+/**
+ * 单生产者单消费者无锁队列
+ *  分片之间传递转发请求和回复，每个方向一条队列。
+ */
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "spsc.h"
+
+#define SPSC_CACHE_LINE 64
+
+struct spscQueue {
+    void** items;
+    size_t mask;
+    // 消费者
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t head;
+    size_t tailCache;   // 消费者上次读到的tail
+    // 生产者
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t tail;
+    size_t headCache;   // 生产者上次读到的head
+};
+
+spscQueue* spscQueueCreate(size_t cap)
+{
+    size_t size = 2;
+    while (size < cap) size <<= 1;
+    spscQueue* q = aligned_alloc(SPSC_CACHE_LINE, sizeof(spscQueue));
+    if (q == NULL) return NULL;
+    q->items = calloc(size, sizeof(void*));
+    q->mask = size - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->tailCache = 0;
+    q->headCache = 0;
+    return q;
+}
+
+void spscQueueRelease(spscQueue* q)
+{
+    if (q == NULL) return;
+    free(q->items);
+    free(q);
+}
+
+int spscQueuePush(spscQueue* q, void* item)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail - q->headCache > q->mask) {
+        q->headCache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail - q->headCache > q->mask) return 0;
+    }
+    q->items[tail & q->mask] = item;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+void* spscQueuePop(spscQueue* q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == q->tailCache) {
+        q->tailCache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (head == q->tailCache) return NULL;
+    }
+    void* item = q->items[head & q->mask];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return item;
+}
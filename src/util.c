@@ -7,6 +7,7 @@
 #include <strings.h>
 #include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include  <stdbool.h>
 /**
  * 打印字符数组缓冲区内容，格式化输出字符和十六进制值
@@ -78,6 +79,17 @@ long long mstime(void) {
     return ((long long)tv.tv_sec) * 1000 + (tv.tv_usec / 1000);
 }
 
+/**
+ * @brief 返回当前us级时间戳
+ *
+ * @return long long
+ */
+long long ustime(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((long long)tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
 // 去除字符串中空白字符,
 void strim(char *s)
 {
@@ -114,3 +126,87 @@ bool string2long(const char*s, long* out)
     return true;
 }
 
+
+/**
+ * 非'\0'结尾的字符串安全转10进制。 用于命令参数视图
+ * @param s
+ * @param len
+ * @param out
+ * @return 是否成功
+ */
+bool string2longLen(const char* s, size_t len, long* out)
+{
+    char buf[32];
+    if (len == 0 || len >= sizeof(buf)) return false;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    return string2long(buf, out);
+}
+
+/**
+ * 带单位的内存大小转字节数： 100, 1k, 1kb, 64mb, 2gb。 单位大小写不敏感，k/m/g均为1024进制
+ * @param s
+ * @param out
+ * @return 是否成功
+ */
+bool memtoull(const char* s, unsigned long long* out)
+{
+    char* endptr;
+    errno = 0;
+    unsigned long long val = strtoull(s, &endptr, 10);
+    if (s == endptr || errno == ERANGE || *s == '-') return false;
+    unsigned long long mul;
+    if (*endptr == '\0' || !strcasecmp(endptr, "b")) mul = 1;
+    else if (!strcasecmp(endptr, "k") || !strcasecmp(endptr, "kb")) mul = 1024;
+    else if (!strcasecmp(endptr, "m") || !strcasecmp(endptr, "mb")) mul = 1024 * 1024;
+    else if (!strcasecmp(endptr, "g") || !strcasecmp(endptr, "gb")) mul = 1024ULL * 1024 * 1024;
+    else return false;
+    *out = val * mul;
+    return true;
+}
+
+/**
+ * 生成len个随机十六进制字符，不追加'\0'。 优先读/dev/urandom，失败时退化为rand
+ * @param p
+ * @param len
+ */
+void getRandomHexChars(char* p, size_t len)
+{
+    static const char charset[] = "0123456789abcdef";
+    unsigned char* b = (unsigned char*)p;
+    FILE* fp = fopen("/dev/urandom", "r");
+    if (fp == NULL || fread(b, len, 1, fp) != 1) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        srand(tv.tv_sec ^ tv.tv_usec ^ getpid());
+        for (size_t i = 0; i < len; i++) b[i] = rand();
+    }
+    if (fp) fclose(fp);
+    for (size_t i = 0; i < len; i++) p[i] = charset[b[i] & 0x0F];
+}
+
+/**
+ * 在分多次到达的数据中查找标记。 *scanned是已经确认不含标记起点的字节数，下次从这里继续，
+ * 每个字节只扫描一次；标记跨两次到达时停在可能的起点，等数据补齐
+ * @param buf 已到达的数据
+ * @param len
+ * @param mark
+ * @param marklen
+ * @param scanned 找不到时更新
+ * @return 标记在buf中的位置，-1表示还没有完整出现
+ */
+long memFindIncremental(const char* buf, size_t len, const char* mark, size_t marklen, size_t* scanned)
+{
+    const char* end = buf + len;
+    const char* p = buf + *scanned;
+    while ((p = memchr(p, mark[0], end - p)) != NULL)
+    {
+        if ((size_t)(end - p) < marklen)
+            break;
+        if (memcmp(p, mark, marklen) == 0)
+            return p - buf;
+        p++;
+    }
+    *scanned = (p ? p : end) - buf;
+    return -1;
+}
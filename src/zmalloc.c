@@ -0,0 +1,344 @@
+/**
+ * 带统计的分配器，小对象按大小分级的slab
+ *
+ * slab结构：
+ *  每个大小级的对象从64KB的slab页中切分，页内没有任何头部。 页表按地址的高位记录每个slab页的大小级，
+ *  zfree查页表就知道指针是不是slab对象、多大。
+ *  每个线程每个大小级一个缓存：空闲链表(复用释放的对象，链表指针存在对象本身) + 当前页的切分位置。
+ *  分配、释放都只访问线程本地的缓存，不加锁；对象可以在一个线程分配、另一个线程释放，释放后归属释放线程。
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "zmalloc.h"
+#include "log.h"
+
+static _Atomic size_t usedMemory = 0;
+static int allocMode = ZMALLOC_LIBC;
+
+static const char* modeNames[] = {
+    [ZMALLOC_LIBC] = "libc",
+    [ZMALLOC_SLAB] = "slab",
+    [ZMALLOC_ARENA] = "arena",
+};
+
+/* ---------------- 大小级 ---------------- */
+
+static const unsigned short classSize[ZMALLOC_SLAB_CLASSES] = {
+    8, 16, 24, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256
+};
+static unsigned char sizeToClass[ZMALLOC_SLAB_MAX / 8 + 1];    // (size+7)/8 -> 大小级
+
+static _Atomic size_t classPages[ZMALLOC_SLAB_CLASSES];
+static _Atomic size_t classInuse[ZMALLOC_SLAB_CLASSES];
+
+typedef struct slabCache {
+    void* freelist;     // 释放的对象，第一个字存下一个
+    char* bump;         // 当前页中下一个没切分的对象
+    char* end;
+} slabCache;
+
+static __thread slabCache slabCaches[ZMALLOC_SLAB_CLASSES];
+
+/* ---------------- 页表 ----------------
+ * 用户态地址47位，slab页64KB对齐，页号31位： 高15位索引根，低16位索引叶子。
+ * 叶子按需创建，值为大小级+1，0表示不是slab页。 页只会登记一次，读不需要加锁
+ */
+#define PAGEMAP_SHIFT 16
+#define PAGEMAP_LEAF_BITS 16
+#define PAGEMAP_ROOT_SIZE (1 << 15)
+
+static _Atomic(unsigned char*) pagemap[PAGEMAP_ROOT_SIZE];
+
+static inline int slabClassOf(const void* ptr)
+{
+    uintptr_t page = (uintptr_t)ptr >> PAGEMAP_SHIFT;
+    uintptr_t root = page >> PAGEMAP_LEAF_BITS;
+    if (root >= PAGEMAP_ROOT_SIZE) return -1;
+    unsigned char* leaf = atomic_load_explicit(&pagemap[root], memory_order_acquire);
+    if (leaf == NULL) return -1;
+    return (int)leaf[page & ((1 << PAGEMAP_LEAF_BITS) - 1)] - 1;
+}
+
+static void pagemapSet(void* page, int cls)
+{
+    uintptr_t idx = (uintptr_t)page >> PAGEMAP_SHIFT;
+    uintptr_t root = idx >> PAGEMAP_LEAF_BITS;
+    unsigned char* leaf = atomic_load_explicit(&pagemap[root], memory_order_acquire);
+    if (leaf == NULL) {
+        unsigned char* fresh = calloc(1, 1 << PAGEMAP_LEAF_BITS);
+        if (fresh == NULL) abort();
+        if (atomic_compare_exchange_strong(&pagemap[root], &leaf, fresh))
+            leaf = fresh;
+        else
+            free(fresh);    // 其他线程先创建了
+    }
+    leaf[idx & ((1 << PAGEMAP_LEAF_BITS) - 1)] = (unsigned char)(cls + 1);
+}
+
+/* ---------------- arena ---------------- */
+
+static char* arenaBase;
+static size_t arenaSize;
+static _Atomic size_t arenaUsed;
+
+static void zmallocOom(size_t size)
+{
+    log_error("zmalloc: out of memory trying to allocate %zu bytes", size);
+    abort();
+}
+
+/**
+ * @brief 新的slab页。 arena模式从预留区间切分，用完后退回按页分配
+ *
+ * @param [in] cls
+ * @return char*
+ */
+static char* slabPageAlloc(int cls)
+{
+    char* page = NULL;
+    if (arenaBase) {
+        size_t off = atomic_fetch_add(&arenaUsed, ZMALLOC_SLAB_PAGE_SIZE);
+        if (off + ZMALLOC_SLAB_PAGE_SIZE <= arenaSize)
+            page = arenaBase + off;
+    }
+    if (page == NULL) {
+        page = aligned_alloc(ZMALLOC_SLAB_PAGE_SIZE, ZMALLOC_SLAB_PAGE_SIZE);
+        if (page == NULL) zmallocOom(ZMALLOC_SLAB_PAGE_SIZE);
+    }
+    pagemapSet(page, cls);
+    atomic_fetch_add_explicit(&classPages[cls], 1, memory_order_relaxed);
+    return page;
+}
+
+static void* slabAlloc(int cls)
+{
+    slabCache* c = &slabCaches[cls];
+    void* ptr = c->freelist;
+    if (ptr) {
+        c->freelist = *(void**)ptr;
+    } else {
+        size_t size = classSize[cls];
+        if (c->bump == NULL || c->bump + size > c->end) {
+            c->bump = slabPageAlloc(cls);
+            c->end = c->bump + ZMALLOC_SLAB_PAGE_SIZE / size * size;
+        }
+        ptr = c->bump;
+        c->bump += size;
+    }
+    atomic_fetch_add_explicit(&classInuse[cls], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&usedMemory, classSize[cls], memory_order_relaxed);
+    return ptr;
+}
+
+static void slabFree(void* ptr, int cls)
+{
+    slabCache* c = &slabCaches[cls];
+    *(void**)ptr = c->freelist;
+    c->freelist = ptr;
+    atomic_fetch_sub_explicit(&classInuse[cls], 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&usedMemory, classSize[cls], memory_order_relaxed);
+}
+
+/* ---------------- 接口 ---------------- */
+
+static inline int slabEnabledFor(size_t size)
+{
+    return allocMode != ZMALLOC_LIBC && size <= ZMALLOC_SLAB_MAX;
+}
+
+static inline void updateAlloc(void* ptr)
+{
+    atomic_fetch_add_explicit(&usedMemory, malloc_usable_size(ptr), memory_order_relaxed);
+}
+
+static inline void updateFree(void* ptr)
+{
+    atomic_fetch_sub_explicit(&usedMemory, malloc_usable_size(ptr), memory_order_relaxed);
+}
+
+void* zmalloc(size_t size)
+{
+    if (slabEnabledFor(size))
+        return slabAlloc(sizeToClass[(size + 7) / 8]);
+    void* ptr = malloc(size);
+    if (ptr == NULL) zmallocOom(size);
+    updateAlloc(ptr);
+    return ptr;
+}
+
+void* zcalloc(size_t nmemb, size_t size)
+{
+    // 和calloc一样，nmemb * size溢出时失败，不能返回回绕后更小的块
+    if (size && nmemb > SIZE_MAX / size)
+        zmallocOom(SIZE_MAX);
+    if (slabEnabledFor(nmemb * size)) {
+        void* ptr = zmalloc(nmemb * size);
+        memset(ptr, 0, nmemb * size);
+        return ptr;
+    }
+    void* ptr = calloc(nmemb, size);
+    if (ptr == NULL) zmallocOom(nmemb * size);
+    updateAlloc(ptr);
+    return ptr;
+}
+
+void* zrealloc(void* ptr, size_t size)
+{
+    if (ptr == NULL) return zmalloc(size);
+    int cls = slabClassOf(ptr);
+    if (cls >= 0 || slabEnabledFor(size)) {
+        // 涉及slab对象：大小级不变时原地返回，否则重新分配并拷贝
+        size_t oldsize = cls >= 0 ? classSize[cls] : malloc_usable_size(ptr);
+        if (cls >= 0 && size <= oldsize && slabEnabledFor(size) && sizeToClass[(size + 7) / 8] == cls)
+            return ptr;
+        void* newptr = zmalloc(size);
+        memcpy(newptr, ptr, oldsize < size ? oldsize : size);
+        zfree(ptr);
+        return newptr;
+    }
+    size_t oldsize = malloc_usable_size(ptr);
+    void* newptr = realloc(ptr, size);
+    if (newptr == NULL) zmallocOom(size);
+    atomic_fetch_sub_explicit(&usedMemory, oldsize, memory_order_relaxed);
+    updateAlloc(newptr);
+    return newptr;
+}
+
+void* zalignedAlloc(size_t alignment, size_t size)
+{
+    void* ptr = aligned_alloc(alignment, size);
+    if (ptr == NULL) zmallocOom(size);
+    updateAlloc(ptr);
+    return ptr;
+}
+
+void zfree(void* ptr)
+{
+    if (ptr == NULL) return;
+    int cls = slabClassOf(ptr);
+    if (cls >= 0) {
+        slabFree(ptr, cls);
+        return;
+    }
+    updateFree(ptr);
+    free(ptr);
+}
+
+char* zstrdup(const char* s)
+{
+    size_t len = strlen(s) + 1;
+    char* p = zmalloc(len);
+    memcpy(p, s, len);
+    return p;
+}
+
+/**
+ * @brief 分配给ptr的实际字节数
+ *
+ * @param [in] ptr
+ * @return size_t
+ */
+size_t zmallocSize(void* ptr)
+{
+    int cls = slabClassOf(ptr);
+    return cls >= 0 ? classSize[cls] : malloc_usable_size(ptr);
+}
+
+/**
+ * @brief 当前经过zmalloc分配、还没释放的字节数。 slab对象按大小级计算
+ *
+ * @return size_t
+ */
+size_t zmallocUsedMemory(void)
+{
+    return atomic_load_explicit(&usedMemory, memory_order_relaxed);
+}
+
+/**
+ * @brief 选择分配模式。 在创建其他线程之前调用一次
+ *
+ * @param [in] mode ZMALLOC_*
+ * @param [in] size arena模式预留的地址空间，0使用ZMALLOC_ARENA_SIZE
+ * @return int 0成功；arena预留失败时退回slab模式，返回-1
+ */
+int zmallocInit(int mode, size_t size)
+{
+    for (int cls = 0, s = 0; s <= ZMALLOC_SLAB_MAX / 8; s++) {
+        while (classSize[cls] < s * 8) cls++;
+        sizeToClass[s] = (unsigned char)cls;
+    }
+    allocMode = mode;
+    if (mode != ZMALLOC_ARENA || arenaBase) return 0;
+
+    arenaSize = size ? size : ZMALLOC_ARENA_SIZE;
+    arenaSize -= arenaSize % ZMALLOC_SLAB_PAGE_SIZE;
+    // 只预留地址空间，物理内存在访问时才分配. 多预留一页用于对齐
+    char* p = mmap(NULL, arenaSize + ZMALLOC_SLAB_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        log_warn("zmalloc: reserve %zu bytes arena failed, use slab mode", arenaSize);
+        allocMode = ZMALLOC_SLAB;
+        return -1;
+    }
+    arenaBase = (char*)(((uintptr_t)p + ZMALLOC_SLAB_PAGE_SIZE - 1) & ~((uintptr_t)ZMALLOC_SLAB_PAGE_SIZE - 1));
+#ifdef MADV_HUGEPAGE
+    madvise(arenaBase, arenaSize, MADV_HUGEPAGE);
+#endif
+    return 0;
+}
+
+int zmallocModeFromString(const char* s)
+{
+    for (int i = 0; i < (int)(sizeof(modeNames) / sizeof(modeNames[0])); i++) {
+        if (strcasecmp(s, modeNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char* zmallocModeName(void)
+{
+    return modeNames[allocMode];
+}
+
+const char* zmallocModeToString(int mode)
+{
+    return mode >= 0 && mode < (int)(sizeof(modeNames) / sizeof(modeNames[0])) ? modeNames[mode] : "unknown";
+}
+
+/**
+ * @brief 进程常驻内存，读取/proc/self/statm
+ *
+ * @return size_t 读取失败返回0
+ */
+size_t zmallocGetRss(void)
+{
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f == NULL) return 0;
+    unsigned long size, resident = 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief 大小级的占用情况
+ *
+ * @param [in] cls
+ * @param [out] size 对象大小
+ * @param [out] pages slab页数
+ * @param [out] inuse 已分配的对象数
+ */
+void zmallocClassStats(int cls, size_t* size, size_t* pages, size_t* inuse)
+{
+    *size = classSize[cls];
+    *pages = atomic_load_explicit(&classPages[cls], memory_order_relaxed);
+    *inuse = atomic_load_explicit(&classInuse[cls], memory_order_relaxed);
+}
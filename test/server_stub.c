@@ -0,0 +1,176 @@
+/**
+ * @file server_stub.c
+ * @brief 单元测试的桩。 config.c、replbacklog.c直接链接进unit_tests，server和其他模块的函数在这里提供
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "server_stub.h"
+#include "config.h"
+#include "redis.h"
+#include "aof.h"
+#include "evict.h"
+#include "repli.h"
+#include "client.h"
+#include "ringbuffer.h"
+
+__thread struct redisServer* server;
+
+int stubFsyncPolicyChanged;
+int stubBacklogResized;
+int stubEvictions;
+
+static sds lastReply;    // 这次调用写入回复队列的内容，NULL表示没有写入
+
+/**
+ * @brief 清零server和计数，之后由loadServerConfig填入默认值
+ */
+void stubServerReset(void)
+{
+    if (server && server->replBacklog)
+        ringBufferFree(server->replBacklog);
+    free(server);
+    server = calloc(1, sizeof(struct redisServer));
+    server->shardsNum = 1;
+    stubFsyncPolicyChanged = 0;
+    stubBacklogResized = 0;
+    stubEvictions = 0;
+}
+
+/**
+ * @brief 执行CONFIG GET pattern
+ *
+ * @param [in] pattern
+ * @return sds 完整的RESP回复，调用者释放
+ */
+sds stubConfigGet(const char* pattern)
+{
+    char* argv[3] = {"CONFIG", "GET", (char*)pattern};
+    size_t argvlen[3] = {6, 3, strlen(pattern)};
+    redisClient c;
+    memset(&c, 0, sizeof(c));
+    c.argv = argv;
+    c.argvlen = argvlen;
+    c.argc = 3;
+    lastReply = NULL;
+    configGetCommand(&c);
+    return lastReply;
+}
+
+/**
+ * @brief 设置复制ID和offset，创建size字节的积压缓冲区(保存size-1字节)
+ */
+void stubReplicationSetup(const char* replid, const char* replid2, long secondReplidOffset,
+                          long offset, long backlogSize)
+{
+    snprintf(server->replid, sizeof(server->replid), "%s", replid);
+    snprintf(server->replid2, sizeof(server->replid2), "%s", replid2);
+    server->secondReplidOffset = secondReplidOffset;
+    server->offset = offset;
+    if (server->replBacklog)
+        ringBufferFree(server->replBacklog);
+    server->replBacklog = backlogSize ? ringBufferCreateSize(backlogSize) : NULL;
+}
+
+long stubReplicationOffset(void)
+{
+    return server->offset;
+}
+
+/**
+ * @brief 从发来PSYNC replid offset
+ *
+ * @param [out] reply 放进从的回复队列的全部内容，没有时为空串，调用者释放
+ * @return bool 是否增量同步
+ */
+bool stubTryPartialResync(const char* replid, long offset, sds* reply)
+{
+    redisClient c;
+    memset(&c, 0, sizeof(c));
+    c.ip = "127.0.0.1";
+    c.port = 7000;
+    lastReply = NULL;
+    bool ok = masterTryPartialResync(&c, replid, offset);
+    *reply = lastReply ? lastReply : sdsempty();
+    return ok;
+}
+
+void addWrite(redisClient* client, char* s)
+{
+    addWriteBuf(client, s, strlen(s));
+}
+
+void addWriteBuf(redisClient* client, const char* buf, size_t len)
+{
+    (void)client;
+    lastReply = lastReply ? sdscatlen(lastReply, buf, len) : sdsnewlen(buf, len);
+}
+
+void addWriteSds(redisClient* client, sds s)
+{
+    addWriteBuf(client, s, sdslen(s));
+    sdsfree(s);
+}
+
+int aofFsyncPolicyFromString(const char* s)
+{
+    if (!strcasecmp(s, "always")) return AOF_FSYNC_ALWAYS;
+    if (!strcasecmp(s, "everysec")) return AOF_FSYNC_EVERYSEC;
+    if (!strcasecmp(s, "no")) return AOF_FSYNC_NO;
+    return -1;
+}
+
+const char* aofFsyncPolicyToString(int policy)
+{
+    switch (policy) {
+    case AOF_FSYNC_ALWAYS: return "always";
+    case AOF_FSYNC_NO: return "no";
+    default: return "everysec";
+    }
+}
+
+void aofFsyncPolicyChanged(void)
+{
+    stubFsyncPolicyChanged++;
+}
+
+static const char* policyNames[] = {
+    [MAXMEMORY_NO_EVICTION] = "noeviction",
+    [MAXMEMORY_ALLKEYS_LRU] = "allkeys-lru",
+    [MAXMEMORY_VOLATILE_LRU] = "volatile-lru",
+    [MAXMEMORY_ALLKEYS_RANDOM] = "allkeys-random",
+    [MAXMEMORY_VOLATILE_TTL] = "volatile-ttl",
+    [MAXMEMORY_ALLKEYS_LFU] = "allkeys-lfu",
+    [MAXMEMORY_VOLATILE_LFU] = "volatile-lfu",
+};
+
+int maxmemoryPolicyFromString(const char* s)
+{
+    for (int i = 0; i < (int)(sizeof(policyNames) / sizeof(policyNames[0])); i++) {
+        if (strcasecmp(s, policyNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char* maxmemoryPolicyToString(int policy)
+{
+    return policyNames[policy];
+}
+
+int policyUsesObjectAccess(int policy)
+{
+    return policy != MAXMEMORY_NO_EVICTION && policy != MAXMEMORY_ALLKEYS_RANDOM &&
+           policy != MAXMEMORY_VOLATILE_TTL;
+}
+
+int performEvictions(void)
+{
+    stubEvictions++;
+    return EVICT_OK;
+}
+
+void resizeReplicationBacklog(void)
+{
+    stubBacklogResized++;
+}
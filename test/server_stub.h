@@ -0,0 +1,21 @@
+/**
+ * 单元测试使用的桩: 直接链接的config.c、replbacklog.c引用的server和aof/evict/repli/client函数。
+ *  apply回调只计数，写入回复队列的内容保存下来给测试检查
+ */
+#ifndef FEDIS_SERVER_STUB_H
+#define FEDIS_SERVER_STUB_H
+#include <stdbool.h>
+#include "sds.h"
+
+extern int stubFsyncPolicyChanged;  // aofFsyncPolicyChanged调用次数
+extern int stubBacklogResized;      // resizeReplicationBacklog调用次数
+extern int stubEvictions;           // performEvictions调用次数
+
+void stubServerReset(void);
+sds stubConfigGet(const char* pattern);
+void stubReplicationSetup(const char* replid, const char* replid2, long secondReplidOffset,
+                          long offset, long backlogSize);
+long stubReplicationOffset(void);
+bool stubTryPartialResync(const char* replid, long offset, sds* reply);
+
+#endif //FEDIS_SERVER_STUB_H
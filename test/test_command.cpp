@@ -1,12 +1,95 @@
 #include <gtest/gtest.h>
 extern "C" {
 #include <string.h>
+#include <strings.h>
 #include "resp.h"
 #include "log.h"
 #include "redis.h"
 }
 
-TEST(CommandTest, Set)
+static void nopProc(redisClient* c) { (void)c; }
+
+static redisCommand testCmds[] = {
+    {CMD_WRITE | CMD_MASTER, "SET", nopProc, 3},
+    {CMD_READ | CMD_MASTER | CMD_SLAVE, "GET", nopProc, 2},
+    {CMD_WRITE | CMD_MASTER, "DEL", nopProc, -2},
+    {CMD_MASTER | CMD_SLAVE, "PING", nopProc, 1},
+};
+#define TEST_CMDS_N ((int)(sizeof(testCmds) / sizeof(testCmds[0])))
+
+/* 测试结束时释放表，ASSERT提前返回也不泄漏 */
+struct TableGuard {
+    commandTable* t;
+    ~TableGuard() { commandTableRelease(t); }
+};
+
+TEST(CommandTest, FindCaseInsensitive)
+{
+    commandTable* t = commandTableCreate(testCmds, TEST_CMDS_N, REDIS_CLUSTER_MASTER);
+    TableGuard guard{t};
+    ASSERT_NE(t, nullptr);
+    EXPECT_EQ(t->used, (unsigned long)TEST_CMDS_N);
+
+    commandTableEntry* e = commandTableFind(t, "set", 3);
+    ASSERT_NE(e, nullptr);
+    EXPECT_EQ(e->cmd, &testCmds[0]);
+    e = commandTableFind(t, "GeT", 3);
+    ASSERT_NE(e, nullptr);
+    EXPECT_EQ(e->cmd, &testCmds[1]);
+
+    EXPECT_EQ(commandTableFind(t, "SETX", 4), nullptr);
+    EXPECT_EQ(commandTableFind(t, "SE", 2), nullptr);
+    EXPECT_EQ(commandTableFind(t, "", 0), nullptr);
+}
+
+TEST(CommandTest, FindByView)
 {
-    // 构建一个为客户端伪劣客户端，不需要server
-}
\ No newline at end of file
+    commandTable* t = commandTableCreate(testCmds, TEST_CMDS_N, REDIS_CLUSTER_MASTER);
+    TableGuard guard{t};
+    // argv[0]是查询缓冲区中的视图，不以'\0'结尾
+    const char buf[] = "pingdel";
+    commandTableEntry* e = commandTableFind(t, buf, 4);
+    ASSERT_NE(e, nullptr);
+    EXPECT_EQ(e->cmd, &testCmds[3]);
+    e = commandTableFind(t, buf + 4, 3);
+    ASSERT_NE(e, nullptr);
+    EXPECT_EQ(e->cmd, &testCmds[2]);
+}
+
+TEST(CommandTest, Arity)
+{
+    EXPECT_TRUE(commandCheckArity(&testCmds[0], 3));
+    EXPECT_FALSE(commandCheckArity(&testCmds[0], 2));
+    EXPECT_FALSE(commandCheckArity(&testCmds[0], 4));
+    // 变长
+    EXPECT_FALSE(commandCheckArity(&testCmds[2], 1));
+    EXPECT_TRUE(commandCheckArity(&testCmds[2], 2));
+    EXPECT_TRUE(commandCheckArity(&testCmds[2], 10));
+}
+
+TEST(CommandTest, RejectFlagsByRole)
+{
+    commandTable* t = commandTableCreate(testCmds, TEST_CMDS_N, REDIS_CLUSTER_MASTER);
+    EXPECT_EQ(commandTableFind(t, "SET", 3)->rejectClientFlags, 0);
+    commandTableRelease(t);
+
+    // 从服务器：普通客户端不能写, 主服务器同步过来的写命令可以
+    t = commandTableCreate(testCmds, TEST_CMDS_N, REDIS_CLUSTER_SLAVE);
+    commandTableEntry* e = commandTableFind(t, "SET", 3);
+    EXPECT_TRUE(e->rejectClientFlags & REDIS_CLIENT_NORMAL);
+    EXPECT_FALSE(e->rejectClientFlags & REDIS_CLIENT_MASTER);
+    EXPECT_EQ(commandTableFind(t, "GET", 3)->rejectClientFlags, 0);
+    commandTableRelease(t);
+}
+
+TEST(CommandTest, DuplicateIgnored)
+{
+    redisCommand dup[] = {
+        {CMD_MASTER, "PING", nopProc, 1},
+        {CMD_MASTER, "ping", nopProc, 2},
+    };
+    commandTable* t = commandTableCreate(dup, 2, REDIS_CLUSTER_MASTER);
+    EXPECT_EQ(t->used, 1ul);
+    EXPECT_EQ(commandTableFind(t, "PING", 4)->cmd, &dup[0]);
+    commandTableRelease(t);
+}
@@ -21,4 +21,20 @@ TEST(ConfTest, conf)
     EXPECT_STREQ(role, "slave");
     free(role);
     free(filename);
-}
\ No newline at end of file
+}
+
+TEST(ConfTest, MemoryUnits)
+{
+    unsigned long long v;
+    ASSERT_TRUE(memtoull("100", &v));
+    EXPECT_EQ(v, 100u);
+    ASSERT_TRUE(memtoull("1kb", &v));
+    EXPECT_EQ(v, 1024u);
+    ASSERT_TRUE(memtoull("64M", &v));
+    EXPECT_EQ(v, 64u * 1024 * 1024);
+    ASSERT_TRUE(memtoull("2gb", &v));
+    EXPECT_EQ(v, 2ull * 1024 * 1024 * 1024);
+    EXPECT_FALSE(memtoull("", &v));
+    EXPECT_FALSE(memtoull("-1", &v));
+    EXPECT_FALSE(memtoull("10tb", &v));
+}
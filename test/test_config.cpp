@@ -0,0 +1,218 @@
+/**
+ * 测试 配置表: CONFIG SET/GET/REWRITE
+ *  config.c直接链接，server和apply回调用server_stub.c中的桩
+ */
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+extern "C" {
+#include "config.h"
+#include "server_stub.h"
+#include "zmalloc.h"
+}
+
+class ConfigTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        snprintf(path, sizeof(path), "/tmp/fedis-config-XXXXXX");
+        int fd = mkstemp(path);
+        ASSERT_NE(fd, -1);
+        close(fd);
+        stubServerReset();
+    }
+    void TearDown() override
+    {
+        unlink(path);
+    }
+    void writeConfig(const std::string& s)
+    {
+        FILE* f = fopen(path, "w");
+        ASSERT_NE(f, nullptr);
+        fwrite(s.data(), 1, s.size(), f);
+        fclose(f);
+    }
+    std::string readConfig()
+    {
+        std::string s;
+        FILE* f = fopen(path, "r");
+        if (!f) return s;
+        char tmp[4096];
+        size_t n;
+        while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0) s.append(tmp, n);
+        fclose(f);
+        return s;
+    }
+    // CONFIG GET name，只有一项匹配时返回它的值
+    std::string get(const char* name)
+    {
+        sds reply = stubConfigGet(name);
+        std::string r(reply, sdslen(reply));
+        sdsfree(reply);
+        std::string prefix = "*2\r\n$" + std::to_string(strlen(name)) + "\r\n" + name + "\r\n$";
+        if (r.compare(0, prefix.size(), prefix) != 0) return "(no match) " + r;
+        size_t body = r.find("\r\n", prefix.size()) + 2;
+        return r.substr(body, r.size() - body - 2);
+    }
+    int set(const char* name, const char* value)
+    {
+        err = nullptr;
+        return configSetValue(name, value, &err);
+    }
+    char path[64];
+    const char* err = nullptr;
+};
+
+// SET之后GET读到新值；内存大小GET返回字节数
+TEST_F(ConfigTest, SetGetRoundTrip)
+{
+    writeConfig("");
+    ASSERT_EQ(loadServerConfig(path), 0);
+    EXPECT_EQ(get("maxmemory"), "0");
+    EXPECT_EQ(get("appendfsync"), "everysec");
+
+    EXPECT_EQ(set("maxmemory", "100mb"), 0);
+    EXPECT_EQ(get("maxmemory"), "104857600");
+    EXPECT_EQ(set("appendfsync", "no"), 0);
+    EXPECT_EQ(get("appendfsync"), "no");
+    EXPECT_EQ(set("activerehashing", "no"), 0);
+    EXPECT_EQ(get("activerehashing"), "no");
+    EXPECT_EQ(set("MAXMEMORY-SAMPLES", "7"), 0);
+    EXPECT_EQ(get("maxmemory-samples"), "7");
+    EXPECT_EQ(set("maxmemory-policy", "allkeys-lfu"), 0);
+    EXPECT_EQ(get("maxmemory-policy"), "allkeys-lfu");
+    EXPECT_EQ(set("save", "60 5 10 100"), 0);
+    EXPECT_EQ(get("save"), "60 5 10 100");
+    EXPECT_EQ(set("save", ""), 0);
+    EXPECT_EQ(get("save"), "");
+}
+
+// 模式按配置表的顺序匹配，名字小写后比较
+TEST_F(ConfigTest, GetPattern)
+{
+    writeConfig("maxmemory-samples=9\n");
+    ASSERT_EQ(loadServerConfig(path), 0);
+    sds reply = stubConfigGet("MAXMEMORY*");
+    EXPECT_EQ(std::string(reply, sdslen(reply)),
+              "*6\r\n$9\r\nmaxmemory\r\n$1\r\n0\r\n"
+              "$16\r\nmaxmemory-policy\r\n$10\r\nnoeviction\r\n"
+              "$17\r\nmaxmemory-samples\r\n$1\r\n9\r\n");
+    sdsfree(reply);
+    reply = stubConfigGet("no-such-*");
+    EXPECT_EQ(std::string(reply, sdslen(reply)), "*0\r\n");
+    sdsfree(reply);
+}
+
+// SET成功后调用apply，失败不调用
+TEST_F(ConfigTest, ApplyCallbacks)
+{
+    writeConfig("");
+    ASSERT_EQ(loadServerConfig(path), 0);
+
+    EXPECT_EQ(set("appendfsync", "always"), 0);
+    EXPECT_EQ(stubFsyncPolicyChanged, 1);
+    EXPECT_NE(set("appendfsync", "sometimes"), 0);
+    EXPECT_EQ(stubFsyncPolicyChanged, 1);
+
+    EXPECT_EQ(set("repl-backlog-size", "2mb"), 0);
+    EXPECT_EQ(stubBacklogResized, 1);
+    EXPECT_EQ(get("repl-backlog-size"), "2097152");
+
+    // 当前内存超过新的maxmemory时立即淘汰，0表示不限制
+    void* used = zmalloc(64);
+    EXPECT_EQ(set("maxmemory", "1"), 0);
+    EXPECT_EQ(stubEvictions, 1);
+    EXPECT_EQ(set("maxmemory", "0"), 0);
+    EXPECT_EQ(set("maxmemory", "1gb"), 0);
+    EXPECT_EQ(stubEvictions, 1);
+    zfree(used);
+}
+
+// 不可修改、越界、格式错误的值被拒绝，原值不变
+TEST_F(ConfigTest, RejectInvalid)
+{
+    writeConfig("port=7000\n");
+    ASSERT_EQ(loadServerConfig(path), 0);
+
+    EXPECT_EQ(set("port", "7001"), -1);
+    EXPECT_STREQ(err, "can't set immutable config");
+    EXPECT_EQ(get("port"), "7000");
+    EXPECT_EQ(set("consistency", "aof"), -1);
+    EXPECT_STREQ(err, "can't set immutable config");
+
+    EXPECT_EQ(set("maxmemory-samples", "0"), -1);
+    EXPECT_STREQ(err, "argument out of range");
+    EXPECT_EQ(set("maxmemory-samples", "2147483648"), -1);
+    EXPECT_EQ(get("maxmemory-samples"), "5");
+    EXPECT_EQ(set("maxmemory-samples", "five"), -1);
+    EXPECT_STREQ(err, "argument couldn't be parsed into an integer");
+
+    EXPECT_EQ(set("activerehashing", "maybe"), -1);
+    EXPECT_STREQ(err, "argument must be 'yes' or 'no'");
+    EXPECT_EQ(get("activerehashing"), "yes");
+    EXPECT_EQ(set("maxmemory", "lots"), -1);
+    EXPECT_EQ(get("maxmemory"), "0");
+    EXPECT_EQ(set("maxmemory-policy", "lru"), -1);
+    EXPECT_EQ(get("maxmemory-policy"), "noeviction");
+    EXPECT_EQ(set("save", "60"), -1);
+    EXPECT_EQ(get("save"), "900 1 300 10000 10 1");
+
+    EXPECT_EQ(set("no-such-option", "1"), -1);
+    EXPECT_STREQ(err, "Unknown option");
+    EXPECT_EQ(stubFsyncPolicyChanged + stubBacklogResized + stubEvictions, 0);
+}
+
+// REWRITE保留注释、空行和不认识的行，已有的项原地替换、重复的只留第一处，不是默认值的追加到末尾
+TEST_F(ConfigTest, Rewrite)
+{
+    writeConfig("# fedis test config\n"
+                "port=7000\n"
+                "maxmemory = 1mb\n"
+                "  # indented comment\n"
+                "unknown-option=1\n"
+                "maxmemory=2mb\n"
+                "\n"
+                "appendfsync=always\n"
+                "activerehashing=yes");
+    ASSERT_EQ(loadServerConfig(path), 0);
+    EXPECT_EQ(get("maxmemory"), "2097152");
+
+    EXPECT_EQ(set("maxmemory", "3mb"), 0);
+    EXPECT_EQ(set("appendfsync", "no"), 0);
+    EXPECT_EQ(set("maxmemory-samples", "7"), 0);
+    EXPECT_EQ(set("save", "60 5"), 0);
+    ASSERT_EQ(configRewrite(path), 0);
+    const std::string rewritten = "# fedis test config\n"
+                                  "port=7000\n"
+                                  "maxmemory=3mb\n"
+                                  "  # indented comment\n"
+                                  "unknown-option=1\n"
+                                  "\n"
+                                  "appendfsync=no\n"
+                                  "activerehashing=yes\n"
+                                  "save=60 5\n"
+                                  "maxmemory-samples=7\n";
+    EXPECT_EQ(readConfig(), rewritten);
+
+    // 重新加载得到相同的配置，再次REWRITE不变
+    stubServerReset();
+    ASSERT_EQ(loadServerConfig(path), 0);
+    EXPECT_EQ(get("maxmemory"), "3145728");
+    EXPECT_EQ(get("appendfsync"), "no");
+    EXPECT_EQ(get("save"), "60 5");
+    ASSERT_EQ(configRewrite(path), 0);
+    EXPECT_EQ(readConfig(), rewritten);
+}
+
+// 文件不存在时只写入不是默认值的项
+TEST_F(ConfigTest, RewriteMissingFile)
+{
+    writeConfig("");
+    ASSERT_EQ(loadServerConfig(path), 0);
+    unlink(path);
+    EXPECT_EQ(set("lfu-log-factor", "20"), 0);
+    ASSERT_EQ(configRewrite(path), 0);
+    EXPECT_EQ(readConfig(), "lfu-log-factor=20\n");
+}
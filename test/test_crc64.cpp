@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+extern "C" {
+#include "crc64.h"
+#include "rio.h"
+}
+
+// 逐位计算的参考实现
+static uint64_t crc64Bitwise(uint64_t crc, const unsigned char* p, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        for (int j = 0; j < 8; j++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0x95ac9329ac4bc9b5ULL : crc >> 1;
+    }
+    return crc;
+}
+
+TEST(Crc64Test, CheckValue)
+{
+    EXPECT_EQ(crc64(0, "123456789", 9), 0xe9c6d914c4b8d9caULL);
+    EXPECT_EQ(crc64(0, "", 0), 0u);
+}
+
+// 任意起始对齐、任意分段，结果都和逐位计算一致
+TEST(Crc64Test, SlicedMatchesBitwise)
+{
+    unsigned char buf[1024];
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (unsigned char)(i * 131 + 7);
+    for (size_t off = 0; off < 9; off++) {
+        size_t len = sizeof(buf) - off;
+        uint64_t expect = crc64Bitwise(0, buf + off, len);
+        ASSERT_EQ(crc64(0, buf + off, len), expect);
+        for (size_t split = 0; split < len; split += 37) {
+            uint64_t crc = crc64(0, buf + off, split);
+            ASSERT_EQ(crc64(crc, buf + off + split, len - split), expect) << off << " " << split;
+        }
+    }
+}
+
+// 带缓冲的fd rio：小块、跨缓冲、超过缓冲的写入，读回内容和校验和一致
+TEST(RioTest, BufferedFDChecksum)
+{
+    char path[] = "/tmp/fedis-rio-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+
+    std::string data;
+    for (int i = 0; i < 5000; i++) data += "key:" + std::to_string(i) + ";";
+    std::string big(300, 'x');
+
+    rio w;
+    rioInitWithBufferedFD(&w, fd, 64);
+    w.updateCksum = rioGenericUpdateChecksum;
+    for (size_t i = 0; i < data.size(); i += 7)
+        ASSERT_EQ(rioWrite(&w, data.data() + i, std::min<size_t>(7, data.size() - i)),
+                  std::min<size_t>(7, data.size() - i));
+    rioWrite(&w, big.data(), big.size());
+    rioFlush(&w);
+    EXPECT_EQ(w.error, 0);
+    EXPECT_EQ(w.processedBytes, data.size() + big.size());
+    uint64_t written = w.cksum;
+    rioFreeBufferedFD(&w);
+    std::string all = data + big;
+    EXPECT_EQ(written, crc64(0, all.data(), all.size()));
+
+    lseek(fd, 0, SEEK_SET);
+    rio r;
+    rioInitWithBufferedFD(&r, fd, 64);
+    r.updateCksum = rioGenericUpdateChecksum;
+    std::string got(all.size(), '\0');
+    ASSERT_EQ(rioRead(&r, &got[0], 10), 10);
+    ASSERT_EQ(rioRead(&r, &got[10], 200), 200);
+    ASSERT_EQ(rioRead(&r, &got[210], all.size() - 210), (ssize_t)(all.size() - 210));
+    char extra;
+    EXPECT_EQ(rioRead(&r, &extra, 1), 0);
+    EXPECT_EQ(got, all);
+    EXPECT_EQ(r.cksum, written);
+    rioFreeBufferedFD(&r);
+    close(fd);
+    unlink(path);
+}
+
+// AOF重写按RESP写出命令，和客户端发送的格式相同
+TEST(RioTest, WriteBulkCommand)
+{
+    rio r;
+    rioInitWithBuf(&r, sdsempty());
+    EXPECT_EQ(rioWriteBulkCount(&r, '*', 3), 4u);
+    EXPECT_EQ(rioWriteBulkString(&r, "SET", 3), 9u);
+    EXPECT_EQ(rioWriteBulkString(&r, "", 0), 6u);
+    EXPECT_EQ(rioWriteBulkLongLong(&r, -42), 9u);
+    sds buf = (sds)r.data;
+    EXPECT_EQ(std::string(buf, sdslen(buf)), "*3\r\n$3\r\nSET\r\n$0\r\n\r\n$3\r\n-42\r\n");
+    EXPECT_EQ(r.processedBytes, sdslen(buf));
+    sdsfree(buf);
+}
@@ -30,7 +30,7 @@ void test_dbAddFind() {
     assert(dbAdd(db, key, value) == 0);
     robj *found = dbGet(db, key);
     assert(found != NULL);
-    assert(strcmp(((sds*)(found->ptr))->buf, "VALUE") == 0);
+    assert(strcmp((sds)(found->ptr), "VALUE") == 0);
 
     dbFree(db);
     log_debug("✅ %s passed!\n", __func__);
@@ -0,0 +1,252 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <string>
+extern "C" {
+#include "dict.h"
+}
+
+/* 键为strdup的字符串，值为整数 */
+static unsigned long strHash(const void* key)
+{
+    return dictGenHashFunction(key, strlen((const char*)key));
+}
+
+static void* strDup(void* privdata, const void* key)
+{
+    (void)privdata;
+    return strdup((const char*)key);
+}
+
+static int strCompare(void* privdata, const void* key1, const void* key2)
+{
+    (void)privdata;
+    return strcmp((const char*)key1, (const char*)key2);
+}
+
+static int strCompareView(void* privdata, const void* key, const char* buf, size_t len)
+{
+    (void)privdata;
+    return strlen((const char*)key) == len && memcmp(key, buf, len) == 0 ? 0 : 1;
+}
+
+static void strFree(void* privdata, void* key)
+{
+    (void)privdata;
+    free(key);
+}
+
+static dictType chainedType = {
+    .hashFunction = strHash,
+    .keyDup = strDup,
+    .valDup = NULL,
+    .keyCompare = strCompare,
+    .keyCompareView = strCompareView,
+    .keyDestructor = strFree,
+    .valDestructor = NULL,
+    .engine = DICT_ENGINE_CHAINED,
+};
+
+static dictType swissType = {
+    .hashFunction = strHash,
+    .keyDup = strDup,
+    .valDup = NULL,
+    .keyCompare = strCompare,
+    .keyCompareView = strCompareView,
+    .keyDestructor = strFree,
+    .valDestructor = NULL,
+    .engine = DICT_ENGINE_SWISS,
+};
+
+static std::string key(int i)
+{
+    return "key:" + std::to_string(i);
+}
+
+class DictEngineTest : public ::testing::TestWithParam<dictType*> {
+protected:
+    void SetUp() override { d = dictCreate(GetParam(), NULL); }
+    void TearDown() override { dictRelease(d); }
+    dict* d;
+};
+
+TEST_P(DictEngineTest, AddFindReplaceDelete)
+{
+    EXPECT_TRUE(dictIsEmpty(d));
+    EXPECT_EQ(dictFind(d, "a"), nullptr);
+    EXPECT_EQ(dictAdd(d, "a", (void*)1), DICT_OK);
+    EXPECT_EQ(dictAdd(d, "a", (void*)2), DICT_ERR);
+    EXPECT_EQ(dictFetchValue(d, "a"), (void*)1);
+    EXPECT_EQ(dictReplace(d, "a", (void*)3), DICT_OK);
+    EXPECT_EQ(dictReplace(d, "b", (void*)3), DICT_ERR);
+    dictEntry* entry = dictFind(d, "a");
+    ASSERT_NE(entry, nullptr);
+    EXPECT_STREQ((char*)entry->key, "a");
+    EXPECT_EQ(entry->v.val, (void*)3);
+    EXPECT_EQ(dictSize(d), 1u);
+    EXPECT_EQ(dictDelete(d, "a"), DICT_OK);
+    EXPECT_EQ(dictDelete(d, "a"), DICT_ERR);
+    EXPECT_EQ(dictFind(d, "a"), nullptr);
+    EXPECT_TRUE(dictIsEmpty(d));
+}
+
+// 插入过程中经历多次扩容，rehash中途和结束后都要能查到所有键
+TEST_P(DictEngineTest, GrowWhileRehashing)
+{
+    const int n = 20000;
+    int sawRehashing = 0;
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(dictAdd(d, key(i).c_str(), (void*)(uintptr_t)(i + 1)), DICT_OK);
+        if (dictIsRehashing(d)) {
+            sawRehashing = 1;
+            ASSERT_EQ(dictFetchValue(d, key(i / 2).c_str()), (void*)(uintptr_t)(i / 2 + 1));
+        }
+    }
+    EXPECT_TRUE(sawRehashing);
+    EXPECT_EQ(dictSize(d), (size_t)n);
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(dictFetchValue(d, key(i).c_str()), (void*)(uintptr_t)(i + 1));
+    }
+    EXPECT_EQ(dictFind(d, "missing"), nullptr);
+}
+
+// 每个键恰好遍历一次，包括rehash中途
+TEST_P(DictEngineTest, IteratorVisitsEachKeyOnce)
+{
+    const int n = 5000;
+    for (int i = 0; i < n; i++) {
+        dictAdd(d, key(i).c_str(), NULL);
+    }
+    std::set<std::string> seen;
+    dictIterator* iter = dictGetIterator(d);
+    dictEntry* entry;
+    while ((entry = dictIterNext(iter)) != NULL) {
+        EXPECT_TRUE(seen.insert((char*)entry->key).second);
+    }
+    dictReleaseIterator(iter);
+    EXPECT_EQ(seen.size(), (size_t)n);
+}
+
+// 反复插入删除：删除后空出的槽位可以复用，缩容后键仍然可查
+TEST_P(DictEngineTest, ChurnAndShrink)
+{
+    const int n = 10000;
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < n; i++) {
+            ASSERT_EQ(dictAdd(d, key(round * n + i).c_str(), NULL), DICT_OK);
+        }
+        for (int i = 0; i < n; i += 2) {
+            ASSERT_EQ(dictDelete(d, key(round * n + i).c_str()), DICT_OK);
+        }
+    }
+    EXPECT_EQ(dictSize(d), (size_t)(3 * n / 2));
+    // 删到只剩10个，触发缩容
+    for (int k = 0; k < 3 * n; k++) {
+        if (k % 2 == 1 && k >= 20) dictDelete(d, key(k).c_str());
+    }
+    EXPECT_EQ(dictSize(d), 10u);
+    for (int k = 0; k < 3 * n; k++) {
+        int expect = k % 2 == 1 && k < 20;
+        ASSERT_EQ(dictContains(d, key(k).c_str()), expect) << key(k);
+    }
+    for (int i = 0; i < 100; i++) {
+        char* k = (char*)dictGetRandomKey(d);
+        ASSERT_NE(k, nullptr);
+        EXPECT_TRUE(dictContains(d, k));
+    }
+}
+
+// 不访问字典时，由dictRehashMilliseconds批量完成rehash
+TEST_P(DictEngineTest, RehashMilliseconds)
+{
+    int n = 0;
+    while (!dictIsRehashing(d) || dictSize(d) < 1000) {
+        dictAdd(d, key(n).c_str(), (void*)(uintptr_t)(n + 1));
+        n++;
+    }
+    EXPECT_LT(dictRehashProgress(d), 1.0);
+    int rounds = 0;
+    while (dictIsRehashing(d)) {
+        EXPECT_GT(dictRehashMilliseconds(d, 1), 0);
+        ASSERT_LT(++rounds, 1000);
+    }
+    EXPECT_EQ(dictRehashProgress(d), 1.0);
+    EXPECT_EQ(dictRehash(d, 1), 0);
+    EXPECT_EQ(dictSize(d), (size_t)n);
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(dictFetchValue(d, key(i).c_str()), (void*)(uintptr_t)(i + 1));
+    }
+}
+
+// 空字典返回NULL；rehash中途也能随机到两张表中的键
+TEST_P(DictEngineTest, RandomKey)
+{
+    EXPECT_EQ(dictGetRandomKey(d), nullptr);
+    dictAdd(d, "a", NULL);
+    dictDelete(d, "a");
+    EXPECT_EQ(dictGetRandomKey(d), nullptr);
+
+    int n = 0;
+    while (!dictIsRehashing(d) || dictSize(d) < 1000) {
+        dictAdd(d, key(n++).c_str(), NULL);
+    }
+    std::set<std::string> seen;
+    for (int i = 0; i < 20000; i++) {
+        char* k = (char*)dictGetRandomKey(d);
+        ASSERT_NE(k, nullptr);
+        ASSERT_TRUE(dictContains(d, k));
+        seen.insert(k);
+    }
+    EXPECT_GT(seen.size(), (size_t)n / 2);
+}
+
+// 预先分配后批量插入不再触发rehash；插入后不会被缩回去
+TEST_P(DictEngineTest, ExpandPresizes)
+{
+    const int n = 10000;
+    EXPECT_EQ(dictExpand(d, n), DICT_OK);
+    EXPECT_FALSE(dictIsRehashing(d));
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(dictAdd(d, key(i).c_str(), (void*)(uintptr_t)(i + 1)), DICT_OK);
+        ASSERT_FALSE(dictIsRehashing(d)) << i;
+    }
+    EXPECT_EQ(dictExpand(d, n / 2), DICT_ERR);
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(dictFetchValue(d, key(i).c_str()), (void*)(uintptr_t)(i + 1));
+    }
+}
+
+// 键视图不以'\0'结尾，hash和比较都只看[buf, buf+len)
+TEST_P(DictEngineTest, FindAndDeleteByView)
+{
+    const int n = 3000;
+    for (int i = 0; i < n; i++) {
+        dictAdd(d, key(i).c_str(), (void*)(uintptr_t)(i + 1));
+    }
+    for (int i = 0; i < n; i++) {
+        std::string buf = key(i) + "trailing";
+        dictEntry* entry = dictFindView(d, buf.data(), key(i).size());
+        ASSERT_NE(entry, nullptr) << key(i);
+        EXPECT_EQ(entry->v.val, (void*)(uintptr_t)(i + 1));
+    }
+    EXPECT_EQ(dictFindView(d, "key:1", 4), nullptr);
+    EXPECT_EQ(dictFindView(d, "key:1x", 6), nullptr);
+
+    for (int i = 0; i < n; i += 2) {
+        std::string k = key(i);
+        dictKeyView view = dictMakeView(k.data(), k.size());
+        ASSERT_EQ(dictDeleteByView(d, &view), DICT_OK);
+        EXPECT_EQ(dictDeleteByView(d, &view), DICT_ERR);
+    }
+    EXPECT_EQ(dictSize(d), (size_t)n / 2);
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(dictContains(d, key(i).c_str()), i % 2 == 1) << key(i);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines, DictEngineTest,
+    ::testing::Values(&chainedType, &swissType),
+    [](const ::testing::TestParamInfo<dictType*>& info) {
+        return std::string(info.param->engine == DICT_ENGINE_SWISS ? "Swiss" : "Chained");
+    });
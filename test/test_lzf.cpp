@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+extern "C" {
+#include "lzf.h"
+}
+
+static std::string roundtrip(const std::string& in)
+{
+    std::vector<char> packed(in.size() + in.size() / 16 + 64);
+    size_t n = lzfCompress(in.data(), in.size(), packed.data(), packed.size());
+    EXPECT_GT(n, 0u);
+    std::string out(in.size(), '\0');
+    EXPECT_EQ(lzfDecompress(packed.data(), n, &out[0], out.size()), in.size());
+    return out;
+}
+
+// 重复、文本、随机、超过最大回溯长度的长串，压缩后都能还原
+TEST(LzfTest, Roundtrip)
+{
+    std::string text;
+    for (int i = 0; text.size() < 50000; i++)
+        text += "{\"id\":" + std::to_string(i * 7919 % 100000) + ",\"tags\":[\"alpha\",\"beta\"]},";
+    std::string random(20000, '\0');
+    uint32_t x = 1;
+    for (auto& c : random) c = (char)((x = x * 1103515245 + 12345) >> 16);
+
+    for (const std::string& in : {std::string("a"), std::string("abcabcabcabc"), std::string(10000, 'x'),
+                                  text, random}) {
+        EXPECT_EQ(roundtrip(in), in);
+    }
+
+    std::vector<char> packed(text.size());
+    size_t n = lzfCompress(text.data(), text.size(), packed.data(), packed.size());
+    EXPECT_LT(n, text.size() / 3);
+}
+
+// 输出缓冲放不下时返回0，不可压缩的数据据此保存原样
+TEST(LzfTest, NoGain)
+{
+    std::string random(4096, '\0');
+    uint32_t x = 7;
+    for (auto& c : random) c = (char)((x = x * 1103515245 + 12345) >> 16);
+    std::vector<char> packed(random.size() - 4);
+    EXPECT_EQ(lzfCompress(random.data(), random.size(), packed.data(), packed.size()), 0u);
+}
+
+// 与liblzf的格式一致：字面量"abc" + 长度3距离3的回溯
+TEST(LzfTest, Format)
+{
+    const unsigned char in[] = {0x02, 'a', 'b', 'c', 0x20, 0x02};
+    char out[16];
+    ASSERT_EQ(lzfDecompress(in, sizeof(in), out, sizeof(out)), 6u);
+    EXPECT_EQ(std::string(out, 6), "abcabc");
+    // 输出放不下
+    EXPECT_EQ(lzfDecompress(in, sizeof(in), out, 5), 0u);
+}
+
+// 损坏的输入：截断、引用超出已输出的数据，返回0
+TEST(LzfTest, CorruptInput)
+{
+    char out[64];
+    const unsigned char truncated[] = {0x05, 'a', 'b'};
+    EXPECT_EQ(lzfDecompress(truncated, sizeof(truncated), out, sizeof(out)), 0u);
+    const unsigned char badRef[] = {0x00, 'a', 0x20, 0x05};
+    EXPECT_EQ(lzfDecompress(badRef, sizeof(badRef), out, sizeof(out)), 0u);
+    const unsigned char missingOff[] = {0x00, 'a', 0xE0, 0x01};
+    EXPECT_EQ(lzfDecompress(missingOff, sizeof(missingOff), out, sizeof(out)), 0u);
+}
@@ -8,10 +8,203 @@
 
 
 #include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <string>
 extern "C" {
-
+#include "replstate.h"
+#include "util.h"
+#include "server_stub.h"
+// repli.h依赖ae.h等C头文件，这里只声明用到的函数
+void replicationFeedBacklog(const char* buf, size_t len);
 }
 TEST(RepliTest, disconnect)
 {
     //
-}
\ No newline at end of file
+}
+
+class ReplStateTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        snprintf(path, sizeof(path), "/tmp/fedis-replstate-XXXXXX");
+        int tmp = mkstemp(path);
+        ASSERT_NE(tmp, -1);
+        close(tmp);
+        fd = replStateOpen(path);
+        ASSERT_NE(fd, -1);
+    }
+    void TearDown() override
+    {
+        close(fd);
+        unlink(path);
+    }
+    char path[64];
+    int fd;
+};
+
+// 空文件没有状态；写入后重新打开能读回
+TEST_F(ReplStateTest, WriteAndReopen)
+{
+    replState st;
+    EXPECT_EQ(replStateRead(fd, &st), -1);
+
+    replState out = {12345, "9f1c0e7a5d3b2c4e6f8091a2b3c4d5e6f7081920"};
+    ASSERT_EQ(replStateWrite(fd, &out), 0);
+    out.offset = 67890;
+    snprintf(out.replid, sizeof(out.replid), "0123456789abcdef0123456789abcdef01234567");
+    ASSERT_EQ(replStateWrite(fd, &out), 0);
+
+    int fd2 = replStateOpen(path);
+    ASSERT_NE(fd2, -1);
+    ASSERT_EQ(replStateRead(fd2, &st), 0);
+    EXPECT_EQ(st.offset, 67890);
+    EXPECT_STREQ(st.replid, "0123456789abcdef0123456789abcdef01234567");
+    close(fd2);
+}
+
+// 记录中任意一个字节损坏(写到一半宕机)都读不出状态
+TEST_F(ReplStateTest, CorruptRecordRejected)
+{
+    replState out = {42, "9f1c0e7a5d3b2c4e6f8091a2b3c4d5e6f7081920"};
+    ASSERT_EQ(replStateWrite(fd, &out), 0);
+    off_t size = lseek(fd, 0, SEEK_END);
+    ASSERT_GT(size, 0);
+    for (off_t i = 0; i < size; i++) {
+        unsigned char b;
+        ASSERT_EQ(pread(fd, &b, 1, i), 1);
+        unsigned char bad = b ^ 0x5a;
+        ASSERT_EQ(pwrite(fd, &bad, 1, i), 1);
+        replState st;
+        EXPECT_EQ(replStateRead(fd, &st), -1) << "byte " << i;
+        ASSERT_EQ(pwrite(fd, &b, 1, i), 1);
+    }
+    replState st;
+    ASSERT_EQ(replStateRead(fd, &st), 0);
+    EXPECT_EQ(st.offset, 42);
+}
+
+// 无盘同步的 $EOF:<标记>: RDB后的标记跨多次read到达，RDB中有标记的前缀也不能误判
+TEST(RepliTest, EofMarkSplitAcrossReads)
+{
+    const std::string mark = "0123456789abcdef0123456789abcdef01234567";
+    std::string payload = "REDIS0002" + mark.substr(0, 39) + "x" + mark.substr(0, 10) + "\xff";
+    std::string stream = payload + mark;
+    for (size_t split = 1; split < stream.size(); split++) {
+        size_t scanned = 0;
+        EXPECT_EQ(memFindIncremental(stream.data(), split, mark.data(), mark.size(), &scanned), -1) << split;
+        EXPECT_LE(scanned, split);
+        EXPECT_LE(scanned, payload.size()) << split;
+        EXPECT_EQ(memFindIncremental(stream.data(), stream.size(), mark.data(), mark.size(), &scanned),
+                  (long)payload.size()) << split;
+    }
+
+    // 逐字节到达
+    size_t scanned = 0;
+    long pos = -1;
+    for (size_t len = 1; len <= stream.size() && pos < 0; len++)
+        pos = memFindIncremental(stream.data(), len, mark.data(), mark.size(), &scanned);
+    EXPECT_EQ(pos, (long)payload.size());
+}
+
+#define REPLID "9f1c0e7a5d3b2c4e6f8091a2b3c4d5e6f7081920"
+#define REPLID2 "0123456789abcdef0123456789abcdef01234567"
+
+class ReplBacklogTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        stubServerReset();
+    }
+    // 写入n字节可辨认的命令流，同时记在stream中。 stream[i]是offset base+i的字节
+    void feed(long n)
+    {
+        std::string buf;
+        for (long i = 0; i < n; i++)
+            buf += (char)('a' + (stream.size() + i) % 26);
+        replicationFeedBacklog(buf.data(), buf.size());
+        stream += buf;
+    }
+    // 增量同步时回复的全部内容，拒绝时返回"(full)"
+    std::string psync(const char* replid, long offset)
+    {
+        sds reply;
+        bool ok = stubTryPartialResync(replid, offset, &reply);
+        std::string r(reply, sdslen(reply));
+        sdsfree(reply);
+        if (!ok) {
+            EXPECT_EQ(r, "") << "rejected PSYNC must not queue anything";
+            return "(full)";
+        }
+        return r;
+    }
+    // 从offset开始的命令流
+    std::string from(long offset)
+    {
+        return "+CONTINUE " REPLID "\r\n" + stream.substr(offset - base);
+    }
+    long base = 1000;
+    std::string stream;
+};
+
+// 64字节的积压缓冲区写入100字节后回绕，只有最近63字节[1037, 1100]可以续传
+TEST_F(ReplBacklogTest, WindowAfterWrap)
+{
+    stubReplicationSetup(REPLID, "", -1, base, 64);
+    for (int i = 0; i < 10; i++)
+        feed(10);
+    ASSERT_EQ(stubReplicationOffset(), 1100);
+
+    EXPECT_EQ(psync(REPLID, 1037), from(1037));
+    EXPECT_EQ(psync(REPLID, 1050), from(1050));
+    EXPECT_EQ(psync(REPLID, 1099), from(1099));
+    EXPECT_EQ(psync(REPLID, 1100), "+CONTINUE " REPLID "\r\n");
+    EXPECT_EQ(psync(REPLID, 1036), "(full)");
+    EXPECT_EQ(psync(REPLID, 1101), "(full)");
+    EXPECT_EQ(psync(REPLID, 0), "(full)");
+    EXPECT_EQ(psync(REPLID, -1), "(full)");
+    EXPECT_EQ(psync("?", 1050), "(full)");
+
+    // 回绕之后继续写，窗口随之后移
+    feed(5);
+    EXPECT_EQ(psync(REPLID, 1037), "(full)");
+    EXPECT_EQ(psync(REPLID, 1042), from(1042));
+}
+
+// 提升为主之前的复制ID: offset不超过切换时的offset才能续传，回复新的复制ID
+TEST_F(ReplBacklogTest, SecondReplid)
+{
+    stubReplicationSetup(REPLID, REPLID2, 1080, base, 64);
+    feed(100);
+
+    EXPECT_EQ(psync(REPLID2, 1080), from(1080));
+    EXPECT_EQ(psync(REPLID2, 1040), from(1040));
+    EXPECT_EQ(psync(REPLID2, 1081), "(full)");
+    EXPECT_EQ(psync(REPLID2, 1036), "(full)");
+    // 新ID不受切换时offset的限制
+    EXPECT_EQ(psync(REPLID, 1090), from(1090));
+}
+
+// 超过一块(16KB)的积压内容分块拷贝，跨回绕点的字节保持顺序
+TEST_F(ReplBacklogTest, MultiChunkCopy)
+{
+    stubReplicationSetup(REPLID, "", -1, base, 40000);
+    for (int i = 0; i < 100; i++)
+        feed(1000 + i);
+    long offset = stubReplicationOffset();
+    ASSERT_EQ(offset, base + (long)stream.size());
+
+    EXPECT_EQ(psync(REPLID, offset - 39999), from(offset - 39999));
+    EXPECT_EQ(psync(REPLID, offset - 20000), from(offset - 20000));
+    EXPECT_EQ(psync(REPLID, offset - 40000), "(full)");
+}
+
+// 没有积压缓冲区(比如分片模式)总是全量同步，offset仍然推进
+TEST_F(ReplBacklogTest, NoBacklog)
+{
+    stubReplicationSetup(REPLID, "", -1, base, 0);
+    feed(10);
+    EXPECT_EQ(stubReplicationOffset(), 1010);
+    EXPECT_EQ(psync(REPLID, 1010), "(full)");
+}
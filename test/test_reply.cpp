@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <string>
+extern "C" {
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "reply.h"
+}
+
+class ReplyListTest : public ::testing::Test
+{
+protected:
+    replyList* l;
+    int fds[2];
+    void SetUp() override {
+        l = (replyList*)malloc(sizeof(replyList));
+        replyListInit(l);
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        int sz = 4096;
+        setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz));
+        setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    }
+    void TearDown() override {
+        replyListFree(l);
+        free(l);
+        close(fds[0]);
+        close(fds[1]);
+    }
+    // 读出对端所有数据
+    std::string drain() {
+        std::string out;
+        char buf[8192];
+        ssize_t n;
+        while ((n = read(fds[1], buf, sizeof(buf))) > 0) out.append(buf, n);
+        return out;
+    }
+};
+
+static int released = 0;
+static void countRelease(void* owner) { (void)owner; released++; }
+
+TEST_F(ReplyListTest, InlineThenBlocks)
+{
+    replyListAdd(l, "+OK\r\n", 5);
+    EXPECT_EQ(l->bufpos, 5u);
+    EXPECT_EQ(l->head, nullptr);
+
+    // 超过内联缓冲的部分进入块链表
+    std::string big(REPLY_CHUNK_BYTES, 'x');
+    replyListAdd(l, big.data(), big.size());
+    EXPECT_EQ(l->bufpos, (size_t)REPLY_CHUNK_BYTES);
+    ASSERT_NE(l->head, nullptr);
+    EXPECT_EQ(l->head->len, 5u);
+    // 链表非空后，小回复追加到尾部块，保持顺序
+    replyListAdd(l, "+PONG\r\n", 7);
+    EXPECT_EQ(l->head, l->tail);
+    EXPECT_EQ(l->tail->len, 12u);
+    EXPECT_EQ(replyListPending(l), 5 + big.size() + 7);
+}
+
+TEST_F(ReplyListTest, RefSmallIsCopied)
+{
+    released = 0;
+    replyListAddRef(l, "+OK\r\n", 5, countRelease, NULL);
+    EXPECT_EQ(released, 1);
+    EXPECT_EQ(l->head, nullptr);
+    EXPECT_EQ(l->bufpos, 5u);
+}
+
+TEST_F(ReplyListTest, PartialWriteContinues)
+{
+    std::string expect = "$100000\r\n";
+    std::string val(100000, 'v');
+    for (size_t i = 0; i < val.size(); i++) val[i] = 'a' + i % 26;
+    released = 0;
+    replyListAdd(l, expect.data(), expect.size());
+    replyListAddRef(l, val.data(), val.size(), countRelease, NULL);
+    replyListAdd(l, "\r\n", 2);
+    expect += val + "\r\n";
+
+    // 对端缓冲很小，必然部分写
+    ssize_t n = replyListWrite(l, fds[0]);
+    ASSERT_GT(n, 0);
+    EXPECT_LT((size_t)n, expect.size());
+    EXPECT_EQ(replyListPending(l), expect.size() - n);
+    EXPECT_EQ(released, 0);
+
+    std::string got = drain();
+    int rounds = 0;
+    while (replyListPending(l) > 0) {
+        ASSERT_GE(replyListWrite(l, fds[0]), 0);
+        got += drain();
+        ASSERT_LT(++rounds, 100000);
+    }
+    got += drain();
+    EXPECT_EQ(got, expect);
+    // release延迟到replyListReleaseSent
+    EXPECT_EQ(released, 0);
+    ASSERT_NE(l->sent, nullptr);
+    replyListReleaseSent(l);
+    EXPECT_EQ(released, 1);
+    EXPECT_EQ(l->sent, nullptr);
+    EXPECT_EQ(l->head, nullptr);
+    EXPECT_EQ(l->bufpos, 0u);
+}
+
+TEST_F(ReplyListTest, ManyBlocksExceedIov)
+{
+    std::string expect;
+    std::string val(REPLY_REF_MIN_BYTES, 'r');
+    released = 0;
+    for (int i = 0; i < REPLY_MAX_IOV * 2; i++) {
+        replyListAddRef(l, val.data(), val.size(), countRelease, NULL);
+        replyListAdd(l, "\r\n", 2);
+        expect += val + "\r\n";
+    }
+    std::string got;
+    while (replyListPending(l) > 0) {
+        ASSERT_GE(replyListWrite(l, fds[0]), 0);
+        got += drain();
+    }
+    EXPECT_EQ(got, expect);
+    replyListReleaseSent(l);
+    EXPECT_EQ(released, REPLY_MAX_IOV * 2);
+}
+
+TEST_F(ReplyListTest, WriteErrorOnClosedPeer)
+{
+    replyListAdd(l, "+OK\r\n", 5);
+    close(fds[1]);
+    fds[1] = open("/dev/null", O_RDONLY);
+    // 与服务器一致，忽略SIGPIPE，写入已关闭的对端返回EPIPE
+    signal(SIGPIPE, SIG_IGN);
+    EXPECT_EQ(replyListWrite(l, fds[0]), -1);
+    EXPECT_EQ(replyListPending(l), 5u);
+}
+
+TEST_F(ReplyListTest, CopyAfterPartialWrite)
+{
+    std::string expect = "+OK\r\n";
+    std::string val(REPLY_CHUNK_BYTES, 'c');
+    replyListAdd(l, expect.data(), expect.size());
+    replyListAddRef(l, val.data(), val.size(), NULL, NULL);
+    replyListAdd(l, "\r\n", 2);
+    expect += val + "\r\n";
+
+    ssize_t n = replyListWrite(l, fds[0]);
+    ASSERT_GT(n, 0);
+    // 只拷贝还没发送的部分
+    std::string rest(replyListPending(l), '\0');
+    replyListCopy(l, &rest[0]);
+    EXPECT_EQ(rest, expect.substr(n));
+}
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 extern "C" {
 #include <string.h>
+#include <string>
+#include <vector>
 #include "resp.h"
 #include "log.h"
 }
@@ -123,6 +125,37 @@ TEST(Resptest, EncodeArrayString)
     free(s);
 }
 
+// 编码结果跨过初始容量时每个参数的头部都完整(INFO的回复在1KB附近)
+TEST(Resptest, EncodeArrayStringGrows)
+{
+    for (int width = 1; width <= 40; width++) {
+        std::vector<std::string> args;
+        std::vector<char*> argv;
+        std::string expect = "*100\r\n";
+        for (int i = 0; i < 100; i++) {
+            args.push_back(std::string(width + i % 7, 'a' + i % 26));
+            expect += "$" + std::to_string(args.back().size()) + "\r\n" + args.back() + "\r\n";
+        }
+        for (std::string& a : args) argv.push_back(&a[0]);
+        char* s = respEncodeArrayString(argv.size(), argv.data());
+        EXPECT_EQ(std::string(s), expect) << "width " << width;
+        free(s);
+    }
+}
+
+TEST(Resptest, CatCommand)
+{
+    // 参数二进制安全，追加在已有内容之后
+    const char* argv[] = {"SET", "k\r\n", "v"};
+    size_t argvlen[] = {3, 3, 0};
+    sds s = sdsnew("+x\r\n");
+    s = respCatCommand(s, 3, argv, argvlen);
+    const char expect[] = "+x\r\n*3\r\n$3\r\nSET\r\n$3\r\nk\r\n\r\n$0\r\n\r\n";
+    ASSERT_EQ(sdslen(s), sizeof(expect) - 1);
+    EXPECT_EQ(memcmp(s, expect, sdslen(s)), 0);
+    sdsfree(s);
+}
+
 TEST(Resptest, EncodeBulkString)
 {
     char *s =respEncodeBulkString("hello");
@@ -161,4 +194,68 @@ TEST(Resptest, ParseAresp)
     endptr = respParse(s, strlen(s));
     EXPECT_EQ(endptr, nullptr);
 
-}
\ No newline at end of file
+}
+TEST(RespReqParserTest, HandlePipeline)
+{
+    respReqParser p;
+    respReqParserInit(&p);
+    const char* buf = "*2\r\n$3\r\nGET\r\n$1\r\na\r\n*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$2\r\nvv\r\n";
+    size_t len = strlen(buf);
+
+    ASSERT_EQ(respParseRequest(&p, buf, len), RESP_REQ_OK);
+    ASSERT_EQ(p.argc, 2);
+    EXPECT_EQ(p.argvlen[0], 3u);
+    EXPECT_EQ(memcmp(buf + p.argvoff[0], "GET", 3), 0);
+    EXPECT_EQ(memcmp(buf + p.argvoff[1], "a", 1), 0);
+    respReqParserReset(&p);
+
+    ASSERT_EQ(respParseRequest(&p, buf, len), RESP_REQ_OK);
+    ASSERT_EQ(p.argc, 3);
+    EXPECT_EQ(p.argvlen[2], 2u);
+    EXPECT_EQ(memcmp(buf + p.argvoff[2], "vv", 2), 0);
+    respReqParserReset(&p);
+
+    EXPECT_EQ(p.pos, len);
+    EXPECT_EQ(respParseRequest(&p, buf, len), RESP_REQ_INCOMPLETE);
+    respReqParserFree(&p);
+}
+
+TEST(RespReqParserTest, HandlePartialAndBinary)
+{
+    respReqParser p;
+    respReqParserInit(&p);
+    // bulk内含'\0'和"\r\n"，按长度读取
+    const char buf[] = "*2\r\n$3\r\nGET\r\n$5\r\na\0\r\nb\r\n";
+    size_t len = sizeof(buf) - 1;
+    for (size_t i = 1; i < len; ++i)
+    {
+        EXPECT_EQ(respParseRequest(&p, buf, i), RESP_REQ_INCOMPLETE) << i;
+    }
+    ASSERT_EQ(respParseRequest(&p, buf, len), RESP_REQ_OK);
+    ASSERT_EQ(p.argc, 2);
+    EXPECT_EQ(p.argvlen[1], 5u);
+    EXPECT_EQ(memcmp(buf + p.argvoff[1], "a\0\r\nb", 5), 0);
+    respReqParserReset(&p);
+
+    // 裁剪已消费前缀后游标平移
+    EXPECT_EQ(p.cmdstart, len);
+    respReqParserShift(&p, len);
+    EXPECT_EQ(p.pos, 0u);
+    respReqParserFree(&p);
+}
+
+TEST(RespReqParserTest, HandleProtocolError)
+{
+    respReqParser p;
+    respReqParserInit(&p);
+    EXPECT_EQ(respParseRequest(&p, "*a\r\n", 4), RESP_REQ_ERR);
+    respReqParserFree(&p);
+
+    respReqParserInit(&p);
+    EXPECT_EQ(respParseRequest(&p, "*1\r\n:3\r\n", 8), RESP_REQ_ERR);
+    respReqParserFree(&p);
+
+    respReqParserInit(&p);
+    EXPECT_EQ(respParseRequest(&p, "*1\r\n$1\r\nabc\r\n", 13), RESP_REQ_ERR);
+    respReqParserFree(&p);
+}
@@ -13,7 +13,7 @@ protected:
         ASSERT_NE(rb, nullptr);
     }
     void TearDown() override {
-        free(rb);
+        ringBufferFree(rb);
     }
 };
 // 单字节
@@ -79,3 +79,39 @@ TEST_F(RingBufferTest, InvalidParameters) {
     ringBufferEnQeueue(rb, 0x01);
     EXPECT_FALSE(ringBufferDequeueBulk(rb, data, 10));
 }
+// head在tail之后(已回环)时批量入队、出队
+TEST_F(RingBufferTest, BulkAfterWrap) {
+    uint8_t junk[1000];
+    ringBufferEnQeueueBulk(rb, junk, 1000);
+    ringBufferDequeueBulk(rb, junk, 1000);
+    uint8_t input[100];
+    for (int i = 0; i < 100; i++) input[i] = i;
+    ASSERT_TRUE(ringBufferEnQeueueBulk(rb, input, 100));  // tail回到开头
+    ASSERT_TRUE(ringBufferEnQeueueBulk(rb, input, 10));
+    uint8_t output[110];
+    ASSERT_TRUE(ringBufferDequeueBulk(rb, output, 110));
+    EXPECT_EQ(0, memcmp(input, output, 100));
+    EXPECT_EQ(0, memcmp(input, output + 100, 10));
+}
+// 覆盖写入只保留最近的数据，Peek按偏移读取不出队
+TEST_F(RingBufferTest, WriteOverwriteAndPeek) {
+    RingBuffer* b = ringBufferCreateSize(17);   // 最多16字节
+    uint8_t input[40];
+    for (int i = 0; i < 40; i++) input[i] = i;
+    ringBufferWrite(b, input, 10);
+    EXPECT_EQ(ringBufferSize(b), 10);
+    ringBufferWrite(b, input + 10, 10);          // 丢弃最旧的4字节
+    EXPECT_EQ(ringBufferSize(b), 16);
+    uint8_t out[16];
+    ASSERT_TRUE(ringBufferPeek(b, 0, out, 16));
+    EXPECT_EQ(0, memcmp(out, input + 4, 16));
+    ASSERT_TRUE(ringBufferPeek(b, 10, out, 6));
+    EXPECT_EQ(0, memcmp(out, input + 14, 6));
+    EXPECT_FALSE(ringBufferPeek(b, 10, out, 7));
+    EXPECT_EQ(ringBufferSize(b), 16);
+
+    ringBufferWrite(b, input, 40);               // 一次超过容量
+    ASSERT_TRUE(ringBufferPeek(b, 0, out, 16));
+    EXPECT_EQ(0, memcmp(out, input + 24, 16));
+    ringBufferFree(b);
+}
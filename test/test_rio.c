@@ -33,7 +33,7 @@ void test_file_rio() {
 
 void test_buffer_rio() {
     rio buffer_rio;
-    sds* s = sdsempty();
+    sds s = sdsempty();
     rioInitWithBuf(&buffer_rio, s);
 
     const char *data = "Hello, Buffer RIO!";
@@ -47,7 +47,7 @@ void test_buffer_rio() {
     assert(rioRead(NULL, buf, 10) == RIO_ERR_NULL);
     assert(rioWrite(NULL, data, 10) == RIO_ERR_NULL);
     
-    sdsfree(s);
+    sdsfree(buffer_rio.data);
     printf("Buffer RIO test passed.\n");
 }
 
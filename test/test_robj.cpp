@@ -1,8 +1,8 @@
 #include <gtest/gtest.h>
-
-#include "sds.h"
+#include <string>
 
 extern "C" {
+#include "sds.h"
 #include <string.h>
 #include "log.h"
 #include "robj.h"
@@ -10,7 +10,7 @@ extern "C" {
 TEST(RobjTest, StringEncoding)
 {
     robj* o;
-    sds* s;
+    sds s;
     // long型str
     o = robjCreateStringObject("12");
     EXPECT_EQ(o->encoding, REDIS_ENCODING_INT);
@@ -29,31 +29,94 @@ TEST(RobjTest, StringEncoding)
     o = robjCreateStringObject("0x111111111111111111");
     EXPECT_EQ(o->encoding, REDIS_ENCODING_EMBSTR);
     EXPECT_EQ(o->type, REDIS_STRING);
-    s = (sds*)o->ptr;
-    EXPECT_STREQ(s->buf, "0x111111111111111111");
+    s = (sds)o->ptr;
+    EXPECT_STREQ(s, "0x111111111111111111");
     robjDestroy(o);
 
     // 嵌入字符串: 31字节
     o = robjCreateStringObject("2helloworldhelloworldhelloworld");
     EXPECT_EQ(o->encoding, REDIS_ENCODING_EMBSTR);
     EXPECT_EQ(o->type, REDIS_STRING);
-    s = (sds*)o->ptr;
-    EXPECT_STREQ(s->buf, "2helloworldhelloworldhelloworld");
+    s = (sds)o->ptr;
+    EXPECT_STREQ(s, "2helloworldhelloworldhelloworld");
+    EXPECT_EQ(sdslen(s), 31u);
     robjDestroy(o);
 
     // raw字符串: 32字节
     o = robjCreateStringObject("12helloworldhelloworldhelloworld");
     EXPECT_EQ(o->encoding, REDIS_ENCODING_RAW);
     EXPECT_EQ(o->type, REDIS_STRING);
-    s = (sds*)o->ptr;
-    EXPECT_STREQ(s->buf, "12helloworldhelloworldhelloworld");
+    s = (sds)o->ptr;
+    EXPECT_STREQ(s, "12helloworldhelloworldhelloworld");
     robjDestroy(o);
 
     // 浮点数 字符串表示
     o = robjCreateStringObject("0.12345678909090900");
     EXPECT_EQ(o->encoding, REDIS_ENCODING_EMBSTR);
     EXPECT_EQ(o->type, REDIS_STRING);
-    s = (sds*)o->ptr;
-    EXPECT_STREQ(s->buf, "0.12345678909090900");
+    s = (sds)o->ptr;
+    EXPECT_STREQ(s, "0.12345678909090900");
+    robjDestroy(o);
+}
+
+// 共享整数对象：范围内的整数返回同一个对象，引用计数固定，释放不影响；范围外、关闭共享时单独分配
+TEST(RobjTest, SharedIntegers)
+{
+    robjInit();
+    robj* a = robjCreateStringObject("12");
+    robj* b = robjCreateStringObjectFromLong(12);
+    EXPECT_EQ(a, b);
+    EXPECT_TRUE(robjIsShared(a));
+    robjDestroy(a);
+    EXPECT_EQ(a->refcount, OBJ_SHARED_REFCOUNT);
+    EXPECT_EQ((long)a->ptr, 12);
+
+    robj* big = robjCreateStringObjectFromLong(1000);
+    EXPECT_FALSE(robjIsShared(big));
+    EXPECT_EQ(big->encoding, REDIS_ENCODING_INT);
+    robjDestroy(big);
+    robj* neg = robjCreateStringObject("-1");
+    EXPECT_FALSE(robjIsShared(neg));
+    robjDestroy(neg);
+
+    robjSetShareIntegers(0);
+    robj* c = robjCreateStringObjectFromLong(12);
+    EXPECT_NE(c, a);
+    EXPECT_EQ(c->refcount, 1);
+    robjDestroy(c);
+    robjSetShareIntegers(1);
+}
+
+// 超过压缩阈值且可压缩的值压缩保存，解压后内容不变；不可压缩、低于阈值、整数不受影响
+TEST(RobjTest, CompressedString)
+{
+    std::string json;
+    for (int i = 0; json.size() < 4096; i++)
+        json += "{\"id\":" + std::to_string(i) + ",\"name\":\"user\",\"active\":true},";
+
+    robjSetCompressThreshold(1024);
+    robj* o = robjCreateStringObjectLen(json.data(), json.size());
+    EXPECT_EQ(o->encoding, REDIS_ENCODING_COMPRESSED);
+    EXPECT_EQ(robjCompressedRawLen(o), json.size());
+    EXPECT_LT(sdslen((sds)o->ptr), json.size() / 2);
+    sds s = robjDecompressString(o);
+    EXPECT_EQ(std::string(s, sdslen(s)), json);
+    sdsfree(s);
+    robjDestroy(o);
+
+    std::string random(2048, 0);
+    uint32_t x = 1;
+    for (auto& c : random) c = (char)((x = x * 1103515245 + 12345) >> 16);
+    o = robjCreateStringObjectLen(random.data(), random.size());
+    EXPECT_EQ(o->encoding, REDIS_ENCODING_RAW);
+    robjDestroy(o);
+
+    o = robjCreateStringObjectLen(json.data(), 512);
+    EXPECT_EQ(o->encoding, REDIS_ENCODING_RAW);
+    robjDestroy(o);
+
+    robjSetCompressThreshold(0);
+    o = robjCreateStringObjectLen(json.data(), json.size());
+    EXPECT_EQ(o->encoding, REDIS_ENCODING_RAW);
     robjDestroy(o);
 }
@@ -0,0 +1,331 @@
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+#include <string.h>
+#include "sds.h"
+}
+
+TEST(SdsTest, HandleNew)
+{
+    // 正常情况
+    sds str = sdsnew("hello");
+    ASSERT_NE(str, nullptr);
+    EXPECT_EQ(sdslen(str), 5u);
+    EXPECT_STREQ(str, "hello");
+    sdsfree(str);
+
+    // 空字符串
+    str = sdsnew("");
+    ASSERT_NE(str, nullptr);
+    EXPECT_EQ(sdslen(str), 0u);
+    EXPECT_STREQ(str, "");
+    sdsfree(str);
+
+    str = sdsempty();
+    ASSERT_NE(str, nullptr);
+    EXPECT_EQ(sdslen(str), 0u);
+    EXPECT_STREQ(str, "");
+    sdsfree(str);
+
+    // NULL 输入
+    EXPECT_EQ(sdsnew(NULL), nullptr);
+    sdsfree(NULL);
+}
+
+TEST(SdsTest, HandleBinary)
+{
+    // 内容中的'\0'不影响长度和比较
+    const char bin[] = {'a', '\0', 'b', '\0', 'c'};
+    sds s1 = sdsnewlen(bin, sizeof(bin));
+    EXPECT_EQ(sdslen(s1), 5u);
+    EXPECT_EQ(memcmp(s1, bin, sizeof(bin)), 0);
+
+    sds s2 = sdsnewlen(bin, 3);
+    EXPECT_NE(sdscmp(s1, s2), 0);
+    EXPECT_LT(sdscmp(s2, s1), 0);
+    s2 = sdscatlen(s2, bin + 3, 2);
+    EXPECT_EQ(sdscmp(s1, s2), 0);
+
+    // init为NULL时填充0
+    sds z = sdsnewlen(NULL, 4);
+    EXPECT_EQ(sdslen(z), 4u);
+    EXPECT_EQ(memcmp(z, "\0\0\0\0", 4), 0);
+
+    sdsfree(s1);
+    sdsfree(s2);
+    sdsfree(z);
+}
+
+TEST(SdsTest, HandleHeaderType)
+{
+    // 长度跨越头部类型时内容保持不变
+    sds s = sdsempty();
+    EXPECT_EQ(s[-1] & SDS_TYPE_MASK, SDS_TYPE_8);
+    std::string expect;
+    for (int i = 0; i < 70000; i++) {
+        char c = 'a' + i % 26;
+        s = sdscatlen(s, &c, 1);
+        expect.push_back(c);
+    }
+    EXPECT_EQ(s[-1] & SDS_TYPE_MASK, SDS_TYPE_32);
+    ASSERT_EQ(sdslen(s), expect.size());
+    EXPECT_EQ(memcmp(s, expect.data(), expect.size()), 0);
+    EXPECT_EQ(s[sdslen(s)], '\0');
+    EXPECT_GE(sdsAllocSize(s), sdslen(s) + 1);
+    sdsfree(s);
+}
+
+TEST(SdsTest, HandleDumpClear)
+{
+    sds str = sdsnew("hello");
+    sds copy = sdsdump(str);
+    ASSERT_NE(copy, nullptr);
+    EXPECT_NE(copy, str);
+    EXPECT_EQ(sdslen(copy), sdslen(str));
+    EXPECT_STREQ(copy, str);
+    sdsfree(copy);
+
+    EXPECT_EQ(sdsdump(NULL), nullptr);
+
+    size_t alloc = sdsalloc(str);
+    sdsclear(str);
+    EXPECT_EQ(sdslen(str), 0u);
+    EXPECT_STREQ(str, "");
+    // 清空不释放空间
+    EXPECT_EQ(sdsavail(str), alloc);
+    sdsfree(str);
+
+    sdsclear(NULL);
+}
+
+TEST(SdsTest, HandleCat)
+{
+    sds str = sdsnew("hello");
+    str = sdscat(str, " world");
+    EXPECT_EQ(sdslen(str), 11u);
+    EXPECT_STREQ(str, "hello world");
+    sdsfree(str);
+
+    // 空字符串拼接
+    str = sdsnew("");
+    str = sdscat(str, "hello");
+    EXPECT_EQ(sdslen(str), 5u);
+    EXPECT_STREQ(str, "hello");
+
+    // NULL 输入
+    str = sdscat(str, NULL);
+    EXPECT_EQ(sdslen(str), 5u);
+    EXPECT_STREQ(str, "hello");
+    sdsfree(str);
+
+    // 非字符串
+    char buf[] = {' ', 'w', 'o', 'r', 'l', 'd'};
+    str = sdsnew("hello");
+    str = sdscatlen(str, buf, 6);
+    EXPECT_EQ(sdslen(str), 11u);
+    EXPECT_STREQ(str, "hello world");
+    sdsfree(str);
+    EXPECT_EQ(sdscatlen(NULL, buf, 6), nullptr);
+
+    // sdscatsds 不修改源
+    sds str1 = sdsnew("hello");
+    sds str2 = sdsnew(" world");
+    str1 = sdscatsds(str1, str2);
+    EXPECT_STREQ(str1, "hello world");
+    EXPECT_STREQ(str2, " world");
+    str1 = sdscatsds(str1, NULL);
+    EXPECT_EQ(sdslen(str1), 11u);
+    sdsfree(str1);
+    sdsfree(str2);
+}
+
+TEST(SdsTest, HandleCpyGrow)
+{
+    sds str = sdsnew("hello");
+    str = sdscpy(str, "world");
+    EXPECT_EQ(sdslen(str), 5u);
+    EXPECT_STREQ(str, "world");
+
+    // 比原容量长
+    str = sdscpy(str, "hello world hello world");
+    EXPECT_EQ(sdslen(str), 23u);
+    EXPECT_STREQ(str, "hello world hello world");
+
+    // NULL 输入
+    str = sdscpy(str, NULL);
+    EXPECT_EQ(sdslen(str), 0u);
+    EXPECT_STREQ(str, "");
+    sdsfree(str);
+
+    str = sdsnew("hello");
+    str = sdsgrowzero(str, 10);
+    EXPECT_EQ(sdslen(str), 10u);
+    EXPECT_STREQ(str, "hello"); // 前 5 个字符不变
+    EXPECT_EQ(memcmp(str + 5, "\0\0\0\0\0\0", 6), 0); // 新增部分用零填充
+
+    // 扩展长度小于当前长度, 不变
+    str = sdsgrowzero(str, 3);
+    EXPECT_EQ(sdslen(str), 10u);
+    sdsfree(str);
+
+    EXPECT_EQ(sdsgrowzero(NULL, 10), nullptr);
+}
+
+TEST(SdsTest, HandleRange)
+{
+    sds str = sdsnew("hello world");
+    sdsrange(str, 6, 10);
+    EXPECT_EQ(sdslen(str), 5u);
+    EXPECT_STREQ(str, "world");
+    sdsfree(str);
+
+    // 负索引
+    str = sdsnew("hello world");
+    sdsrange(str, -5, -1);
+    EXPECT_EQ(sdslen(str), 5u);
+    EXPECT_STREQ(str, "world");
+    sdsfree(str);
+
+    // end越界截断, start越界为空
+    str = sdsnew("hello world");
+    sdsrange(str, 6, 100);
+    EXPECT_STREQ(str, "world");
+    sdsrange(str, 5, 10);
+    EXPECT_EQ(sdslen(str), 0u);
+    sdsfree(str);
+
+    // start > end
+    str = sdsnew("hello");
+    sdsrange(str, 3, 1);
+    EXPECT_EQ(sdslen(str), 0u);
+    EXPECT_STREQ(str, "");
+    sdsfree(str);
+
+    // 空字符串
+    str = sdsnew("");
+    sdsrange(str, 0, 0);
+    EXPECT_EQ(sdslen(str), 0u);
+    EXPECT_STREQ(str, "");
+    sdsfree(str);
+
+    // NULL 输入
+    sdsrange(NULL, 0, 0);
+}
+
+TEST(SdsTest, HandleTrimCmp)
+{
+    sds str = sdsnew("  hello world  ");
+    sdstrim(str, " ");
+    EXPECT_EQ(sdslen(str), 11u);
+    EXPECT_STREQ(str, "hello world");
+    sdsfree(str);
+
+    str = sdsnew("    ");
+    sdstrim(str, " ");
+    EXPECT_EQ(sdslen(str), 0u);
+    sdsfree(str);
+
+    str = sdsnew("");
+    sdstrim(str, " ");
+    EXPECT_EQ(sdslen(str), 0u);
+    EXPECT_STREQ(str, "");
+    sdsfree(str);
+    sdstrim(NULL, " ");
+
+    sds str1 = sdsnew("hello");
+    sds str2 = sdsnew("hello");
+    EXPECT_EQ(sdscmp(str1, str2), 0);
+    str2 = sdscpy(str2, "world");
+    EXPECT_LT(sdscmp(str1, str2), 0);
+    EXPECT_GT(sdscmp(str2, str1), 0);
+    // 前缀更短的更小
+    str2 = sdscpy(str2, "hell");
+    EXPECT_GT(sdscmp(str1, str2), 0);
+    sdsfree(str1);
+    sdsfree(str2);
+
+    // NULL 输入
+    EXPECT_EQ(sdscmp(NULL, NULL), -1);
+}
+
+/*
+ * 旧实现: 结构体 + 独立buf, 两次分配。 仅用于下面的分配次数对比
+ */
+namespace legacy {
+static long allocs = 0;
+struct sds {
+    int len;
+    int free;
+    char* buf;
+};
+static sds* sdsnewlen(const char* init, int len)
+{
+    int bufLen = len < 1024 ? len * 2 + 1 : len + 1024 + 1;
+    sds* ss = (sds*)calloc(1, sizeof(sds));
+    ss->buf = (char*)calloc(bufLen, sizeof(char));
+    allocs += 2;
+    ss->len = len;
+    ss->free = bufLen - len - 1;
+    memcpy(ss->buf, init, len);
+    return ss;
+}
+static void sdscatlen(sds* dest, const char* buf, int n)
+{
+    int len = dest->len;
+    int newlen = len + n;
+    if (n > dest->free) {
+        int newbuflen = newlen < 1024 ? newlen * 2 + 1 : newlen + 1024 + 1;
+        dest->buf = (char*)realloc(dest->buf, newbuflen);
+        allocs++;
+        dest->free = newbuflen - newlen - 1;
+        memset(dest->buf + len, 0, newbuflen - len);
+    } else {
+        dest->free -= n;
+    }
+    memcpy(dest->buf + len, buf, n);
+    dest->len = newlen;
+}
+static void sdsfree(sds* ss)
+{
+    free(ss->buf);
+    free(ss);
+}
+}
+
+/**
+ * 分配次数: 新实现每个字符串一次分配，追加构建中等长度字符串的分配次数不多于旧实现。
+ * 新实现通过 追加前可用空间是否足够 统计，耗时对比见bench/sds-benchmark.c
+ */
+TEST(SdsTest, FewerAllocsThanLegacy)
+{
+    const int nappend = 256;
+    const char chunk[] = "0123456789abcdef";
+    const int chunklen = sizeof(chunk) - 1;
+
+    legacy::allocs = 0;
+    legacy::sds* ls = legacy::sdsnewlen("key:1", 5);
+    legacy::sdsfree(ls);
+    EXPECT_EQ(legacy::allocs, 2);
+
+    legacy::allocs = 0;
+    ls = legacy::sdsnewlen("", 0);
+    for (int i = 0; i < nappend; i++) {
+        legacy::sdscatlen(ls, chunk, chunklen);
+    }
+    EXPECT_EQ(ls->len, nappend * chunklen);
+    legacy::sdsfree(ls);
+    long legacyCatAllocs = legacy::allocs;
+
+    long newCatAllocs = 1;
+    sds s = sdsempty();
+    for (int i = 0; i < nappend; i++) {
+        if (sdsavail(s) < (size_t)chunklen)
+            newCatAllocs++;
+        s = sdscatlen(s, chunk, chunklen);
+    }
+    EXPECT_EQ(sdslen(s), (size_t)nappend * chunklen);
+    EXPECT_EQ(memcmp(s + (nappend - 1) * chunklen, chunk, chunklen), 0);
+    sdsfree(s);
+    EXPECT_LE(newCatAllocs, legacyCatAllocs);
+}
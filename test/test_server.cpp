@@ -0,0 +1,417 @@
+/**
+ * 启动fedis进程测试命令行为: 过期时间、AOF重放
+ *
+ * 服务器配置和AOF写在data/下，端口7391
+ */
+#include <gtest/gtest.h>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#define TEST_SERVER_PORT 7391
+#define TEST_SERVER_CONF "data/test-server.conf"
+#define TEST_SERVER_AOF "data/test-server.aof"
+#define TEST_SERVER_RDB "data/test-server.rdb"
+
+class ServerTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        writeConfig("");
+        unlink(PROJECT_ROOT "/" TEST_SERVER_AOF);
+        unlink(PROJECT_ROOT "/" TEST_SERVER_RDB);
+    }
+    void TearDown() override
+    {
+        stopServer();
+        unlink(PROJECT_ROOT "/" TEST_SERVER_AOF);
+        unlink(PROJECT_ROOT "/" TEST_SERVER_RDB);
+        unlink(PROJECT_ROOT "/" TEST_SERVER_CONF);
+    }
+    // 默认AOF、appendfsync always。 extra中的配置行写在后面，覆盖默认值
+    void writeConfig(const std::string& extra)
+    {
+        FILE* f = fopen(PROJECT_ROOT "/" TEST_SERVER_CONF, "w");
+        ASSERT_NE(f, nullptr);
+        fprintf(f, "role=master\nport=%d\ndbnum=4\n", TEST_SERVER_PORT);
+        fprintf(f, "aof_file=" TEST_SERVER_AOF "\nrdb_file=" TEST_SERVER_RDB "\n");
+        fprintf(f, "consistency=aof\nappendfsync=always\nsave=\n%s", extra.c_str());
+        fclose(f);
+    }
+
+    void spawnServer()
+    {
+        pid = fork();
+        ASSERT_NE(pid, -1);
+        if (pid == 0) {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            if (chdir(PROJECT_ROOT) == -1) _exit(127);
+            execl(FEDIS_BIN, FEDIS_BIN, TEST_SERVER_CONF, (char*)nullptr);
+            _exit(127);
+        }
+    }
+    void startServer()
+    {
+        spawnServer();
+        for (int i = 0; i < 100; i++) {
+            if (connectServer()) return;
+            usleep(50 * 1000);
+        }
+        FAIL() << "fedis not listening on " << TEST_SERVER_PORT;
+    }
+    // 启动应当失败: 返回退出状态，5秒内没有退出返回-1
+    int startServerExpectExit()
+    {
+        spawnServer();
+        int status = 0;
+        for (int i = 0; i < 100; i++) {
+            if (waitpid(pid, &status, WNOHANG) == pid) {
+                pid = -1;
+                return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            }
+            usleep(50 * 1000);
+        }
+        return -1;
+    }
+    // SIGINT正常关闭，关闭前AOF落盘
+    void stopServer()
+    {
+        if (sock != -1) close(sock);
+        sock = -1;
+        if (pid > 0) {
+            kill(pid, SIGINT);
+            waitpid(pid, nullptr, 0);
+        }
+        pid = -1;
+    }
+    bool connectServer()
+    {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(TEST_SERVER_PORT);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            struct timeval tv = {5, 0};
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            return true;
+        }
+        close(sock);
+        sock = -1;
+        return false;
+    }
+
+    // 发送命令，返回一条回复: 状态/错误/整数回复原样(去掉CRLF)，$回复返回内容，空$回复返回"(nil)"，
+    // *回复返回各元素用'\n'连接
+    std::string command(std::initializer_list<std::string> args)
+    {
+        std::string req = "*" + std::to_string(args.size()) + "\r\n";
+        for (const std::string& a : args)
+            req += "$" + std::to_string(a.size()) + "\r\n" + a + "\r\n";
+        if (send(sock, req.data(), req.size(), 0) != (ssize_t)req.size()) return "(send error)";
+        return readReply();
+    }
+    std::string readReply()
+    {
+        std::string line = readLine();
+        if (!line.empty() && line[0] == '*') {
+            std::string all;
+            for (long i = atol(line.c_str() + 1); i > 0; i--)
+                all += readReply() + "\n";
+            return all;
+        }
+        if (line.empty() || line[0] != '$') return line;
+        long len = atol(line.c_str() + 1);
+        if (len < 0) return "(nil)";
+        while (buf.size() < (size_t)len + 2 && fill()) {}
+        std::string bulk = buf.substr(0, len);
+        buf.erase(0, len + 2);
+        return bulk;
+    }
+    std::string readFile(const char* path)
+    {
+        std::string s;
+        FILE* f = fopen(path, "r");
+        if (!f) return s;
+        char tmp[4096];
+        size_t n;
+        while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0) s.append(tmp, n);
+        fclose(f);
+        return s;
+    }
+    void writeFile(const char* path, const std::string& s)
+    {
+        FILE* f = fopen(path, "w");
+        ASSERT_NE(f, nullptr);
+        fwrite(s.data(), 1, s.size(), f);
+        fclose(f);
+    }
+    std::string readAof()
+    {
+        return readFile(PROJECT_ROOT "/" TEST_SERVER_AOF);
+    }
+
+    pid_t pid = -1;
+    int sock = -1;
+
+private:
+    bool fill()
+    {
+        char tmp[4096];
+        ssize_t n = recv(sock, tmp, sizeof(tmp), 0);
+        if (n <= 0) return false;
+        buf.append(tmp, n);
+        return true;
+    }
+    std::string readLine()
+    {
+        size_t pos;
+        while ((pos = buf.find("\r\n")) == std::string::npos)
+            if (!fill()) return "";
+        std::string line = buf.substr(0, pos);
+        buf.erase(0, pos + 2);
+        return line;
+    }
+    std::string buf;
+};
+
+// 相对过期时间以绝对时刻写入AOF，过期后重放不会复活
+TEST_F(ServerTest, AofReplayAfterDeadline)
+{
+    startServer();
+    EXPECT_EQ(command({"SET", "k", "v", "PX", "300"}), "+OK");
+    EXPECT_EQ(command({"SET", "k2", "v"}), "+OK");
+    EXPECT_EQ(command({"EXPIRE", "k2", "1"}), "+OK");
+    EXPECT_EQ(command({"SET", "keep", "v"}), "+OK");
+    stopServer();
+
+    std::string aof = readAof();
+    EXPECT_NE(aof.find("PEXPIREAT"), std::string::npos);
+    EXPECT_EQ(aof.find("$2\r\nPX\r\n"), std::string::npos);
+    EXPECT_EQ(aof.find("$6\r\nEXPIRE\r\n"), std::string::npos);
+
+    usleep(1100 * 1000);
+    startServer();
+    EXPECT_EQ(command({"GET", "k"}), "-ERR key not found");
+    EXPECT_EQ(command({"GET", "k2"}), "-ERR key not found");
+    EXPECT_EQ(command({"GET", "keep"}), "v");
+}
+
+TEST_F(ServerTest, ExpireCommands)
+{
+    startServer();
+    EXPECT_EQ(command({"SET", "k", "v"}), "+OK");
+    EXPECT_EQ(command({"PTTL", "k"}), "-ERR key not found");
+    EXPECT_EQ(command({"PEXPIRE", "k", "100000"}), "+OK");
+    std::string pttl = command({"PTTL", "k"});
+    ASSERT_EQ(pttl.rfind("pttl:", 0), 0u) << pttl;
+    long ms = atol(pttl.c_str() + 5);
+    EXPECT_GT(ms, 99000);
+    EXPECT_LE(ms, 100000);
+    EXPECT_EQ(command({"PERSIST", "k"}), ":1");
+    EXPECT_EQ(command({"PERSIST", "k"}), ":0");
+    EXPECT_EQ(command({"PTTL", "k"}), "-ERR key not found");
+
+    // 过去的时刻: 键立即过期
+    EXPECT_EQ(command({"PEXPIREAT", "k", "1"}), "+OK");
+    EXPECT_EQ(command({"GET", "k"}), "-ERR key not found");
+    EXPECT_EQ(command({"PEXPIRE", "missing", "1000"}), "-ERR key not found");
+}
+
+TEST_F(ServerTest, ExpireOverflow)
+{
+    startServer();
+    EXPECT_EQ(command({"SET", "k", "v"}), "+OK");
+    EXPECT_EQ(command({"SET", "k", "v", "EX", "9223372036854775"}), "-ERR invalid expire time");
+    EXPECT_EQ(command({"SET", "k", "v", "PX", "9223372036854775807"}), "-ERR invalid expire time");
+    EXPECT_EQ(command({"EXPIRE", "k", "9223372036854775"}), "-ERR invalid expire time");
+    EXPECT_EQ(command({"EXPIRE", "k", "-9223372036854776"}), "-ERR invalid expire time");
+    EXPECT_EQ(command({"PEXPIRE", "k", "9223372036854775807"}), "-ERR invalid expire time");
+    // 被拒绝的命令不改变原有的值和过期时间
+    EXPECT_EQ(command({"GET", "k"}), "v");
+    EXPECT_EQ(command({"PTTL", "k"}), "-ERR key not found");
+}
+
+TEST_F(ServerTest, SetNxXx)
+{
+    startServer();
+    EXPECT_EQ(command({"SET", "k", "v1", "XX"}), "(nil)");
+    EXPECT_EQ(command({"GET", "k"}), "-ERR key not found");
+    EXPECT_EQ(command({"SET", "k", "v1", "NX"}), "+OK");
+    EXPECT_EQ(command({"SET", "k", "v2", "NX"}), "(nil)");
+    EXPECT_EQ(command({"GET", "k"}), "v1");
+    EXPECT_EQ(command({"SET", "k", "v3", "XX", "PX", "100000"}), "+OK");
+    EXPECT_EQ(command({"GET", "k"}), "v3");
+    EXPECT_EQ(command({"PTTL", "k"}).rfind("pttl:", 0), 0u);
+    // 不带EX/PX的SET清除过期时间
+    EXPECT_EQ(command({"SET", "k", "v4", "XX"}), "+OK");
+    EXPECT_EQ(command({"PTTL", "k"}), "-ERR key not found");
+}
+
+TEST_F(ServerTest, DecrbyLongMin)
+{
+    startServer();
+    EXPECT_EQ(command({"SET", "n", "1"}), "+OK");
+    EXPECT_EQ(command({"DECRBY", "n", "-9223372036854775808"}), "-ERR increment or decrement would overflow");
+    EXPECT_EQ(command({"GET", "n"}), "1");
+    EXPECT_EQ(command({"DECRBY", "n", "-9223372036854775807"}), "-ERR increment or decrement would overflow");
+    EXPECT_EQ(command({"DECRBY", "n", "2"}), ":-1");
+}
+
+// INCRBYFLOAT以结果 SET key value 写入AOF，过期时间随PEXPIREAT保留
+TEST_F(ServerTest, IncrbyfloatPropagatesResult)
+{
+    startServer();
+    EXPECT_EQ(command({"SET", "f", "10.5"}), "+OK");
+    EXPECT_EQ(command({"INCRBYFLOAT", "f", "0.1"}), "10.6");
+    EXPECT_EQ(command({"PEXPIRE", "f", "100000"}), "+OK");
+    EXPECT_EQ(command({"INCRBYFLOAT", "f", "1"}), "11.6");
+    stopServer();
+
+    std::string aof = readAof();
+    EXPECT_EQ(aof.find("INCRBYFLOAT"), std::string::npos);
+    EXPECT_NE(aof.find("$1\r\nf\r\n$4\r\n11.6\r\n"), std::string::npos);
+
+    startServer();
+    EXPECT_EQ(command({"GET", "f"}), "11.6");
+    EXPECT_EQ(command({"PTTL", "f"}).rfind("pttl:", 0), 0u);
+}
+
+// 主动过期、淘汰删除的键以DEL写入AOF
+TEST_F(ServerTest, DeletionsPropagated)
+{
+    startServer();
+    EXPECT_EQ(command({"SET", "e", "v", "PX", "50"}), "+OK");
+    usleep(300 * 1000);
+    EXPECT_EQ(command({"SET", "a", "v"}), "+OK");
+    EXPECT_EQ(command({"SET", "b", "v"}), "+OK");
+    EXPECT_EQ(command({"CONFIG", "SET", "maxmemory-policy", "allkeys-random"}), "+OK");
+    EXPECT_EQ(command({"CONFIG", "SET", "maxmemory", "1"}), "+OK");
+    // 写命令执行前淘汰所有键。 PERSIST不受DENYOOM限制，也不修改数据库
+    EXPECT_EQ(command({"PERSIST", "a"}), ":0");
+    EXPECT_EQ(command({"CONFIG", "SET", "maxmemory", "0"}), "+OK");
+    stopServer();
+
+    std::string aof = readAof();
+    EXPECT_NE(aof.find("$3\r\nDEL\r\n$1\r\ne\r\n"), std::string::npos);
+    EXPECT_NE(aof.find("$3\r\nDEL\r\n$1\r\na\r\n"), std::string::npos);
+    EXPECT_NE(aof.find("$3\r\nDEL\r\n$1\r\nb\r\n"), std::string::npos);
+
+    startServer();
+    EXPECT_EQ(command({"GET", "a"}), "-ERR key not found");
+    EXPECT_EQ(command({"GET", "b"}), "-ERR key not found");
+}
+
+// 版本不同的RDB不能当作空库启动，文件保持原样
+TEST_F(ServerTest, RdbUnknownVersionRefused)
+{
+    writeConfig("consistency=rdb\n");
+    const std::string old("REDIS0001\xff\0\0\0\0\0\0\0\0", 18);
+    writeFile(PROJECT_ROOT "/" TEST_SERVER_RDB, old);
+    EXPECT_EQ(startServerExpectExit(), EXIT_FAILURE);
+    EXPECT_EQ(readFile(PROJECT_ROOT "/" TEST_SERVER_RDB), old);
+}
+
+// AOF末尾半条命令(写入时宕机): aof-load-truncated=no拒绝启动；yes截到最后一条完整命令，之后追加的命令重启后能重放
+TEST_F(ServerTest, AofLoadTruncated)
+{
+    startServer();
+    EXPECT_EQ(command({"SET", "a", "1"}), "+OK");
+    EXPECT_EQ(command({"INCR", "n"}), ":1");
+    EXPECT_EQ(command({"INCR", "n"}), ":2");
+    stopServer();
+
+    std::string full = readAof();
+    size_t valid = full.rfind("*2\r\n$4\r\nINCR\r\n");
+    ASSERT_NE(valid, std::string::npos);
+    const std::string cut = full.substr(0, full.size() - 5);
+    writeFile(PROJECT_ROOT "/" TEST_SERVER_AOF, cut);
+
+    writeConfig("aof-load-truncated=no\n");
+    EXPECT_EQ(startServerExpectExit(), EXIT_FAILURE);
+    EXPECT_EQ(readAof(), cut);
+
+    writeConfig("aof-load-truncated=yes\n");
+    startServer();
+    EXPECT_EQ(command({"GET", "a"}), "1");
+    EXPECT_EQ(command({"GET", "n"}), "1");
+    EXPECT_EQ(readAof(), full.substr(0, valid));
+    EXPECT_EQ(command({"INCR", "n"}), ":2");
+    EXPECT_EQ(command({"SET", "b", "2"}), "+OK");
+    stopServer();
+
+    std::string aof = readAof();
+    EXPECT_EQ(aof.compare(0, valid, full, 0, valid), 0);
+    startServer();
+    EXPECT_EQ(command({"GET", "n"}), "2");
+    EXPECT_EQ(command({"GET", "b"}), "2");
+}
+
+// BGREWRITEAOF期间继续写: 子进程快照之后的命令经重写缓冲追加到新文件，重启后键、过期时间都在，INCR没有重复
+TEST_F(ServerTest, BgrewriteaofWhileWriting)
+{
+    writeConfig("appendfsync=everysec\n");
+    startServer();
+    const int keys = 2000;
+    for (int i = 0; i < keys; i++)
+        ASSERT_EQ(command({"SET", "k" + std::to_string(i), "v" + std::to_string(i)}), "+OK");
+    for (int i = 0; i < 100; i++)
+        ASSERT_EQ(command({"EXPIRE", "k" + std::to_string(i), "1000"}), "+OK");
+    for (int i = 1; i <= 100; i++)
+        ASSERT_EQ(command({"INCR", "n"}), ":" + std::to_string(i));
+
+    EXPECT_EQ(command({"BGREWRITEAOF"}), "+Background append only file rewriting started");
+    for (int i = 101; i <= 200; i++)
+        ASSERT_EQ(command({"INCR", "n"}), ":" + std::to_string(i));
+    for (int i = 0; i < 50; i++) {
+        ASSERT_EQ(command({"SET", "u" + std::to_string(i), "w"}), "+OK");
+        ASSERT_EQ(command({"PEXPIRE", "u" + std::to_string(i), "500000"}), "+OK");
+    }
+    std::string info;
+    for (int i = 0; i < 100; i++) {
+        info = command({"INFO"});
+        if (info.find("aof_rewrite_in_progress:0") != std::string::npos) break;
+        usleep(50 * 1000);
+    }
+    ASSERT_NE(info.find("aof_rewrite_in_progress:0"), std::string::npos);
+    EXPECT_NE(info.find("aof_last_bgrewrite_status:ok"), std::string::npos);
+    for (int i = 201; i <= 250; i++)
+        ASSERT_EQ(command({"INCR", "n"}), ":" + std::to_string(i));
+    stopServer();
+
+    // 重写前的INCR合并成了一条SET
+    std::string aof = readAof();
+    size_t incrs = 0;
+    for (size_t pos = 0; (pos = aof.find("$4\r\nINCR\r\n", pos)) != std::string::npos; pos++) incrs++;
+    EXPECT_LT(incrs, 250u);
+
+    startServer();
+    EXPECT_EQ(command({"GET", "n"}), "250");
+    for (int i = 0; i < keys; i++)
+        ASSERT_EQ(command({"GET", "k" + std::to_string(i)}), "v" + std::to_string(i));
+    for (int i = 0; i < 100; i++) {
+        std::string pttl = command({"PTTL", "k" + std::to_string(i)});
+        long ms = atol(pttl.c_str() + strlen("pttl:"));
+        EXPECT_GT(ms, 900 * 1000) << pttl;
+        EXPECT_LE(ms, 1000 * 1000) << pttl;
+    }
+    for (int i = 0; i < 50; i++) {
+        EXPECT_EQ(command({"GET", "u" + std::to_string(i)}), "w");
+        std::string pttl = command({"PTTL", "u" + std::to_string(i)});
+        long ms = atol(pttl.c_str() + strlen("pttl:"));
+        EXPECT_GT(ms, 400 * 1000) << pttl;
+        EXPECT_LE(ms, 500 * 1000) << pttl;
+    }
+    EXPECT_EQ(command({"PTTL", "k100"}), "-ERR key not found");
+}
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <cstdint>
+extern "C" {
+#include "spsc.h"
+}
+
+TEST(SpscQueueTest, FifoAndFull)
+{
+    spscQueue* q = spscQueueCreate(3); // 取整为4
+    ASSERT_NE(q, nullptr);
+    EXPECT_EQ(spscQueuePop(q), nullptr);
+    for (uintptr_t i = 1; i <= 4; i++) {
+        EXPECT_EQ(spscQueuePush(q, (void*)i), 1);
+    }
+    EXPECT_EQ(spscQueuePush(q, (void*)5), 0);
+    EXPECT_EQ(spscQueuePop(q), (void*)1);
+    // 腾出一个位置后可以继续，下标回绕
+    EXPECT_EQ(spscQueuePush(q, (void*)5), 1);
+    for (uintptr_t i = 2; i <= 5; i++) {
+        EXPECT_EQ(spscQueuePop(q), (void*)i);
+    }
+    EXPECT_EQ(spscQueuePop(q), nullptr);
+    spscQueueRelease(q);
+}
+
+TEST(SpscQueueTest, TwoThreadsKeepOrder)
+{
+    const uintptr_t n = 1000000;
+    spscQueue* q = spscQueueCreate(1024);
+    std::thread producer([&] {
+        for (uintptr_t i = 1; i <= n; i++) {
+            while (!spscQueuePush(q, (void*)i)) std::this_thread::yield();
+        }
+    });
+    uintptr_t expect = 1;
+    while (expect <= n) {
+        void* item = spscQueuePop(q);
+        if (item == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_EQ((uintptr_t)item, expect);
+        expect++;
+    }
+    producer.join();
+    EXPECT_EQ(spscQueuePop(q), nullptr);
+    spscQueueRelease(q);
+}
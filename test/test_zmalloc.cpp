@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <thread>
+#include <vector>
+extern "C" {
+#include "zmalloc.h"
+#include "sds.h"
+}
+
+// 分配、扩容、释放后统计回到原值
+TEST(ZmallocTest, TracksUsedMemory)
+{
+    size_t before = zmallocUsedMemory();
+    void* p = zmalloc(100);
+    EXPECT_GE(zmallocUsedMemory() - before, 100u);
+    p = zrealloc(p, 4000);
+    EXPECT_GE(zmallocUsedMemory() - before, 4000u);
+    void* q = zalignedAlloc(64, 256);
+    char* s = zstrdup("hello");
+    EXPECT_STREQ(s, "hello");
+    zfree(p);
+    zfree(q);
+    zfree(s);
+    zfree(NULL);
+    EXPECT_EQ(zmallocUsedMemory(), before);
+}
+
+// sds经过zmalloc分配，也计入统计
+TEST(ZmallocTest, SdsIsAccounted)
+{
+    size_t before = zmallocUsedMemory();
+    sds s = sdsnewlen(NULL, 1000);
+    EXPECT_GE(zmallocUsedMemory() - before, 1000u);
+    sdsfree(s);
+    EXPECT_EQ(zmallocUsedMemory(), before);
+}
+
+// nmemb * size溢出时和分配失败一样abort，不返回回绕后更小的块(日志在stdout，不匹配输出)
+TEST(ZmallocTest, CallocOverflowAborts)
+{
+    EXPECT_DEATH(zcalloc(SIZE_MAX / 8 + 2, 8), "");
+    EXPECT_DEATH(zcalloc(2, SIZE_MAX / 2 + 1), "");
+    void* p = zcalloc(0, SIZE_MAX);
+    zfree(p);
+}
+
+// slab模式：小对象按大小级统计，释放后同一线程复用；realloc跨大小级保留内容
+TEST(ZmallocTest, SlabClasses)
+{
+    zmallocInit(ZMALLOC_SLAB, 0);
+    size_t before = zmallocUsedMemory();
+    void* p = zmalloc(20);
+    EXPECT_EQ(zmallocSize(p), 24u);
+    EXPECT_EQ(zmallocUsedMemory() - before, 24u);
+    zfree(p);
+    EXPECT_EQ(zmallocUsedMemory(), before);
+    EXPECT_EQ(zmalloc(17), p);
+
+    memcpy(p, "0123456789abcdef", 17);
+    char* q = (char*)zrealloc(p, 24);
+    EXPECT_EQ(q, p);
+    q = (char*)zrealloc(q, 200);
+    EXPECT_STREQ(q, "0123456789abcdef");
+    EXPECT_EQ(zmallocSize(q), 224u);
+    q = (char*)zrealloc(q, 1000);
+    EXPECT_STREQ(q, "0123456789abcdef");
+    EXPECT_GE(zmallocSize(q), 1000u);
+    zfree(q);
+    EXPECT_EQ(zmallocUsedMemory(), before);
+
+    size_t size, pages, inuse;
+    zmallocClassStats(2, &size, &pages, &inuse);
+    EXPECT_EQ(size, 24u);
+    EXPECT_GE(pages, 1u);
+}
+
+// 一个线程分配的对象可以在另一个线程释放
+TEST(ZmallocTest, SlabCrossThreadFree)
+{
+    zmallocInit(ZMALLOC_SLAB, 0);
+    size_t before = zmallocUsedMemory();
+    std::vector<void*> ptrs;
+    std::thread producer([&] {
+        for (int i = 0; i < 10000; i++) ptrs.push_back(zmalloc(i % 256 + 1));
+    });
+    producer.join();
+    for (void* p : ptrs) zfree(p);
+    EXPECT_EQ(zmallocUsedMemory(), before);
+}